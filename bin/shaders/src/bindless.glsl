@@ -0,0 +1,41 @@
+#extension GL_EXT_nonuniform_qualifier : require
+
+#ifndef BINDLESS_SET
+#define BINDLESS_SET 1
+#endif
+
+struct BindlessDraw
+{
+	uint instance;
+	uint material;
+};
+
+struct BindlessMaterial
+{
+	vec4 albedoAlpha;
+	float spec;
+	float roughness;
+	uint albedoAlphaMap; // texture index + 1, 0 for none
+	uint normalHeightMap;
+	uint specRoughnessMap;
+	uint dummy0;
+	uint dummy1;
+	uint dummy2;
+};
+
+layout(set = BINDLESS_SET, binding = 0) readonly buffer bindless_draws_
+{
+	BindlessDraw draws[];
+}bindless_draws;
+
+layout(set = BINDLESS_SET, binding = 1) readonly buffer bindless_materials_
+{
+	BindlessMaterial materials[];
+}bindless_materials;
+
+layout(set = BINDLESS_SET, binding = 2) uniform sampler2D bindless_textures[];
+
+vec4 bindless_sample(uint map, vec2 uv)
+{
+	return texture(bindless_textures[nonuniformEXT(map - 1)], uv);
+}
@@ -0,0 +1,33 @@
+#ifndef BONE_PALETTE_SET
+#define BONE_PALETTE_SET 2
+#endif
+
+struct BonePaletteInstance
+{
+	mat4 world;
+	uint boneOffset;
+	uint dummy0;
+	uint dummy1;
+	uint dummy2;
+};
+
+layout(set = BONE_PALETTE_SET, binding = 0) readonly buffer bone_palette_matrices_
+{
+	mat4 matrix[];
+}bone_palette_matrices;
+
+layout(set = BONE_PALETTE_SET, binding = 1) readonly buffer bone_palette_instances_
+{
+	BonePaletteInstance instance[];
+}bone_palette_instances;
+
+// the model matrix of a skinned vertex of the instance
+mat4 bone_palette_skin(uint instance, vec4 boneWeight, vec4 boneID)
+{
+	BonePaletteInstance i = bone_palette_instances.instance[instance];
+	mat4 skinMatrix = boneWeight[0] * bone_palette_matrices.matrix[i.boneOffset + uint(boneID[0])];
+	skinMatrix += boneWeight[1] * bone_palette_matrices.matrix[i.boneOffset + uint(boneID[1])];
+	skinMatrix += boneWeight[2] * bone_palette_matrices.matrix[i.boneOffset + uint(boneID[2])];
+	skinMatrix += boneWeight[3] * bone_palette_matrices.matrix[i.boneOffset + uint(boneID[3])];
+	return i.world * skinMatrix;
+}
@@ -16,6 +16,7 @@ layout(binding = 8) uniform sampler2D img_normal_height;
 layout(binding = 9) uniform sampler2D img_spec_roughness;
 
 #include "../ubo_light.glsl"
+#include "../ubo_light_cluster.glsl"
 
 layout(binding = 11) uniform sampler2D img_envr;
 
@@ -71,6 +72,59 @@ highp float map_01(float x, float v0, float v1)
 	return (x - v0) / (v1 - v0);
 }
 
+float get_shadow_visibility(Light light, vec4 coordWorld, float linerDepth)
+{
+	int shadowId = int(light.color.a); // the first layer of the light, negative when it casts no shadow
+	if (shadowId < 0)
+		return 1.0;
+	int shadowLayer = light.coord.w == 0.0 ? get_shadow_cascade(shadowId, linerDepth) : shadowId;
+	vec4 shadowCoord = ubo_shadow.matrix[shadowLayer] * coordWorld;
+	shadowCoord /= shadowCoord.w;
+	if (shadowCoord.z < 0.0 || shadowCoord.z > 1.0)
+		return 1.0;
+	float occluder = texture(img_shadow, vec3(shadowCoord.xy * 0.5 + 0.5, float(shadowLayer))).r;
+	float reciever = shadowCoord.z;
+	//return clamp(occluder * exp(-esm_factor * reciever), 0.0, 1.0);
+	return occluder < exp(esm_factor * reciever) ? 0.0 : 1.0;
+}
+
+vec3 shade_light(Light light, vec3 coordView, vec4 coordWorld, float linerDepth, vec3 viewDir, vec3 normal, vec3 albedo, float spec, float roughness)
+{
+	float visibility = get_shadow_visibility(light, coordWorld, linerDepth);
+	if (visibility == 0.0) return vec3(0.0);
+	
+	vec3 lightColor = light.color.xyz * visibility;
+	vec3 lightDir = light.coord.xyz;
+	if (light.coord.w == 0.0)
+	{
+		lightDir = (ubo_matrix.view * vec4(lightDir, 0.0)).xyz;
+	}
+	else
+	{
+		lightDir = (ubo_matrix.view * vec4(lightDir, 1.0)).xyz - coordView;
+		lightColor /= lightDir.x * lightDir.x + lightDir.y * lightDir.y + lightDir.z * lightDir.z;
+	}
+	lightDir = normalize(lightDir);
+	float nl = dot(normal, lightDir);
+	if (nl < 0.0) return vec3(0.0);
+
+	if (light.coord.w == 2.0)
+	{
+		float spotVal = dot(-lightDir, vec3(ubo_matrix.view * vec4(light.spotData.xyz, 0.0)));
+		spotVal -= light.spotData.w;
+		if (spotVal < 0.0) return vec3(0.0);
+		float k = spotVal / (1.0 - light.spotData.w);
+		lightColor *= k * k;
+	}
+#if defined(USE_PHONG)
+	vec3 r = reflect(-lightDir, normal);
+	float vr = max(dot(r, -viewDir), 0.0);
+	return albedo * lightColor * nl + spec * pow(vr, (1.0 - roughness) * 128.0) * lightColor;
+#elif defined(USE_PBR)
+	return brdf(-viewDir, lightDir, normal, roughness, spec, albedo, lightColor) * nl;
+#endif
+}
+
 void main()
 {
 	vec3 viewDir = normalize(inViewDir);
@@ -108,66 +162,11 @@ void main()
 #endif
 	
 	vec3 lightSumColor = vec3(0.0);
-	for (int i = 0; i < ubo_light.count; i++)
-	{
-		Light light = ubo_light.lights[i];
-
-		float visibility = 1.0;
-		/*
-		{
-			int shadowId = int(light.color.a);
-			if (shadowId != -1)
-			{
-				vec4 shadowCoord = ubo_shadow.matrix[shadowId] * coordWorld; 
-				shadowCoord /= shadowCoord.w;
-				if (shadowCoord.z >= 0.0 && shadowCoord.z <= 1.0)
-				{
-					float occluder = texture(img_shadow, vec3(shadowCoord.xy * 0.5 + 0.5, shadowId * 6)).r;
-					float reciever = shadowCoord.z;
-					//visibility = clamp(occluder * exp(-esm_factor * reciever), 0.0, 1.0);
-					visibility = occluder < exp(esm_factor * reciever) ? 0.0 : 1.0;
-					//visibility = (occluder / exp(esm_factor * reciever)) / 8.0;
-					//visibility = (exp(esm_factor * reciever) - occluder) / 8.0;
-					//visibility = occluder < reciever ? 0.0 : 1.0;
-				}
-
-				//lightSumColor = vec3(visibility); break;
-			}
-		}
-		*/
-		if (visibility == 0.0) continue;
-		
-		vec3 lightColor = light.color.xyz * visibility;
-		vec3 lightDir = light.coord.xyz;
-		if (light.coord.w == 0.0)
-		{
-			lightDir = (ubo_matrix.view * vec4(lightDir, 0.0)).xyz;
-		}
-		else
-		{
-			lightDir = (ubo_matrix.view * vec4(lightDir, 1.0)).xyz - coordView;
-			lightColor /= lightDir.x * lightDir.x + lightDir.y * lightDir.y + lightDir.z * lightDir.z;
-		}
-		lightDir = normalize(lightDir);
-		float nl = dot(normal, lightDir);
-		if (nl < 0.0) continue;
-
-		if (light.coord.w == 2.0)
-		{
-			float spotVal = dot(-lightDir, vec3(ubo_matrix.view * vec4(light.spotData.xyz, 0.0)));
-			spotVal -= light.spotData.w;
-			if (spotVal < 0.0) continue;
-			float k = spotVal / (1.0 - light.spotData.w);
-			lightColor *= k * k;
-		}
-#if defined(USE_PHONG)
-		vec3 r = reflect(-lightDir, normal);
-		float vr = max(dot(r, -viewDir), 0.0);
-		lightSumColor += albedo * lightColor * nl + spec * pow(vr, (1.0 - roughness) * 128.0) * lightColor;
-#elif defined(USE_PBR)
-		lightSumColor += brdf(-viewDir, lightDir, normal, roughness, spec, albedo, lightColor) * nl;
-#endif
-	}
+	for (uint i = 0; i < ubo_light_cluster.dim.w; i++)
+		lightSumColor += shade_light(ubo_light.lights[get_light_cluster_index(i)], coordView, coordWorld, linerDepth, viewDir, normal, albedo, spec, roughness);
+	uvec2 range = get_light_cluster_range(get_light_cluster(gl_FragCoord.xy, linerDepth, vec2(ubo_constant.cx, ubo_constant.cy)));
+	for (uint i = range.x; i < range.x + range.y; i++)
+		lightSumColor += shade_light(ubo_light.lights[get_light_cluster_index(i)], coordView, coordWorld, linerDepth, viewDir, normal, albedo, spec, roughness);
 	
 	vec3 color = lightSumColor;
 #if defined(USE_IBL)
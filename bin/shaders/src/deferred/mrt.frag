@@ -1,4 +1,4 @@
-#include "../material.glsl"
+#include "../bindless.glsl"
 
 layout(location = 0) in flat uint inMaterialID;
 layout(location = 1) in vec2 inTexcoord;
@@ -11,44 +11,39 @@ layout(location = 2) out vec4 outSpecRoughness;
 		
 void main()
 {
-	uint mapIndex;
+	BindlessMaterial material = bindless_materials.materials[inMaterialID];
 
 	vec3 albedo;
 	float alpha;
-	mapIndex = ubo_material.material[inMaterialID].mapIndex & 0xff;
-	if (mapIndex == 0)
+	if (material.albedoAlphaMap == 0)
 	{
-		uint v = ubo_material.material[inMaterialID].albedoAlphaCompress;
-		albedo = vec3((v & 0xff) / 255.0, ((v >> 8) & 0xff) / 255.0, ((v >> 16) & 0xff) / 255.0);
-		alpha = ((v >> 24) & 0xff) / 255.0;
+		albedo = material.albedoAlpha.rgb;
+		alpha = material.albedoAlpha.a;
 	}
 	else
 	{
-		vec4 v = texture(imgs_material[mapIndex - 1], inTexcoord);
+		vec4 v = bindless_sample(material.albedoAlphaMap, inTexcoord);
 		albedo = v.rgb;
 		alpha = v.a;
 	}
 	
 	vec3 normal = inNormal;
-	mapIndex = (ubo_material.material[inMaterialID].mapIndex >> 8) & 0xff;
-	if (mapIndex > 0)
+	if (material.normalHeightMap > 0)
 	{
-		vec4 v = texture(imgs_material[mapIndex - 1], inTexcoord);
+		vec4 v = bindless_sample(material.normalHeightMap, inTexcoord);
 		vec3 tn = normalize(v.xyz * 2.0 - 1.0);
 		normal = normalize(mat3(-inTangent, cross(normal, -inTangent), normal) * tn);
 	}
 
 	float spec, roughness;
-	mapIndex = (ubo_material.material[inMaterialID].mapIndex >> 16) & 0xff;
-	if (mapIndex == 0)
+	if (material.specRoughnessMap == 0)
 	{
-		uint v = ubo_material.material[inMaterialID].specRoughnessCompress;
-		spec = (v & 0xff) / 255.0;
-		roughness = ((v >> 8) & 0xff) / 255.0;
+		spec = material.spec;
+		roughness = material.roughness;
 	}
 	else
 	{
-		vec4 v = texture(imgs_material[mapIndex - 1], inTexcoord);
+		vec4 v = bindless_sample(material.specRoughnessMap, inTexcoord);
 		spec = v.r;
 		roughness = v.g;
 	}
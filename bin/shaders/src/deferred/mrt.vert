@@ -1,5 +1,11 @@
 #include "../ubo_matrix.glsl"
 #include "object.glsl"
+#include "../bindless.glsl"
+#if defined(ANIM)
+#include "../bone_palette.glsl"
+#endif
+
+// gl_InstanceIndex is the draw, an instanced draw of a skinned geometry has a draw for each instance in the bone palette
 
 layout(location = 0) in vec3 inVertex;
 layout(location = 1) in vec2 inTexcoord;
@@ -17,16 +23,13 @@ layout(location = 3) out vec3 outTangent;
 
 void main()
 {
-	uint objID = gl_InstanceIndex >> 8;
-	outMaterialID = gl_InstanceIndex & 0xff;
 	outTexcoord = inTexcoord;
-	mat4 modelMatrix = ubo_object.matrix[objID];
+	BindlessDraw draw = bindless_draws.draws[gl_InstanceIndex];
+	outMaterialID = draw.material;
 #if defined(ANIM)
-	mat4 skinMatrix = inBoneWeight[0] * ubo_bone[objID].matrix[int(inBoneID[0])];
-	skinMatrix += inBoneWeight[1] * ubo_bone[objID].matrix[int(inBoneID[1])];
-	skinMatrix += inBoneWeight[2] * ubo_bone[objID].matrix[int(inBoneID[2])];
-	skinMatrix += inBoneWeight[3] * ubo_bone[objID].matrix[int(inBoneID[3])];
-	modelMatrix = modelMatrix * skinMatrix;
+	mat4 modelMatrix = bone_palette_skin(draw.instance, inBoneWeight, inBoneID);
+#else
+	mat4 modelMatrix = ubo_object.matrix[draw.instance];
 #endif
 	mat3 normalMatrix = transpose(inverse(mat3(ubo_matrix.view * modelMatrix)));
 	outNormal = normalize(normalMatrix * inNormal);
@@ -3,7 +3,7 @@
 
 layout(binding = 4) uniform sampler2D imgs_blend[8];
 
-#include "../material.glsl"
+#include "../bindless.glsl"
 
 layout (location = 0) in flat uint inTerrainId;
 layout (location = 1) in vec2 inUV;
@@ -21,40 +21,33 @@ float spec, roughness;
 
 void get_material(uint mat_index, float blend)
 {
-	uint mapIndex;
+	BindlessMaterial material = bindless_materials.materials[mat_index];
 
-	mapIndex = ubo_material.material[mat_index].mapIndex & 0xff;
-	if (mapIndex == 0)
-	{
-		uint v = ubo_material.material[mat_index].albedoAlphaCompress;
-		albedo += vec3((v & 0xff) / 255.0, ((v >> 8) & 0xff) / 255.0, ((v >> 16) & 0xff) / 255.0) * blend;
-	}
+	if (material.albedoAlphaMap == 0)
+		albedo += material.albedoAlpha.rgb * blend;
 	else
 	{
-		vec4 v = texture(imgs_material[mapIndex - 1], tilledUV);
+		vec4 v = bindless_sample(material.albedoAlphaMap, tilledUV);
 		albedo += v.rgb * blend;
 	}
 	
-	mapIndex = (ubo_material.material[mat_index].mapIndex >> 8) & 0xff;
-	if (mapIndex > 0)
+	if (material.normalHeightMap > 0)
 	{
-		vec4 v = texture(imgs_material[mapIndex - 1], tilledUV);
+		vec4 v = bindless_sample(material.normalHeightMap, tilledUV);
 		vec3 tn = normalize(v.xyz * 2.0 - 1.0);
 		normal += normalize(mat3(-inTangent, cross(normal, -inTangent), normal) * tn) * blend;
 	}
 	else
 		normal += inNormal * blend;
 
-	mapIndex = (ubo_material.material[mat_index].mapIndex >> 16) & 0xff;
-	if (mapIndex == 0)
+	if (material.specRoughnessMap == 0)
 	{
-		uint v = ubo_material.material[mat_index].specRoughnessCompress;
-		spec += (v & 0xff) / 255.0 * blend;
-		roughness += ((v >> 8) & 0xff) / 255.0 * blend;
+		spec += material.spec * blend;
+		roughness += material.roughness * blend;
 	}
 	else
 	{
-		vec4 v = texture(imgs_material[mapIndex - 1], tilledUV);
+		vec4 v = bindless_sample(material.specRoughnessMap, tilledUV);
 		spec += v.r * blend;
 		roughness += v.g * blend;
 	}
@@ -71,12 +64,8 @@ void main()
 	tilledUV = inUV * ubo_terrain.d[inTerrainId].tiling_scale * 
 		vec2(ubo_terrain.d[inTerrainId].block_cx, ubo_terrain.d[inTerrainId].block_cy);
 
-	uint curr_mat_index = ubo_terrain.d[inTerrainId].material_index;
 	for(int i = 0 ; i < ubo_terrain.d[inTerrainId].material_count; i++)
-	{
-		get_material(curr_mat_index & 0xff, blend[i]);
-		curr_mat_index >> 8;
-	}
+		get_material(ubo_terrain.d[inTerrainId].material_index[i], blend[i]);
 
 	outAlbedoAlpha = vec4(albedo, 1.0);
 	outNormalHeight = vec4(normal * 0.5 + 0.5, 0.0);
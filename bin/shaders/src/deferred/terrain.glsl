@@ -9,7 +9,8 @@ struct Terrain
 	float tessellation_factor;
 	float tiling_scale;
 	uint material_count;
-	uint material_index;
+	uint dummy;
+	uvec4 material_index;
 };
 
 layout(binding = 3) uniform ubo_terrain_
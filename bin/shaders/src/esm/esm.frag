@@ -1,21 +1,6 @@
 #include "..\math.h"
 
-struct Material
-{
-	uint albedoAlphaCompress;
-	uint specRoughnessCompress;
-
-	uint mapIndex;
-	
-	uint dummy;
-};
-
-layout(set = 1, binding = 0) uniform ubo_material_
-{
-	Material material[256];
-}ubo_material;
-
-layout(set = 1, binding = 1) uniform sampler2D imgs_material[256];
+#include "../bindless.glsl"
 
 layout(location = 0) in vec2 inTexcoord;
 layout(location = 1) in flat uint inMaterialID;
@@ -30,10 +15,10 @@ highp float map_01(float x, float v0, float v1)
 void main()
 {
 	/*
-	uint mapIndex = ubo_material.material[inMaterialID].mapIndex & 0xff;
-	if (mapIndex != 0)
+	uint map = bindless_materials.materials[inMaterialID].albedoAlphaMap;
+	if (map != 0)
 	{
-		vec4 v = texture(imgs_material[mapIndex - 1], inTexcoord);
+		vec4 v = bindless_sample(map, inTexcoord);
 		if (v.a < 0.5)
 			discard;
 	}
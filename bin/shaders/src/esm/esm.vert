@@ -1,8 +1,6 @@
+#include "../bindless.glsl"
 #if defined(ANIM)
-layout(binding = 2) uniform ubo_object_animated_
-{
-	mat4 matrix[8];
-}ubo_object;
+#include "../bone_palette.glsl"
 #else
 layout(binding = 2) uniform ubo_object_static_
 {
@@ -10,17 +8,18 @@ layout(binding = 2) uniform ubo_object_static_
 }ubo_object;
 #endif
 
-layout(binding = 14) uniform ubo_shadow_
+// a draw into a layer, gl_InstanceIndex is the draw, an instanced draw of a skinned geometry has a draw for each
+// instance in the bone palette
+layout(push_constant) uniform PushConstant
 {
-	mat4 matrix[8];
-}ubo_shadow;
+	uint shadowID;
+}pc;
 
-#if defined(ANIM)
-layout(set = 2, binding = 0) uniform ubo_bone_
+layout(binding = 14) uniform ubo_shadow_
 {
-	mat4 matrix[256];
-}ubo_bone[8];
-#endif
+	mat4 matrix[24];
+	vec4 cascade_splits[4];
+}ubo_shadow;
 
 layout(location = 0) in vec3 inVertex;
 layout(location = 1) in vec2 inTexcoord;
@@ -34,22 +33,13 @@ layout(location = 1) out flat uint outMaterialID;
 
 void main()
 {
-	uint objID;
-	uint shadowID;
-	{
-		uint v = gl_InstanceIndex >> 8;
-		objID = v & 0x80000;
-		shadowID = v >> 20;
-		outMaterialID = gl_InstanceIndex & 0xff;
-	}
 	outTexcoord = inTexcoord;
-	mat4 modelMatrix = ubo_object.matrix[objID];
+	BindlessDraw draw = bindless_draws.draws[gl_InstanceIndex];
+	outMaterialID = draw.material;
 #if defined(ANIM)
-	mat4 skinMatrix = inBoneWeight[0] * ubo_bone[objID].matrix[int(inBoneID[0])];
-	skinMatrix += inBoneWeight[1] * ubo_bone[objID].matrix[int(inBoneID[1])];
-	skinMatrix += inBoneWeight[2] * ubo_bone[objID].matrix[int(inBoneID[2])];
-	skinMatrix += inBoneWeight[3] * ubo_bone[objID].matrix[int(inBoneID[3])];
-	modelMatrix = modelMatrix * skinMatrix;
+	mat4 modelMatrix = bone_palette_skin(draw.instance, inBoneWeight, inBoneID);
+#else
+	mat4 modelMatrix = ubo_object.matrix[draw.instance];
 #endif
-	gl_Position = ubo_shadow.matrix[shadowID] * modelMatrix * vec4(inVertex, 1);
+	gl_Position = ubo_shadow.matrix[pc.shadowID] * modelMatrix * vec4(inVertex, 1);
 }
\ No newline at end of file
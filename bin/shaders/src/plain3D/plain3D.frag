@@ -6,22 +6,7 @@ layout(push_constant) uniform PushConstant
 }pc;
 
 #if defined(USE_MATERIAL)
-struct Material
-{
-	uint albedoAlphaCompress;
-	uint specRoughnessCompress;
-
-	uint mapIndex;
-	
-	uint dummy;
-};
-
-layout(set = 1, binding = 0) uniform ubo_material_
-{
-	Material material[256];
-}ubo_material;
-
-layout(set = 1, binding = 1) uniform sampler2D imgs_material[256];
+#include "../bindless.glsl"
 #endif
 
 #if defined(USE_MATERIAL)
@@ -38,14 +23,11 @@ void main()
 {
 	vec3 color;
 #if defined(USE_MATERIAL)
-	uint mapIndex = ubo_material.material[inMaterialID].mapIndex & 0xff;
-	if (mapIndex == 0)
-	{
-		uint v = ubo_material.material[inMaterialID].albedoAlphaCompress;
-		color = vec3((v & 0xff) / 255.0, ((v >> 8) & 0xff) / 255.0, ((v >> 16) & 0xff) / 255.0);
-	}
+	BindlessMaterial material = bindless_materials.materials[inMaterialID];
+	if (material.albedoAlphaMap == 0)
+		color = material.albedoAlpha.rgb;
 	else
-		color = texture(imgs_material[mapIndex - 1], inTexcoord).rgb;
+		color = bindless_sample(material.albedoAlphaMap, inTexcoord).rgb;
 #else
 	color = pc.color.rgb;
 #endif
@@ -1,6 +1,19 @@
 layout(binding = 14) uniform ubo_shadow_
 {
-	mat4 matrix[8];
+	mat4 matrix[24]; // 6 layers per light, the cascades of a parallax light are its first layers
+	vec4 cascade_splits[4]; // the far depth of each cascade
 }ubo_shadow;
 
 layout(binding = 15) uniform sampler2DArray img_shadow;
+
+int get_shadow_cascade(int shadowId, float linerDepth)
+{
+	vec4 splits = ubo_shadow.cascade_splits[shadowId / 6];
+	int c = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		if (linerDepth > splits[i])
+			c++;
+	}
+	return shadowId + c;
+}
@@ -5,8 +5,8 @@ struct Light
 	vec4 spotData;
 };
 
-layout(binding = 10) uniform ubo_light_
+layout(binding = 10) readonly buffer ubo_light_
 {
 	uint count;
-	Light lights[256];
+	Light lights[];
 }ubo_light;
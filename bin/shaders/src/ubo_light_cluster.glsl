@@ -0,0 +1,31 @@
+#define LIGHT_CLUSTER_COUNT (16 * 9 * 24)
+
+layout(binding = 16) readonly buffer ubo_light_cluster_
+{
+	uvec4 dim; // xyz - cluster count, w - parallax light count
+	vec4 slice; // x - scale, y - bias, slice = log(depth) * scale + bias
+	uvec2 offsets[LIGHT_CLUSTER_COUNT]; // offset and count of each cluster
+}ubo_light_cluster;
+
+layout(binding = 17) readonly buffer ubo_light_index_
+{
+	uint indices[]; // the parallax lights first, then the lights of each cluster
+}ubo_light_index;
+
+uint get_light_cluster(vec2 fragCoord, float linerDepth, vec2 screenSize)
+{
+	uvec3 c;
+	c.xy = min(uvec2(fragCoord / screenSize * vec2(ubo_light_cluster.dim.xy)), ubo_light_cluster.dim.xy - 1);
+	c.z = uint(clamp(log(linerDepth) * ubo_light_cluster.slice.x + ubo_light_cluster.slice.y, 0.0, float(ubo_light_cluster.dim.z - 1)));
+	return (c.z * ubo_light_cluster.dim.y + c.y) * ubo_light_cluster.dim.x + c.x;
+}
+
+uvec2 get_light_cluster_range(uint cluster)
+{
+	return ubo_light_cluster.offsets[cluster];
+}
+
+uint get_light_cluster_index(uint i)
+{
+	return ubo_light_index.indices[i];
+}
@@ -23,6 +23,7 @@
 #include "instance_private.h"
 
 #include <flame/system.h>
+#include <flame/profiler.h>
 #include <flame/math.h>
 #include <flame/graphics/device.h>
 #include <flame/graphics/renderpass.h>
@@ -42,6 +43,8 @@
 #include <Windows.h>
 #include <stdarg.h>
 #include <list>
+#include <map>
+#include <algorithm>
 
 namespace flame
 {
@@ -342,32 +345,22 @@ namespace flame
 			auto vertex_size = max(draw_data->TotalVtxCount, 1) * sizeof(ImDrawVert);
 			auto index_size = max(draw_data->TotalIdxCount, 1) * sizeof(ImDrawIdx);
 
-			if (!_priv->vtx_buffer || _priv->vtx_buffer->size < vertex_size)
+			// with frames in flight a buffer of our own could still be read by the gpu, the transient ring's
+			// slice of this frame is not (it grows when it is full)
+			graphics::TransientRange vtx_range, idx_range;
+			if (!graphics::allocate_transient(_priv->d, vertex_size, 4, &vtx_range) ||
+				!graphics::allocate_transient(_priv->d, index_size, 4, &idx_range))
 			{
-				if (_priv->vtx_buffer)
-				{
-					_priv->vtx_buffer->unmap();
-					graphics::destroy_buffer(_priv->d, _priv->vtx_buffer);
-				}
-				_priv->vtx_buffer = graphics::create_buffer(_priv->d, vertex_size,
-					graphics::BufferUsageVertexBuffer, graphics::MemPropHost);
-				_priv->vtx_buffer->map();
-			}
-
-			if (!_priv->idx_buffer || _priv->idx_buffer->size < index_size)
-			{
-				if (_priv->idx_buffer)
-				{
-					_priv->idx_buffer->unmap();
-					graphics::destroy_buffer(_priv->d, _priv->idx_buffer);
-				}
-				_priv->idx_buffer = graphics::create_buffer(_priv->d, index_size,
-					graphics::BufferUsageIndexBuffer, graphics::MemPropHost);
-				_priv->idx_buffer->map();
+				_priv->frame_vtx_buffer = nullptr; // out of memory, nothing is drawn this frame
+				_priv->frame_idx_buffer = nullptr;
+				return;
 			}
-
-			auto vtx_dst = (ImDrawVert*)_priv->vtx_buffer->mapped;
-			auto idx_dst = (ImDrawIdx*)_priv->idx_buffer->mapped;
+			_priv->frame_vtx_buffer = vtx_range.buffer;
+			_priv->frame_vtx_offset = vtx_range.offset;
+			_priv->frame_idx_buffer = idx_range.buffer;
+			_priv->frame_idx_offset = idx_range.offset;
+			auto vtx_dst = (ImDrawVert*)vtx_range.mapped;
+			auto idx_dst = (ImDrawIdx*)idx_range.mapped;
 
 			for (int n = 0; n < draw_data->CmdListsCount; n++)
 			{
@@ -377,9 +370,6 @@ namespace flame
 				vtx_dst += cmd_list->VtxBuffer.Size;
 				idx_dst += cmd_list->IdxBuffer.Size;
 			}
-
-			_priv->vtx_buffer->flush();
-			_priv->idx_buffer->flush();
 #endif
 		}
 
@@ -390,10 +380,15 @@ namespace flame
 			auto draw_data = ImGui::GetDrawData();
 
 			cb->begin_renderpass(rp, fb);
+			if (!_priv->frame_vtx_buffer)
+			{
+				cb->end_renderpass();
+				return;
+			}
 			cb->bind_pipeline(_priv->pl);
 			cb->bind_descriptorset(_priv->ds);
-			cb->bind_vertexbuffer(_priv->vtx_buffer);
-			cb->bind_indexbuffer(_priv->idx_buffer, graphics::IndiceTypeUshort);
+			cb->bind_vertexbuffer(_priv->frame_vtx_buffer, _priv->frame_vtx_offset);
+			cb->bind_indexbuffer(_priv->frame_idx_buffer, graphics::IndiceTypeUshort, _priv->frame_idx_offset);
 			cb->set_viewport(Ivec2(0), Ivec2(im_io.DisplaySize.x, im_io.DisplaySize.y));
 			cb->set_scissor(Ivec2(0), Ivec2(im_io.DisplaySize.x, im_io.DisplaySize.y));
 			Vec4 pc;
@@ -977,6 +972,156 @@ namespace flame
 			ImGui::SetMouseCursor(c);
 		}
 
+		static bool profiler_follow = true;
+		static unsigned long long profiler_selected_frame;
+
+		static ImU32 profiler_zone_color(unsigned int hash)
+		{
+			return ImColor::HSV((hash % 360) / 360.f, 0.55f, 0.75f);
+		}
+
+		void Instance::show_profiler(bool *p_open)
+		{
+			if (!ImGui::Begin("Profiler", p_open))
+			{
+				ImGui::End();
+				return;
+			}
+
+			auto frame_count = profile_get_frame_count();
+			if (frame_count == 0)
+			{
+				ImGui::TextUnformatted("no frames recorded");
+				ImGui::End();
+				return;
+			}
+
+			float times[ProfileHistoryFrames];
+			auto max_time = 0.f;
+			for (auto i = 0; i < frame_count; i++)
+			{
+				auto f = profile_get_frame(i);
+				times[i] = (f->end - f->begin) / 1000000.f;
+				max_time = std::max(max_time, times[i]);
+			}
+			ImGui::PlotHistogram("##frames", times, frame_count, 0, "frame ms", 0.f, max_time * 1.1f, ImVec2(-1.f, 60.f));
+			if (ImGui::IsItemHovered() && ImGui::IsMouseClicked(0))
+			{
+				auto rect_min = ImGui::GetItemRectMin();
+				auto rect_max = ImGui::GetItemRectMax();
+				auto i = int((ImGui::GetIO().MousePos.x - rect_min.x) / (rect_max.x - rect_min.x) * frame_count);
+				i = std::min(std::max(i, 0), frame_count - 1);
+				profiler_selected_frame = profile_get_frame(i)->index;
+				profiler_follow = false;
+			}
+
+			ImGui::Checkbox("Follow", &profiler_follow);
+			ImGui::SameLine();
+			if (ImGui::Button("Save Chrome Trace"))
+				profile_save_chrome_trace("profile.json");
+
+			// the selected frame, or the newest when it left the history
+			auto f = profile_get_frame(frame_count - 1);
+			auto first_index = profile_get_frame(0)->index;
+			if (!profiler_follow && profiler_selected_frame >= first_index && profiler_selected_frame <= f->index)
+				f = profile_get_frame(profiler_selected_frame - first_index);
+			else
+				profiler_follow = true;
+			auto frame_time = f->end - f->begin;
+			ImGui::Text("frame %llu: %.3fms, %d zones, %d gpu zones", f->index, frame_time / 1000000.0,
+				(int)f->zones.size(), (int)f->gpu_zones.size());
+			if (f->dropped > 0)
+			{
+				ImGui::SameLine();
+				ImGui::TextColored(ImVec4(1.f, 0.3f, 0.3f, 1.f), "%d dropped", f->dropped);
+			}
+
+			// timeline, a row for each thread and one for the gpu, zones stack down by depth
+			auto dl = ImGui::GetWindowDrawList();
+			auto line_height = ImGui::GetTextLineHeightWithSpacing();
+			auto label_width = 100.f;
+			auto pos = ImGui::GetCursorScreenPos();
+			auto width = std::max(ImGui::GetContentRegionAvailWidth() - label_width, 10.f);
+			auto scale = frame_time > 0 ? width / frame_time : 0.f;
+			auto mouse = ImGui::GetIO().MousePos;
+			const ProfileZone *hovered = nullptr;
+			auto y = pos.y;
+			auto draw_row = [&](const char *label, const ProfileZone *zones, int count) {
+				auto depth = 0;
+				for (auto i = 0; i < count; i++)
+					depth = std::max(depth, (int)zones[i].depth);
+				dl->AddText(ImVec2(pos.x, y), ImGui::GetColorU32(ImGuiCol_Text), label);
+				for (auto i = 0; i < count; i++)
+				{
+					auto &z = zones[i];
+					auto base = z.thread == ProfileGpuThread ? 0 : f->begin; // gpu zones are relative to the frame already
+					ImVec2 a(pos.x + label_width + std::max((z.begin - base) * scale, 0.f), y + z.depth * line_height);
+					ImVec2 c(std::max(pos.x + label_width + (z.end - base) * scale, a.x + 1.f), a.y + line_height - 1.f);
+					dl->AddRectFilled(a, c, profiler_zone_color(z.hash));
+					if (c.x - a.x > ImGui::CalcTextSize(z.name).x)
+						dl->AddText(ImVec2(a.x + 2.f, a.y), IM_COL32(255, 255, 255, 255), z.name);
+					if (mouse.x >= a.x && mouse.x < c.x && mouse.y >= a.y && mouse.y < c.y)
+						hovered = &z;
+				}
+				y += (depth + 1) * line_height + 4.f;
+			};
+			for (auto i = 0; i < f->zones.size(); )
+			{
+				auto thread = f->zones[i].thread;
+				auto j = i;
+				while (j < f->zones.size() && f->zones[j].thread == thread)
+					j++;
+				draw_row(profile_get_thread_name(thread), &f->zones[i], j - i);
+				i = j;
+			}
+			if (!f->gpu_zones.empty())
+				draw_row("gpu", f->gpu_zones.data(), f->gpu_zones.size());
+			ImGui::Dummy(ImVec2(label_width + width, y - pos.y));
+			if (hovered && ImGui::IsWindowHovered())
+				ImGui::SetTooltip("%s: %.3fms", hovered->name, (hovered->end - hovered->begin) / 1000000.0);
+
+			// totals by name, the most expensive first
+			struct Total
+			{
+				const char *name;
+				int count;
+				long long time;
+				long long max_time;
+			};
+			std::map<unsigned int, Total> totals;
+			for (auto &z : f->zones)
+			{
+				auto &t = totals[z.hash];
+				t.name = z.name;
+				t.count++;
+				t.time += z.end - z.begin;
+				t.max_time = std::max(t.max_time, z.end - z.begin);
+			}
+			std::vector<Total> sorted;
+			for (auto &t : totals)
+				sorted.push_back(t.second);
+			std::sort(sorted.begin(), sorted.end(), [](const Total &a, const Total &b) {
+				return a.time > b.time;
+			});
+			ImGui::Columns(4, "profiler_totals");
+			ImGui::Separator();
+			ImGui::TextUnformatted("Zone"); ImGui::NextColumn();
+			ImGui::TextUnformatted("Count"); ImGui::NextColumn();
+			ImGui::TextUnformatted("Total ms"); ImGui::NextColumn();
+			ImGui::TextUnformatted("Max ms"); ImGui::NextColumn();
+			ImGui::Separator();
+			for (auto &t : sorted)
+			{
+				ImGui::TextUnformatted(t.name); ImGui::NextColumn();
+				ImGui::Text("%d", t.count); ImGui::NextColumn();
+				ImGui::Text("%.3f", t.time / 1000000.0); ImGui::NextColumn();
+				ImGui::Text("%.3f", t.max_time / 1000000.0); ImGui::NextColumn();
+			}
+			ImGui::Columns(1);
+
+			ImGui::End();
+		}
+
 		Instance *create_instance(graphics::Device *d, graphics::Renderpass *rp, Surface *s)
 		{
 			auto i = new Instance;
@@ -985,9 +1130,9 @@ namespace flame
 			i->_priv->d = d;
 
 			i->_priv->vert = graphics::create_shader(d, "ui.vert");
-			i->_priv->vert->build();
 			i->_priv->frag = graphics::create_shader(d, "ui.frag");
-			i->_priv->frag->build();
+			graphics::Shader *shaders[] = { i->_priv->vert, i->_priv->frag };
+			graphics::build_shaders(shaders, 2);
 
 			i->_priv->pl = create_pipeline(d);
 			i->_priv->pl->set_cull_mode(graphics::CullModeNone);
@@ -1019,6 +1164,10 @@ namespace flame
 
 			i->_priv->vtx_buffer = nullptr;
 			i->_priv->idx_buffer = nullptr;
+			i->_priv->frame_vtx_buffer = nullptr;
+			i->_priv->frame_vtx_offset = 0;
+			i->_priv->frame_idx_buffer = nullptr;
+			i->_priv->frame_idx_offset = 0;
 #else
 			i->_priv->vtx_buffer = graphics::create_buffer(d);
 			i->_priv->idx_buffer = graphics::create_buffer(d);
@@ -168,6 +168,10 @@ namespace flame
 				std::function<void(MediumString *input)> &callback, const char *default_input = nullptr);
 
 			FLAME_UI_EXPORTS void set_mousecursor(CursorType type);
+
+			// a window of the profiler's history (flame/profiler.h): the frame times, the zones of the
+			// selected frame on a timeline and their totals, and a chrome trace export
+			FLAME_UI_EXPORTS void show_profiler(bool *p_open = nullptr);
 		};
 
 		FLAME_UI_EXPORTS Instance *create_instance(graphics::Device *d, graphics::Renderpass *rp, Surface *s);
@@ -0,0 +1,590 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <flame/math.h>
+
+#include <float.h>
+#include <vector>
+#include <algorithm>
+
+namespace flame
+{
+	struct AABB
+	{
+		Vec3 min;
+		Vec3 max;
+
+		AABB()
+		{
+		}
+
+		AABB(const Vec3 &_min, const Vec3 &_max) :
+			min(_min),
+			max(_max)
+		{
+		}
+
+		float area() const
+		{
+			auto d = max - min;
+			return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+		}
+
+		bool contains(const AABB &o) const
+		{
+			return min.x <= o.min.x && min.y <= o.min.y && min.z <= o.min.z &&
+				max.x >= o.max.x && max.y >= o.max.y && max.z >= o.max.z;
+		}
+	};
+
+	inline AABB merge(const AABB &a, const AABB &b)
+	{
+		return AABB(Vec3(std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)),
+			Vec3(std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)));
+	}
+
+	// dir does not need to be normalized, hit distances are in units of dir
+	struct Ray
+	{
+		Vec3 origin;
+		Vec3 dir;
+		Vec3 inv_dir;
+
+		Ray()
+		{
+		}
+
+		Ray(const Vec3 &_origin, const Vec3 &_dir) :
+			origin(_origin),
+			dir(_dir)
+		{
+			for (auto i = 0; i < 3; i++)
+				inv_dir[i] = dir[i] != 0.f ? 1.f / dir[i] : (dir[i] < 0.f ? -FLT_MAX : FLT_MAX);
+		}
+	};
+
+	// slab test, t_near is where the ray enters the box (0 when it starts inside)
+	inline bool ray_aabb(const Ray &r, const AABB &b, float t_max, float &t_near)
+	{
+		auto t0 = 0.f;
+		auto t1 = t_max;
+		for (auto i = 0; i < 3; i++)
+		{
+			auto ta = (b.min[i] - r.origin[i]) * r.inv_dir[i];
+			auto tb = (b.max[i] - r.origin[i]) * r.inv_dir[i];
+			if (ta > tb)
+				std::swap(ta, tb);
+			t0 = std::max(t0, ta);
+			t1 = std::min(t1, tb);
+			if (t0 > t1)
+				return false;
+		}
+		t_near = t0;
+		return true;
+	}
+
+	// the planes are (normal, d), a point p is inside when dot(normal, p) + d >= 0,
+	// which is what CameraComponent::get_frustum_planes gives in world space
+	enum FrustumTestResult
+	{
+		FrustumOutside,
+		FrustumIntersect,
+		FrustumInside
+	};
+
+	inline FrustumTestResult frustum_test(const Vec4 *planes, const AABB &b)
+	{
+		auto ret = FrustumInside;
+		for (auto i = 0; i < 6; i++)
+		{
+			auto &p = planes[i];
+			// the corner farthest along the normal, then the nearest one
+			auto far_d = p.x * (p.x > 0.f ? b.max.x : b.min.x) + p.y * (p.y > 0.f ? b.max.y : b.min.y) +
+				p.z * (p.z > 0.f ? b.max.z : b.min.z) + p.w;
+			if (far_d < 0.f)
+				return FrustumOutside;
+			auto near_d = p.x * (p.x > 0.f ? b.min.x : b.max.x) + p.y * (p.y > 0.f ? b.min.y : b.max.y) +
+				p.z * (p.z > 0.f ? b.min.z : b.max.z) + p.w;
+			if (near_d < 0.f)
+				ret = FrustumIntersect;
+		}
+		return ret;
+	}
+
+	// boxes in SoA (min_x[n], min_y[n], ..., max_z[n]), the indices of the ones that are not fully
+	// outside are written to out, returns how many, four boxes are tested at a time when simd is on
+	inline int frustum_cull_aabbs(const Vec4 *planes, const float *const *box_soa, int count, const int *ids, int *out)
+	{
+		auto min_x = box_soa[0], min_y = box_soa[1], min_z = box_soa[2];
+		auto max_x = box_soa[3], max_y = box_soa[4], max_z = box_soa[5];
+		// a plane only needs the corner farthest along its normal, which corner that is does
+		// not depend on the box, so pick the arrays once per plane
+		const float *px[6], *py[6], *pz[6];
+		for (auto j = 0; j < 6; j++)
+		{
+			px[j] = planes[j].x > 0.f ? max_x : min_x;
+			py[j] = planes[j].y > 0.f ? max_y : min_y;
+			pz[j] = planes[j].z > 0.f ? max_z : min_z;
+		}
+
+		auto n = 0;
+		auto i = 0;
+#if defined(FLAME_MATH_SIMD)
+		using namespace math_simd;
+		F4 nx[6], ny[6], nz[6], nw[6];
+		for (auto j = 0; j < 6; j++)
+		{
+			nx[j] = splat(planes[j].x);
+			ny[j] = splat(planes[j].y);
+			nz[j] = splat(planes[j].z);
+			nw[j] = splat(planes[j].w);
+		}
+		auto zero = splat(0.f);
+		for (; i + 4 <= count; i += 4)
+		{
+			auto outside = zero;
+			for (auto j = 0; j < 6; j++)
+			{
+				auto d = add(add(mul(nx[j], load(px[j] + i)), mul(ny[j], load(py[j] + i))),
+					add(mul(nz[j], load(pz[j] + i)), nw[j]));
+				outside = bit_or(outside, less(d, zero));
+			}
+			auto m = mask(outside);
+			for (auto k = 0; k < 4; k++)
+			{
+				if (!(m & (1 << k)))
+					out[n++] = ids ? ids[i + k] : i + k;
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			auto outside = false;
+			for (auto j = 0; j < 6; j++)
+			{
+				auto &p = planes[j];
+				if (p.x * px[j][i] + p.y * py[j][i] + p.z * pz[j][i] + p.w < 0.f)
+				{
+					outside = true;
+					break;
+				}
+			}
+			if (!outside)
+				out[n++] = ids ? ids[i] : i;
+		}
+		return n;
+	}
+
+	// dynamic bounding volume tree, leaves keep a fattened box so small moves do not touch the
+	// tree, insertion picks the sibling with the least area increase and the tree is kept
+	// balanced by rotations on the way up
+	class AABBTree
+	{
+	public:
+		struct Node
+		{
+			AABB box;
+			int parent; // also the next free node when free
+			int child1;
+			int child2; // -1 for leaves
+			int height; // -1 when free
+			int user;
+		};
+	protected:
+		std::vector<Node> nodes;
+		int root;
+		int free_node;
+		int leaf_count;
+		float margin;
+
+		// for query_frustum
+		std::vector<int> stack;
+		std::vector<int> candidates;
+		std::vector<float> candidate_soa[6];
+
+		int alloc_node()
+		{
+			if (free_node == -1)
+			{
+				auto old_size = (int)nodes.size();
+				nodes.resize(std::max(16, old_size * 2));
+				for (auto i = old_size; i < (int)nodes.size(); i++)
+				{
+					nodes[i].parent = i + 1 < (int)nodes.size() ? i + 1 : -1;
+					nodes[i].height = -1;
+				}
+				free_node = old_size;
+			}
+			auto id = free_node;
+			auto &n = nodes[id];
+			free_node = n.parent;
+			n.parent = -1;
+			n.child1 = -1;
+			n.child2 = -1;
+			n.height = 0;
+			n.user = -1;
+			return id;
+		}
+
+		void free(int id)
+		{
+			nodes[id].parent = free_node;
+			nodes[id].height = -1;
+			free_node = id;
+		}
+
+		bool is_leaf(int id) const
+		{
+			return nodes[id].child1 == -1;
+		}
+
+		void insert_leaf(int leaf)
+		{
+			if (root == -1)
+			{
+				root = leaf;
+				nodes[root].parent = -1;
+				return;
+			}
+
+			// find the best sibling
+			auto box = nodes[leaf].box;
+			auto index = root;
+			while (!is_leaf(index))
+			{
+				auto &n = nodes[index];
+				auto area = n.box.area();
+				auto combined_area = merge(n.box, box).area();
+				auto cost = 2.f * combined_area; // make a new parent for this node and the leaf
+				auto inheritance_cost = 2.f * (combined_area - area); // the minimum cost of pushing the leaf further down
+
+				float costs[2];
+				int children[] = { n.child1, n.child2 };
+				for (auto k = 0; k < 2; k++)
+				{
+					auto &c = nodes[children[k]];
+					auto merged_area = merge(box, c.box).area();
+					costs[k] = (is_leaf(children[k]) ? merged_area : merged_area - c.box.area()) + inheritance_cost;
+				}
+
+				if (cost < costs[0] && cost < costs[1])
+					break;
+				index = costs[0] < costs[1] ? children[0] : children[1];
+			}
+
+			auto sibling = index;
+			auto old_parent = nodes[sibling].parent;
+			auto new_parent = alloc_node();
+			nodes[new_parent].parent = old_parent;
+			nodes[new_parent].box = merge(box, nodes[sibling].box);
+			nodes[new_parent].height = nodes[sibling].height + 1;
+			nodes[new_parent].child1 = sibling;
+			nodes[new_parent].child2 = leaf;
+			nodes[sibling].parent = new_parent;
+			nodes[leaf].parent = new_parent;
+			if (old_parent != -1)
+			{
+				if (nodes[old_parent].child1 == sibling)
+					nodes[old_parent].child1 = new_parent;
+				else
+					nodes[old_parent].child2 = new_parent;
+			}
+			else
+				root = new_parent;
+
+			refit_upward(nodes[leaf].parent);
+		}
+
+		void remove_leaf(int leaf)
+		{
+			if (leaf == root)
+			{
+				root = -1;
+				return;
+			}
+
+			auto parent = nodes[leaf].parent;
+			auto grand_parent = nodes[parent].parent;
+			auto sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+			if (grand_parent != -1)
+			{
+				if (nodes[grand_parent].child1 == parent)
+					nodes[grand_parent].child1 = sibling;
+				else
+					nodes[grand_parent].child2 = sibling;
+				nodes[sibling].parent = grand_parent;
+				free(parent);
+				refit_upward(grand_parent);
+			}
+			else
+			{
+				root = sibling;
+				nodes[sibling].parent = -1;
+				free(parent);
+			}
+		}
+
+		void refit_upward(int index)
+		{
+			while (index != -1)
+			{
+				index = balance(index);
+				auto &n = nodes[index];
+				n.height = 1 + std::max(nodes[n.child1].height, nodes[n.child2].height);
+				n.box = merge(nodes[n.child1].box, nodes[n.child2].box);
+				index = n.parent;
+			}
+		}
+
+		// if one side is taller by more than one, rotate the taller child up, returns the new subtree root
+		int balance(int a)
+		{
+			auto &A = nodes[a];
+			if (is_leaf(a) || A.height < 2)
+				return a;
+
+			auto b = A.child1;
+			auto c = A.child2;
+			auto diff = nodes[c].height - nodes[b].height;
+			if (diff > 1)
+				return rotate(a, c, b);
+			if (diff < -1)
+				return rotate(a, b, c);
+			return a;
+		}
+
+		// up is the taller child of a, other the shorter one
+		int rotate(int a, int up, int other)
+		{
+			auto f = nodes[up].child1;
+			auto g = nodes[up].child2;
+
+			nodes[up].child1 = a;
+			nodes[up].parent = nodes[a].parent;
+			nodes[a].parent = up;
+			auto up_parent = nodes[up].parent;
+			if (up_parent != -1)
+			{
+				if (nodes[up_parent].child1 == a)
+					nodes[up_parent].child1 = up;
+				else
+					nodes[up_parent].child2 = up;
+			}
+			else
+				root = up;
+
+			// the taller grandchild stays under up, the other one takes up's place under a
+			auto keep = nodes[f].height > nodes[g].height ? f : g;
+			auto give = keep == f ? g : f;
+			nodes[up].child2 = keep;
+			if (nodes[a].child1 == up)
+				nodes[a].child1 = give;
+			else
+				nodes[a].child2 = give;
+			nodes[give].parent = a;
+
+			nodes[a].box = merge(nodes[other].box, nodes[give].box);
+			nodes[a].height = 1 + std::max(nodes[other].height, nodes[give].height);
+			nodes[up].box = merge(nodes[a].box, nodes[keep].box);
+			nodes[up].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+			return up;
+		}
+
+	public:
+		AABBTree(float _margin = 0.1f) :
+			root(-1),
+			free_node(-1),
+			leaf_count(0),
+			margin(_margin)
+		{
+		}
+
+		int get_leaf_count() const
+		{
+			return leaf_count;
+		}
+
+		int get_height() const
+		{
+			return root == -1 ? 0 : nodes[root].height;
+		}
+
+		const Node &get_node(int id) const
+		{
+			return nodes[id];
+		}
+
+		int get_root() const
+		{
+			return root;
+		}
+
+		// returns the proxy, keep it to update or remove
+		int insert(const AABB &box, int user)
+		{
+			auto id = alloc_node();
+			nodes[id].box = AABB(box.min - Vec3(margin), box.max + Vec3(margin));
+			nodes[id].user = user;
+			insert_leaf(id);
+			leaf_count++;
+			return id;
+		}
+
+		void remove(int proxy)
+		{
+			remove_leaf(proxy);
+			free(proxy);
+			leaf_count--;
+		}
+
+		// returns true when the leaf had to be moved
+		bool update(int proxy, const AABB &box)
+		{
+			if (nodes[proxy].box.contains(box))
+				return false;
+			remove_leaf(proxy);
+			nodes[proxy].box = AABB(box.min - Vec3(margin), box.max + Vec3(margin));
+			insert_leaf(proxy);
+			return true;
+		}
+
+		int get_user(int proxy) const
+		{
+			return nodes[proxy].user;
+		}
+
+		// callback(int user, float t_max) for every leaf whose box the ray hits before t_max, nearest
+		// boxes first, the callback returns the new t_max (the distance of its hit) to cut the search
+		template <class F>
+		void query_ray(const Ray &r, float t_max, const F &callback)
+		{
+			float t;
+			if (root == -1 || !ray_aabb(r, nodes[root].box, t_max, t))
+				return;
+
+			stack.clear();
+			stack.push_back(root);
+			while (!stack.empty())
+			{
+				auto id = stack.back();
+				stack.pop_back();
+				auto &n = nodes[id];
+				if (!ray_aabb(r, n.box, t_max, t))
+					continue;
+				if (is_leaf(id))
+				{
+					t_max = callback(n.user, t_max);
+					continue;
+				}
+				float t1, t2;
+				auto hit1 = ray_aabb(r, nodes[n.child1].box, t_max, t1);
+				auto hit2 = ray_aabb(r, nodes[n.child2].box, t_max, t2);
+				if (hit1 && hit2)
+				{
+					// the far one goes first so the near one is popped first
+					stack.push_back(t1 < t2 ? n.child2 : n.child1);
+					stack.push_back(t1 < t2 ? n.child1 : n.child2);
+				}
+				else if (hit1)
+					stack.push_back(n.child1);
+				else if (hit2)
+					stack.push_back(n.child2);
+			}
+		}
+
+		// callback(int user) for every leaf that is not outside, subtrees fully inside are taken
+		// without more tests, the leaves under intersecting nodes are tested in one simd batch
+		template <class F>
+		void query_frustum(const Vec4 *planes, const F &callback)
+		{
+			if (root == -1)
+				return;
+
+			candidates.clear();
+			stack.clear();
+			stack.push_back(root);
+			while (!stack.empty())
+			{
+				auto id = stack.back();
+				stack.pop_back();
+				auto &n = nodes[id];
+				if (is_leaf(id))
+				{
+					candidates.push_back(id);
+					continue;
+				}
+				switch (frustum_test(planes, n.box))
+				{
+					case FrustumIntersect:
+						stack.push_back(n.child1);
+						stack.push_back(n.child2);
+						break;
+					case FrustumInside:
+					{
+						auto begin = stack.size();
+						stack.push_back(id);
+						while (stack.size() > begin)
+						{
+							auto id = stack.back();
+							stack.pop_back();
+							if (is_leaf(id))
+								callback(nodes[id].user);
+							else
+							{
+								stack.push_back(nodes[id].child1);
+								stack.push_back(nodes[id].child2);
+							}
+						}
+						break;
+					}
+					default:
+						break;
+				}
+			}
+
+			int count = candidates.size();
+			if (count == 0)
+				return;
+			for (auto k = 0; k < 6; k++)
+				candidate_soa[k].resize(count);
+			for (auto i = 0; i < count; i++)
+			{
+				auto &b = nodes[candidates[i]].box;
+				candidate_soa[0][i] = b.min.x;
+				candidate_soa[1][i] = b.min.y;
+				candidate_soa[2][i] = b.min.z;
+				candidate_soa[3][i] = b.max.x;
+				candidate_soa[4][i] = b.max.y;
+				candidate_soa[5][i] = b.max.z;
+			}
+			const float *soa[] = { candidate_soa[0].data(), candidate_soa[1].data(), candidate_soa[2].data(),
+				candidate_soa[3].data(), candidate_soa[4].data(), candidate_soa[5].data() };
+			stack.resize(count);
+			auto visible = frustum_cull_aabbs(planes, soa, count, candidates.data(), stack.data());
+			for (auto i = 0; i < visible; i++)
+				callback(nodes[stack[i]].user);
+			stack.clear();
+		}
+	};
+}
@@ -2,7 +2,6 @@
 #include <regex>
 #include <list>
 #include <chrono>
-#include <stack>
 
 #include <flame/global.h>
 #include <flame/system.h>
@@ -10,6 +9,7 @@
 #include <flame/engine/core/core.h>
 #include <flame/engine/graphics/texture.h>
 #include <flame/engine/graphics/synchronization.h>
+#include <flame/engine/graphics/pick_up.h>
 #include <flame/engine/entity/entity.h>
 #include <flame/engine/entity/node.h>
 #include <flame/engine/physics/physics.h>
@@ -21,9 +21,6 @@ namespace flame
 	long long now_ns;
 	double elapsed_time;
 
-	std::stack<Profile> profile_stack;
-	std::vector<Profile> profiles;
-
 	long long p_total_time = 1;
 	long long p_head_time;
 	long long p_ui_begin_time;
@@ -31,21 +28,6 @@ namespace flame
 	long long p_render_time;
 	long long p_tail_time;
 
-	void begin_profile(const std::string &name)
-	{
-		Profile p;
-		p.name = name;
-		p.time = get_now_ns();
-		profile_stack.push(p);
-	}
-
-	void end_profile()
-	{
-		profiles.push_back(profile_stack.top());
-		profile_stack.pop();
-		profiles.back().time = get_now_ns() - profiles.back().time;
-	}
-
 	static SurfaceManager *surface_manager;
 	static Surface *surface;
 	static VkSurfaceKHR vk_surface;
@@ -141,6 +123,8 @@ namespace flame
 		SetProcessDPIAware();
 #endif
 		init_graphics(debug_level > 0, _resolution_x, _resolution_y);
+		load_queue = new LoadQueue(0, add_after_frame_event);
+		job_system = create_job_system();
 		image_available = createSemaphore();
 		render_finished = createSemaphore();
 		create_swapchain();
@@ -161,6 +145,9 @@ namespace flame
 		return NoErr;
 	}
 
+	LoadQueue *load_queue;
+	JobSystem *job_system;
+
 	static std::list<std::function<void()>> _after_frame_events;
 
 	static std::mutex _after_frame_event_mtx;
@@ -190,7 +177,7 @@ namespace flame
 
 		for (;;)
 		{
-			profiles.clear();
+			profile_begin_frame();
 
 			MSG msg;
 			while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
@@ -218,18 +205,25 @@ namespace flame
 			}
 
 			{
-				root_node->update();
+				{
+					FLAME_PROFILE("update");
+					root_node->update();
+				}
 
 				vk_chk_res(vkAcquireNextImageKHR(vk_device, vk_swapchain, UINT64_MAX, image_available, VK_NULL_HANDLE, &curr_window_image_index));
 
-				ui::begin();
+				{
+					FLAME_PROFILE("record");
+					ui::begin();
 
-				render_func();
+					render_func();
 
-				ui::end();
+					ui::end();
+				}
 
 				if (!draw_list.empty())
 				{
+					FLAME_PROFILE("submit");
 					vk_queue_submit(draw_list.size(), draw_list.data(), image_available, render_finished);
 					draw_list.clear();
 				}
@@ -243,16 +237,28 @@ namespace flame
 				present_info.swapchainCount = 1;
 				present_info.pSwapchains = &vk_swapchain;
 				present_info.pImageIndices = &curr_window_image_index;
-				vk_chk_res(vkQueuePresentKHR(vk_graphics_queue, &present_info));
-				vk_queue_wait_idle();
+				{
+					FLAME_PROFILE("present");
+					vk_chk_res(vkQueuePresentKHR(vk_graphics_queue, &present_info));
+					vk_queue_wait_idle();
+				}
 
+				// the picks recorded into this frame's cbs are submitted, this one also resolves the old ones
+				pick_up_end_frame();
+
+				// the events may add events (or the loader threads may), run them unlocked
+				std::list<std::function<void()>> events;
 				_after_frame_event_mtx.lock();
-				for (auto &e : _after_frame_events)
-					e();
-				_after_frame_events.clear();
+				events.swap(_after_frame_events);
 				_after_frame_event_mtx.unlock();
-				//end_profile();
+				{
+					FLAME_PROFILE("after frame events");
+					for (auto &e : events)
+						e();
+				}
 			}
+
+			profile_end_frame();
 		}
 	}
 }
@@ -5,6 +5,9 @@
 #include <vector>
 
 #include <flame/global.h>
+#include <flame/profiler.h>
+#include <flame/load_queue.h>
+#include <flame/jobs.h>
 #include <flame/engine/graphics/graphics.h>
 
 namespace flame
@@ -14,14 +17,6 @@ namespace flame
 	extern long long now_ns;
 	extern double elapsed_time;
 
-	struct Profile
-	{
-		std::string name;
-		long long time;
-	};
-
-	extern std::vector<Profile> profiles;
-
 	extern long long p_total_time;
 	extern long long p_head_time;
 	extern long long p_ui_begin_time;
@@ -29,9 +24,6 @@ namespace flame
 	extern long long p_render_time;
 	extern long long p_tail_time;
 
-	void begin_profile(const std::string &name);
-	void end_profile();
-
 	extern unsigned long long total_frame_count;
 	extern uint32_t FPS;
 
@@ -40,5 +32,10 @@ namespace flame
 	int init(int _resolution_x, int _resolution_y, int debug_level,
 		int window_cx, int window_cy, int window_style, const std::string &window_title);
 	void add_after_frame_event(const std::function<void()> &e); // once
+
+	// the loader threads of the async resource loads, their completions come through add_after_frame_event
+	extern LoadQueue *load_queue;
+	// short cpu work split over the cores, created on (and helped by) the main thread
+	extern JobSystem *job_system;
 	void add_to_draw_list(VkCommandBuffer cb);
 }
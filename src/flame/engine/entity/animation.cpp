@@ -6,7 +6,7 @@
 #include <flame/math.h>
 #include <flame/filesystem.h>
 #include <flame/engine/core/core.h>
-#include <flame/engine/graphics/buffer.h>
+#include <flame/graphics/bonepalette.h>
 #include <flame/engine/entity/model.h>
 #include <flame/engine/entity/animation.h>
 
@@ -173,16 +173,29 @@ namespace flame
 	}
 
 	std::map<unsigned int, std::weak_ptr<Animation>> _animations;
-	std::shared_ptr<Animation> getAnimation(const std::string &filename)
+
+	static std::shared_ptr<Animation> _find_animation(unsigned int hash)
 	{
-		auto hash = HASH(filename.c_str());
 		auto it = _animations.find(hash);
 		if (it != _animations.end())
-		{
-			auto s = it->second.lock();
-			if (s) return s;
-		}
+			return it->second.lock();
+		return nullptr;
+	}
+
+	std::shared_ptr<Animation> getAnimation(const std::string &filename)
+	{
+		auto s = _find_animation(HASH(filename.c_str()));
+		if (s)
+			return s;
+
+		auto a = loadAnimation(filename);
+		if (!a)
+			return nullptr;
+		return addAnimation(a);
+	}
 
+	std::shared_ptr<Animation> loadAnimation(const std::string &filename)
+	{
 		std::experimental::filesystem::path path(filename);
 		if (!std::experimental::filesystem::exists(filename))
 			return nullptr;
@@ -199,11 +212,37 @@ namespace flame
 		auto a = std::make_shared<Animation>();
 		a->filename = filename;
 		load_func(a.get(), filename);
+		return a;
+	}
 
+	std::shared_ptr<Animation> addAnimation(std::shared_ptr<Animation> a)
+	{
+		auto hash = HASH(a->filename.c_str());
+		auto s = _find_animation(hash);
+		if (s)
+			return s;
 		_animations[hash] = a;
 		return a;
 	}
 
+	std::shared_ptr<LoadTicket> getAnimationAsync(const std::string &filename, int priority,
+		const std::function<void(std::shared_ptr<Animation>)> &callback)
+	{
+		auto s = _find_animation(HASH(filename.c_str()));
+		auto a = std::make_shared<std::shared_ptr<Animation>>();
+		return load_queue->push(priority, [=](LoadTicket &) {
+			if (s)
+				return true;
+			*a = loadAnimation(filename);
+			return *a != nullptr;
+		}, [=](bool ok) {
+			if (s)
+				callback(s);
+			else
+				callback(ok ? addAnimation(*a) : nullptr);
+		});
+	}
+
 	std::vector<std::pair<Model *, std::weak_ptr<AnimationBinding>>> _animation_bindings;
 	std::shared_ptr<AnimationBinding> get_animation_binding(Model *m, std::shared_ptr<Animation> anim)
 	{
@@ -240,6 +279,7 @@ namespace flame
 		}
 
 		_animation_bindings.emplace_back(m, b);
+		return b;
 	}
 
 	AnimationRunner::AnimationRunner(Model *_model)
@@ -249,8 +289,6 @@ namespace flame
 		bone_matrix = std::make_unique<glm::mat4[]>(model->bones.size());
 		for (int i = 0; i < model->bones.size(); i++)
 			bone_matrix[i] = glm::mat4(1.f);
-		bone_buffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof(glm::mat4) * model->bones.size());
-		bone_buffer->update(bone_matrix.get(), sizeof(glm::mat4) * model->bones.size());
 	}
 
 	void AnimationRunner::reset_bones()
@@ -293,7 +331,6 @@ namespace flame
 			return;
 
 		reset_bones();
-		bone_buffer->update(bone_matrix.get(), sizeof(glm::mat4) * model->bones.size());
 		curr_anim = animation;
 		curr_frame = 0;
 		curr_frame_index.resize(animation->tracks.size());
@@ -431,7 +468,17 @@ namespace flame
 
 		for (int i = 0; i < model->bones.size(); i++)
 			bone_matrix[i] *= glm::translate(-model->bones[i]->rootCoord);
+	}
 
-		bone_buffer->update(bone_matrix.get(), sizeof(glm::mat4) * model->bones.size());
+	int AnimationRunner::acquire_palette(graphics::BonepalettePacker &p)
+	{
+		int bone_count = model->bones.size();
+		// an ik pose is only this one's
+		graphics::BonepaletteKey k(model, enable_IK ? nullptr : curr_anim, (int)curr_frame);
+		bool fresh;
+		auto offset = p.acquire(k, bone_count, &fresh);
+		if (fresh)
+			memcpy(p.get(offset), bone_matrix.get(), sizeof(glm::mat4) * bone_count);
+		return offset;
 	}
 }
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <memory>
+#include <functional>
 
 #include <flame/math.h>
 
@@ -33,7 +34,16 @@ namespace flame
 		void remove_track(AnimationTrack *t);
 	};
 
+	struct LoadTicket;
+
 	std::shared_ptr<Animation> getAnimation(const std::string &filename);
+	// no caching, can be called on the loader threads
+	std::shared_ptr<Animation> loadAnimation(const std::string &filename);
+	// puts a loaded animation into the cache, returns the cached one if the file is already there
+	std::shared_ptr<Animation> addAnimation(std::shared_ptr<Animation> a);
+	// the file is read on a loader thread, callback is called after a frame (with nullptr when it failed)
+	std::shared_ptr<LoadTicket> getAnimationAsync(const std::string &filename, int priority,
+		const std::function<void(std::shared_ptr<Animation>)> &callback);
 
 	struct AnimationBinding
 	{
@@ -43,7 +53,11 @@ namespace flame
 	};
 
 	struct Model;
-	struct Buffer;
+
+	namespace graphics
+	{
+		struct BonepalettePacker;
+	}
 
 	std::shared_ptr<AnimationBinding> get_animation_binding(Model *m, std::shared_ptr<Animation> anim);
 
@@ -58,12 +72,11 @@ namespace flame
 		Model *model;
 		std::unique_ptr<BoneData[]> bone_data;
 		std::unique_ptr<glm::mat4[]> bone_matrix;
-		std::unique_ptr<Buffer> bone_buffer;
 
 		AnimationBinding *curr_anim = nullptr;
 		float curr_frame = 0.f;
 		std::vector<int> curr_frame_index;
-		bool enable_IK;
+		bool enable_IK = false;
 
 		AnimationRunner(Model *_model);
 		void reset_bones();
@@ -71,5 +84,8 @@ namespace flame
 		void refresh_bone(int i);
 		void set_animation(AnimationBinding *animation);
 		void update();
+		// the bone matrices go into the packer of the frame, the instances on the same frame of the same
+		// animation share them, returns the offset of the palette
+		int acquire_palette(graphics::BonepalettePacker &p);
 	};
 }
@@ -126,7 +126,8 @@ namespace flame
 			}
 		}
 
-		auto vp = proj_matrix * get_parent()->get_matrix();
+		// world space planes, so they can be used for culling on the cpu too
+		auto vp = proj_matrix * view_matrix;
 
 		frustum_planes[0].x = vp[0].w + vp[0].x;
 		frustum_planes[0].y = vp[1].w + vp[1].x;
@@ -159,6 +160,6 @@ namespace flame
 		frustum_planes[5].w = vp[3].w - vp[3].z;
 
 		for (auto i = 0; i < 6; i++)
-			frustum_planes[i] = glm::normalize(frustum_planes[i]);
+			frustum_planes[i] /= glm::length(glm::vec3(frustum_planes[i]));
 	}
 }
@@ -34,5 +34,7 @@ namespace flame
 		virtual void unserialize(XMLNode *src) {};
 	protected:
 		virtual void on_update() {};
+		// the world transform of the parent changed, called on every change
+		virtual void on_world_dirty() {};
 	};
 }
@@ -1,13 +1,18 @@
 #include <sstream>
-#include <regex>
+#include <unordered_map>
 #include <iostream>
 #include <algorithm>
 #include <map>
+#include <list>
 #include <deque>
 #include <tuple>
 
 #include <flame/string.h>
 #include <flame/filesystem.h>
+#include <flame/system.h>
+#include <flame/range_allocator.h>
+#include <flame/text_parse.h>
+#include <flame/ray_cast.h>
 #include <flame/engine/resource/resource.h>
 #include <flame/engine/graphics/buffer.h>
 #include <flame/engine/graphics/texture.h>
@@ -17,6 +22,7 @@
 #include <flame/engine/entity/model.h>
 #include <flame/engine/entity/animation.h>
 #include <flame/engine/physics/physics.h>
+#include <flame/engine/core/core.h>
 
 namespace flame
 {
@@ -35,91 +41,200 @@ namespace flame
 	}
 
 	std::map<unsigned int, std::weak_ptr<Model>> _models;
-	void _create_vertex_and_index_buffer()
+
+	// every model takes a range in the vertex buffers and the index buffer, a model only uploads its own range,
+	// the buffers get re-packed (and grown) only when a range cannot be found
+	struct ModelGeometryRange
 	{
-		auto vertex_stat_count = 0;
-		auto vertex_anim_count = 0;
-		auto indice_count = 0;
+		Model *model;
+		int vertex_count;
+		int indice_count;
+		bool skeleton;
+	};
 
-		for (auto it = _models.begin(); it != _models.end();)
-		{
-			auto s = it->second.lock();
-			if (s)
+	static std::list<ModelGeometryRange> _geometry_ranges;
+	static RangeAllocator _vertex_heap;
+	static RangeAllocator _indice_heap;
+
+	static void _upload_model_geometry(const std::vector<ModelGeometryRange*> &list)
+	{
+		auto vs_size = 0;
+		auto va_size = 0;
+		auto i_size = 0;
+		for (auto r : list)
+		{
+			vs_size += sizeof(ModelVertex) * r->vertex_count;
+			if (r->skeleton)
+				va_size += sizeof(ModelVertexSkeleton) * r->vertex_count;
+			i_size += sizeof(int) * r->indice_count;
+		}
+		auto total_size = vs_size + va_size + i_size;
+		if (total_size == 0)
+			return;
+
+		auto staging_buffer = defalut_staging_buffer;
+		if (total_size > staging_buffer->size)
+			staging_buffer->resize(total_size);
+
+		std::vector<VkBufferCopy> vs_ranges;
+		std::vector<VkBufferCopy> va_ranges;
+		std::vector<VkBufferCopy> i_ranges;
+
+		staging_buffer->map(0, total_size);
+		auto vs_map = (unsigned char*)staging_buffer->mapped;
+		auto va_map = vs_map + vs_size;
+		auto i_map = va_map + va_size;
+		auto vs_offset = 0;
+		auto va_offset = vs_size;
+		auto i_offset = vs_size + va_size;
+		for (auto r : list)
+		{
+			auto m = r->model;
+			if (r->vertex_count > 0)
 			{
-				vertex_stat_count += s->vertexes.size();
-				vertex_anim_count += s->vertexes_skeleton.size();
-				indice_count += s->indices.size();
-				it++;
+				auto size = sizeof(ModelVertex) * r->vertex_count;
+				memcpy(vs_map, m->vertexes.data(), size);
+				vs_ranges.push_back({ (VkDeviceSize)vs_offset, sizeof(ModelVertex) * m->vertex_base, size });
+				vs_map += size;
+				vs_offset += size;
+				if (r->skeleton)
+				{
+					auto size = sizeof(ModelVertexSkeleton) * r->vertex_count;
+					memcpy(va_map, m->vertexes_skeleton.data(), size);
+					va_ranges.push_back({ (VkDeviceSize)va_offset, sizeof(ModelVertexSkeleton) * m->vertex_base, size });
+					va_map += size;
+					va_offset += size;
+				}
+			}
+			if (r->indice_count > 0)
+			{
+				auto size = sizeof(int) * r->indice_count;
+				memcpy(i_map, m->indices.data(), size);
+				i_ranges.push_back({ (VkDeviceSize)i_offset, sizeof(int) * m->indice_base, size });
+				i_map += size;
+				i_offset += size;
 			}
-			else
-				it = _models.erase(it);
 		}
+		staging_buffer->unmap();
 
-		vertex_static_buffer = std::make_unique<Buffer>(BufferTypeVertex, sizeof(ModelVertex) * vertex_stat_count);
-		vertex_skeleton_Buffer = std::make_unique<Buffer>(BufferTypeVertex, sizeof(ModelVertexSkeleton) * vertex_anim_count);
-		index_buffer = std::make_unique<Buffer>(BufferTypeIndex, sizeof(int) * indice_count);
+		staging_buffer->copy_to(vertex_static_buffer.get(), vs_ranges.size(), vs_ranges.data());
+		staging_buffer->copy_to(vertex_skeleton_Buffer.get(), va_ranges.size(), va_ranges.data());
+		staging_buffer->copy_to(index_buffer.get(), i_ranges.size(), i_ranges.data());
+	}
 
-		Buffer stagingBuffer(BufferTypeStaging, vertex_static_buffer->size + vertex_skeleton_Buffer->size + index_buffer->size);
+	static void _repack_model_geometry(int vertex_capacity, int indice_capacity)
+	{
+		_vertex_heap.reset(vertex_capacity);
+		_indice_heap.reset(indice_capacity);
+
+		auto has_skeleton = false;
+		std::vector<ModelGeometryRange*> list;
+		for (auto &r : _geometry_ranges)
+		{
+			r.model->vertex_base = _vertex_heap.allocate(r.vertex_count);
+			r.model->indice_base = _indice_heap.allocate(r.indice_count);
+			if (r.skeleton)
+				has_skeleton = true;
+			list.push_back(&r);
+		}
+
+		vertex_static_buffer = std::make_unique<Buffer>(BufferTypeVertex, sizeof(ModelVertex) * vertex_capacity);
+		// the skeleton part shares vertex_base with the static part, so it spans the whole vertex range once there is a skinned model
+		vertex_skeleton_Buffer = std::make_unique<Buffer>(BufferTypeVertex, has_skeleton ? sizeof(ModelVertexSkeleton) * vertex_capacity : 0);
+		index_buffer = std::make_unique<Buffer>(BufferTypeIndex, sizeof(int) * indice_capacity);
+
+		_upload_model_geometry(list);
+	}
+
+	static void _allocate_model_geometry(ModelGeometryRange &r)
+	{
+		auto vertex_base = _vertex_heap.allocate(r.vertex_count);
+		auto indice_base = _indice_heap.allocate(r.indice_count);
+		if (vertex_base == -1 || indice_base == -1)
+		{
+			if (vertex_base != -1)
+				_vertex_heap.free(vertex_base, r.vertex_count);
+			if (indice_base != -1)
+				_indice_heap.free(indice_base, r.indice_count);
+
+			// the free space is not enough or is scattered, re-pack all models (r included),
+			// and grow a heap if less than a quarter of it would be left free, so re-packing stays rare
+			auto get_capacity = [](RangeAllocator &h, int count) {
+				auto capacity = h.get_capacity();
+				auto need = h.get_used() + count;
+				if (need * 4 > capacity * 3)
+					capacity = std::max(capacity * 2, need * 4 / 3 + 1);
+				return (int)capacity;
+			};
+			_repack_model_geometry(get_capacity(_vertex_heap, r.vertex_count), get_capacity(_indice_heap, r.indice_count));
+			return;
+		}
 
-		stagingBuffer.map(0, stagingBuffer.size);
-		unsigned char *vs_map = (unsigned char*)stagingBuffer.mapped;
-		auto va_map = vs_map + vertex_static_buffer->size;
-		auto i_map = va_map + vertex_skeleton_Buffer->size;
-		auto vertex_offset = 0;
-		auto indice_offset = 0;
-		for (auto &m : _models)
+		r.model->vertex_base = vertex_base;
+		r.model->indice_base = indice_base;
+
+		if (r.skeleton && vertex_skeleton_Buffer->size < sizeof(ModelVertexSkeleton) * _vertex_heap.get_capacity())
 		{
-			auto s = m.second.lock();
-			if (s && !s->vertexes_skeleton.empty())
-			{
-				s->vertex_base = vertex_offset;
-				s->indice_base = indice_offset;
-				memcpy(vs_map + vertex_offset * sizeof(ModelVertex), s->vertexes.data(), sizeof(ModelVertex) * s->vertexes.size());
-				memcpy(va_map + vertex_offset * sizeof(ModelVertexSkeleton), s->vertexes_skeleton.data(), sizeof(ModelVertexSkeleton) * s->vertexes.size());
-				memcpy(i_map + indice_offset * sizeof(int), s->indices.data(), sizeof(int) * s->indices.size());
-				vertex_offset += s->vertexes.size();
-				indice_offset += s->indices.size();
-			}
+			// the first skinned model
+			_repack_model_geometry(_vertex_heap.get_capacity(), _indice_heap.get_capacity());
+			return;
 		}
-		for (auto &m : _models)
+
+		_upload_model_geometry({ &r });
+	}
+
+	static void _free_model_geometry(Model *m)
+	{
+		for (auto it = _geometry_ranges.begin(); it != _geometry_ranges.end(); it++)
 		{
-			auto s = m.second.lock();
-			if (s && s->vertexes_skeleton.empty())
+			if (it->model == m)
 			{
-				s->vertex_base = vertex_offset;
-				s->indice_base = indice_offset;
-				memcpy(vs_map + vertex_offset * sizeof(ModelVertex), s->vertexes.data(), sizeof(ModelVertex) * s->vertexes.size());
-				memcpy(i_map + indice_offset * sizeof(int), s->indices.data(), sizeof(int) * s->indices.size());
-				vertex_offset += s->vertexes.size();
-				indice_offset += s->indices.size();
+				_vertex_heap.free(m->vertex_base, it->vertex_count);
+				_indice_heap.free(m->indice_base, it->indice_count);
+				_geometry_ranges.erase(it);
+				return;
 			}
 		}
-		stagingBuffer.unmap();
-
-		if (vertex_stat_count > 0)
-			stagingBuffer.copy_to(vertex_static_buffer.get(), vertex_static_buffer->size);
-		if (vertex_anim_count > 0)
-			stagingBuffer.copy_to(vertex_skeleton_Buffer.get(), vertex_skeleton_Buffer->size, va_map - vs_map);
-		if (indice_count > 0)
-			stagingBuffer.copy_to(index_buffer.get(), index_buffer->size, i_map - vs_map);
 	}
 
-	void Model::UV::add(const glm::vec2 &v)
+	static void _add_model_geometry(Model *m)
 	{
-		int index = -1;
-		for (int i = 0; i < unique.size(); i++)
+		_free_model_geometry(m);
+
+		for (auto it = _models.begin(); it != _models.end(); )
 		{
-			if (is_same(unique[i], v))
-			{
-				index = i;
-				break;
-			}
+			if (it->second.expired())
+				it = _models.erase(it);
+			else
+				it++;
 		}
-		if (index == -1)
+
+		_geometry_ranges.push_back({ m, (int)m->vertexes.size(), (int)m->indices.size(), !m->vertexes_skeleton.empty() });
+		_allocate_model_geometry(_geometry_ranges.back());
+	}
+
+	void defragment_model_geometry()
+	{
+		_repack_model_geometry(_vertex_heap.get_capacity(), _indice_heap.get_capacity());
+	}
+
+	Model::~Model()
+	{
+		_free_model_geometry(this);
+	}
+
+	void Model::UV::add(const glm::vec2 &v)
+	{
+		if (!welder)
 		{
-			index = unique.size();
-			unique.push_back(v);
+			welder = std::make_unique<VertexWelder<glm::vec2, 2>>(EPS, unique.size());
+			for (auto &u : unique)
+				welder->push(u);
 		}
+
+		auto index = welder->add(v);
+		if (index == unique.size())
+			unique.push_back(v);
 		indices.push_back(index);
 	}
 
@@ -154,68 +269,35 @@ namespace flame
 
 		geometry_aux = std::make_unique<GeometryAux>();
 		geometry_aux->triangles = std::make_unique<GeometryAux::Triangle[]>(triangle_count);
+
+		VertexWelder<glm::vec3, 3> welder(EPS, vertexes.size());
+		std::vector<int> unique_indices(triangle_count * 3);
+		for (int i = 0; i < triangle_count * 3; i++)
+			unique_indices[i] = welder.add(vertexes[indices[i]].position);
+		geometry_aux->unique_vertex = welder.get_unique();
+
+		std::vector<std::pair<int, int>> adjacency(triangle_count * 3);
+		build_triangle_adjacency(unique_indices.data(), triangle_count, adjacency.data());
+
 		for (int i = 0; i < triangle_count; i++)
 		{
 			for (int j = 0; j < 3; j++)
 			{
-				auto ii = indices[i * 3 + j];
-
-				auto idx = -1;
-				for (int k = 0; k < geometry_aux->unique_vertex.size(); k++)
-				{
-					if (is_same(vertexes[ii].position, geometry_aux->unique_vertex[k]))
-					{
-						idx = k;
-						break;
-					}
-				}
-				if (idx == -1)
-				{
-					idx = geometry_aux->unique_vertex.size();
-					geometry_aux->unique_vertex.push_back(vertexes[ii].position);
-				}
-				geometry_aux->triangles[i].indices[j] = idx;
-				geometry_aux->triangles[i].adjacency[j].first = -1;
-				geometry_aux->triangles[i].adjacency[j].second = -1;
+				geometry_aux->triangles[i].indices[j] = unique_indices[i * 3 + j];
+				geometry_aux->triangles[i].adjacency[j] = adjacency[i * 3 + j];
 			}
 		}
-		for (int i = 0; i < triangle_count; i++)
-		{
-			for (int j = 0; j < 3; j++)
-			{
-				if (geometry_aux->triangles[i].adjacency[j].first == -1)
-				{
-					bool ok = false;
-
-					auto i0 = geometry_aux->triangles[i].indices[j];
-					auto i1 = geometry_aux->triangles[i].indices[(j + 1) % 3];
-					for (int k = 0; k < triangle_count; k++)
-					{
-						if (i == k)
-							continue;
-
-						for (int l = 0; l < 3; l++)
-						{
-							if (geometry_aux->triangles[k].adjacency[l].first == -1)
-							{
-								auto i2 = geometry_aux->triangles[k].indices[l];
-								auto i3 = geometry_aux->triangles[k].indices[(l + 1) % 3];
-								if (i0 == i3 && i1 == i2)
-								{
-									geometry_aux->triangles[k].adjacency[l] = { i, (j + 2) % 3 };
-									geometry_aux->triangles[i].adjacency[j] = { k, (l + 2) % 3 };
-									ok = true;
-									break;
-								}
-							}
-						}
+	}
 
-						if (ok)
-							break;
-					}
-				}
-			}
+	TriangleBVH *Model::get_bvh()
+	{
+		if (!bvh)
+		{
+			bvh = std::make_unique<TriangleBVH>();
+			if (!vertexes.empty())
+				bvh->build(&vertexes[0].position, sizeof(ModelVertex), indices.data(), indices.size());
 		}
+		return bvh.get();
 	}
 
 	void Model::create_uv()
@@ -317,6 +399,7 @@ namespace flame
 		}while (true);
 
 		uv->series.back().second = uv->indices.size();
+		uv->welder.reset();
 
 		auto cx = max_x - min_x;
 		auto cz = max_z - min_z;
@@ -361,25 +444,17 @@ namespace flame
 			std::vector<ModelVertex> new_vertexes;
 			std::vector<int> new_indices;
 
+			VertexWelder<glm::vec3, 3> welder(EPS, vertexes.size());
 			for (int i = 0; i < indices.size(); i++)
 			{
 				ModelVertex a = vertexes[indices[i]];
 				a.uv = uv ? uv->unique[uv->indices[i]] : glm::vec2(0.f);
 
-				int index = -1;
-				for (int j = 0; j < new_vertexes.size(); j++)
-				{
-					if (a == new_vertexes[j])
-					{
-						index = j;
-						break;
-					}
-				}
-				if (index == -1)
-				{
-					index = new_vertexes.size();
+				auto index = welder.add(a.position, [&](int j) {
+					return a == new_vertexes[j];
+				});
+				if (index == new_vertexes.size())
 					new_vertexes.push_back(a);
-				}
 				new_indices.push_back(index);
 			}
 
@@ -393,24 +468,18 @@ namespace flame
 			std::vector<ModelVertexSkeleton> new_vertexes_skeleton;
 			std::vector<int> new_indices;
 
+			VertexWelder<glm::vec3, 3> welder(EPS, vertexes.size());
 			for (int i = 0; i < indices.size(); i++)
 			{
 				ModelVertex a0 = vertexes[indices[i]];
 				a0.uv = uv ? uv->unique[uv->indices[i]] : glm::vec2(0.f);
 				ModelVertexSkeleton a1 = vertexes_skeleton[indices[i]];
 
-				int index = -1;
-				for (int j = 0; j < new_vertexes.size(); j++)
-				{
-					if (a0 == new_vertexes[j] && a1 == new_vertexes_skeleton[j])
-					{
-						index = j;
-						break;
-					}
-				}
-				if (index == -1)
+				auto index = welder.add(a0.position, [&](int j) {
+					return a0 == new_vertexes[j] && a1 == new_vertexes_skeleton[j];
+				});
+				if (index == new_vertexes.size())
 				{
-					index = new_vertexes.size();
 					new_vertexes.push_back(a0);
 					new_vertexes_skeleton.push_back(a1);
 				}
@@ -422,7 +491,7 @@ namespace flame
 			indices = new_indices;
 		}
 
-		_create_vertex_and_index_buffer();
+		_add_model_geometry(this);
 	}
 
 	void Model::assign_uv_to_bake(UV *uv)
@@ -856,44 +925,107 @@ namespace flame
 				m->bones[parentID]->children.push_back(i);
 			}
 		}
+	}
 
-		if (m->vertexes_skeleton.size())
-		{
-			auto a = getAnimation(m->stand_animation_filename);
-			if (a) 
-				m->stateAnimations[ModelStateAnimationStand] = get_animation_binding(m, a);
-			a = getAnimation(m->forward_animation_filename);
-			if (a) 
-				m->stateAnimations[ModelStateAnimationForward] = get_animation_binding(m, a);
-			a = getAnimation(m->backward_animation_filename);
-			if (a) 
-				m->stateAnimations[ModelStateAnimationBackward] = get_animation_binding(m, a);
-			a = getAnimation(m->leftward_animation_filename);
-			if (a) 
-				m->stateAnimations[ModelStateAnimationLeftward] = get_animation_binding(m, a);
-			a = getAnimation(m->rightward_animation_filename);
-			if (a) 
-				m->stateAnimations[ModelStateAnimationRightward] = get_animation_binding(m, a);
-			a = getAnimation(m->jump_animation_filename);
-			if (a) 
-				m->stateAnimations[ModelStateAnimationJump] = get_animation_binding(m, a);
+	static const std::string &_state_animation_filename(Model *m, int kind)
+	{
+		switch (kind)
+		{
+			case ModelStateAnimationForward:
+				return m->forward_animation_filename;
+			case ModelStateAnimationBackward:
+				return m->backward_animation_filename;
+			case ModelStateAnimationLeftward:
+				return m->leftward_animation_filename;
+			case ModelStateAnimationRightward:
+				return m->rightward_animation_filename;
+			case ModelStateAnimationJump:
+				return m->jump_animation_filename;
+			default:
+				return m->stand_animation_filename;
 		}
 	}
 
-	namespace OBJ
+	// animations are the ones read on a loader thread, or nullptr to get them here
+	static void _bind_state_animations(Model *m, std::shared_ptr<Animation> *animations)
 	{
-		void load(Model *m, const std::string &filename)
+		if (m->vertexes_skeleton.empty())
+			return;
+		for (auto i = 0; i < ModelStateAnimationCount; i++)
 		{
-			std::ifstream file(filename);
+			auto a = animations ? (animations[i] ? addAnimation(animations[i]) : nullptr) :
+				getAnimation(_state_animation_filename(m, i));
+			if (a)
+				m->stateAnimations[i] = get_animation_binding(m, a);
+		}
+	}
 
-			Geometry *currentGeometry = nullptr;
+	// the loaders also run on the loader threads, where the material list must not be touched,
+	// there the materials are collected and made when the model is handed to the main thread
+	struct _MaterialDesc
+	{
+		Geometry *g;
+		glm::vec4 albedo_alpha;
+		float spec;
+		float roughness;
+		std::string albedo_alpha_map;
+		std::string spec_roughness_map;
+		std::string normal_height_map;
+		std::string name;
+	};
+
+	static thread_local std::vector<_MaterialDesc> *_deferred_materials = nullptr;
+
+	static void _make_material(const _MaterialDesc &d)
+	{
+		d.g->material = getMaterial(d.albedo_alpha, d.spec, d.roughness, d.albedo_alpha_map, d.spec_roughness_map, d.normal_height_map);
+		if (d.name != "")
+			d.g->material->set_name(d.name);
+	}
+
+	static void _set_geometry_material(Geometry *g, const glm::vec4 &albedo_alpha, float spec, float roughness,
+		const std::string &albedo_alpha_map, const std::string &spec_roughness_map, const std::string &normal_height_map,
+		const std::string &name = "")
+	{
+		_MaterialDesc d = { g, albedo_alpha, spec, roughness, albedo_alpha_map, spec_roughness_map, normal_height_map, name };
+		if (_deferred_materials)
+		{
+			g->material = default_material;
+			_deferred_materials->push_back(d);
+		}
+		else
+			_make_material(d);
+	}
+
+	struct IVec3Hash
+	{
+		size_t operator()(const glm::ivec3 &v) const
+		{
+			return ((size_t)v.x * 73856093) ^ ((size_t)v.y * 19349663) ^ ((size_t)v.z * 83492791);
+		}
+	};
+
+	namespace OBJ
+	{
+		struct Mtl
+		{
+			std::string name;
+			float spec;
+			float roughness;
+			std::string albedo_alpha_map_name;
+			std::string normal_height_map_name;
+		};
 
-			std::vector<glm::vec3> temp_positions;
-			std::vector<glm::vec2> temp_uvs;
-			std::vector<glm::vec3> temp_normals;
-			std::vector<glm::ivec3> temp_indices;
+		static void load_mtl(Model *m, const std::string &lib_name, std::vector<Mtl> &materials)
+		{
+			std::ifstream file(m->filepath + "/" + lib_name);
+			if (!file.good())
+				return;
 
-			std::vector<std::shared_ptr<Material>> temp_materials;
+			std::string mtlName;
+			float spec = 0.f, roughness = 1.f;
+			std::string albedo_alpha_map_name;
+			std::string normal_height_map_name;
 
 			while (!file.eof())
 			{
@@ -903,135 +1035,93 @@ namespace flame
 				std::stringstream ss(line);
 				std::string token;
 				ss >> token;
-				if (token == "v")
-				{
-					glm::vec3 v;
-					ss >> v.x;
-					ss >> v.y;
-					ss >> v.z;
-					temp_positions.push_back(v);
-				}
-				else if (token == "vn")
+
+				if (token == "newmtl")
+					ss >> mtlName;
+				else if (token == "tk_spec")
+					ss >> spec;
+				else if (token == "tk_roughness")
+					ss >> roughness;
+				else if (token == "map_Kd")
 				{
-					glm::vec3 n;
-					ss >> n.x;
-					ss >> n.y;
-					ss >> n.z;
-					temp_normals.push_back(n);
+					std::string filename;
+					ss >> filename;
+					albedo_alpha_map_name = m->filepath + "/" + filename;
 				}
-				else if (token == "vt")
+				else if (token == "map_bump")
 				{
-					glm::vec2 t;
-					ss >> t.x;
-					ss >> t.y;
-					temp_uvs.push_back(t);
+					std::string filename;
+					ss >> filename;
+					normal_height_map_name = m->filepath + "/" + filename;
 				}
-				else if (token == "f")
-				{
-					for (int i = 0; i < 3; i++)
-					{
-						std::string token;
-						ss >> token;
+			}
 
-						std::regex pattern(R"(([0-9]+)?/([0-9]+)?/([0-9]+)?)");
-						std::smatch match;
-						std::regex_search(token, match, pattern);
+			materials.push_back({ mtlName, spec, roughness, albedo_alpha_map_name, normal_height_map_name });
+		}
 
-						glm::ivec3 ids;
-						for (int j = 0; j < 3; j++)
-							ids[j] = match[j + 1].matched ? std::stoi(match[j + 1].str()) - 1 : -1;
+		void load(Model *m, const std::string &filename)
+		{
+			auto file = map_file(filename.c_str());
+			if (!file)
+				return;
+			ObjData d;
+			parse_obj((const char*)file->data, file->size, d);
+			unmap_file(file);
 
-						int index = -1;
-						for (int j = 0; j < temp_indices.size(); j++)
-						{
-							if (ids == temp_indices[j])
-							{
-								index = j;
-								break;
-							}
-						}
-						if (index == -1)
-						{
-							index = m->vertexes.size();
-							m->vertexes.push_back({
-								temp_positions[ids[0]],
-								ids[1] != -1 ? temp_uvs[ids[1]] : glm::vec2(0.f),
-								ids[2] != -1 ? temp_normals[ids[2]] : glm::vec3(0.f),
-								glm::vec3(0.f)
-							});
-							temp_indices.push_back(ids);
+			std::vector<Mtl> temp_materials;
+			for (auto &lib : d.mtllibs)
+			{
+				if (lib != "")
+					load_mtl(m, lib, temp_materials);
+			}
 
-						}
-						m->indices.push_back(index);
-						currentGeometry->indiceCount++;
-					}
-				}
-				else if (token == "usemtl")
+			Geometry *currentGeometry = nullptr;
+			auto add_geometry = [&](const std::string &material_name) {
+				auto g = new Geometry;
+				currentGeometry = g;
+				g->material = default_material;
+				for (auto &mat : temp_materials)
 				{
-					std::string name;
-					ss >> name;
-					auto g = new Geometry;
-					currentGeometry = g;
-					for (auto &m : temp_materials)
-					{
-						if (m->get_name() == name)
-							currentGeometry->material = m;
-					}
-					currentGeometry->indiceBase = m->indices.size();
-					m->geometries.emplace_back(g);
+					if (mat.name == material_name)
+						_set_geometry_material(g, glm::vec4(1.f), mat.spec, mat.roughness, mat.albedo_alpha_map_name, "", mat.normal_height_map_name, mat.name);
 				}
-				else if (token == "mtllib")
+				g->indiceBase = m->indices.size();
+				m->geometries.emplace_back(g);
+			};
+
+			std::unordered_map<glm::ivec3, int, IVec3Hash> vertex_map;
+			int corner_count = d.corners.size() / 3;
+			vertex_map.reserve(corner_count);
+			m->indices.reserve(m->indices.size() + corner_count);
+			auto group_index = 0;
+			for (auto i = 0; i < corner_count; i++)
+			{
+				while (group_index < d.groups.size() && d.groups[group_index].corner_begin == i)
+					add_geometry(d.groups[group_index++].material);
+				if (!currentGeometry)
+					add_geometry("");
+
+				glm::ivec3 ids(d.corners[i * 3 + 0], d.corners[i * 3 + 1], d.corners[i * 3 + 2]);
+				auto it = vertex_map.find(ids);
+				int index;
+				if (it == vertex_map.end())
 				{
-					std::string libName;
-					ss >> libName;
-
-					if (libName != "")
-					{
-						std::ifstream file(m->filepath + "/" + libName);
-						if (file.good())
-						{
-
-							std::string mtlName;
-							float spec = 0.f, roughness = 1.f;
-							std::string albedo_alpha_map_name;
-							std::string normal_height_map_name;
-
-							while (!file.eof())
-							{
-								std::string line;
-								std::getline(file, line);
-
-								std::stringstream ss(line);
-								std::string token;
-								ss >> token;
-
-								if (token == "newmtl")
-									ss >> mtlName;
-								else if (token == "tk_spec")
-									ss >> spec;
-								else if (token == "tk_roughness")
-									ss >> roughness;
-								else if (token == "map_Kd")
-								{
-									std::string filename;
-									ss >> filename;
-									albedo_alpha_map_name = m->filepath + "/" + filename;
-								}
-								else if (token == "map_bump")
-								{
-									std::string filename;
-									ss >> filename;
-									normal_height_map_name = m->filepath + "/" + filename;
-								}
-							}
-
-							auto m = getMaterial(glm::vec4(1.f), spec, roughness, albedo_alpha_map_name, "", normal_height_map_name);
-							m->set_name(mtlName);
-							temp_materials.push_back(m);
-						}
-					}
+					index = m->vertexes.size();
+					m->vertexes.push_back({
+						*(glm::vec3*)&d.positions[ids[0] * 3],
+						ids[1] != -1 ? *(glm::vec2*)&d.uvs[ids[1] * 2] : glm::vec2(0.f),
+						ids[2] != -1 ? *(glm::vec3*)&d.normals[ids[2] * 3] : glm::vec3(0.f),
+						glm::vec3(0.f)
+					});
+					vertex_map[ids] = index;
 				}
+				else
+					index = it->second;
+				m->indices.push_back(index);
+				currentGeometry->indiceCount++;
 			}
+			while (group_index < d.groups.size())
+				add_geometry(d.groups[group_index++].material);
 
 			_process_model(m, true);
 		}
@@ -1190,7 +1280,7 @@ namespace flame
 				file.read((char*)&data, sizeof(MaterialData));
 
 				auto g = new Geometry;
-				g->material = getMaterial(data.diffuse, 0.f, 1.f, 
+				_set_geometry_material(g, data.diffuse, 0.f, 1.f,
 					m->filepath + "/" + data.mapName, "", "");
 				g->indiceBase = currentIndiceVertex;
 				g->indiceCount = data.indiceCount;
@@ -1393,14 +1483,10 @@ namespace flame
 					a = n->find_attribute("count"); assert(a);
 					auto count = std::stoi(a->value);
 					s->float_array = new float[count];
-					auto str = n->content;
-					int offset = 0, read_count;
-					int id = 0;
-					while (sscanf(str.c_str() + offset, "%f%n", &s->float_array[id], &read_count) == 1 && id < count)
-					{
-						offset += read_count;
-						id++;
-					}
+					auto &str = n->content;
+					auto read = parse_floats(str.data(), str.data() + str.size(), s->float_array, count);
+					for (; read < count; read++)
+						s->float_array[read] = 0.f;
 					sources.emplace_back(s);
 				}
 				else if (c->name == "vertices")
@@ -1469,110 +1555,64 @@ namespace flame
 						}
 						else if (cc->name == "vcount")
 						{
-							auto str = cc->content;
-							int offset = 0, read_count;
+							auto &str = cc->content;
+							auto p = str.data(), end = str.data() + str.size();
 							int count;
-							while (sscanf(str.c_str() + offset, "%d%n", &count, &read_count) == 1)
+							skip_whitespaces(p, end);
+							while (parse_int(p, end, count))
 							{
 								assert(count == 3);
 								vcount.push_back(count);
-								offset += read_count;
+								skip_whitespaces(p, end);
 							}
 						}
 						else if (cc->name == "p")
 						{
-							auto str = cc->content;
-							int offset = 0, read_count;
+							auto &str = cc->content;
 							assert(element_count_per_vertex > 0 && element_count_per_vertex <= 3);
-							switch (element_count_per_vertex)
+							auto indice_count = vcount.size() * 3;
+							std::vector<int> ids(indice_count * element_count_per_vertex);
+							indice_count = parse_ints(str.data(), str.data() + str.size(), ids.data(), ids.size()) / element_count_per_vertex;
+
+							if (element_count_per_vertex == 1)
 							{
-								case 1:
+								for (auto i = 0; i < indice_count; i++)
 								{
-									auto indice_count = vcount.size() * 3;
+									auto index = ids[i];
+									m->vertexes.push_back({
+										sources[position_source_index]->v3(index),
+										glm::vec2(0.f),
+										glm::vec3(0.f),
+										glm::vec3(0.f)
+										});
+									m->indices.push_back(index);
+								}
+							}
+							else
+							{
+								std::unordered_map<glm::ivec3, int, IVec3Hash> vertex_map;
+								vertex_map.reserve(indice_count);
+								for (auto i = 0; i < indice_count; i++)
+								{
+									glm::ivec3 id(0);
+									for (auto j = 0; j < element_count_per_vertex; j++)
+										id[j] = ids[i * element_count_per_vertex + j];
+									auto it = vertex_map.find(id);
 									int index;
-									while (sscanf(str.c_str() + offset, "%d%n", &index, &read_count) == 1 && indice_count > 0)
+									if (it == vertex_map.end())
 									{
+										index = m->vertexes.size();
 										m->vertexes.push_back({
-											sources[position_source_index]->v3(index),
-											glm::vec2(0.f),
-											glm::vec3(0.f),
+											sources[position_source_index]->v3(id[position_offset]),
+											uv_source_index == -1 ? glm::vec2(0.f) : sources[uv_source_index]->v2(id[uv_offset]),
+											normal_source_index == -1 ? glm::vec3(0.f) : sources[normal_source_index]->v3(id[normal_offset]),
 											glm::vec3(0.f)
-											});
-										m->indices.push_back(index);
-										indice_count--;
-										offset += read_count;
-									}
-									break;
-								}
-								case 2:
-								{
-									std::vector<glm::ivec2> ids;
-									std::regex pattern(R"(([0-9]+)\s+([0-9]+))");
-									auto indice_count = vcount.size() * 3;
-									glm::ivec2 id;
-									while (sscanf(str.c_str() + offset, "%d %d%n", &id.x, &id.y, &read_count) == 2 && indice_count > 0)
-									{
-										auto index = -1;
-										for (int i = 0; i < ids.size(); i++)
-										{
-											if (id == ids[i])
-											{
-												index = i;
-												break;
-											}
-										}
-										if (index == -1)
-										{
-											index = m->vertexes.size();
-											m->vertexes.push_back({
-												sources[position_source_index]->v3(id[position_offset]),
-												uv_source_index == -1 ? glm::vec2(0.f) : sources[uv_source_index]->v2(id[uv_offset]),
-												normal_source_index == -1 ? glm::vec3(0.f) : sources[normal_source_index]->v3(id[normal_offset]),
-												glm::vec3(0.f)
-											});
-											ids.push_back(id);
-
-										}
-										m->indices.push_back(index);
-										indice_count--;
-										offset += read_count;
+										});
+										vertex_map[id] = index;
 									}
-									break;
-								}
-								case 3:
-								{
-									std::vector<glm::ivec3> ids;
-									std::regex pattern(R"(([0-9]+)\s+([0-9]+)\s+([0-9]+))");
-									auto indice_count = vcount.size() * 3;
-									glm::ivec3 id;
-									while (sscanf(str.c_str() + offset, "%d %d %d%n", &id.x, &id.y, &id.z, &read_count) == 3 && indice_count > 0)
-									{
-										auto index = -1;
-										for (int i = 0; i < ids.size(); i++)
-										{
-											if (id == ids[i])
-											{
-												index = i;
-												break;
-											}
-										}
-										if (index == -1)
-										{
-											index = m->vertexes.size();
-											m->vertexes.push_back({
-												sources[position_source_index]->v3(id[position_offset]),
-												uv_source_index == -1 ? glm::vec2(0.f) : sources[uv_source_index]->v2(id[uv_offset]),
-												normal_source_index == -1 ? glm::vec3(0.f) : sources[normal_source_index]->v3(id[normal_offset]),
-												glm::vec3(0.f)
-											});
-											ids.push_back(id);
-
-										}
-										m->indices.push_back(index);
-										indice_count--;
-										offset += read_count;
-									}
-									break;
+									else
+										index = it->second;
+									m->indices.push_back(index);
 								}
 							}
 						}
@@ -1628,7 +1668,7 @@ namespace flame
 				auto normalHeightMapName = read_string(file);
 
 				auto g = new Geometry;
-				g->material = getMaterial(albedo_alpha, spec, roughness,
+				_set_geometry_material(g, albedo_alpha, spec, roughness,
 					m->filepath + "/" + albedoAlphaMapName,
 					m->filepath + "/" + specRoughnessMapName,
 					m->filepath + "/" + normalHeightMapName);
@@ -1851,34 +1891,46 @@ namespace flame
 	{
 		auto hash = HASH(m->filename.c_str());
 		_models[hash] = m;
-		_create_vertex_and_index_buffer();
+		_add_model_geometry(m.get());
 	}
 
-	std::shared_ptr<Model> getModel(const std::string &filename)
+	typedef void(*ModelLoadFunc)(Model *, const std::string &);
+
+	static ModelLoadFunc _get_model_load_func(const std::experimental::filesystem::path &path)
+	{
+		auto ext = path.extension().string();
+		if (ext == ".obj")
+			return &OBJ::load;
+		if (ext == ".pmd")
+			return &PMD::load;
+		if (ext == ".dae")
+			return &COLLADA::load;
+		if (ext == ".tkm")
+			return &TKM::load;
+		return nullptr;
+	}
+
+	static std::shared_ptr<Model> _find_model(unsigned int hash)
 	{
-		auto hash = HASH(filename.c_str());
 		auto it = _models.find(hash);
 		if (it != _models.end())
-		{
-			auto s = it->second.lock();
-			if (s) return s;
-		}
+			return it->second.lock();
+		return nullptr;
+	}
+
+	std::shared_ptr<Model> getModel(const std::string &filename)
+	{
+		auto hash = HASH(filename.c_str());
+		auto s = _find_model(hash);
+		if (s)
+			return s;
 
 		std::experimental::filesystem::path path(filename);
 		if (!std::experimental::filesystem::exists(path))
 			return nullptr;
 
-		auto ext = path.extension().string();
-		void(*load_func)(Model *, const std::string &) = nullptr;
-		if (ext == ".obj")
-			load_func = &OBJ::load;
-		else if (ext == ".pmd")
-			load_func = &PMD::load;
-		else if (ext == ".dae")
-			load_func = &COLLADA::load;
-		else if (ext == ".tkm")
-			load_func = &TKM::load;
-		else
+		auto load_func = _get_model_load_func(path);
+		if (!load_func)
 			return nullptr;
 
 		auto m = std::make_shared<Model>();
@@ -1887,12 +1939,100 @@ namespace flame
 		if (m->filepath == "")
 			m->filepath = ".";
 		load_func(m.get(), filename);
+		_bind_state_animations(m.get(), nullptr);
 
 		_models[hash] = m;
-		_create_vertex_and_index_buffer();
+		_add_model_geometry(m.get());
 		return m;
 	}
 
+	struct _ModelLoad
+	{
+		std::shared_ptr<Model> m;
+		std::vector<_MaterialDesc> materials;
+		std::shared_ptr<Animation> animations[ModelStateAnimationCount];
+
+		// a model that did not reach the main thread (cancelled) is released there too,
+		// ~Model touches the geometry ranges
+		~_ModelLoad()
+		{
+			if (m)
+			{
+				auto last = m;
+				m.reset();
+				add_after_frame_event([last]() {});
+			}
+		}
+	};
+
+	std::shared_ptr<LoadTicket> getModelAsync(const std::string &filename, int priority,
+		const std::function<void(std::shared_ptr<Model>)> &callback)
+	{
+		auto hash = HASH(filename.c_str());
+		auto job = std::make_shared<_ModelLoad>();
+		job->m = _find_model(hash);
+		auto cached = job->m != nullptr;
+		return load_queue->push(priority, [=](LoadTicket &t) {
+			if (cached)
+				return true;
+
+			std::experimental::filesystem::path path(filename);
+			if (!std::experimental::filesystem::exists(path))
+				return false;
+
+			auto load_func = _get_model_load_func(path);
+			if (!load_func)
+				return false;
+
+			auto m = std::make_shared<Model>();
+			m->filename = filename;
+			m->filepath = path.parent_path().string();
+			if (m->filepath == "")
+				m->filepath = ".";
+			_deferred_materials = &job->materials;
+			load_func(m.get(), filename);
+			_deferred_materials = nullptr;
+			if (!m->vertexes_skeleton.empty())
+			{
+				for (auto i = 0; i < ModelStateAnimationCount && !t.cancelled; i++)
+				{
+					auto &name = _state_animation_filename(m.get(), i);
+					if (name != "")
+						job->animations[i] = loadAnimation(name);
+				}
+			}
+			job->m = m;
+			return true;
+		}, [=](bool ok) {
+			if (cached)
+			{
+				auto m = job->m;
+				job->m.reset();
+				callback(m);
+				return;
+			}
+			if (!ok)
+			{
+				callback(nullptr);
+				return;
+			}
+
+			// the same file may have been loaded by getModel in the meantime
+			auto m = _find_model(hash);
+			if (!m)
+			{
+				m = job->m;
+				for (auto &d : job->materials)
+					_make_material(d);
+				_bind_state_animations(m.get(), job->animations);
+				_models[hash] = m;
+				_add_model_geometry(m.get());
+			}
+			job->m.reset();
+			callback(m);
+		});
+	}
+
 	void saveModel(Model *m, const std::string &filename)
 	{
 		std::experimental::filesystem::path path(filename);
@@ -1924,6 +2064,7 @@ namespace flame
 			_process_model(m.get(), true);
 
 			_models[HASH(m->filename.c_str())] = m;
+			_add_model_geometry(m.get());
 
 			triangleModel = m;
 		}
@@ -1951,6 +2092,7 @@ namespace flame
 			_process_model(m.get(), true);
 
 			_models[HASH(m->filename.c_str())] = m;
+			_add_model_geometry(m.get());
 
 			cubeModel = m;
 		}
@@ -1984,6 +2126,7 @@ namespace flame
 			_process_model(m.get(), true);
 
 			_models[HASH(m->filename.c_str())] = m;
+			_add_model_geometry(m.get());
 
 			sphereModel = m;
 		}
@@ -2011,6 +2154,7 @@ namespace flame
 			_process_model(m.get(), true);
 
 			_models[HASH(m->filename.c_str())] = m;
+			_add_model_geometry(m.get());
 
 			cylinderModel = m;
 		}
@@ -2030,6 +2174,7 @@ namespace flame
 			_process_model(m.get(), true);
 
 			_models[HASH(m->filename.c_str())] = m;
+			_add_model_geometry(m.get());
 
 			coneModel = m;
 		}
@@ -2052,6 +2197,7 @@ namespace flame
 			_process_model(m.get(), true);
 
 			_models[HASH(m->filename.c_str())] = m;
+			_add_model_geometry(m.get());
 
 			arrowModel = m;
 		}
@@ -2073,6 +2219,7 @@ namespace flame
 			_process_model(m.get(), true);
 
 			_models[HASH(m->filename.c_str())] = m;
+			_add_model_geometry(m.get());
 
 			torusModel = m;
 		}
@@ -2103,10 +2250,9 @@ namespace flame
 			_process_model(m.get(), true);
 
 			_models[HASH(m->filename.c_str())] = m;
+			_add_model_geometry(m.get());
 
 			hamerModel = m;
 		}
-
-		_create_vertex_and_index_buffer();
 	}
 }
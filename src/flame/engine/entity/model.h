@@ -2,8 +2,10 @@
 
 #include <memory>
 #include <vector>
+#include <functional>
 
 #include <flame/math.h>
+#include <flame/mesh.h>
 #include <flame/engine/config.h>
 #include <flame/engine/graphics/graphics.h>
 
@@ -42,6 +44,7 @@ namespace flame
 	};
 
 	struct Material;
+	class TriangleBVH;
 	struct Buffer;
 	struct Animation;
 	struct AnimationBinding;
@@ -103,6 +106,8 @@ namespace flame
 			std::vector<int> indices;
 			std::vector<std::pair<int, int>> series;
 
+			std::unique_ptr<VertexWelder<glm::vec2, 2>> welder; // dropped when 'unique' is changed by others
+
 			void add(const glm::vec2 &v);
 		};
 
@@ -121,6 +126,7 @@ namespace flame
 		UV *geometry_uv = nullptr;
 		UV *bake_uv = nullptr;
 		std::unique_ptr<GeometryAux> geometry_aux;
+		std::unique_ptr<TriangleBVH> bvh; // made by get_bvh, reset it after changing vertexes or indices
 
 		int bake_grid_pixel_size = 4;
 		int bake_image_cx = 256;
@@ -155,10 +161,13 @@ namespace flame
 
 		glm::vec3 eye_position = glm::vec3(0.f);
 
+		~Model();
+
 		void add_vertex_position_normal(const glm::vec3 &position, const glm::vec3 &normal);
 
 		const char *get_uv_use_name(UV *uv) const;
 		void create_geometry_aux();
+		TriangleBVH *get_bvh();
 		void create_uv();
 		void remove_uv(UV *uv);
 		void assign_uv_to_geometry(UV *uv);
@@ -205,7 +214,14 @@ namespace flame
 	extern std::shared_ptr<Model> hamerModel;
 
 	void add_model(std::shared_ptr<Model> m);
+	// re-pack the ranges of all models, vertex_base and indice_base of models may change
+	void defragment_model_geometry();
 	std::shared_ptr<Model> getModel(const std::string &filename);
+	struct LoadTicket;
+	// the file is read on a loader thread and the model is put into the geometry buffers after a frame,
+	// callback is called then (with nullptr when it failed), use a placeholder until that
+	std::shared_ptr<LoadTicket> getModelAsync(const std::string &filename, int priority,
+		const std::function<void(std::shared_ptr<Model>)> &callback);
 	void saveModel(Model *m, const std::string &filename);
 
 	void init_model();
@@ -1,8 +1,11 @@
 //#include "../graphics/buffer.h"
-//#include "../model/animation.h"
 //#include "../physics/physics.h"
 #include <flame/filesystem.h>
+#include <flame/aabb_tree.h>
+#include <flame/ray_cast.h>
+#include <flame/engine/entity/node.h>
 #include <flame/engine/entity/model.h>
+#include <flame/engine/entity/animation.h>
 #include "model_instance.h"
 
 namespace flame
@@ -23,14 +26,45 @@ namespace flame
 					model = m;
 				else
 					model = cubeModel;
+				create_animation_runner();
 			}
 		}
 	}
 
+	void ModelInstanceComponent::create_animation_runner()
+	{
+		// the renderers draw the models with skeleton vertexes as the skinned ones
+		if (model->vertexes_skeleton.size() > 0)
+		{
+			animation_runner = std::make_unique<AnimationRunner>(model.get());
+			if (model->stateAnimations[ModelStateAnimationStand])
+				animation_runner->set_animation(model->stateAnimations[ModelStateAnimationStand].get());
+		}
+		else
+			animation_runner.reset();
+	}
+
+	void ModelInstanceComponent::on_update()
+	{
+		if (animation_runner)
+			animation_runner->update();
+	}
+
+	void ModelInstanceComponent::on_world_dirty()
+	{
+		if (instance_list && instance_list->is_valid(instance_handle))
+			instance_list->mark_dirty(instance_handle.index);
+	}
+
 	ModelInstanceComponent::ModelInstanceComponent() :
 		Component(ComponentTypeModelInstance),
 		model(cubeModel),
-		instance_index(-1)
+		instance_index(-1),
+		instance_list(nullptr)
+	{
+	}
+
+	ModelInstanceComponent::~ModelInstanceComponent()
 	{
 	}
 
@@ -39,6 +73,11 @@ namespace flame
 		return model.get();
 	}
 
+	AnimationRunner *ModelInstanceComponent::get_animation_runner() const
+	{
+		return animation_runner.get();
+	}
+
 	int ModelInstanceComponent::get_instance_index() const
 	{
 		return instance_index;
@@ -47,6 +86,7 @@ namespace flame
 	void ModelInstanceComponent::set_model(std::shared_ptr<Model> _model)
 	{
 		model = _model;
+		create_animation_runner();
 
 		broadcast(this, MessageChangeModel);
 	}
@@ -56,6 +96,45 @@ namespace flame
 		instance_index = v;
 	}
 
+	void ModelInstanceComponent::set_instance_list(SpareList *list, const SlotHandle &h)
+	{
+		instance_list = list;
+		instance_handle = h;
+	}
+
+	bool ray_cast_model_instance(ModelInstanceComponent *i, const glm::vec3 &origin, const glm::vec3 &dir,
+		float t_max, RayHit *hit)
+	{
+		auto m = i->get_model();
+		if (!m)
+			return false;
+		auto bvh = m->get_bvh();
+		if (bvh->empty())
+			return false;
+
+		auto inv = glm::inverse(i->get_parent()->get_world_matrix());
+		Mat4 inv_world(Vec4(inv[0][0], inv[0][1], inv[0][2], inv[0][3]), Vec4(inv[1][0], inv[1][1], inv[1][2], inv[1][3]),
+			Vec4(inv[2][0], inv[2][1], inv[2][2], inv[2][3]), Vec4(inv[3][0], inv[3][1], inv[3][2], inv[3][3]));
+		return ray_cast(*bvh, inv_world, Ray(Vec3(origin.x, origin.y, origin.z), Vec3(dir.x, dir.y, dir.z)), t_max, hit);
+	}
+
+	ModelInstanceComponent *ray_cast_model_instances(AABBTree &tree, const std::function<ModelInstanceComponent*(int user)> &get_instance,
+		const glm::vec3 &origin, const glm::vec3 &dir, float t_max, RayHit *hit)
+	{
+		RayHit h;
+		ModelInstanceComponent *found = nullptr;
+		tree.query_ray(Ray(Vec3(origin.x, origin.y, origin.z), Vec3(dir.x, dir.y, dir.z)), t_max, [&](int user, float t) {
+			auto i = get_instance(user);
+			if (!ray_cast_model_instance(i, origin, dir, t, &h))
+				return t;
+			found = i;
+			return h.t;
+		});
+		if (found && hit)
+			*hit = h;
+		return found;
+	}
+
 	//ObjectRigidBodyData::~ObjectRigidBodyData()
 	//{
 	//	if (actor)
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <functional>
+#include <memory>
+
+#include <flame/math.h>
+#include <flame/spare_list.h>
 #include <flame/engine/entity/component.h>
 
 //namespace physx
@@ -11,6 +16,9 @@
 namespace flame
 {
 	struct Model;
+	struct AnimationRunner;
+	struct RayHit;
+	class AABBTree;
 
 	//enum ModelInstanceComponentPhysicsType
 	//{
@@ -36,22 +44,40 @@ namespace flame
 
 		//std::uint32_t physics_type = 0;
 
-		//std::unique_ptr<AnimationRunner> animationComponent;
+		std::unique_ptr<AnimationRunner> animation_runner; // skinned models only
 		//std::vector<std::unique_ptr<ModelInstanceComponentRigidBodyData>> rigidbodyDatas;
 		//physx::PxController *pxController = nullptr;
 		//float floatingTime = 0.f;
 
 		int instance_index;
+		SpareList *instance_list; // the list of the renderer for static ones, its slot is marked dirty on a move
+		SlotHandle instance_handle;
+
+		void create_animation_runner();
+	protected:
+		virtual void on_update() override;
+		virtual void on_world_dirty() override;
 	public:
 		virtual void serialize(XMLNode *dst) override;
 		virtual void unserialize(XMLNode *src) override;
 
 		ModelInstanceComponent();
+		virtual ~ModelInstanceComponent();
 
 		Model *get_model() const;
+		AnimationRunner *get_animation_runner() const;
 		int get_instance_index() const;
 
 		void set_model(std::shared_ptr<Model> _model);
 		void set_instance_index(int v);
+		void set_instance_list(SpareList *list, const SlotHandle &h);
 	};
+
+	// tests the model triangles (bind pose) in the world space of i's node, hit->t is in units of dir
+	bool ray_cast_model_instance(ModelInstanceComponent *i, const glm::vec3 &origin, const glm::vec3 &dir,
+		float t_max, RayHit *hit = nullptr);
+	// the nearest instance that the ray hits before t_max, only the leaves of tree that the ray reaches are
+	// tested, nearest first, get_instance gives the instance of a leaf's user
+	ModelInstanceComponent *ray_cast_model_instances(AABBTree &tree, const std::function<ModelInstanceComponent*(int user)> &get_instance,
+		const glm::vec3 &origin, const glm::vec3 &dir, float t_max, RayHit *hit = nullptr);
 }
@@ -1,9 +1,45 @@
 #include <flame/global.h>
+#include <flame/type.h>
 #include <flame/engine/core/core.h>
 #include <flame/engine/entity/node.h>
 
+#include <algorithm>
+
 namespace flame
 {
+	// bumped on any add_child/remove_child, root nodes rebuild their transform list when it changes
+	static unsigned long long node_structure_version = 0;
+
+	// depth sorted SoA of a whole tree, parents always come before their children, so world
+	// transforms can be computed in one linear pass, and nodes in the same depth are independent
+	struct NodeTransformList
+	{
+		unsigned long long version;
+		std::vector<Node*> nodes;
+		std::vector<int> parents; // index in the list, -1 for the root
+		std::vector<int> depth_offsets; // the begin of each depth, plus the end
+		std::vector<uchar> dirties;
+		std::vector<glm::mat4> local_matrices;
+		std::vector<glm::mat3> local_axes;
+		std::vector<glm::mat4> world_matrices;
+		std::vector<glm::mat3> world_axes;
+	};
+
+	// the depths of a big tree are split over the job system, the small ones stay on this thread
+	template <class F>
+	static void parallel_range(int begin, int end, const F &f)
+	{
+		const auto min_count_per_job = 2048;
+
+		if (!job_system || end - begin < min_count_per_job * 2)
+		{
+			f(begin, end);
+			return;
+		}
+
+		job_system->parallel_for(begin, end, min_count_per_job, f);
+	}
+
 	bool Node::broadcast_upward(Object *src, Message msg)
 	{
 		if (Object::broadcast(src, msg))
@@ -24,12 +60,20 @@ namespace flame
 		euler_dirty(false),
 		quat_dirty(false),
 		matrix_dirty(false),
+		world_matrix(1.f),
+		world_axis(1.f),
+		world_dirty(true),
+		world_lazy_updated(false),
 		transform_dirty_frame(0),
 		type(_type),
 		parent(nullptr)
 	{
 	}
 
+	Node::~Node()
+	{
+	}
+
 	const glm::vec3 &Node::get_coord() const
 	{
 		return coord;
@@ -68,12 +112,11 @@ namespace flame
 		return matrix;
 	}
 
-	glm::mat4 Node::get_world_matrix()
+	const glm::mat4 &Node::get_world_matrix()
 	{
-		auto m = get_matrix();
-		if (parent)
-			m = parent->get_world_matrix() * m;
-		return m;
+		if (world_dirty)
+			update_world();
+		return world_matrix;
 	}
 
 	glm::vec3 Node::get_world_coord()
@@ -81,12 +124,11 @@ namespace flame
 		return glm::vec3(get_world_matrix()[3]);
 	}
 
-	glm::mat3 Node::get_world_axis()
+	const glm::mat3 &Node::get_world_axis()
 	{
-		auto a = get_axis();
-		if (parent)
-			a = parent->get_world_axis() * a;
-		return a;
+		if (world_dirty)
+			update_world();
+		return world_axis;
 	}
 
 	void Node::set_coord(const glm::vec3 &_coord)
@@ -425,7 +467,7 @@ namespace flame
 		coord += t->coord;
 		matrix_dirty = true;
 
-		transform_dirty_frame = total_frame_count;
+		mark_world_dirty();
 	}
 
 	void Node::relate(Node *t)
@@ -434,7 +476,7 @@ namespace flame
 		axis *= glm::transpose(t->axis);
 		matrix_dirty = true;
 
-		transform_dirty_frame = total_frame_count;
+		mark_world_dirty();
 	}
 
 	void Node::update_matrix()
@@ -471,6 +513,149 @@ namespace flame
 		quat_dirty = false;
 	}
 
+	void Node::update_world()
+	{
+		if (parent)
+		{
+			world_matrix = parent->get_world_matrix() * get_matrix();
+			world_axis = parent->get_world_axis() * get_axis();
+		}
+		else
+		{
+			world_matrix = get_matrix();
+			world_axis = get_axis();
+		}
+		world_dirty = false;
+		world_lazy_updated = true;
+	}
+
+	void Node::mark_world_dirty()
+	{
+		world_dirty = true;
+		transform_dirty_frame = total_frame_count;
+		for (auto &c : components)
+			c->on_world_dirty();
+		for (auto &c : children)
+		{
+			// a child that is already marked in this frame has its whole subtree marked
+			if (!c->world_dirty || c->transform_dirty_frame != transform_dirty_frame)
+				c->mark_world_dirty();
+		}
+	}
+
+	void Node::update_world_transforms()
+	{
+		if (!transform_list)
+		{
+			transform_list = std::make_unique<NodeTransformList>();
+			transform_list->version = node_structure_version - 1;
+		}
+		auto &l = *transform_list;
+
+		if (l.version != node_structure_version)
+		{
+			l.nodes.clear();
+			l.parents.clear();
+			l.depth_offsets.clear();
+
+			l.nodes.push_back(this);
+			l.parents.push_back(-1);
+			l.depth_offsets.push_back(0);
+			for (auto begin = 0; begin < l.nodes.size(); )
+			{
+				int end = l.nodes.size();
+				l.depth_offsets.push_back(end);
+				for (auto i = begin; i < end; i++)
+				{
+					for (auto &c : l.nodes[i]->children)
+					{
+						l.nodes.push_back(c.get());
+						l.parents.push_back(i);
+					}
+				}
+				begin = end;
+			}
+
+			auto n = l.nodes.size();
+			l.dirties.resize(n);
+			l.local_matrices.resize(n);
+			l.local_axes.resize(n);
+			l.world_matrices.resize(n);
+			l.world_axes.resize(n);
+			for (auto i = 0; i < n; i++)
+				l.nodes[i]->world_lazy_updated = !l.nodes[i]->world_dirty; // pull in all valid caches
+
+			l.version = node_structure_version;
+		}
+
+		// gather, the local matrices are only touched for dirty nodes
+		int n = l.nodes.size();
+		auto any_dirty = false;
+		for (auto i = 0; i < n; i++)
+		{
+			auto nd = l.nodes[i];
+			if (nd->world_dirty)
+			{
+				l.dirties[i] = 1;
+				l.local_matrices[i] = nd->get_matrix();
+				l.local_axes[i] = nd->get_axis();
+				any_dirty = true;
+			}
+			else
+			{
+				l.dirties[i] = 0;
+				if (nd->world_lazy_updated)
+				{
+					l.world_matrices[i] = nd->world_matrix;
+					l.world_axes[i] = nd->world_axis;
+				}
+			}
+			nd->world_lazy_updated = false;
+		}
+		if (!any_dirty)
+			return;
+
+		// the dirty flag of a parent has been propagated to its children by mark_world_dirty,
+		// so a clean node never needs a recompute, and a dirty node always reads an up-to-date parent
+		if (l.dirties[0])
+		{
+			if (parent)
+			{
+				l.world_matrices[0] = parent->get_world_matrix() * l.local_matrices[0];
+				l.world_axes[0] = parent->get_world_axis() * l.local_axes[0];
+			}
+			else
+			{
+				l.world_matrices[0] = l.local_matrices[0];
+				l.world_axes[0] = l.local_axes[0];
+			}
+		}
+		for (auto d = 1; d + 1 < l.depth_offsets.size(); d++)
+		{
+			parallel_range(l.depth_offsets[d], l.depth_offsets[d + 1], [&](int begin, int end) {
+				for (auto i = begin; i < end; i++)
+				{
+					if (!l.dirties[i])
+						continue;
+					auto p = l.parents[i];
+					l.world_matrices[i] = l.world_matrices[p] * l.local_matrices[i];
+					l.world_axes[i] = l.world_axes[p] * l.local_axes[i];
+				}
+			});
+		}
+
+		// scatter
+		for (auto i = 0; i < n; i++)
+		{
+			if (!l.dirties[i])
+				continue;
+			auto nd = l.nodes[i];
+			nd->world_matrix = l.world_matrices[i];
+			nd->world_axis = l.world_axes[i];
+			nd->world_dirty = false;
+		}
+	}
+
 	long long Node::get_transform_dirty_frame()
 	{
 		return transform_dirty_frame;
@@ -483,6 +668,9 @@ namespace flame
 		for (auto &c : components)
 			c->on_update();
 		on_update();
+
+		if (!parent)
+			update_world_transforms();
 	}
 
 	NodeType Node::get_type() const
@@ -509,6 +697,8 @@ namespace flame
 	{
 		n->parent = this;
 		children.emplace_back(n);
+		node_structure_version++;
+		n->mark_world_dirty();
 		broadcast_upward(n, MessageNodeAdd);
 		component_boardcast(n, MessageComponentAdd);
 	}
@@ -522,6 +712,7 @@ namespace flame
 				component_boardcast(n, MessageComponentRemove);
 				broadcast_upward(n, MessageNodeRemove);
 				children.erase(it);
+				node_structure_version++;
 				return;
 			}
 		}
@@ -550,7 +741,7 @@ namespace flame
 	void Node::mark_coord_setted()
 	{
 		matrix_dirty = true;
-		transform_dirty_frame = total_frame_count;
+		mark_world_dirty();
 	}
 
 	void Node::mark_euler_setted()
@@ -559,7 +750,7 @@ namespace flame
 		euler_dirty = false;
 		quat_dirty = true;
 		matrix_dirty = true;
-		transform_dirty_frame = total_frame_count;
+		mark_world_dirty();
 	}
 
 	void Node::mark_quat_setted()
@@ -568,7 +759,7 @@ namespace flame
 		euler_dirty = true;
 		quat_dirty = false;
 		matrix_dirty = true;
-		transform_dirty_frame = total_frame_count;
+		mark_world_dirty();
 	}
 
 	void Node::mark_axis_setted()
@@ -577,13 +768,13 @@ namespace flame
 		euler_dirty = true;
 		quat_dirty = true;
 		matrix_dirty = true;
-		transform_dirty_frame = total_frame_count;
+		mark_world_dirty();
 	}
 
 	void Node::mark_scale_setted()
 	{
 		matrix_dirty = true;
-		transform_dirty_frame = total_frame_count;
+		mark_world_dirty();
 	}
 
 	void Node::component_boardcast(Node *n, Message msg)
@@ -16,6 +16,7 @@ namespace flame
 	};
 
 	struct Component;
+	struct NodeTransformList;
 
 	 class Node : public Object
 	{
@@ -40,18 +41,26 @@ namespace flame
 		bool euler_dirty;
 		bool quat_dirty;
 		bool matrix_dirty;
+
+		// world transform cache, a change on a node marks its whole subtree dirty
+		glm::mat4 world_matrix;
+		glm::mat3 world_axis;
+		bool world_dirty;
+		bool world_lazy_updated; // updated by a get_world_* call since the last update_world_transforms
 	protected:
-		long long transform_dirty_frame;
+		long long transform_dirty_frame; // also setted when any ancestor changes
 	private:
 		NodeType type;
 		Node *parent;
 		std::vector<std::unique_ptr<Node>> children; 
 		std::vector<std::unique_ptr<Component>> components;
+
+		std::unique_ptr<NodeTransformList> transform_list; // only for root nodes
 	public:
 		bool broadcast_upward(Object *src, Message msg);
 
 		Node(NodeType _type = NodeTypeNode);
-		virtual ~Node() {};
+		virtual ~Node();
 
 		const glm::vec3 &get_coord() const;
 		const glm::vec3 &get_euler();
@@ -60,9 +69,9 @@ namespace flame
 
 		const glm::mat3 &get_axis();
 		const glm::mat4 &get_matrix();
-		glm::mat4 get_world_matrix();
+		const glm::mat4 &get_world_matrix();
 		glm::vec3 get_world_coord();
-		glm::mat3 get_world_axis();
+		const glm::mat3 &get_world_axis();
 
 		void set_coord(const glm::vec3 &_coord);
 		void set_coord(float x, float y, float z);
@@ -123,6 +132,8 @@ namespace flame
 		void remove_component(Component *c);
 
 		void update();
+		// update world transforms of the whole tree in one pass, called by update() of the root node
+		void update_world_transforms();
 	protected:
 		virtual void on_update() {};
 
@@ -131,7 +142,9 @@ namespace flame
 		void update_axis();
 		void update_euler();
 		void update_quat();
+		void update_world();
 
+		void mark_world_dirty();
 		void mark_coord_setted();
 		void mark_euler_setted();
 		void mark_quat_setted();
@@ -1,12 +1,26 @@
 #include <flame/global.h>
 #include <flame/string.h>
+#include <flame/engine/core/core.h>
+#include <flame/engine/graphics/buffer.h>
 #include <flame/engine/graphics/texture.h>
+#include <flame/engine/graphics/command_buffer.h>
 #include <flame/engine/ui/fileselector.h>
 
 namespace flame
 {
 	namespace ui
 	{
+		enum
+		{
+			ScanBatchSize = 256, // entries handed over at a time by the scanning thread
+			ScanItemsPerFrame = 1000,
+			ThumbnailSize = 64,
+			ThumbnailAtlasSize = 1024,
+			ThumbnailUploadsPerFrame = 32
+		};
+
+		static const char *thumbnail_cache_dir = "thumbnails";
+
 		FileSelector::FileItem::FileItem(FileSelector *_parent) :
 			parent(_parent),
 			file_type(FileTypeUnknown)
@@ -15,8 +29,6 @@ namespace flame
 
 		FileSelector::FileItem::~FileItem()
 		{
-			if (preview_image && preview_image != parent->empty_image)
-				decrease_texture_ref(preview_image.get());
 		}
 
 		FileSelector::FileSelector(const std::string &_title, FileSelectorIo io, const std::string &_default_dir,
@@ -53,16 +65,39 @@ namespace flame
 				flame::ui::increase_texture_ref(folder_image.get());
 				flame::ui::increase_texture_ref(file_image.get());
 				flame::ui::increase_texture_ref(empty_image.get());
+
+				thumbnail_atlas = std::make_unique<ThumbnailAtlas>(ThumbnailAtlasSize, ThumbnailSize);
+				thumbnail_sizes.resize(thumbnail_atlas->get_cell_count());
+				thumbnail_image = new Texture(TextureTypeImage, ThumbnailAtlasSize, ThumbnailAtlasSize, VK_FORMAT_R8G8B8A8_UNORM, 0);
+				auto cb = begin_once_command_buffer();
+				thumbnail_image->transition_layout(cb, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+				thumbnail_image->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				end_once_command_buffer(cb);
+				flame::ui::increase_texture_ref(thumbnail_image);
+				thumbnail_staging = new Buffer(BufferTypeStaging, ThumbnailUploadsPerFrame * ThumbnailSize * ThumbnailSize * 4);
+				thumbnail_cb = new CommandBuffer;
 			}
 		}
 
 		FileSelector::~FileSelector()
 		{
+			if (scan_ticket)
+				load_queue->cancel(scan_ticket);
+			for (auto &r : thumbnail_requests)
+			{
+				if (r.second)
+					load_queue->cancel(r.second);
+			}
+
 			if (tree_mode)
 			{
 				flame::ui::decrease_texture_ref(folder_image.get());
 				flame::ui::decrease_texture_ref(file_image.get());
 				flame::ui::decrease_texture_ref(empty_image.get());
+				flame::ui::decrease_texture_ref(thumbnail_image);
+				delete thumbnail_image;
+				delete thumbnail_staging;
+				delete thumbnail_cb;
 			}
 		}
 
@@ -119,92 +154,265 @@ namespace flame
 			file_watcher = add_file_watcher(FileWatcherModeAll, s);
 		}
 
+		static void _scan_dir(const std::filesystem::path &src, bool recursive, bool enable_file, LoadTicket &ticket,
+			FileSelector::ScanResult *r, std::vector<FileSelector::ScanEntry> &batch)
+		{
+			auto parent = src.string();
+			std::error_code ec;
+			for (std::filesystem::directory_iterator it(src, ec), end; !ec && it != end; it.increment(ec))
+			{
+				if (ticket.cancelled)
+					return;
+
+				FileSelector::ScanEntry e;
+				e.is_dir = std::filesystem::is_directory(it->status());
+				if (!e.is_dir && !enable_file)
+					continue;
+				e.parent = parent;
+				e.name = it->path().filename().string();
+				e.filename = it->path().string();
+				batch.push_back(e);
+				if (batch.size() >= ScanBatchSize)
+				{
+					std::lock_guard<std::mutex> lock(r->mtx);
+					r->entries.insert(r->entries.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+					batch.clear();
+				}
+
+				// the dir comes before its contents, so its item exists when they are added
+				if (e.is_dir && recursive)
+					_scan_dir(it->path(), recursive, enable_file, ticket, r, batch);
+			}
+		}
+
 		void FileSelector::refresh()
 		{
-			std::string select_dir_filename;
+			scan_select_dir.clear();
 			if (select_dir)
-				select_dir_filename = select_dir->filename;
+				scan_select_dir = select_dir->filename;
 
 			curr_dir.dir_list.clear();
 			curr_dir.file_list.clear();
 			select_index = -1;
 			select_dir = nullptr;
 
+			if (scan_ticket)
+				load_queue->cancel(scan_ticket);
+			scan_ticket.reset();
+			scan_result.reset();
+			scan_pending.clear();
+			scan_pending_index = 0;
+			scan_dirs.clear();
+			scanning = false;
+
+			if (thumbnail_atlas)
+			{
+				// the files may have changed, the disk cache makes getting them again cheap
+				for (auto &r : thumbnail_requests)
+				{
+					if (r.second)
+						load_queue->cancel(r.second);
+				}
+				thumbnail_requests.clear();
+				thumbnail_uploads.clear();
+				thumbnail_atlas->clear();
+			}
+
 			if (!on_refresh())
 				return;
 
-			std::function<void(DirItem *, const std::filesystem::path &)> fIterDir;
-			fIterDir = [&](DirItem *dst, const std::filesystem::path &src) {
-				if (src.string() == select_dir_filename)
-					select_dir = dst;
+			if (curr_dir.filename == scan_select_dir)
+				select_dir = &curr_dir;
+			scan_dirs[std::filesystem::path(curr_dir.filename).string()] = &curr_dir;
+
+			auto r = std::make_shared<ScanResult>();
+			std::filesystem::path src(curr_dir.filename);
+			auto recursive = tree_mode;
+			auto files = enable_file;
+			scan_result = r;
+			scanning = true;
+			scan_ticket = load_queue->push(LoadPriorityHigh, [r, src, recursive, files](LoadTicket &ticket) {
+				std::vector<ScanEntry> batch;
+				_scan_dir(src, recursive, files, ticket, r.get(), batch);
+				std::lock_guard<std::mutex> lock(r->mtx);
+				r->entries.insert(r->entries.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+				r->done = true;
+				return true;
+			});
+		}
 
-				std::filesystem::directory_iterator end_it;
-				for (std::filesystem::directory_iterator it(src); it != end_it; it++)
+		void FileSelector::take_scan_results()
+		{
+			if (!scanning)
+				return;
+
+			if (scan_pending_index == scan_pending.size())
+			{
+				scan_pending.clear();
+				scan_pending_index = 0;
+				std::lock_guard<std::mutex> lock(scan_result->mtx);
+				scan_pending.swap(scan_result->entries);
+				if (scan_pending.empty() && scan_result->done)
 				{
-					auto str = it->path().filename().string();
-					if (std::filesystem::is_directory(it->status()))
-					{
-						auto i = new DirItem;
-						i->value = str;
-						i->name = ICON_FA_FOLDER_O" " + str;
-						i->filename = it->path().string();
-						if (tree_mode)
-							fIterDir(i, it->path());
-						dst->dir_list.emplace_back(i);
-					}
-					else if (enable_file)
-					{
-						auto i = on_new_file_item();
-						i->value = str;
-						i->filename = it->path().string();
+					scanning = false;
+					scan_result.reset();
+					scan_ticket.reset();
+					return;
+				}
+			}
 
-						auto ext = it->path().extension().string();
-						const char *prefix;
-						if (is_text_file(ext))
-						{
-							i->file_type = FileTypeText;
-							prefix = ICON_FA_FILE_TEXT_O" ";
-						}
-						else if (is_image_file(ext))
-						{
-							i->file_type = FileTypeImage;
-							prefix = ICON_FA_FILE_IMAGE_O" ";
-							if (tree_mode)
-							{
-								i->preview_image = get_texture(i->filename);
-								if (!i->preview_image)
-									i->preview_image = empty_image;
-								else
-									increase_texture_ref(i->preview_image.get());
-							}
-						}
-						else if (is_model_file(ext))
-						{
-							i->file_type = FileTypeModel;
-							prefix = ICON_FA_FILE_O" ";
-						}
-						else if (is_terrain_file(ext))
-						{
-							i->file_type = FileTypeTerrain;
-							prefix = ICON_FA_FILE_O" ";
-						}
-						else if (is_scene_file(ext))
-						{
-							i->file_type = FileTypeScene;
-							prefix = ICON_FA_FILE_O" ";
-						}
-						else
-							prefix = ICON_FA_FILE_O" ";
-						i->name = prefix + str;
+			auto end = std::min((int)scan_pending.size(), scan_pending_index + ScanItemsPerFrame);
+			for (; scan_pending_index < end; scan_pending_index++)
+			{
+				auto &e = scan_pending[scan_pending_index];
+				auto it = scan_dirs.find(e.parent);
+				if (it != scan_dirs.end())
+					add_item(it->second, e);
+			}
+		}
 
-						on_add_file_item(i);
+		void FileSelector::add_item(DirItem *dst, const ScanEntry &e)
+		{
+			if (e.is_dir)
+			{
+				auto i = new DirItem;
+				i->value = e.name;
+				i->name = ICON_FA_FOLDER_O" " + e.name;
+				i->filename = e.filename;
+				if (i->filename == scan_select_dir)
+					select_dir = i;
+				if (tree_mode)
+					scan_dirs[i->filename] = i;
+				dst->dir_list.emplace_back(i);
+				return;
+			}
 
-						dst->file_list.emplace_back(i);
-					}
-				}
-			};
+			auto i = on_new_file_item();
+			i->value = e.name;
+			i->filename = e.filename;
+
+			auto ext = std::filesystem::path(e.filename).extension().string();
+			const char *prefix;
+			if (is_text_file(ext))
+			{
+				i->file_type = FileTypeText;
+				prefix = ICON_FA_FILE_TEXT_O" ";
+			}
+			else if (is_image_file(ext))
+			{
+				i->file_type = FileTypeImage;
+				prefix = ICON_FA_FILE_IMAGE_O" ";
+			}
+			else if (is_model_file(ext))
+			{
+				i->file_type = FileTypeModel;
+				prefix = ICON_FA_FILE_O" ";
+			}
+			else if (is_terrain_file(ext))
+			{
+				i->file_type = FileTypeTerrain;
+				prefix = ICON_FA_FILE_O" ";
+			}
+			else if (is_scene_file(ext))
+			{
+				i->file_type = FileTypeScene;
+				prefix = ICON_FA_FILE_O" ";
+			}
+			else
+				prefix = ICON_FA_FILE_O" ";
+			i->name = prefix + e.name;
+
+			on_add_file_item(i);
+
+			dst->file_list.emplace_back(i);
+		}
+
+		Texture *FileSelector::get_item_image(FileItem *i, float size, ImVec2 *draw_size, ImVec2 *uv0, ImVec2 *uv1)
+		{
+			*draw_size = ImVec2(size, size);
+			*uv0 = ImVec2(0.f, 0.f);
+			*uv1 = ImVec2(1.f, 1.f);
+			if (i->file_type != FileTypeImage)
+				return file_image.get();
+
+			auto id = thumbnail_atlas->find(i->filename);
+			if (id != -1)
+			{
+				auto &s = thumbnail_sizes[id];
+				auto uv = thumbnail_atlas->get_uv(id, s.x, s.y);
+				auto scale = size / ThumbnailSize;
+				*draw_size = ImVec2(s.x * scale, s.y * scale);
+				*uv0 = ImVec2(uv.x, uv.y);
+				*uv1 = ImVec2(uv.z, uv.w);
+				return thumbnail_image;
+			}
+
+			// a request that failed stays in the map with no ticket, so it is not asked again
+			if (thumbnail_requests.find(i->filename) == thumbnail_requests.end())
+			{
+				auto filename = i->filename;
+				auto t = std::make_shared<Thumbnail>();
+				thumbnail_requests[filename] = load_queue->push(LoadPriorityNormal, [filename, t](LoadTicket &) {
+					return get_thumbnail(filename, ThumbnailSize, thumbnail_cache_dir, t.get());
+				}, [this, filename, t](bool ok) {
+					if (ok)
+						thumbnail_uploads.push_back({ filename, std::move(*t) });
+					else
+						thumbnail_requests[filename].reset();
+				});
+			}
+			return empty_image.get();
+		}
+
+		void FileSelector::show_thumbnail(FileItem *i, float size)
+		{
+			ImVec2 draw_size, uv0, uv1;
+			auto img = get_item_image(i, size, &draw_size, &uv0, &uv1);
+			ImGui::Image(ImTextureID(img->ui_index), draw_size, uv0, uv1);
+		}
+
+		void FileSelector::upload_thumbnails()
+		{
+			if (thumbnail_uploads.empty())
+				return;
+
+			auto count = std::min((int)thumbnail_uploads.size(), (int)ThumbnailUploadsPerFrame);
+			thumbnail_staging->map();
+			std::vector<VkBufferImageCopy> regions(count);
+			auto offset = 0;
+			for (auto i = 0; i < count; i++)
+			{
+				auto &u = thumbnail_uploads[i];
+				auto &t = u.thumbnail;
+				auto id = thumbnail_atlas->add(u.filename);
+				thumbnail_sizes[id] = Ivec2(t.cx, t.cy);
+				thumbnail_requests.erase(u.filename);
+				memcpy((char*)thumbnail_staging->mapped + offset, t.data.data(), t.data.size());
+
+				auto pos = thumbnail_atlas->get_cell_pos(id);
+				auto &r = regions[i];
+				r = {};
+				r.bufferOffset = offset;
+				r.imageOffset.x = pos.x;
+				r.imageOffset.y = pos.y;
+				r.imageExtent.width = t.cx;
+				r.imageExtent.height = t.cy;
+				r.imageExtent.depth = 1;
+				r.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				r.imageSubresource.layerCount = 1;
+				offset += t.data.size();
+			}
+			thumbnail_staging->unmap();
+
+			// submitted ahead of the ui's command buffer in the same batch, the barriers order the copies before the draws
+			thumbnail_cb->begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+			thumbnail_image->transition_layout(thumbnail_cb, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+			vkCmdCopyBufferToImage(thumbnail_cb->v, thumbnail_staging->v, thumbnail_image->v, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, count, regions.data());
+			thumbnail_image->transition_layout(thumbnail_cb, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			thumbnail_cb->end();
+			add_to_draw_list(thumbnail_cb->v);
 
-			fIterDir(&curr_dir, curr_dir.filename);
+			thumbnail_uploads.erase(thumbnail_uploads.begin(), thumbnail_uploads.begin() + count);
 		}
 
 		void FileSelector::on_show()
@@ -219,6 +427,8 @@ namespace flame
 				refresh();
 				need_refresh = false;
 			}
+			take_scan_results();
+			upload_thumbnails();
 
 			const float itemSpacing = ImGui::GetStyle().ItemSpacing.x;
 
@@ -1,12 +1,19 @@
 #pragma once
 
+#include <mutex>
+#include <unordered_map>
+
 #include <flame/filesystem.h>
 #include <flame/system.h>
+#include <flame/thumbnail.h>
 #include <flame/engine/ui/window.h>
 
 namespace flame
 {
+	struct Buffer;
 	struct Texture;
+	struct CommandBuffer;
+	struct LoadTicket;
 
 	namespace ui
 	{
@@ -54,7 +61,6 @@ namespace flame
 				FileSelector *parent;
 
 				FileType file_type;
-				std::shared_ptr<Texture> preview_image;
 
 				FileItem(FileSelector *_parent);
 				virtual ~FileItem();
@@ -68,6 +74,46 @@ namespace flame
 			DirItem *select_dir = nullptr;
 			bool need_refresh = true;
 
+			// the directories are read on a loader thread, the items are added over the next frames
+			struct ScanEntry
+			{
+				std::string parent;
+				std::string name;
+				std::string filename;
+				bool is_dir;
+			};
+
+			struct ScanResult
+			{
+				std::mutex mtx;
+				std::vector<ScanEntry> entries;
+				bool done = false;
+			};
+
+			std::shared_ptr<ScanResult> scan_result;
+			std::shared_ptr<LoadTicket> scan_ticket;
+			std::vector<ScanEntry> scan_pending;
+			int scan_pending_index = 0;
+			std::unordered_map<std::string, DirItem*> scan_dirs;
+			std::string scan_select_dir;
+			bool scanning = false;
+
+			// tree mode, image thumbnails are made on loader threads (cached on disk) and kept in an atlas
+			struct ThumbnailUpload
+			{
+				std::string filename;
+				Thumbnail thumbnail;
+			};
+
+			std::unique_ptr<ThumbnailAtlas> thumbnail_atlas;
+			Texture *thumbnail_image = nullptr;
+			std::vector<Ivec2> thumbnail_sizes; // of each cell
+			std::unordered_map<std::string, std::shared_ptr<LoadTicket>> thumbnail_requests;
+			std::vector<ThumbnailUpload> thumbnail_uploads;
+			// the copies go with the frame's draw list, the frame ends with a queue wait so both are free again next frame
+			Buffer *thumbnail_staging = nullptr;
+			CommandBuffer *thumbnail_cb = nullptr;
+
 			std::function<bool(std::string)> callback;
 
 			FileWatcher *file_watcher;
@@ -81,6 +127,13 @@ namespace flame
 			~FileSelector();
 			void set_current_path(const std::string &s);
 			void refresh();
+			void take_scan_results();
+			void add_item(DirItem *dst, const ScanEntry &e);
+			// tree mode only, the image to draw for a file item in a size x size box: the thumbnail in the
+			// atlas for images (asked for when missing, empty_image until it comes), file_image for others
+			Texture *get_item_image(FileItem *i, float size, ImVec2 *draw_size, ImVec2 *uv0, ImVec2 *uv1);
+			void show_thumbnail(FileItem *i, float size);
+			void upload_thumbnails();
 			virtual void on_show() override;
 			virtual bool on_refresh();
 			virtual FileItem *on_new_file_item();
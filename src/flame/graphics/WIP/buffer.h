@@ -13,7 +13,8 @@ namespace flame
 		BufferTypeImmediateVertex,
 		BufferTypeImmediateIndex,
 		BufferTypeIndirectVertex,
-		BufferTypeIndirectIndex
+		BufferTypeIndirectIndex,
+		BufferTypeStorage
 	};
 
 	struct Buffer
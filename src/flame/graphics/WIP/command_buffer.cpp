@@ -1,5 +1,8 @@
 #include <assert.h>
 
+#include <flame/time.h>
+#include <flame/jobs.h>
+#include <flame/graphics/record_passes.h>
 #include <flame/engine/graphics/buffer.h>
 #include <flame/engine/graphics/texture.h>
 #include <flame/engine/graphics/renderpass.h>
@@ -11,6 +14,18 @@
 
 namespace flame
 {
+	CommandBuffer::CommandBuffer(VkCommandPool _pool, VkCommandBufferLevel level) :
+		pool(_pool)
+	{
+		VkCommandBufferAllocateInfo info;
+		info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		info.pNext = nullptr;
+		info.commandPool = pool;
+		info.level = level;
+		info.commandBufferCount = 1;
+		vk_chk_res(vkAllocateCommandBuffers(vk_device, &info, &v));
+	}
+
 	void CommandBuffer::next_subpass(VkSubpassContents contents)
 	{
 		vkCmdNextSubpass(v, VK_SUBPASS_CONTENTS_INLINE);
@@ -117,4 +132,92 @@ namespace flame
 	}
 
 	CommandPool *command_pool = nullptr;
+
+	PassRecorder::PassRecorder() :
+		queue_family(0),
+		record_ms(0.f),
+		record_work_ms(0.f)
+	{
+		// the pools are for vk_graphics_queue, of the first family that can do graphics
+		unsigned int family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(vk_physical_device, &family_count, nullptr);
+		std::vector<VkQueueFamilyProperties> families(family_count);
+		vkGetPhysicalDeviceQueueFamilyProperties(vk_physical_device, &family_count, families.data());
+		for (auto i = 0; i < family_count; i++)
+		{
+			if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			{
+				queue_family = i;
+				break;
+			}
+		}
+	}
+
+	PassRecorder::~PassRecorder()
+	{
+		for (auto &w : workers)
+		{
+			for (auto cb : w.cbs)
+				delete cb;
+			vkDestroyCommandPool(vk_device, w.pool, nullptr);
+		}
+	}
+
+	void PassRecorder::begin_frame()
+	{
+		for (auto &w : workers)
+		{
+			vk_chk_res(vkResetCommandPool(vk_device, w.pool, 0));
+			w.used_cb_count = 0;
+		}
+		record_ms = 0.f;
+		record_work_ms = 0.f;
+	}
+
+	void PassRecorder::record_passes(CommandBuffer *primary, JobSystem *js, int pass_count, RecordPass *passes, int grain)
+	{
+		auto t0 = get_now_ns();
+
+		auto worker_count = js->get_worker_count() + 1;
+		while (workers.size() < worker_count)
+		{
+			Worker w;
+			VkCommandPoolCreateInfo info;
+			info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			info.pNext = nullptr;
+			info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			info.queueFamilyIndex = queue_family;
+			vk_chk_res(vkCreateCommandPool(vk_device, &info, nullptr, &w.pool));
+			w.used_cb_count = 0;
+			workers.push_back(w);
+		}
+
+		auto work_time = graphics::record_pass_chunks<CommandBuffer>(js, pass_count, passes, grain, [&](int worker, RecordPass &p) {
+			auto &w = workers[worker];
+			if (w.used_cb_count == w.cbs.size())
+				w.cbs.push_back(new CommandBuffer(w.pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+			auto cb = w.cbs[w.used_cb_count++];
+			VkCommandBufferInheritanceInfo inheritance = {};
+			inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritance.renderPass = p.renderpass->v;
+			inheritance.subpass = 0;
+			inheritance.framebuffer = p.framebuffer->v;
+			cb->begin(VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT, &inheritance);
+			return cb;
+		}, [&](int i, int cb_count, CommandBuffer **cbs) {
+			auto &p = passes[i];
+			std::vector<VkCommandBuffer> vs(cb_count);
+			for (auto j = 0; j < cb_count; j++)
+				vs[j] = cbs[j]->v;
+			primary->begin_renderpass(p.renderpass, p.framebuffer, p.clear_values, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			if (!vs.empty())
+				vkCmdExecuteCommands(primary->v, vs.size(), vs.data());
+			if (p.rest)
+				p.rest(primary);
+			primary->end_renderpass();
+		});
+
+		record_ms += (get_now_ns() - t0) / 1000000.f;
+		record_work_ms += work_time / 1000000.f;
+	}
 }
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <vector>
+#include <functional>
+
 #include <flame/engine/graphics/graphics.h>
 
 namespace flame
 {
+	struct JobSystem;
 	struct Pipeline;
 	struct RenderPass;
 	struct Framebuffer;
@@ -15,15 +19,19 @@ namespace flame
 	struct CommandBuffer
 	{
 		VkCommandBuffer v;
+		VkCommandPool pool = 0; // it is freed into, command_pool when null
 		Pipeline *currentPipeline = nullptr;
 
 		// must call in main thread
 		CommandBuffer(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+		// from a pool of the caller, any thread that has the pool to itself
+		CommandBuffer(VkCommandPool _pool, VkCommandBufferLevel level);
 		// must call in main thread
 		~CommandBuffer();
 		void begin(VkCommandBufferUsageFlags flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, VkCommandBufferInheritanceInfo *pInheritance = nullptr);
 		void end();
-		void begin_renderpass(RenderPass *renderPass, Framebuffer *fb, VkClearValue *pClearValue = nullptr);
+		void begin_renderpass(RenderPass *renderPass, Framebuffer *fb, VkClearValue *pClearValue = nullptr,
+			VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 		void next_subpass(VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 		void end_renderpass();
 		void set_viewport_and_scissor(int cx, int cy);
@@ -50,5 +58,44 @@ namespace flame
 	CommandBuffer *begin_once_command_buffer();
 	void end_once_command_buffer(CommandBuffer *cb);
 
+	// the first subpass of a pass, its items are split into chunks of at most grain, each is recorded into a
+	// secondary command buffer, which starts with nothing bound and no viewport or scissor set
+	struct RecordPass
+	{
+		RenderPass *renderpass;
+		Framebuffer *framebuffer;
+		VkClearValue *clear_values;
+		int item_count;
+		std::function<void(CommandBuffer *cb, int begin, int end)> record;
+		std::function<void(CommandBuffer *primary)> rest; // optional, the later subpasses, inline
+	};
+
+	// graphics::Framecontext::record_passes for the renderers that are still on this api, both are on
+	// graphics::record_pass_chunks
+	struct PassRecorder
+	{
+		struct Worker
+		{
+			VkCommandPool pool;
+			std::vector<CommandBuffer*> cbs;
+			int used_cb_count;
+		};
+
+		unsigned int queue_family; // of vk_graphics_queue, that the primaries are submitted to
+		std::vector<Worker> workers; // the first one is for a thread that is not a worker of the job system
+
+		float record_ms; // since begin_frame, from the start to the last secondary
+		float record_work_ms; // the recording time of all secondaries, over record_ms is the speedup of the threads
+
+		PassRecorder();
+		// must call in main thread
+		~PassRecorder();
+		// once a frame, the gpu must be done with the command buffers of the last frame
+		void begin_frame();
+		// the chunks of all passes are recorded at the same time on the workers of js, then primary gets the passes
+		// in order, each in a renderpass that executes its secondaries
+		void record_passes(CommandBuffer *primary, JobSystem *js, int pass_count, RecordPass *passes, int grain = 64);
+	};
+
 	extern CommandPool *command_pool;
 }
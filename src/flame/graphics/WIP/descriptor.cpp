@@ -71,7 +71,7 @@ namespace flame
 		return i;
 	}
 
-	VkWriteDescriptorSet DescriptorSet::get_write(int binding, int index, VkDescriptorBufferInfo *info)
+	VkWriteDescriptorSet DescriptorSet::get_write(int binding, int index, VkDescriptorBufferInfo *info, VkDescriptorType type)
 	{
 		VkWriteDescriptorSet write;
 		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -79,7 +79,7 @@ namespace flame
 		write.dstSet = v;
 		write.dstBinding = binding;
 		write.dstArrayElement = index;
-		write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		write.descriptorType = type;
 		write.descriptorCount = 1;
 		write.pBufferInfo = info;
 		write.pImageInfo = nullptr;
@@ -32,7 +32,7 @@ namespace flame
 		DescriptorSet(Pipeline *pipeline, int index = 0);
 		// must call in main thread
 		~DescriptorSet();
-		VkWriteDescriptorSet get_write(int binding, int index, VkDescriptorBufferInfo *info);
+		VkWriteDescriptorSet get_write(int binding, int index, VkDescriptorBufferInfo *info, VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
 		VkWriteDescriptorSet get_write(int binding, int index, VkDescriptorImageInfo *info);
 	};
 
@@ -8,81 +8,58 @@
 
 namespace flame
 {
-	struct MaterialShaderStruct
+	static graphics::BindlessSlots _material_slots;
+	static graphics::BindlessDirty _dirty_materials;
+	static std::vector<graphics::BindlessMaterialData> _material_data; // per slot
+	static std::vector<std::weak_ptr<Material>> _materials; // per slot
+
+	struct MaterialImage
 	{
-		union
-		{
-			struct
-			{
-				unsigned char albedo_r;
-				unsigned char albedo_g;
-				unsigned char albedo_b;
-				unsigned char alpha;
-			};
-			unsigned int packed;
-		}albedo_alpha;
-
-		union
-		{
-			struct
-			{
-				unsigned char spec;
-				unsigned char roughness;
-				unsigned char dummy0;
-				unsigned char dummy1;
-			};
-			unsigned int packed;
-		}spec_roughness;
-
-		union
-		{
-			struct
-			{
-				unsigned char albedo_alpha;
-				unsigned char normal_height;
-				unsigned char spec_roughness;
-				unsigned char dummy;
-			};
-			unsigned int packed;
-		}map_index;
-
-		unsigned int dummy;
+		std::weak_ptr<Texture> t;
+		graphics::BindlessHandle h;
 	};
 
+	static graphics::BindlessSlots _material_image_slots;
+	static std::vector<MaterialImage> _material_images; // per slot
+
+	static uint _material_image_index(Texture *t)
+	{
+		if (!t)
+			return 0;
+		for (auto &i : _material_images)
+		{
+			if (_material_image_slots.valid(i.h) && i.t.lock().get() == t)
+				return i.h.index + 1;
+		}
+		return 0;
+	}
+
 	static void _update_material(Material *m)
 	{
-		defalut_staging_buffer->map(0, sizeof(MaterialShaderStruct));
-		auto map = (unsigned char*)defalut_staging_buffer->mapped;
-		MaterialShaderStruct stru;
+		auto h = m->get_handle();
+		if (!_material_slots.valid(h))
+			return;
+
+		auto &d = _material_data[h.index];
 		auto albedo_alpha = glm::clamp(m->get_albedo_alpha(), 0.f, 1.f);
-		stru.albedo_alpha.albedo_r = albedo_alpha.r * 255.f;
-		stru.albedo_alpha.albedo_g = albedo_alpha.g * 255.f;
-		stru.albedo_alpha.albedo_b = albedo_alpha.b * 255.f;
-		stru.albedo_alpha.alpha = albedo_alpha.a * 255.f;
-		stru.spec_roughness.spec = glm::clamp(m->get_spec(), 0.f, 1.f) * 255.f;
-		stru.spec_roughness.roughness = glm::clamp(m->get_roughness(), 0.f, 1.f) * 255.f;
-		auto albedo_alpha_map = m->get_albedo_alpha_map();
-		auto spec_roughness_map = m->get_spec_roughness_map();
-		auto normal_height_map = m->get_normal_height_map();
-		stru.map_index.albedo_alpha = albedo_alpha_map ? albedo_alpha_map->material_index + 1 : 0;
-		stru.map_index.spec_roughness = spec_roughness_map ? spec_roughness_map->material_index + 1 : 0;
-		stru.map_index.normal_height = normal_height_map ? normal_height_map->material_index + 1 : 0;
-		memcpy(map, &stru, sizeof(MaterialShaderStruct));
-		defalut_staging_buffer->unmap();
-
-		VkBufferCopy range = {};
-		range.srcOffset = 0;
-		range.dstOffset = sizeof(MaterialShaderStruct) * m->get_index();
-		range.size = sizeof(MaterialShaderStruct);
-
-		defalut_staging_buffer->copy_to(materialBuffer, 1, &range);
+		d.albedo_alpha = Vec4(albedo_alpha.r, albedo_alpha.g, albedo_alpha.b, albedo_alpha.a);
+		d.spec = glm::clamp(m->get_spec(), 0.f, 1.f);
+		d.roughness = glm::clamp(m->get_roughness(), 0.f, 1.f);
+		d.albedo_alpha_map = _material_image_index(m->get_albedo_alpha_map());
+		d.normal_height_map = _material_image_index(m->get_normal_height_map());
+		d.spec_roughness_map = _material_image_index(m->get_spec_roughness_map());
+		_dirty_materials.add(h.index);
 	}
 
 	Material::Material() :
 		albedo_alpha(1.f),
-		spec_roughness(0.f, 1.f),
-		index(-1)
+		spec_roughness(0.f, 1.f)
+	{
+	}
+
+	Material::~Material()
 	{
+		_material_slots.remove(handle);
 	}
 
 	std::string Material::get_name() const
@@ -143,7 +120,12 @@ namespace flame
 
 	int Material::get_index() const
 	{
-		return index;
+		return handle.index;
+	}
+
+	graphics::BindlessHandle Material::get_handle() const
+	{
+		return handle;
 	}
 
 	void Material::set_name(const std::string &v)
@@ -211,42 +193,37 @@ namespace flame
 		_update_material(this);
 	}
 
-	void Material::set_index(int v)
+	void Material::set_handle(const graphics::BindlessHandle &v)
 	{
-		index = v;
+		handle = v;
 	}
 
-	static SpareList _material_list(MaxMaterialCount);
-	static std::weak_ptr<Material> _materials[MaxMaterialCount];
 	std::shared_ptr<Material> default_material;
 	Buffer *materialBuffer = nullptr;
 
+	template<class F>
+	static std::shared_ptr<Material> _find_material(F f)
+	{
+		for (auto &w : _materials)
+		{
+			auto m = w.lock();
+			if (m && f(m.get()))
+				return m;
+		}
+		return nullptr;
+	}
+
 	std::shared_ptr<Material> getMaterial(const glm::vec4 &albedo_alpha, float spec, float roughness,
 		const std::string &albedo_alpha_map_filename, const std::string &spec_roughness_map_filename,
 		const std::string &normal_height_map_filename)
 	{
-		std::shared_ptr<Material> m;
-		_material_list.iterate([&](int index, void *p, bool &remove) {
-			auto _m = _materials[index].lock();
-			if (_m)
-			{
-				if (is_same(_m->get_albedo_alpha(), albedo_alpha) &&
-					is_same(_m->get_spec(), spec) &&
-					is_same(_m->get_roughness(), roughness) &&
-					_m->get_albedo_alpha_map_name() == albedo_alpha_map_filename &&
-					_m->get_spec_roughness_map_name() == spec_roughness_map_filename &&
-					_m->get_normal_height_map_name() == normal_height_map_filename)
-				{
-					m = _m;
-					return false;
-				}
-			}
-			else
-			{
-				_materials[index].reset();
-				remove = true;
-			}
-			return true;
+		auto m = _find_material([&](Material *_m) {
+			return is_same(_m->get_albedo_alpha(), albedo_alpha) &&
+				is_same(_m->get_spec(), spec) &&
+				is_same(_m->get_roughness(), roughness) &&
+				_m->get_albedo_alpha_map_name() == albedo_alpha_map_filename &&
+				_m->get_spec_roughness_map_name() == spec_roughness_map_filename &&
+				_m->get_normal_height_map_name() == normal_height_map_filename;
 		});
 
 		if (!m)
@@ -258,9 +235,14 @@ namespace flame
 			m->set_albedo_alpha_map(albedo_alpha_map_filename);
 			m->set_spec_roughness_map(spec_roughness_map_filename);
 			m->set_normal_height_map(normal_height_map_filename);
-			auto index = _material_list.add(m.get());
-			m->set_index(index);
-			_materials[index] = m;
+			auto h = _material_slots.add();
+			m->set_handle(h);
+			if (h.index >= _materials.size())
+			{
+				_materials.resize(h.index + 1);
+				_material_data.resize(h.index + 1);
+			}
+			_materials[h.index] = m;
 			_update_material(m.get());
 		}
 
@@ -269,30 +251,14 @@ namespace flame
 
 	std::shared_ptr<Material> getMaterial(const std::string name)
 	{
-		std::shared_ptr<Material> m;
-		_material_list.iterate([&](int index, void *p, bool &remove) {
-			auto _m = _materials[index].lock();
-			if (_m)
-			{
-				if (_m->get_name() == name)
-				{
-					m = _m;
-					return false;
-				}
-			}
-			else
-			{
-				_materials[index].reset();
-				remove = true;
-			}
-			return true;
+		auto m = _find_material([&](Material *_m) {
+			return _m->get_name() == name;
 		});
 
 		return m ? m : default_material;
 	}
 
-	static SpareList _material_image_list(MaxMaterialImageCount);
-	static std::weak_ptr<Texture> _material_images[MaxMaterialImageCount];
+	static int _material_image_capacity = 1024;
 
 	std::shared_ptr<Texture> getMaterialImage(const std::string &_filename)
 	{
@@ -300,23 +266,26 @@ namespace flame
 			return nullptr;
 
 		std::shared_ptr<Texture> i;
-		_material_image_list.iterate([&](int index, void *p, bool &remove) {
-			auto _i = _material_images[index].lock();
+		for (auto &mi : _material_images)
+		{
+			if (!_material_image_slots.valid(mi.h))
+				continue;
+			auto _i = mi.t.lock();
 			if (_i)
 			{
 				if (_i->filename == _filename)
 				{
 					i = _i;
-					return false;
+					break;
 				}
 			}
 			else
 			{
-				_material_images[index].reset();
-				remove = true;
+				// no material uses it anymore, its slot is given again when no frame uses it
+				_material_image_slots.remove(mi.h);
+				mi.t.reset();
 			}
-			return true;
-		});
+		}
 
 		if (!i)
 		{
@@ -324,11 +293,20 @@ namespace flame
 			if (!i)
 				return nullptr;
 
-			auto index = _material_image_list.add(i.get());
-			i->material_index = index;
-			_material_images[index] = i;
+			auto h = _material_image_slots.add();
+			if (h.index >= _material_images.size())
+				_material_images.resize(h.index + 1);
+			_material_images[h.index].t = i;
+			_material_images[h.index].h = h;
 
-			updateDescriptorSets(&ds_material->get_write(MaterialImagesDescriptorBinding, index, &get_texture_info(i.get(), colorSampler)));
+			if (_material_image_slots.capacity() > _material_image_capacity)
+			{
+				// the set is made again at the next update
+				while (_material_image_capacity < _material_image_slots.capacity())
+					_material_image_capacity *= 2;
+			}
+			else
+				updateDescriptorSets(&ds_material->get_write(MaterialImagesDescriptorBinding, h.index, &get_texture_info(i.get(), colorSampler)));
 		}
 
 		return i;
@@ -337,41 +315,161 @@ namespace flame
 	DescriptorSet *ds_material = nullptr;
 
 	static std::shared_ptr<DescriptorSetLayout> _material_layout;
+	static int _material_layout_image_count = 0;
+	static int _material_capacity = 1024;
+	static Buffer *_draw_buffer = nullptr;
+	static int _draw_capacity = 65536;
+	static std::vector<graphics::BindlessDrawData> _draws;
 
-	void init_material()
+	int add_material_draw(unsigned int instance, Material *m)
+	{
+		graphics::BindlessDrawData d;
+		d.instance = instance;
+		d.material = m->get_index();
+		_draws.push_back(d);
+		return _draws.size() - 1;
+	}
+
+	static void _create_material_set()
 	{
 		std::vector<DescriptorSetLayoutBinding> bindings = {
 			{
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				MaterialDrawBufferDescriptorBinding,
+				1,
+				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
+			},
+			{
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				MaterialBufferDescriptorBinding,
 				1,
-				VK_SHADER_STAGE_FRAGMENT_BIT
+				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
 			},
 			{
 				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 				MaterialImagesDescriptorBinding,
-				MaxMaterialCount,
-				VK_SHADER_STAGE_FRAGMENT_BIT
+				_material_image_capacity,
+				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
 			}
 		};
 		_material_layout = get_descriptor_set_layout(bindings);
+		_material_layout_image_count = _material_image_capacity;
 
+		delete ds_material;
 		ds_material = new DescriptorSet(_material_layout.get());
 
-		materialBuffer = new Buffer(BufferTypeUniform, sizeof(MaterialShaderStruct) * MaxMaterialCount);
+		std::vector<VkDescriptorImageInfo> image_infos(_material_image_capacity);
+		for (auto i = 0; i < _material_image_capacity; i++)
+		{
+			std::shared_ptr<Texture> t;
+			if (i < _material_images.size() && _material_image_slots.valid(_material_images[i].h))
+				t = _material_images[i].t.lock();
+			image_infos[i] = get_texture_info(t ? t.get() : default_color_texture.get(), colorSampler);
+		}
+		std::vector<VkWriteDescriptorSet> writes(_material_image_capacity);
+		for (auto i = 0; i < _material_image_capacity; i++)
+			writes[i] = ds_material->get_write(MaterialImagesDescriptorBinding, i, &image_infos[i]);
+		updateDescriptorSets(writes.size(), writes.data());
+	}
+
+	static void _link_material_buffers()
+	{
+		VkDescriptorBufferInfo draw_info = get_buffer_info(_draw_buffer);
+		VkDescriptorBufferInfo material_info = get_buffer_info(materialBuffer);
+		VkWriteDescriptorSet writes[] = {
+			ds_material->get_write(MaterialDrawBufferDescriptorBinding, 0, &draw_info, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+			ds_material->get_write(MaterialBufferDescriptorBinding, 0, &material_info, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+		};
+		updateDescriptorSets(TK_ARRAYSIZE(writes), writes);
+	}
+
+	void update_materials()
+	{
+		auto relink = false;
+
+		if (_material_image_capacity != _material_layout_image_count)
+		{
+			_create_material_set();
+			relink = true;
+		}
+		if (_material_slots.capacity() > _material_capacity)
+		{
+			while (_material_capacity < _material_slots.capacity())
+				_material_capacity *= 2;
+			materialBuffer->resize(sizeof(graphics::BindlessMaterialData) * _material_capacity);
+			for (auto i = 0; i < _material_slots.capacity(); i++)
+				_dirty_materials.add(i);
+			relink = true;
+		}
+		if (_draws.size() > _draw_capacity)
+		{
+			while (_draw_capacity < _draws.size())
+				_draw_capacity *= 2;
+			_draw_buffer->resize(sizeof(graphics::BindlessDrawData) * _draw_capacity);
+			relink = true;
+		}
+		if (relink)
+			_link_material_buffers();
+
+		// the changed materials and the draws in one copy
+		std::vector<std::pair<uint, uint>> dirty_ranges;
+		_dirty_materials.take(dirty_ranges);
+		auto material_count = 0;
+		for (auto &r : dirty_ranges)
+			material_count += r.second;
+		auto materials_size = sizeof(graphics::BindlessMaterialData) * material_count;
+		auto draws_size = sizeof(graphics::BindlessDrawData) * _draws.size();
+		if (materials_size + draws_size > 0)
+		{
+			if (materials_size + draws_size > defalut_staging_buffer->size)
+				defalut_staging_buffer->resize(materials_size + draws_size);
+			defalut_staging_buffer->map(0, materials_size + draws_size);
+			auto map = (unsigned char*)defalut_staging_buffer->mapped;
+			std::vector<VkBufferCopy> material_ranges;
+			auto offset = 0;
+			for (auto &r : dirty_ranges)
+			{
+				auto size = sizeof(graphics::BindlessMaterialData) * r.second;
+				memcpy(map + offset, &_material_data[r.first], size);
+				VkBufferCopy range = {};
+				range.srcOffset = offset;
+				range.dstOffset = sizeof(graphics::BindlessMaterialData) * r.first;
+				range.size = size;
+				material_ranges.push_back(range);
+				offset += size;
+			}
+			if (draws_size > 0)
+				memcpy(map + offset, _draws.data(), draws_size);
+			defalut_staging_buffer->unmap();
+			if (!material_ranges.empty())
+				defalut_staging_buffer->copy_to(materialBuffer, material_ranges.size(), material_ranges.data());
+			if (draws_size > 0)
+				defalut_staging_buffer->copy_to(_draw_buffer, draws_size, offset, 0);
+		}
+		_draws.clear();
+
+		// a removed slot is given again when the frame that used it is done
+		_material_slots.next_frame(2);
+		_material_image_slots.next_frame(2);
+	}
+
+	void init_material()
+	{
+		materialBuffer = new Buffer(BufferTypeStorage, sizeof(graphics::BindlessMaterialData) * _material_capacity);
+		_draw_buffer = new Buffer(BufferTypeStorage, sizeof(graphics::BindlessDrawData) * _draw_capacity);
+
+		_create_material_set();
+		_link_material_buffers();
 
 		default_material = std::make_shared<Material>();
 		default_material->set_name("[default_material]");
-		default_material->set_index(0);
 		{
-			auto index = _material_list.add(default_material.get());
-			_materials[index] = default_material;
+			auto h = _material_slots.add();
+			default_material->set_handle(h);
+			_materials.resize(h.index + 1);
+			_material_data.resize(h.index + 1);
+			_materials[h.index] = default_material;
 		}
 		_update_material(default_material.get());
-
-		updateDescriptorSets(&ds_material->get_write(MaterialBufferDescriptorBinding, 0, &get_buffer_info(materialBuffer)));
-
-		for (auto i = 0; i < MaxMaterialImageCount; i++)
-			updateDescriptorSets(&ds_material->get_write(MaterialImagesDescriptorBinding, i, &get_texture_info(default_color_texture.get(), colorSampler)));
 	}
 }
@@ -4,13 +4,10 @@
 #include <memory>
 
 #include <flame/math.h>
-#include <flame/spare_list.h>
+#include <flame/graphics/bindless.h>
 
 namespace flame
 {
-	enum { MaxMaterialCount = 256 };
-	enum { MaxMaterialImageCount = 256 };
-
 	struct Buffer;
 	struct Texture;
 	struct DescriptorSet;
@@ -27,9 +24,10 @@ namespace flame
 		std::shared_ptr<Texture> spec_roughness_map;
 		std::shared_ptr<Texture> normal_height_map;
 
-		int index = -1;
+		graphics::BindlessHandle handle;
 	public:
 		Material();
+		~Material();
 
 		std::string get_name() const;
 		glm::vec4 get_albedo_alpha() const;
@@ -41,7 +39,9 @@ namespace flame
 		std::string get_albedo_alpha_map_name() const;
 		std::string get_spec_roughness_map_name() const;
 		std::string get_normal_height_map_name() const;
+		// the slot in the material buffer
 		int get_index() const;
+		graphics::BindlessHandle get_handle() const;
 
 		void set_name(const std::string &v);
 		void set_albedo_alpha(const glm::vec4 &v);
@@ -50,7 +50,7 @@ namespace flame
 		void set_albedo_alpha_map(const std::string &filename);
 		void set_spec_roughness_map(const std::string &filename);
 		void set_normal_height_map(const std::string &filename);
-		void set_index(int v);
+		void set_handle(const graphics::BindlessHandle &v);
 	};
 
 	extern std::shared_ptr<Material> default_material;
@@ -62,7 +62,19 @@ namespace flame
 
 	std::shared_ptr<Texture> getMaterialImage(const std::string &filename);
 
+	// set 1 of the material pipelines, see shaders/src/bindless.glsl:
+	//  binding 0 - the draws of this frame
+	//  binding 1 - the materials
+	//  binding 2 - the material images
+	// it is made again when the images outgrow it
 	extern DescriptorSet *ds_material;
 
+	// must call in main thread, returns the first instance for the draw, an instanced draw adds one for each of its
+	// instances, after each other
+	int add_material_draw(unsigned int instance, Material *m);
+	// must call in main thread, once a frame before the recording, copies the changed materials and the draws
+	// added since the last call
+	void update_materials();
+
 	void init_material();
 }
@@ -1,3 +1,5 @@
+#include <vector>
+
 #include <flame/global.h>
 #include <flame/engine/core/core.h>
 #include <flame/engine/graphics/buffer.h>
@@ -15,40 +17,77 @@ namespace flame
 	static std::shared_ptr<RenderPass> renderpass;
 	std::shared_ptr<Framebuffer> pick_up_fb;
 
-	unsigned int pick_up(int x, int y, const std::function<void(CommandBuffer*)> &drawCallback)
+	struct PickUpSlot
+	{
+		std::unique_ptr<Buffer> buffer;
+		std::vector<std::promise<unsigned int>> promises;
+		CommandBuffer *pass_cb = nullptr;
+	};
+
+	static PickUpSlot pick_up_slots[PickUpFrameLag];
+	static int pick_up_frame = 0;
+
+	static std::future<unsigned int> _ready_pick_up(unsigned int v)
 	{
-		if (x < 0 || y < 0 || x > pick_up_image->get_cx() || y > pick_up_image->get_cy())
-			return 0;
+		std::promise<unsigned int> p;
+		p.set_value(v);
+		return p.get_future();
+	}
+
+	std::future<unsigned int> pick_up(CommandBuffer *cb, int x, int y, const std::function<void(CommandBuffer*)> &drawCallback)
+	{
+		if (x < 0 || y < 0 || x >= pick_up_image->get_cx() || y >= pick_up_image->get_cy())
+			return _ready_pick_up(0);
 
-		auto cb = begin_once_command_buffer();
-		cb->begin_renderpass(renderpass.get(), pick_up_fb.get());
-		drawCallback(cb);
-		cb->end_renderpass();
-		end_once_command_buffer(cb);
+		auto &s = pick_up_slots[pick_up_frame % PickUpFrameLag];
+		if (s.promises.size() >= PickUpMaxPerFrame)
+			return _ready_pick_up(0);
 
+		if (s.pass_cb != cb)
 		{
-			VkBufferImageCopy r = {};
-			r.imageOffset.x = x;
-			r.imageOffset.y = y;
-			r.imageExtent.width = 1;
-			r.imageExtent.height = 1;
-			r.imageExtent.depth = 1;
-			r.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			r.imageSubresource.layerCount = 1;
-
-			auto cb = flame::begin_once_command_buffer();
-			pick_up_image->transition_layout(cb, pick_up_image->layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-			vkCmdCopyImageToBuffer(cb->v, pick_up_image->v, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, defalut_staging_buffer->v, 1, &r);
-			pick_up_image->transition_layout(cb, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pick_up_image->layout);
-			flame::end_once_command_buffer(cb);
+			cb->begin_renderpass(renderpass.get(), pick_up_fb.get());
+			drawCallback(cb);
+			cb->end_renderpass();
+			s.pass_cb = cb;
 		}
 
-		defalut_staging_buffer->map(0, 4);
-		auto pixel = (unsigned char*)defalut_staging_buffer->mapped;
-		unsigned int index = pixel[0] + (pixel[1] << 8) + (pixel[2] << 16) + (pixel[3] << 24);
-		defalut_staging_buffer->unmap();
+		VkBufferImageCopy r = {};
+		r.bufferOffset = s.promises.size() * sizeof(unsigned int);
+		r.imageOffset.x = x;
+		r.imageOffset.y = y;
+		r.imageExtent.width = 1;
+		r.imageExtent.height = 1;
+		r.imageExtent.depth = 1;
+		r.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		r.imageSubresource.layerCount = 1;
+
+		pick_up_image->transition_layout(cb, pick_up_image->layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		vkCmdCopyImageToBuffer(cb->v, pick_up_image->v, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, s.buffer->v, 1, &r);
+		pick_up_image->transition_layout(cb, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pick_up_image->layout);
 
-		return index;
+		s.promises.emplace_back();
+		return s.promises.back().get_future();
+	}
+
+	void pick_up_end_frame()
+	{
+		pick_up_frame++;
+
+		// this slot was recorded PickUpFrameLag frames ago, the gpu is done with it
+		auto &s = pick_up_slots[pick_up_frame % PickUpFrameLag];
+		s.pass_cb = nullptr;
+		if (s.promises.empty())
+			return;
+
+		s.buffer->map(0, s.promises.size() * sizeof(unsigned int));
+		auto pixels = (unsigned char*)s.buffer->mapped;
+		for (auto i = 0; i < s.promises.size(); i++)
+		{
+			auto pixel = pixels + i * 4;
+			s.promises[i].set_value(pixel[0] + (pixel[1] << 8) + (pixel[2] << 16) + ((unsigned int)pixel[3] << 24));
+		}
+		s.buffer->unmap();
+		s.promises.clear();
 	}
 
 	void init_pick_up() 
@@ -68,5 +107,8 @@ namespace flame
 		);
 
 		pick_up_fb = get_framebuffer(resolution.x(), resolution.y(), renderpass.get(), TK_ARRAYSIZE(views), views);
+
+		for (auto &s : pick_up_slots)
+			s.buffer = std::make_unique<Buffer>(BufferTypeStaging, PickUpMaxPerFrame * sizeof(unsigned int));
 	}
 }
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <functional>
+#include <future>
 
 namespace flame
 {
@@ -13,7 +14,18 @@ namespace flame
 	extern Texture *pick_up_depth_image;
 	extern std::shared_ptr<Framebuffer> pick_up_fb;
 
-	unsigned int pick_up(int x, int y, const std::function<void(CommandBuffer*)> &drawCallback);
+	enum
+	{
+		PickUpFrameLag = 3, // must be more than the frames the gpu can run behind
+		PickUpMaxPerFrame = 16
+	};
+
+	// records the id pass (once per frame and cb) and a copy of the pixel into a ring of readback buffers,
+	// nothing waits for the gpu, the future is ready PickUpFrameLag pick_up_end_frame calls later,
+	// it gives 0 when x, y is outside or the frame already has PickUpMaxPerFrame picks
+	std::future<unsigned int> pick_up(CommandBuffer *cb, int x, int y, const std::function<void(CommandBuffer*)> &drawCallback);
+	// call once a frame after the cbs given to pick_up are submitted
+	void pick_up_end_frame();
 
 	void init_pick_up();
 }
@@ -26,10 +26,20 @@ namespace flame
 		l.array_element = array_element;
 		l.offset = offset;
 		l.range = range;
+		l.storage = false;
 		uniform_buffer_links.push_back(l);
 		return *this;
 	}
 
+	PipelineInfo &PipelineInfo::add_storage_buffer_link(const std::string &descriptor_name,
+		const std::string &resource_name, int array_element,
+		int offset, int range)
+	{
+		add_uniform_buffer_link(descriptor_name, resource_name, array_element, offset, range);
+		uniform_buffer_links.back().storage = true;
+		return *this;
+	}
+
 	PipelineInfo &PipelineInfo::add_texture_link(const std::string &descriptor_name,
 		const std::string &resource_name, int array_element,
 		VkSampler sampler, int base_level, int level_count,
@@ -140,10 +150,11 @@ namespace flame
 			if (buffer)
 			{
 				buffer_infos[i] = get_buffer_info(buffer, link.offset, link.range);
-				writes.push_back(set->get_write(link.binding, link.array_element, &buffer_infos[i]));
+				writes.push_back(set->get_write(link.binding, link.array_element, &buffer_infos[i],
+					link.storage ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER));
 			}
 			else
-				printf("unable to link resource %s (binding:%d, type:uniform buffer)\n", link.resource_name.c_str(), link.binding);
+				printf("unable to link resource %s (binding:%d, type:%s buffer)\n", link.resource_name.c_str(), link.binding, link.storage ? "storage" : "uniform");
 		}
 
 		std::vector<VkDescriptorImageInfo> image_infos(info.texture_links.size());
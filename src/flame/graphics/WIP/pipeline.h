@@ -22,6 +22,7 @@ namespace flame
 	{
 		int offset;
 		int range;
+		bool storage;
 	};
 
 	struct TextureResourceLink : ResourceLink
@@ -64,6 +65,9 @@ namespace flame
 		PipelineInfo &add_uniform_buffer_link(const std::string &descriptor_name,
 			const std::string &resource_name, int array_element = 0,
 			int offset = 0, int range = 0);
+		PipelineInfo &add_storage_buffer_link(const std::string &descriptor_name,
+			const std::string &resource_name, int array_element = 0,
+			int offset = 0, int range = 0);
 		PipelineInfo &add_texture_link(const std::string &descriptor_name,
 			const std::string &resource_name, int array_element = 0, 
 			VkSampler sampler = 0, int base_level = 0, int level_count = 0,
@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <numeric>
+
+#include <flame/ray_cast.h>
+#include <flame/graphics/bonepalette.h>
 #include <flame/engine/core/core.h>
 #include <flame/engine/graphics/synchronization.h>
 #include <flame/engine/graphics/buffer.h>
@@ -22,6 +27,25 @@
 
 namespace flame
 {
+	static AABB get_world_bounds(ModelInstanceComponent *i)
+	{
+		auto m = i->get_model();
+		auto &mat = i->get_parent()->get_world_matrix();
+		auto c = (m->max_coord + m->min_coord) * 0.5f;
+		auto e = (m->max_coord - m->min_coord) * 0.5f;
+		auto wc = glm::vec3(mat * glm::vec4(c, 1.f));
+		glm::vec3 we;
+		for (auto k = 0; k < 3; k++)
+			we[k] = glm::abs(mat[0][k]) * e.x + glm::abs(mat[1][k]) * e.y + glm::abs(mat[2][k]) * e.z;
+		return AABB(Vec3(wc.x - we.x, wc.y - we.y, wc.z - we.z), Vec3(wc.x + we.x, wc.y + we.y, wc.z + we.z));
+	}
+
+	static Mat4 to_mat4(const glm::mat4 &m)
+	{
+		return Mat4(Vec4(m[0][0], m[0][1], m[0][2], m[0][3]), Vec4(m[1][0], m[1][1], m[1][2], m[1][3]),
+			Vec4(m[2][0], m[2][1], m[2][2], m[2][3]), Vec4(m[3][0], m[3][1], m[3][2], m[3][3]));
+	}
+
 	void PlainRenderer::DrawData::ObjData::fill_with_model(Model *m)
 	{
 		geo_data.resize(1);
@@ -45,7 +69,7 @@ namespace flame
 				data.first_index = m->indice_base + g->indiceBase;
 				data.vertex_offset = m->vertex_base;
 				data.instance_count = 1;
-				data.first_instance = g->material->get_albedo_alpha_map()->material_index;
+				data.first_instance = g->material->get_index();
 				geo_data.push_back(data);
 			}
 		}
@@ -147,6 +171,8 @@ namespace flame
 
 	void PlainRenderer::render(Framebuffer *framebuffer, bool clear, CameraComponent *camera, DrawData *data)
 	{
+		update_materials();
+
 		cb->begin();
 		RenderPass *rp;
 		if (data->mode == mode_wireframe)
@@ -373,6 +399,26 @@ namespace flame
 		LightShaderStruct lights[MaxLightCount];
 	};
 
+	struct ShadowBufferShaderStruct
+	{
+		glm::mat4 matrix[MaxShadowCount * 6]; // 6 layers per light, cascades of parallax lights use the first ones
+		glm::vec4 cascade_splits[MaxShadowCount]; // the far depth of each cascade
+	};
+
+	struct LightClusterBufferShaderStruct
+	{
+		unsigned int cx;
+		unsigned int cy;
+		unsigned int cz;
+		unsigned int parallax_count;
+		float slice_scale;
+		float slice_bias;
+		float dummy0;
+		float dummy1;
+
+		unsigned int offsets[LightClusterCx * LightClusterCy * LightClusterCz * 2]; // offset and count
+	};
+
 	struct TerrainShaderStruct
 	{
 		glm::vec3 coord;
@@ -384,18 +430,8 @@ namespace flame
 		float tessellation_factor;
 		float tiling_scale;
 		unsigned int material_count;
-		union
-		{
-			struct
-			{
-				unsigned char x;
-				unsigned char y;
-				unsigned char z;
-				unsigned char w;
-			};
-			unsigned char v[4];
-			unsigned int packed;
-		}material_index;
+		unsigned int dummy;
+		unsigned int material_index[4];
 	};
 
 	struct WaterShaderStruct
@@ -478,22 +514,25 @@ namespace flame
 					case ComponentTypeModelInstance:
 					{
 						auto i = (ModelInstanceComponent*)c;
-						auto index = i->get_model()->vertexes_skeleton.size() > 0 ? 
-							animated_model_instances.add(i) :
-							static_model_instances.add(i);
-						if (index != -2)
+						if (i->get_model()->vertexes_skeleton.size() > 0)
 						{
-							i->set_instance_index(index);
-							if (i->get_model()->vertexes_skeleton.size() > 0)
+							auto index = i->get_instance_index();
+							if (index < 0 || index >= (int)animated_model_instances.size() || animated_model_instances[index] != i)
 							{
-								animated_model_instance_auxes[index].matrix_updated_frame = -1;
-								animated_model_instance_count_dirty = true;
-							}
-							else
-							{
-								static_model_instance_auxes[index].matrix_updated_frame = -1;
-								static_model_instance_count_dirty = true;
+								i->set_instance_index(animated_model_instances.size());
+								animated_model_instances.push_back(i);
 							}
+							break;
+						}
+						// a new slot is dirty, so its matrix goes up with the next upload
+						auto h = static_model_instances.add_handle(i);
+						if (h.index >= 0)
+						{
+							auto index = h.index;
+							i->set_instance_index(index);
+							i->set_instance_list(&static_model_instances, h);
+							static_model_instance_auxes[index].tree_proxy = static_model_instance_tree.insert(get_world_bounds(i), index);
+							static_model_instance_count_dirty = true;
 						}
 						break;
 					}
@@ -550,13 +589,24 @@ namespace flame
 						if (index != -1)
 						{
 							if (i->get_model()->vertexes_skeleton.size() > 0)
-								animated_model_instances.remove(i);
+							{
+								if (index >= (int)animated_model_instances.size() || animated_model_instances[index] != i)
+									break;
+								// the last one takes its place
+								auto last = animated_model_instances.back();
+								animated_model_instances[index] = last;
+								last->set_instance_index(index);
+								animated_model_instances.pop_back();
+								i->set_instance_index(-1);
+							}
 							else
+							{
+								static_model_instance_tree.remove(static_model_instance_auxes[index].tree_proxy);
 								static_model_instances.remove(i);
-							if (i->get_model()->vertexes_skeleton.size() > 0)
-								animated_model_instance_count_dirty = true;
-							else
+								i->set_instance_index(-1);
+								i->set_instance_list(nullptr, SlotHandle());
 								static_model_instance_count_dirty = true;
+							}
 						}
 						break;
 					}
@@ -592,7 +642,10 @@ namespace flame
 				{
 					auto index = shadow_lights.add(l);
 					if (index != -2)
+					{
 						l->set_shadow_index(index);
+						light_auxes[l->get_light_index()].shadow_updated_frame = -1;
+					}
 				}
 				else
 				{
@@ -604,10 +657,14 @@ namespace flame
 			case MessageChangeModel:
 			{
 				auto i = (ModelInstanceComponent*)sender;
-				if (i->get_model()->vertexes_skeleton.size() > 0)
-					animated_model_instance_count_dirty = true;
-				else
+				// the skinned ones are grouped by model every frame
+				if (i->get_model()->vertexes_skeleton.size() == 0)
+				{
+					// the bounds change with the model, refit it with the matrix next frame
+					if (i->get_instance_index() != -1)
+						static_model_instances.mark_dirty(i->get_instance_index());
 					static_model_instance_count_dirty = true;
+				}
 				return true;
 			}
 		}
@@ -619,17 +676,22 @@ namespace flame
 		ambient_dirty(true),
 		light_count_dirty(true),
 		static_model_instance_count_dirty(true),
-		animated_model_instance_count_dirty(true),
 		terrain_count_dirty(true),
 		static_indirect_count(0),
-		animated_indirect_count(0),
+		static_visible_count(0),
+		static_culled_count(0),
+		light_binning_time_ms(0.f),
+		light_cluster_overflow_count(0),
+		shadow_cascade_count(4),
+		shadow_cascade_split_lambda(0.75f),
+		bone_palette_matrix_capacity(16384),
+		bone_palette_instance_capacity(1024),
 		enable_shadow(_enable_shadow),
 		dst(_dst),
 		resource(&globalResource),
 
 		lights(MaxLightCount),
 		static_model_instances(MaxStaticModelInstanceCount),
-		animated_model_instances(MaxAnimatedModelInstanceCount),
 		terrains(MaxTerrainCount),
 		waters(MaxWaterCount),
 		shadow_lights(MaxShadowCount)
@@ -711,8 +773,7 @@ namespace flame
 				.add_blend_attachment_state(false)
 				.add_shader("deferred/mrt.vert", { "ANIM" })
 				.add_shader("deferred/mrt.frag", { "ANIM" })
-				.add_uniform_buffer_link("ubo_matrix_", "Matrix.UniformBuffer")
-				.add_uniform_buffer_link("ubo_object_animated_", "AnimatedObjectMatrix.UniformBuffer"),
+				.add_uniform_buffer_link("ubo_matrix_", "Matrix.UniformBuffer"),
 				renderpass_defe.get(), 0);
 			terrain_pipeline = new Pipeline(PipelineInfo()
 				.set_vertex_input_state({ { TokenF32V3, 0 },{ TokenF32V2, 0 } })
@@ -755,11 +816,13 @@ namespace flame
 				.add_texture_link("img_albedo_alpha", "AlbedoAlpha.Image", 0, plainUnnormalizedSampler)
 				.add_texture_link("img_normal_height", "NormalHeight.Image", 0, plainUnnormalizedSampler)
 				.add_texture_link("img_spec_roughness", "SpecRoughness.Image", 0, plainUnnormalizedSampler)
-				.add_uniform_buffer_link("ubo_light_", "Light.UniformBuffer")
+				.add_storage_buffer_link("ubo_light_", "Light.StorageBuffer")
+				.add_storage_buffer_link("ubo_light_cluster_", "LightCluster.StorageBuffer")
+				.add_storage_buffer_link("ubo_light_index_", "LightIndex.StorageBuffer")
 				.add_texture_link("img_envr", "Envr.Image", 0, colorSampler)
-				.add_uniform_buffer_link("ubo_ambient_", "Ambient.UniformBuffer"),
-				//.add_link("img_shadow", "Shadow.Image")
-				//.add_link("ubo_shadow_", "Shadow.UniformBuffer"),
+				.add_uniform_buffer_link("ubo_ambient_", "Ambient.UniformBuffer")
+				.add_uniform_buffer_link("ubo_shadow_", "Shadow.UniformBuffer")
+				.add_texture_link("img_shadow", "Shadow.Image", 0, plainSampler, 0, 0, 0, 0, VK_IMAGE_VIEW_TYPE_2D_ARRAY),
 				renderpass_defe.get(), 1);
 			compose_pipeline = new Pipeline(PipelineInfo()
 				.set_cull_mode(VK_CULL_MODE_NONE)
@@ -772,17 +835,22 @@ namespace flame
 		}
 
 		cb_defe = std::make_unique<CommandBuffer>();
+		pass_recorder = std::make_unique<PassRecorder>();
 
 		constantBuffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof ConstantBufferStruct);
 		matrixBuffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof MatrixBufferShaderStruct);
 		staticModelInstanceMatrixBuffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof(glm::mat4) * MaxStaticModelInstanceCount);
-		animatedModelInstanceMatrixBuffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof(glm::mat4) * MaxAnimatedModelInstanceCount);
 		terrainBuffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof(TerrainShaderStruct) * MaxTerrainCount);
 		waterBuffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof(WaterShaderStruct) * MaxWaterCount);
-		lightBuffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof(LightBufferShaderStruct));
+		// past the 16KB uniform buffer limit, so storage buffers
+		lightBuffer = std::make_unique<Buffer>(BufferTypeStorage, sizeof(LightBufferShaderStruct));
+		lightClusterBuffer = std::make_unique<Buffer>(BufferTypeStorage, sizeof(LightClusterBufferShaderStruct));
+		lightIndexBuffer = std::make_unique<Buffer>(BufferTypeStorage, sizeof(unsigned int) * (MaxLightCount + MaxLightClusterIndexCount));
 		ambientBuffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof AmbientBufferShaderStruct);
 		staticObjectIndirectBuffer = std::make_unique<Buffer>(BufferTypeIndirectIndex, sizeof(VkDrawIndexedIndirectCommand) * MaxStaticModelInstanceCount);
-		animatedObjectIndirectBuffer = std::make_unique<Buffer>(BufferTypeIndirectIndex, sizeof(VkDrawIndexedIndirectCommand) * MaxAnimatedModelInstanceCount);
+		bone_palette = std::make_unique<graphics::BonepalettePacker>();
+		bonePaletteBuffer = std::make_unique<Buffer>(BufferTypeStorage, sizeof(Mat4) * bone_palette_matrix_capacity +
+			sizeof(graphics::BonepaletteInstance) * bone_palette_instance_capacity);
 
 		envrImage = std::make_unique<Texture>(TextureTypeAttachment, EnvrSizeCx, EnvrSizeCy, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_TRANSFER_DST_BIT, 4);
 		for (int i = 0; i < 3; i++)
@@ -791,13 +859,13 @@ namespace flame
 		resource.setBuffer(constantBuffer.get(), "Constant.UniformBuffer");
 		resource.setBuffer(matrixBuffer.get(), "Matrix.UniformBuffer");
 		resource.setBuffer(staticModelInstanceMatrixBuffer.get(), "StaticObjectMatrix.UniformBuffer");
-		resource.setBuffer(animatedModelInstanceMatrixBuffer.get(), "AnimatedObjectMatrix.UniformBuffer");
 		resource.setBuffer(terrainBuffer.get(), "Terrain.UniformBuffer");
 		resource.setBuffer(waterBuffer.get(), "Water.UniformBuffer");
-		resource.setBuffer(lightBuffer.get(), "Light.UniformBuffer");
+		resource.setBuffer(lightBuffer.get(), "Light.StorageBuffer");
+		resource.setBuffer(lightClusterBuffer.get(), "LightCluster.StorageBuffer");
+		resource.setBuffer(lightIndexBuffer.get(), "LightIndex.StorageBuffer");
 		resource.setBuffer(ambientBuffer.get(), "Ambient.UniformBuffer");
 		resource.setBuffer(staticObjectIndirectBuffer.get(), "Scene.Static.IndirectBuffer");
-		resource.setBuffer(animatedObjectIndirectBuffer.get(), "Scene.Animated.IndirectBuffer");
 
 		if (enable_shadow)
 		{
@@ -834,7 +902,6 @@ namespace flame
 					.add_shader("esm/esm.vert", { "ANIM" })
 					.add_shader("esm/esm.frag", { "ANIM" })
 					.add_uniform_buffer_link("ubo_constant_", "Constant.UniformBuffer")
-					.add_uniform_buffer_link("ubo_object_animated_", "AnimatedObjectMatrix.UniformBuffer")
 					.add_uniform_buffer_link("u_shadow_", "Shadow.UniformBuffer"),
 					renderpass_color_and_depth.get(), 0);
 
@@ -843,7 +910,7 @@ namespace flame
 
 			cb_shad = std::make_unique<CommandBuffer>();
 
-			shadowBuffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof(glm::mat4) * MaxShadowCount);
+			shadowBuffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof(ShadowBufferShaderStruct));
 
 			esmImage = std::make_unique<Texture>(TextureTypeAttachment, ShadowMapCx, ShadowMapCy, VK_FORMAT_R32_SFLOAT, 0, 1, MaxShadowCount * 6);
 			esmDepthImage = std::make_unique<Texture>(TextureTypeAttachment, ShadowMapCx, ShadowMapCy, VK_FORMAT_D16_UNORM, 0);
@@ -867,23 +934,50 @@ namespace flame
 			esm_pipeline->link_descriptors(ds_esm.get(), &resource);
 			esm_anim_pipeline->link_descriptors(ds_esmAnim.get(), &resource);
 		}
+		else
+		{
+			// the deferred pass binds them anyway, no light indexes into them
+			shadowBuffer = std::make_unique<Buffer>(BufferTypeUniform, sizeof(ShadowBufferShaderStruct));
+			esmImage = std::make_unique<Texture>(TextureTypeAttachment, 1, 1, VK_FORMAT_R32_SFLOAT, 0, 1, 1);
+
+			resource.setImage(esmImage.get(), "Shadow.Image");
+			resource.setBuffer(shadowBuffer.get(), "Shadow.UniformBuffer");
+		}
 
 		ds_mrt = std::make_unique<DescriptorSet>(mrt_pipeline);
 		ds_mrtAnim = std::make_unique<DescriptorSet>(mrt_anim_pipeline);
-		ds_mrtAnim_bone = std::make_unique<DescriptorSet>(mrt_anim_pipeline, 2);
+		ds_bone_palette = std::make_unique<DescriptorSet>(mrt_anim_pipeline, 2);
 		ds_terrain = std::make_unique<DescriptorSet>(terrain_pipeline);
 		ds_water = std::make_unique<DescriptorSet>(water_pipeline);
 		ds_defe = std::make_unique<DescriptorSet>(deferred_pipeline);
 		ds_comp = std::make_unique<DescriptorSet>(compose_pipeline);
 
+		link_bone_palette();
 		create_resolution_related();
 	}
 
 	DeferredRenderer::~DeferredRenderer()
 	{
+		static_model_instances.iterate([&](int index, void *p, bool &remove) {
+			((ModelInstanceComponent*)p)->set_instance_list(nullptr, SlotHandle());
+			return true;
+		});
 		break_link(root_node, this);
 	}
 
+	void DeferredRenderer::link_bone_palette()
+	{
+		// see bone_palette.glsl, both parts keep their places until the buffer grows
+		auto matrix_info = get_buffer_info(bonePaletteBuffer.get(), 0, sizeof(Mat4) * bone_palette_matrix_capacity);
+		auto instance_info = get_buffer_info(bonePaletteBuffer.get(), sizeof(Mat4) * bone_palette_matrix_capacity,
+			sizeof(graphics::BonepaletteInstance) * bone_palette_instance_capacity);
+		VkWriteDescriptorSet writes[] = {
+			ds_bone_palette->get_write(0, 0, &matrix_info, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+			ds_bone_palette->get_write(1, 0, &instance_info, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+		};
+		updateDescriptorSets(TK_ARRAYSIZE(writes), writes);
+	}
+
 	void DeferredRenderer::create_resolution_related()
 	{
 		if (mainImage && mainImage->get_cx() == resolution.x() && mainImage->get_cy() == resolution.y())
@@ -955,41 +1049,53 @@ namespace flame
 
 		if (sky_dirty)
 		{
-			auto funUpdateIBL = [&]() {
+			// the whole sky update goes in one command buffer, a pass samples what the pass before rendered,
+			// and every pass gets its own descriptor set, as a set must not change before the commands using it are done
+			std::vector<std::unique_ptr<DescriptorSet>> ibl_sets;
+			auto funPassBarrier = [&](CommandBuffer *cb) {
+				VkMemoryBarrier barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier(cb->v, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+					0, 1, &barrier, 0, nullptr, 0, nullptr);
+			};
+
+			auto funUpdateIBL = [&](CommandBuffer *cb) {
 				for (int i = 0; i < envrImage->levels.size() - 1; i++)
 				{
-					auto cb = begin_once_command_buffer();
 					auto fb = get_framebuffer(envr_image_downsample[i], renderpass_color16.get());
 
+					funPassBarrier(cb);
 					cb->begin_renderpass(renderpass_color16.get(), fb.get());
 					cb->bind_pipeline(downsample_pipeline);
 					cb->set_viewport_and_scissor(EnvrSizeCx >> (i + 1), EnvrSizeCy >> (i + 1));
 					auto size = glm::vec2(EnvrSizeCx >> (i + 1), EnvrSizeCy >> (i + 1));
 					cb->push_constant(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof glm::vec2, &size);
-					updateDescriptorSets(1, &downsample_pipeline->descriptor_set->get_write(0, 0, &get_texture_info(i == 0 ? envrImage.get() : envr_image_downsample[i - 1], plainSampler)));
-					cb->bind_descriptor_set();
+					auto ds = new DescriptorSet(downsample_pipeline);
+					ibl_sets.emplace_back(ds);
+					updateDescriptorSets(1, &ds->get_write(0, 0, &get_texture_info(i == 0 ? envrImage.get() : envr_image_downsample[i - 1], plainSampler)));
+					cb->bind_descriptor_set(&ds->v);
 					cb->draw(3);
 					cb->end_renderpass();
-
-					end_once_command_buffer(cb);
 				}
 
 				for (int i = 1; i < envrImage->levels.size(); i++)
 				{
-					auto cb = begin_once_command_buffer();
 					auto fb = get_framebuffer(envrImage.get(), renderpass_color16.get(), i);
 
+					funPassBarrier(cb);
 					cb->begin_renderpass(renderpass_color16.get(), fb.get());
 					cb->bind_pipeline(convolve_pipeline);
 					auto data = 1.f + 1024.f - 1024.f * (i / 3.f);
 					cb->push_constant(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(float), &data);
 					cb->set_viewport_and_scissor(EnvrSizeCx >> i, EnvrSizeCy >> i);
-					updateDescriptorSets(1, &convolve_pipeline->descriptor_set->get_write(0, 0, &get_texture_info(envr_image_downsample[i - 1], plainSampler)));
-					cb->bind_descriptor_set();
+					auto ds = new DescriptorSet(convolve_pipeline);
+					ibl_sets.emplace_back(ds);
+					updateDescriptorSets(1, &ds->get_write(0, 0, &get_texture_info(envr_image_downsample[i - 1], plainSampler)));
+					cb->bind_descriptor_set(&ds->v);
 					cb->draw(3);
 					cb->end_renderpass();
-
-					end_once_command_buffer(cb);
 				}
 			};
 
@@ -1021,9 +1127,9 @@ namespace flame
 					cb->draw(3);
 					cb->end_renderpass();
 
-					end_once_command_buffer(cb);
+					funUpdateIBL(cb);
 
-					funUpdateIBL();
+					end_once_command_buffer(cb);
 
 					break;
 				}
@@ -1041,9 +1147,9 @@ namespace flame
 					cb->draw(3);
 					cb->end_renderpass();
 
-					end_once_command_buffer(cb);
+					funUpdateIBL(cb);
 
-					funUpdateIBL();
+					end_once_command_buffer(cb);
 
 					break;
 				}
@@ -1064,9 +1170,9 @@ namespace flame
 						cb->draw(3);
 						cb->end_renderpass();
 
-						end_once_command_buffer(cb);
+						funUpdateIBL(cb);
 
-						funUpdateIBL();
+						end_once_command_buffer(cb);
 					}
 					else
 					{
@@ -1098,39 +1204,36 @@ namespace flame
 
 			ambient_dirty = false;
 		}
-		auto fUpdateModelInstanceMatrixBuffer = [&](SpareList &list, Buffer *buffer) {
+		// only the slots marked dirty, by an add, a model change or a move of the node (see on_world_dirty)
+		auto fUpdateModelInstanceMatrixBuffer = [&](SpareList &list, Buffer *buffer, AABBTree *tree) {
 			if (list.get_size() > 0)
 			{
 				std::vector<VkBufferCopy> ranges;
 				defalut_staging_buffer->map(0, sizeof(glm::mat4) * list.get_size());
 				auto map = (unsigned char*)defalut_staging_buffer->mapped;
 
-				list.iterate([&](int index, void *p, bool &remove) {
+				list.iterate_dirty([&](int index, void *p) {
 					auto i = (ModelInstanceComponent*)p;
 					auto n = i->get_parent();
-					auto &updated_frame = i->get_model()->vertexes_skeleton.size() > 0 ? 
-						animated_model_instance_auxes[index].matrix_updated_frame
-						: static_model_instance_auxes[index].matrix_updated_frame;
-					if (updated_frame < n->get_transform_dirty_frame())
-					{
-						auto srcOffset = sizeof(glm::mat4) * ranges.size();
-						memcpy(map + srcOffset, &n->get_world_matrix(), sizeof(glm::mat4));
-						VkBufferCopy range = {};
-						range.srcOffset = srcOffset;
-						range.dstOffset = sizeof(glm::mat4) * index;
-						range.size = sizeof(glm::mat4);
-						ranges.push_back(range);
-
-						updated_frame = total_frame_count;
-					}
-					return true;
+					auto srcOffset = sizeof(glm::mat4) * ranges.size();
+					memcpy(map + srcOffset, &n->get_world_matrix(), sizeof(glm::mat4));
+					VkBufferCopy range = {};
+					range.srcOffset = srcOffset;
+					range.dstOffset = sizeof(glm::mat4) * index;
+					range.size = sizeof(glm::mat4);
+					ranges.push_back(range);
+
+					if (tree)
+						tree->update(static_model_instance_auxes[index].tree_proxy, get_world_bounds(i));
+
+					static_model_instance_auxes[index].matrix_updated_frame = total_frame_count;
 				});
 				defalut_staging_buffer->unmap();
-				defalut_staging_buffer->copy_to(buffer, ranges.size(), ranges.data());
+				if (!ranges.empty())
+					defalut_staging_buffer->copy_to(buffer, ranges.size(), ranges.data());
 			}
 		};
-		fUpdateModelInstanceMatrixBuffer(static_model_instances, staticModelInstanceMatrixBuffer.get());
-		fUpdateModelInstanceMatrixBuffer(animated_model_instances, animatedModelInstanceMatrixBuffer.get());
+		fUpdateModelInstanceMatrixBuffer(static_model_instances, staticModelInstanceMatrixBuffer.get(), &static_model_instance_tree);
 
 		std::vector<VkWriteDescriptorSet> writes;
 
@@ -1158,7 +1261,7 @@ namespace flame
 					stru.tiling_scale = t->get_tiling_scale();
 					for (int i = 0; i < 4; i++)
 					{
-						stru.material_index.v[i] = t->get_material(i) ?
+						stru.material_index[i] = t->get_material(i) ?
 							t->get_material(i)->get_index() : 0;
 					}
 					stru.material_count = t->get_material_count();
@@ -1221,40 +1324,32 @@ namespace flame
 			defalut_staging_buffer->copy_to(waterBuffer.get(), ranges.size(), ranges.data());
 		}
 
-		auto fUpdateIndirect = [](SpareList &list, Buffer *buffer, int &out_count) {
-			if (list.get_size() > 0)
-			{
-				std::vector<VkDrawIndexedIndirectCommand> commands;
-				list.iterate([&](int index, void *p, bool &remove) {
-					auto i = (ModelInstanceComponent*)p;
-					auto m = i->get_model();
-					for (auto &g : m->geometries)
-					{
-						VkDrawIndexedIndirectCommand command = {};
-						command.instanceCount = 1;
-						command.indexCount = g->indiceCount;
-						command.vertexOffset = m->vertex_base;
-						command.firstIndex = m->indice_base + g->indiceBase;
-						command.firstInstance = (index << 8) + g->material->get_index();
-						commands.push_back(command);
-					}
-					return true;
-				});
-				buffer->update(commands.data(), sizeof(VkDrawIndexedIndirectCommand) * commands.size());
-				out_count = commands.size();
-			}
-		};
-		if (static_model_instance_count_dirty)
+		// static instances: only the ones in the frustum, compacted, rebuilt every frame since the camera moves,
+		// gl_InstanceIndex is the draw (the object and the material)
 		{
-			fUpdateIndirect(static_model_instances, staticObjectIndirectBuffer.get(), static_indirect_count);
+			indirect_commands.clear();
+			static_visible_count = 0;
+			static_model_instance_tree.query_frustum((const Vec4*)camera->get_frustum_planes(), [&](int index) {
+				auto i = (ModelInstanceComponent*)static_model_instances.get(index);
+				auto m = i->get_model();
+				for (auto &g : m->geometries)
+				{
+					VkDrawIndexedIndirectCommand command = {};
+					command.instanceCount = 1;
+					command.indexCount = g->indiceCount;
+					command.vertexOffset = m->vertex_base;
+					command.firstIndex = m->indice_base + g->indiceBase;
+					command.firstInstance = add_material_draw(index, g->material.get());
+					indirect_commands.push_back(command);
+				}
+				static_visible_count++;
+			});
+			static_culled_count = static_model_instances.get_size() - static_visible_count;
+			if (!indirect_commands.empty())
+				staticObjectIndirectBuffer->update(indirect_commands.data(), sizeof(VkDrawIndexedIndirectCommand) * indirect_commands.size());
+			static_indirect_count = indirect_commands.size();
 			static_model_instance_count_dirty = false;
 		}
-		if (animated_model_instance_count_dirty)
-		{
-			fUpdateIndirect(animated_model_instances, animatedObjectIndirectBuffer.get(), animated_indirect_count);
-			animated_model_instance_count_dirty = false;
-		}
-
 		if (light_count_dirty)
 		{
 			unsigned int count = lights.get_size();
@@ -1297,64 +1392,165 @@ namespace flame
 			defalut_staging_buffer->unmap();
 			defalut_staging_buffer->copy_to(lightBuffer.get(), ranges.size(), ranges.data());
 		}
+		{ // light clusters, the camera moves every frame so always rebin
+			if (light_grid.cx != LightClusterCx || light_grid.near_plane != near_plane || light_grid.far_plane != far_plane ||
+				constant_buffer_updated_frame == total_frame_count)
+				light_grid.setup(LightClusterCx, LightClusterCy, LightClusterCz, glm::radians(fovy), resolution.aspect(), near_plane, far_plane);
+
+			LightClusterBufferShaderStruct stru;
+			stru.cx = LightClusterCx;
+			stru.cy = LightClusterCy;
+			stru.cz = LightClusterCz;
+			stru.parallax_count = 0;
+			stru.slice_scale = light_grid.slice_scale;
+			stru.slice_bias = light_grid.slice_bias;
+
+			light_spheres.clear();
+			light_sphere_indices.clear();
+			light_index_upload.clear();
+			auto &view = camera->get_view_matrix();
+			lights.iterate([&](int index, void *p, bool &remove) {
+				auto l = (LightComponent*)p;
+				if (l->get_type() == LightTypeParallax)
+				{
+					// parallax lights light every cluster, they lead the index list
+					light_index_upload.push_back(l->get_light_index());
+					return true;
+				}
+				// the shader attenuates by 1 / d^2, past sqrt(max(color) * 256) it is under 1/256
+				auto c = l->get_color();
+				auto radius = std::sqrt(glm::max(glm::max(c.r, c.g), glm::max(c.b, 0.f)) * 256.f);
+				auto coord = view * glm::vec4(l->get_parent()->get_world_coord(), 1.f);
+				light_spheres.push_back(Vec4(coord.x, coord.y, coord.z, radius));
+				light_sphere_indices.push_back(l->get_light_index());
+				return true;
+			});
+
+			light_grid.bin(light_spheres.data(), light_spheres.size(), MaxLightClusterIndexCount);
+			light_binning_time_ms = light_grid.bin_time_ms;
+			light_cluster_overflow_count = light_grid.overflow_count;
+
+			stru.parallax_count = light_index_upload.size();
+			for (auto i = 0; i < light_grid.offsets.size(); i += 2)
+			{
+				stru.offsets[i] = stru.parallax_count + light_grid.offsets[i];
+				stru.offsets[i + 1] = light_grid.offsets[i + 1];
+			}
+			lightClusterBuffer->update(&stru, sizeof(LightClusterBufferShaderStruct));
+			for (auto i : light_grid.indices)
+				light_index_upload.push_back(light_sphere_indices[i]);
+			if (!light_index_upload.empty())
+				lightIndexBuffer->update(light_index_upload.data(), sizeof(unsigned int) * light_index_upload.size());
+		}
 		if (enable_shadow)
 		{
 			if (shadow_lights.get_size() > 0)
 			{
-				shadow_lights.iterate([&](int index, void *p, bool &remove) {
-					std::vector<VkBufferCopy> ranges;
-					defalut_staging_buffer->map(0, sizeof(glm::mat4) * shadow_lights.get_size());
-					auto map = (unsigned char*)defalut_staging_buffer->mapped;
+				std::vector<VkBufferCopy> ranges;
+				defalut_staging_buffer->map(0, sizeof(glm::mat4) * (MaxShadowCount * 6 + MaxShadowCount));
+				auto map = (unsigned char*)defalut_staging_buffer->mapped;
+
+				auto cascade_count = glm::clamp(shadow_cascade_count, 2, (int)MaxShadowCascadeCount);
+				float splits[MaxShadowCascadeCount + 1];
+				get_shadow_cascade_splits(cascade_count, near_plane, far_plane, shadow_cascade_split_lambda, splits);
+				auto &camera_matrix = camera->get_parent()->get_matrix();
+				Vec3 camera_coord(camera_matrix[3].x, camera_matrix[3].y, camera_matrix[3].z);
+				Vec3 camera_axes[3];
+				for (auto i = 0; i < 3; i++)
+					camera_axes[i] = Vec3(camera_matrix[i].x, camera_matrix[i].y, camera_matrix[i].z);
+				auto tan_hf_fovy = std::tan(glm::radians(fovy * 0.5f));
 
+				shadow_lights.iterate([&](int index, void *p, bool &remove) {
 					auto l = (LightComponent*)p;
 					auto n = l->get_parent();
+					auto &aux = light_auxes[l->get_light_index()];
 					if (l->get_type() == LightTypeParallax)
 					{
-						if (light_auxes[index].attribute_updated_frame < n->get_transform_dirty_frame() || 
-							light_auxes[index].attribute_updated_frame < camera->get_parent()->get_transform_dirty_frame())
+						auto light_changed = aux.shadow_updated_frame < n->get_transform_dirty_frame() ||
+							aux.shadow_updated_frame < l->get_attribute_dirty_frame();
+						aux.shadow_updated_frame = total_frame_count;
+
+						ShadowLightSpace ls;
+						auto &light_axis = n->get_world_axis();
+						ls.set_direction(Vec3(-light_axis[2].x, -light_axis[2].y, -light_axis[2].z));
+
+						// the cascades are fitted every frame, a layer is only drawn again when its box,
+						// its casters or the light changed
+						for (auto c = 0; c < cascade_count; c++)
 						{
-							glm::vec3 p[8];
-							auto cameraCoord = camera->get_parent()->get_world_coord();
-							for (int i = 0; i < 8; i++)
-								p[i] = camera->get_frustum_points()[i] - cameraCoord;
-							auto lighAxis = n->get_world_axis();
-							auto axisT = glm::transpose(lighAxis);
-							auto vMax = axisT * p[0], vMin = vMax;
-							for (int i = 1; i < 8; i++)
+							Vec3 corners[8];
+							get_frustum_slice_corners(camera_coord, camera_axes[0], camera_axes[1], camera_axes[2],
+								tan_hf_fovy, resolution.aspect(), splits[c], splits[c + 1], corners);
+							ShadowCascade cascade;
+							begin_shadow_cascade(ls, corners, ShadowMapCx, splits[c], splits[c + 1], cascade);
+
+							auto layer = index * 6 + c;
+							auto &static_casters = shadow_static_casters[layer];
+							auto &animated_casters = shadow_animated_casters[layer];
+							static_casters.clear();
+							animated_casters.clear();
+							auto caster_changed_frame = -1LL;
+
+							Vec4 planes[6];
+							get_shadow_cascade_planes(ls, cascade, planes);
+							static_model_instance_tree.query_frustum(planes, [&](int id) {
+								auto b = get_world_bounds((ModelInstanceComponent*)static_model_instances.get(id));
+								if (!shadow_cascade_overlaps(ls, cascade, b)) // the tree boxes are fat
+									return;
+								add_shadow_caster(ls, b, id, cascade);
+								static_casters.push_back(id);
+								caster_changed_frame = glm::max(caster_changed_frame, static_model_instance_auxes[id].matrix_updated_frame);
+							});
+							for (auto id = 0; id < (int)animated_model_instances.size(); id++)
 							{
-								auto tp = axisT * p[i];
-								vMax = glm::max(tp, vMax);
-								vMin = glm::min(tp, vMin);
+								auto b = get_world_bounds(animated_model_instances[id]);
+								if (shadow_cascade_overlaps(ls, cascade, b))
+								{
+									add_shadow_caster(ls, b, 0x10000 + id, cascade);
+									animated_casters.push_back(id);
+									caster_changed_frame = total_frame_count; // they animate
+								}
 							}
-							auto halfWidth = (vMax.z - vMin.z) * 0.5f;
-							auto halfHeight = (vMax.y - vMin.y) * 0.5f;
-							auto halfDepth = glm::max(vMax.x - vMin.x, near_plane) * 0.5f;
-							auto center = lighAxis * ((vMax + vMin) * 0.5f) + cameraCoord;
-							//auto shadowMatrix = glm::ortho(-halfWidth, halfWidth, -halfHeight, halfHeight, TKE_NEAR, halfDepth + halfDepth) * 
-							//glm::lookAt(center + halfDepth * lighAxis[2], center, lighAxis[1]);
-							auto camera_coord = camera->get_parent()->get_world_coord();
-							auto shadowMatrix = glm::mat4(
-								1.f, 0.f, 0.f, 0.f,
-								0.f, 1.f, 0.f, 0.f,
-								0.f, 0.f, 0.5f, 0.f,
-								0.f, 0.f, 0.5f, 1.f
-							) * glm::ortho(-1.f, 1.f, -1.f, 1.f, near_plane, far_plane) *
-								glm::lookAt(camera_coord + glm::vec3(0, 100, 0), camera_coord, glm::vec3(0, 1, 0));
+							end_shadow_cascade(cascade);
 
+							auto &prev = aux.cascades[c];
+							if (light_changed || !cascade.same_box(prev) || cascade.caster_count != prev.caster_count ||
+								cascade.caster_hash != prev.caster_hash || aux.cascade_rendered_frame[c] < caster_changed_frame)
+							{
+								glm::mat4 shadowMatrix;
+								get_shadow_cascade_matrix(ls, cascade, &shadowMatrix[0][0]);
+								auto srcOffset = sizeof(glm::mat4) * ranges.size();
+								memcpy(map + srcOffset, &shadowMatrix, sizeof(glm::mat4));
+								VkBufferCopy range = {};
+								range.srcOffset = srcOffset;
+								range.dstOffset = sizeof(glm::mat4) * layer;
+								range.size = sizeof(glm::mat4);
+								ranges.push_back(range);
+
+								aux.cascade_rendered_frame[c] = -1;
+							}
+							prev = cascade;
+						}
+
+						// the splits follow the camera's near/far and the cascade settings, not only the light
+						glm::vec4 split_far(far_plane);
+						for (auto c = 0; c < cascade_count; c++)
+							split_far[c] = splits[c + 1];
+						if (light_changed || split_far != aux.split_far)
+						{
+							aux.split_far = split_far;
 							auto srcOffset = sizeof(glm::mat4) * ranges.size();
-							memcpy(map + srcOffset, &shadowMatrix, sizeof(glm::mat4));
+							memcpy(map + srcOffset, &split_far, sizeof(glm::vec4));
 							VkBufferCopy range = {};
 							range.srcOffset = srcOffset;
-							range.dstOffset = sizeof(glm::mat4) * (index * 6);
-							range.size = sizeof(glm::mat4);
+							range.dstOffset = offsetof(ShadowBufferShaderStruct, cascade_splits) + sizeof(glm::vec4) * index;
+							range.size = sizeof(glm::vec4);
 							ranges.push_back(range);
-
-							light_auxes[index].attribute_updated_frame = total_frame_count;
 						}
 					}
 					else if (l->get_type() == LightTypePoint)
 					{
-						if (light_auxes[index].attribute_updated_frame < n->get_transform_dirty_frame())
+						if (aux.shadow_updated_frame < n->get_transform_dirty_frame())
 						{
 							glm::mat4 shadowMatrix[6];
 
@@ -1367,150 +1563,329 @@ namespace flame
 							shadowMatrix[4] = proj * glm::lookAt(coord, coord + glm::vec3(0, 0, 1), glm::vec3(0, -1, 0));
 							shadowMatrix[5] = proj * glm::lookAt(coord, coord + glm::vec3(0, 0, -1), glm::vec3(0, -1, 0));
 
-							light_auxes[index].attribute_updated_frame = total_frame_count;
+							aux.shadow_updated_frame = total_frame_count;
 						}
 					}
-					defalut_staging_buffer->unmap();
-					defalut_staging_buffer->copy_to(shadowBuffer.get(), ranges.size(), ranges.data());
 					return true;
 				});
+				defalut_staging_buffer->unmap();
+				defalut_staging_buffer->copy_to(shadowBuffer.get(), ranges.size(), ranges.data());
 			}
 		}
 
 		updateDescriptorSets(writes.size(), writes.data());
 
+		pass_recorder->begin_frame();
+
+		// the poses first, each instance once, then the draw lists put their instances after each other
+		bone_palette->clear();
+		animated_bone_offsets.resize(animated_model_instances.size());
+		for (auto id = 0; id < (int)animated_model_instances.size(); id++)
+			animated_bone_offsets[id] = animated_model_instances[id]->get_animation_runner()->acquire_palette(*bone_palette);
+		auto fAddSkinnedDraws = [&](std::vector<int> &ids, std::vector<SkinnedDraw> &draws) {
+			draws.clear();
+			std::sort(ids.begin(), ids.end(), [&](int a, int b) {
+				return animated_model_instances[a]->get_model() < animated_model_instances[b]->get_model();
+			});
+			for (auto id : ids)
+			{
+				auto i = animated_model_instances[id];
+				if (draws.empty() || draws.back().model != i->get_model())
+				{
+					SkinnedDraw d;
+					d.model = i->get_model();
+					d.first_instance = bone_palette->instances.size();
+					d.instance_count = 0;
+					draws.push_back(d);
+				}
+				bone_palette->add_instance(to_mat4(i->get_parent()->get_world_matrix()), animated_bone_offsets[id]);
+				draws.back().instance_count++;
+			}
+			for (auto &d : draws)
+			{
+				d.first_draw = -1;
+				for (auto &g : d.model->geometries)
+				{
+					for (auto k = 0; k < d.instance_count; k++)
+					{
+						auto draw = add_material_draw(d.first_instance + k, g->material.get());
+						if (d.first_draw == -1)
+							d.first_draw = draw;
+					}
+				}
+			}
+		};
+		// gl_InstanceIndex is the draw (the instance in the palette and the material), the layer comes by the push constant
+		auto fDrawSkinned = [](CommandBuffer *cb, const SkinnedDraw &d, int layer) {
+			auto m = d.model;
+			if (layer != -1)
+			{
+				unsigned int pc = layer;
+				cb->push_constant(VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(unsigned int), &pc);
+			}
+			for (int gId = 0; gId < m->geometries.size(); gId++)
+			{
+				auto &g = m->geometries[gId];
+				cb->draw_index(g->indiceCount, m->indice_base + g->indiceBase, m->vertex_base, d.instance_count,
+					d.first_draw + gId * d.instance_count);
+			}
+		};
+
+		std::vector<RecordPass> shadow_passes;
 		if (enable_shadow)
 		{
-			cb_shad->begin();
-
-			shadow_lights.iterate([&](int index, void *p, bool &remove) {
-				auto l = (LightComponent*)p;
-
-				static VkClearValue clearValues[] = {
-					{ 1.f, 0 },
-					{ 1.f, 1.f, 1.f, 1.f }
-				};
-				cb_shad->begin_renderpass(renderpass_color32_and_depth.get(), fb_esm[index].get(), clearValues);
-
-				cb_shad->bind_vertex_buffer2(vertex_static_buffer.get(), vertex_skeleton_Buffer.get());
-				cb_shad->bind_index_buffer(index_buffer.get());
+			static VkClearValue clearValues[] = {
+				{ 1.f, 0 },
+				{ 1.f, 1.f, 1.f, 1.f }
+			};
+			// a pass for each layer to draw, its items are the static casters and then the skinned draws, the layer
+			// comes by the push constant
+			auto fAddLayer = [&](int layer) {
+				fAddSkinnedDraws(shadow_animated_casters[layer], shadow_animated_draws[layer]);
+				auto &static_draws = shadow_static_draws[layer];
+				static_draws.clear();
+				for (auto id : shadow_static_casters[layer])
+				{
+					auto m = ((ModelInstanceComponent*)static_model_instances.get(id))->get_model();
+					static_draws.push_back(-1);
+					for (auto &g : m->geometries)
+					{
+						auto draw = add_material_draw(id, g->material.get());
+						if (static_draws.back() == -1)
+							static_draws.back() = draw;
+					}
+				}
 
-				auto fDrawDepth = [&](SpareList &list) {
-					list.iterate([&](int index, void *p, bool &remove) {
-						auto i = (ModelInstanceComponent*)p;
+				RecordPass p;
+				p.renderpass = renderpass_color32_and_depth.get();
+				p.framebuffer = fb_esm[layer].get();
+				p.clear_values = clearValues;
+				p.item_count = shadow_static_casters[layer].size() + shadow_animated_draws[layer].size();
+				p.record = [this, layer, fDrawSkinned](CommandBuffer *cb, int begin, int end) {
+					auto &static_ids = shadow_static_casters[layer];
+					auto &static_draws = shadow_static_draws[layer];
+					auto &skinned_draws = shadow_animated_draws[layer];
+					int static_count = static_ids.size();
+
+					cb->bind_vertex_buffer2(vertex_static_buffer.get(), vertex_skeleton_Buffer.get());
+					cb->bind_index_buffer(index_buffer.get());
+
+					auto fDraw = [&](int first_draw, ModelInstanceComponent *i) {
 						auto m = i->get_model();
 						for (int gId = 0; gId < m->geometries.size(); gId++)
-							cb_shad->draw_model(m, gId, 1, ((l->get_shadow_index() * 6) << 28) + (index << 8) + gId);
-						return true;
-					});
+							cb->draw_model(m, gId, 1, first_draw + gId);
+					};
+					if (begin < static_count)
+					{
+						cb->bind_pipeline(esm_pipeline);
+						VkDescriptorSet sets[] = {
+							ds_esm->v,
+							ds_material->v
+						};
+						cb->bind_descriptor_set(sets, 0, TK_ARRAYSIZE(sets));
+						unsigned int pc = layer;
+						cb->push_constant(VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(unsigned int), &pc);
+						for (auto i = begin; i < std::min(end, static_count); i++)
+							fDraw(static_draws[i], (ModelInstanceComponent*)static_model_instances.get(static_ids[i]));
+					}
+					if (end > static_count)
+					{
+						cb->bind_pipeline(esm_anim_pipeline);
+						VkDescriptorSet sets[] = {
+							ds_esmAnim->v,
+							ds_material->v,
+							ds_bone_palette->v
+						};
+						cb->bind_descriptor_set(sets, 0, TK_ARRAYSIZE(sets));
+						for (auto i = std::max(begin, static_count); i < end; i++)
+							fDrawSkinned(cb, skinned_draws[i - static_count], layer);
+					}
 				};
-				if (static_model_instances.get_size() > 0)
+				shadow_passes.push_back(p);
+			};
+
+			auto cascade_count = glm::clamp(shadow_cascade_count, 2, (int)MaxShadowCascadeCount);
+			shadow_lights.iterate([&](int index, void *p, bool &remove) {
+				auto l = (LightComponent*)p;
+				if (l->get_type() == LightTypeParallax)
 				{
-					cb_shad->bind_pipeline(esm_pipeline);
-					VkDescriptorSet sets[] = {
-						ds_esm->v,
-						ds_material->v
-					};
-					cb_shad->bind_descriptor_set(sets, 0, TK_ARRAYSIZE(sets));
-					fDrawDepth(static_model_instances);
+					auto &aux = light_auxes[l->get_light_index()];
+					for (auto c = 0; c < cascade_count; c++)
+					{
+						if (aux.cascade_rendered_frame[c] != -1)
+							continue;
+						fAddLayer(index * 6 + c);
+						aux.cascade_rendered_frame[c] = total_frame_count;
+					}
 				}
-
-				if (animated_model_instances.get_size() > 0)
+				else
 				{
-					cb_shad->bind_pipeline(esm_anim_pipeline);
-					VkDescriptorSet sets[] = {
-						ds_esmAnim->v,
-						ds_material->v,
-						ds_mrtAnim_bone->v
-					};
-					cb_shad->bind_descriptor_set(sets, 0, TK_ARRAYSIZE(sets));
-					fDrawDepth(animated_model_instances);
+					// not culled, everything casts
+					auto layer = index * 6;
+					auto &static_casters = shadow_static_casters[layer];
+					auto &animated_casters = shadow_animated_casters[layer];
+					static_casters.clear();
+					animated_casters.clear();
+					static_model_instances.iterate([&](int id, void *p, bool &remove) {
+						static_casters.push_back(id);
+						return true;
+					});
+					for (auto id = 0; id < (int)animated_model_instances.size(); id++)
+						animated_casters.push_back(id);
+					fAddLayer(layer);
 				}
-				cb_shad->end_renderpass();
 				return true;
 			});
-
-			cb_shad->end();
 		}
 
-		cb_defe->begin();
-
-		cb_defe->begin_renderpass(renderpass_defe.get(), framebuffer.get());
-		cb_defe->set_viewport_and_scissor(resolution.x(), resolution.y());
-
-		cb_defe->bind_vertex_buffer2(vertex_static_buffer.get(), vertex_skeleton_Buffer.get());
-		cb_defe->bind_index_buffer(index_buffer.get());
-
-		// mrt
-		// static
-		if (static_model_instances.get_size() > 0)
 		{
-			cb_defe->bind_pipeline(mrt_pipeline);
-			VkDescriptorSet sets[] = {
-				ds_mrt->v,
-				ds_material->v
-			};
-			cb_defe->bind_descriptor_set(sets, 0, TK_ARRAYSIZE(sets));
-			cb_defe->draw_indirect_index(staticObjectIndirectBuffer.get(), static_indirect_count);
+			std::vector<int> ids(animated_model_instances.size());
+			std::iota(ids.begin(), ids.end(), 0);
+			fAddSkinnedDraws(ids, animated_draws);
 		}
-		// animated
-		if (animated_model_instances.get_size())
-		{
-			cb_defe->bind_pipeline(mrt_anim_pipeline);
-			VkDescriptorSet sets[] = {
-				ds_mrtAnim->v,
-				ds_material->v,
-				ds_mrtAnim_bone->v
-			};
-			cb_defe->bind_descriptor_set(sets, 0, TK_ARRAYSIZE(sets));
-			cb_defe->draw_indirect_index(animatedObjectIndirectBuffer.get(), animated_indirect_count);
-		}
-		// terrain
-		if (terrains.get_size() > 0)
+
+		// the changed materials and the draws of this frame, the material set may be made again
+		update_materials();
+
+		// the whole palette in one upload, before the recording since growing changes the descriptors
 		{
-			cb_defe->bind_pipeline(terrain_pipeline);
-			VkDescriptorSet sets[] = {
-				ds_terrain->v,
-				ds_material->v
-			};
-			cb_defe->bind_descriptor_set(sets, 0, TK_ARRAYSIZE(sets));
-			terrains.iterate([&](int index, void *p, bool &remove) {
-				auto t = (TerrainComponent*)p;
-				cb_defe->draw(4, 0, (index << 16) + t->get_block_cx() * t->get_block_cx());
-				return true;
-			});
+			int matrix_count = bone_palette->matrices.size();
+			int instance_count = bone_palette->instances.size();
+			if (matrix_count > bone_palette_matrix_capacity || instance_count > bone_palette_instance_capacity)
+			{
+				while (bone_palette_matrix_capacity < matrix_count)
+					bone_palette_matrix_capacity *= 2;
+				while (bone_palette_instance_capacity < instance_count)
+					bone_palette_instance_capacity *= 2;
+				bonePaletteBuffer->resize(sizeof(Mat4) * bone_palette_matrix_capacity +
+					sizeof(graphics::BonepaletteInstance) * bone_palette_instance_capacity);
+				link_bone_palette();
+			}
+			if (instance_count > 0)
+			{
+				auto matrix_size = sizeof(Mat4) * matrix_count;
+				auto instance_size = sizeof(graphics::BonepaletteInstance) * instance_count;
+				if (matrix_size + instance_size > defalut_staging_buffer->size)
+					defalut_staging_buffer->resize(matrix_size + instance_size);
+				defalut_staging_buffer->map(0, matrix_size + instance_size);
+				auto map = (unsigned char*)defalut_staging_buffer->mapped;
+				memcpy(map, bone_palette->matrices.data(), matrix_size);
+				memcpy(map + matrix_size, bone_palette->instances.data(), instance_size);
+				defalut_staging_buffer->unmap();
+				VkBufferCopy ranges[2] = {};
+				ranges[0].size = matrix_size;
+				ranges[1].srcOffset = matrix_size;
+				ranges[1].dstOffset = sizeof(Mat4) * bone_palette_matrix_capacity;
+				ranges[1].size = instance_size;
+				defalut_staging_buffer->copy_to(bonePaletteBuffer.get(), TK_ARRAYSIZE(ranges), ranges);
+			}
 		}
-		// water
-		if (waters.get_size() > 0)
+
+		if (enable_shadow)
 		{
-			cb_defe->bind_pipeline(water_pipeline);
-			cb_defe->bind_descriptor_set(&ds_water->v);
-			waters.iterate([&](int index, void *p, bool &remove) {
-				auto w = (WaterComponent*)p;
-				cb_defe->draw(4, 0, (index << 16) + w->get_block_cx() * w->get_block_cx());
-				return true;
-			});
+			cb_shad->begin();
+			pass_recorder->record_passes(cb_shad.get(), job_system, shadow_passes.size(), shadow_passes.data(), 32);
+			cb_shad->end();
 		}
 
-		//cb->imageBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
-		//	VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, 
-		//	VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
-		//	esmImage.get(), 0, 1, 0, TKE_MAX_SHADOW_COUNT * 8);
-
-		// deferred
-		cb_defe->next_subpass();
-		cb_defe->bind_pipeline(deferred_pipeline);
-		cb_defe->bind_descriptor_set(&ds_defe->v);
-		cb_defe->draw(3);
+		// the g-buffer draws are the items of the first subpass, the deferred and the compose subpasses follow
+		enum
+		{
+			MrtItemStatic,
+			MrtItemAnimated,
+			MrtItemTerrain,
+			MrtItemWater,
 
-		// compose
-		cb_defe->next_subpass();
-		cb_defe->bind_pipeline(compose_pipeline);
-		cb_defe->bind_descriptor_set(&ds_comp->v);
-		cb_defe->draw(3);
+			MrtItemCount
+		};
+		RecordPass mrt_pass;
+		mrt_pass.renderpass = renderpass_defe.get();
+		mrt_pass.framebuffer = framebuffer.get();
+		mrt_pass.clear_values = nullptr;
+		mrt_pass.item_count = MrtItemCount;
+		mrt_pass.record = [this, fDrawSkinned](CommandBuffer *cb, int begin, int end) {
+			cb->set_viewport_and_scissor(resolution.x(), resolution.y());
+			cb->bind_vertex_buffer2(vertex_static_buffer.get(), vertex_skeleton_Buffer.get());
+			cb->bind_index_buffer(index_buffer.get());
 
-		cb_defe->end_renderpass();
+			for (auto item = begin; item < end; item++)
+			{
+				switch (item)
+				{
+					case MrtItemStatic:
+						if (static_model_instances.get_size() > 0)
+						{
+							cb->bind_pipeline(mrt_pipeline);
+							VkDescriptorSet sets[] = {
+								ds_mrt->v,
+								ds_material->v
+							};
+							cb->bind_descriptor_set(sets, 0, TK_ARRAYSIZE(sets));
+							cb->draw_indirect_index(staticObjectIndirectBuffer.get(), static_indirect_count);
+						}
+						break;
+					case MrtItemAnimated:
+						if (!animated_draws.empty())
+						{
+							cb->bind_pipeline(mrt_anim_pipeline);
+							VkDescriptorSet sets[] = {
+								ds_mrtAnim->v,
+								ds_material->v,
+								ds_bone_palette->v
+							};
+							cb->bind_descriptor_set(sets, 0, TK_ARRAYSIZE(sets));
+							for (auto &d : animated_draws)
+								fDrawSkinned(cb, d, -1);
+						}
+						break;
+					case MrtItemTerrain:
+						if (terrains.get_size() > 0)
+						{
+							cb->bind_pipeline(terrain_pipeline);
+							VkDescriptorSet sets[] = {
+								ds_terrain->v,
+								ds_material->v
+							};
+							cb->bind_descriptor_set(sets, 0, TK_ARRAYSIZE(sets));
+							terrains.iterate([&](int index, void *p, bool &remove) {
+								auto t = (TerrainComponent*)p;
+								cb->draw(4, 0, (index << 16) + t->get_block_cx() * t->get_block_cx());
+								return true;
+							});
+						}
+						break;
+					case MrtItemWater:
+						if (waters.get_size() > 0)
+						{
+							cb->bind_pipeline(water_pipeline);
+							cb->bind_descriptor_set(&ds_water->v);
+							waters.iterate([&](int index, void *p, bool &remove) {
+								auto w = (WaterComponent*)p;
+								cb->draw(4, 0, (index << 16) + w->get_block_cx() * w->get_block_cx());
+								return true;
+							});
+						}
+						break;
+				}
+			}
+		};
+		mrt_pass.rest = [this](CommandBuffer *cb) {
+			// deferred, the state of the primary is undefined after the secondaries
+			cb->next_subpass();
+			cb->set_viewport_and_scissor(resolution.x(), resolution.y());
+			cb->bind_pipeline(deferred_pipeline);
+			cb->bind_descriptor_set(&ds_defe->v);
+			cb->draw(3);
+
+			// compose
+			cb->next_subpass();
+			cb->bind_pipeline(compose_pipeline);
+			cb->bind_descriptor_set(&ds_comp->v);
+			cb->draw(3);
+		};
 
+		cb_defe->begin();
+		pass_recorder->record_passes(cb_defe.get(), job_system, 1, &mrt_pass, 1);
 		cb_defe->end();
 	}
 
@@ -1520,4 +1895,30 @@ namespace flame
 			add_to_draw_list(cb_shad->v);
 		add_to_draw_list(cb_defe->v);
 	}
+
+	ModelInstanceComponent *DeferredRenderer::ray_cast(const glm::vec3 &origin, const glm::vec3 &dir, float t_max, RayHit *hit)
+	{
+		RayHit h;
+		auto found = ray_cast_model_instances(static_model_instance_tree, [&](int id) {
+			return (ModelInstanceComponent*)static_model_instances.get(id);
+		}, origin, dir, t_max, &h);
+		if (found)
+			t_max = h.t;
+
+		// the animated ones are not in the tree, their boxes go first
+		Ray r(Vec3(origin.x, origin.y, origin.z), Vec3(dir.x, dir.y, dir.z));
+		for (auto i : animated_model_instances)
+		{
+			float t;
+			if (ray_aabb(r, get_world_bounds(i), t_max, t) && ray_cast_model_instance(i, origin, dir, t_max, &h))
+			{
+				found = i;
+				t_max = h.t;
+			}
+		}
+
+		if (found && hit)
+			*hit = h;
+		return found;
+	}
 }
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <flame/global.h>
 #include <flame/spare_list.h>
+#include <flame/aabb_tree.h>
+#include <flame/light_cluster.h>
+#include <flame/shadow_cascade.h>
 #include <flame/math.h>
 #include <flame/engine/core/object.h>
 #include <flame/engine/graphics/resource.h>
@@ -18,7 +22,15 @@ namespace flame
 	struct DescriptorSet;
 	struct Framebuffer;
 	struct CommandBuffer;
+	struct PassRecorder;
 	struct Scene;
+	struct RayHit;
+	class ModelInstanceComponent;
+
+	namespace graphics
+	{
+		struct BonepalettePacker;
+	}
 
 	struct Renderer : Object
 	{
@@ -108,9 +120,12 @@ namespace flame
 		void add_to_drawlist();
 	};
 
-	enum { MaxLightCount = 256 };
+	enum { MaxLightCount = 1024 };
+	enum { LightClusterCx = 16 };
+	enum { LightClusterCy = 9 };
+	enum { LightClusterCz = 24 };
+	enum { MaxLightClusterIndexCount = 12288 };
 	enum { MaxStaticModelInstanceCount = 1024 };
-	enum { MaxAnimatedModelInstanceCount = 8 };
 	enum { MaxTerrainCount = 8 };
 	enum { MaxWaterCount = 8 };
 
@@ -134,26 +149,38 @@ namespace flame
 		bool ambient_dirty;
 		bool light_count_dirty;
 		bool static_model_instance_count_dirty;
-		bool animated_model_instance_count_dirty;
 		bool terrain_count_dirty;
 		bool water_count_dirty;
 
 		int static_indirect_count;
-		int animated_indirect_count;
+
+		// static instances are culled against the camera frustum every frame
+		int static_visible_count;
+		int static_culled_count;
+
+		// point and spot lights are binned into view space clusters every frame
+		float light_binning_time_ms;
+		int light_cluster_overflow_count;
+
+		// parallax lights, 2 to 4 cascades, the lambda blends uniform (0) and logarithmic (1) splits
+		int shadow_cascade_count;
+		float shadow_cascade_split_lambda;
 
 		std::unique_ptr<CommandBuffer> cb_defe;
 		std::unique_ptr<CommandBuffer> cb_shad;
+		std::unique_ptr<PassRecorder> pass_recorder; // the shadow layers and the g-buffer are recorded on the job system
 
 		std::unique_ptr<Buffer> constantBuffer;
 		std::unique_ptr<Buffer> matrixBuffer;
 		std::unique_ptr<Buffer> staticModelInstanceMatrixBuffer;
-		std::unique_ptr<Buffer> animatedModelInstanceMatrixBuffer;
 		std::unique_ptr<Buffer> terrainBuffer;
 		std::unique_ptr<Buffer> waterBuffer;
 		std::unique_ptr<Buffer> lightBuffer;
+		std::unique_ptr<Buffer> lightClusterBuffer;
+		std::unique_ptr<Buffer> lightIndexBuffer;
 		std::unique_ptr<Buffer> ambientBuffer;
 		std::unique_ptr<Buffer> staticObjectIndirectBuffer;
-		std::unique_ptr<Buffer> animatedObjectIndirectBuffer;
+		std::unique_ptr<Buffer> bonePaletteBuffer; // the matrices, then the instances
 		std::unique_ptr<Texture> envrImage;
 		std::unique_ptr<Texture> mainImage;
 		std::unique_ptr<Texture> depthImage;
@@ -162,7 +189,7 @@ namespace flame
 		std::unique_ptr<Texture> specRoughnessImage;
 		std::unique_ptr<DescriptorSet> ds_mrt;
 		std::unique_ptr<DescriptorSet> ds_mrtAnim;
-		std::unique_ptr<DescriptorSet> ds_mrtAnim_bone;
+		std::unique_ptr<DescriptorSet> ds_bone_palette; // set: 2
 		std::unique_ptr<DescriptorSet> ds_terrain;
 		std::unique_ptr<DescriptorSet> ds_water;
 		std::unique_ptr<DescriptorSet> ds_defe;
@@ -188,26 +215,62 @@ namespace flame
 		~DeferredRenderer();
 		void render(Scene *scene, CameraComponent *camera);
 		void add_to_drawlist();
+		// the nearest model instance hit before t_max, as of the last render, the static ones come from the tree
+		ModelInstanceComponent *ray_cast(const glm::vec3 &origin, const glm::vec3 &dir, float t_max, RayHit *hit = nullptr);
 
 	private:
 		void create_resolution_related();
+		void link_bone_palette();
 
 		SpareList lights;
 		SpareList static_model_instances;
-		SpareList animated_model_instances;
+		std::vector<ModelInstanceComponent*> animated_model_instances; // the instance index is the place in it
 		SpareList terrains;
 		SpareList waters;
 		SpareList shadow_lights;
 
+		AABBTree static_model_instance_tree;
+		std::vector<VkDrawIndexedIndirectCommand> indirect_commands;
+
+		// the skinned instances are drawn from the bone palette, their poses and world matrices go into it once a
+		// frame, a draw list is grouped by model and each group is an instanced draw
+		struct SkinnedDraw
+		{
+			Model *model;
+			int first_instance;
+			int instance_count;
+			int first_draw; // the draws of a geometry are its instances after each other
+		};
+
+		std::unique_ptr<graphics::BonepalettePacker> bone_palette;
+		int bone_palette_matrix_capacity;
+		int bone_palette_instance_capacity;
+		std::vector<int> animated_bone_offsets; // per instance, of this frame
+		std::vector<SkinnedDraw> animated_draws;
+
+		std::vector<int> shadow_static_casters[MaxShadowCount * 6]; // per layer
+		std::vector<int> shadow_static_draws[MaxShadowCount * 6]; // the first draw of each caster
+		std::vector<int> shadow_animated_casters[MaxShadowCount * 6];
+		std::vector<SkinnedDraw> shadow_animated_draws[MaxShadowCount * 6];
+
+		LightClusterGrid light_grid;
+		std::vector<Vec4> light_spheres;
+		std::vector<uint> light_sphere_indices;
+		std::vector<uint> light_index_upload;
+
 		struct LightAux
 		{
 			long long attribute_updated_frame;
 			long long shadow_updated_frame;
+			ShadowCascade cascades[MaxShadowCascadeCount];
+			long long cascade_rendered_frame[MaxShadowCascadeCount]; // -1 when it needs to be drawn
+			glm::vec4 split_far; // the cascade splits last uploaded
 		};
 
 		struct ModelInstanceAux
 		{
-			long long matrix_updated_frame;
+			long long matrix_updated_frame; // the last upload, for the shadow casters
+			int tree_proxy; // static instances only
 		};
 
 		struct TerrainAux
@@ -223,7 +286,6 @@ namespace flame
 
 		LightAux light_auxes[MaxLightCount];
 		ModelInstanceAux static_model_instance_auxes[MaxStaticModelInstanceCount];
-		ModelInstanceAux animated_model_instance_auxes[MaxAnimatedModelInstanceCount];
 		TerrainAux terrain_auxes[MaxTerrainCount];
 		WaterAux water_auxes[MaxWaterCount];
 	};
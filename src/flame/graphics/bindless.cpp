@@ -0,0 +1,465 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "device_private.h"
+#include "bindless_private.h"
+#include "buffer_private.h"
+#include "texture_private.h"
+#include "sampler_private.h"
+#include "descriptor_private.h"
+#include "commandbuffer_private.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <string.h>
+
+namespace flame
+{
+	namespace graphics
+	{
+#if defined(FLAME_GRAPHICS_VULKAN)
+		// the upper bound of the variable count texture array in the layout, lower when the device allows less
+		static const int BindlessMaxTextureCount = 65536;
+
+		static BindlessMaterialData to_data(BindlessPrivate *p, const BindlessMaterial &m)
+		{
+			BindlessMaterialData d = {};
+			d.albedo_alpha = m.albedo_alpha;
+			d.spec = m.spec;
+			d.roughness = m.roughness;
+			d.albedo_alpha_map = p->textures.valid(m.albedo_alpha_map) ? m.albedo_alpha_map.index + 1 : 0;
+			d.normal_height_map = p->textures.valid(m.normal_height_map) ? m.normal_height_map.index + 1 : 0;
+			d.spec_roughness_map = p->textures.valid(m.spec_roughness_map) ? m.spec_roughness_map.index + 1 : 0;
+			return d;
+		}
+
+		static void retire(BindlessPrivate *p, VkDescriptorPool pool, Descriptorset *set, Buffer *buffer)
+		{
+			p->retired.push_back({ p->frame, pool, set, buffer });
+		}
+
+		static void make_set(Bindless *b)
+		{
+			auto p = b->_priv;
+			auto device = p->d->_priv->device;
+
+			if (b->set)
+				retire(p, p->pool, b->set, nullptr);
+
+			VkDescriptorPoolSize sizes[] = {
+				{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+				{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (uint32_t)p->texture_capacity }
+			};
+			VkDescriptorPoolCreateInfo pool_info = {};
+			pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+			pool_info.poolSizeCount = 2;
+			pool_info.pPoolSizes = sizes;
+			pool_info.maxSets = 1;
+			vk_chk_res(vkCreateDescriptorPool(device, &pool_info, nullptr, &p->pool));
+
+			uint32_t count = p->texture_capacity;
+			VkDescriptorSetVariableDescriptorCountAllocateInfoEXT count_info = {};
+			count_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+			count_info.descriptorSetCount = 1;
+			count_info.pDescriptorCounts = &count;
+
+			b->set = new Descriptorset;
+			b->set->_priv = new DescriptorsetPrivate;
+			b->set->_priv->d = p->d;
+
+			VkDescriptorSetAllocateInfo info;
+			info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			info.pNext = &count_info;
+			info.descriptorPool = p->pool;
+			info.descriptorSetCount = 1;
+			info.pSetLayouts = &b->layout->_priv->v;
+			vk_chk_res(vkAllocateDescriptorSets(device, &info, &b->set->_priv->v));
+
+			b->set->set_storagebuffer(0, 0, p->draw_buffer);
+			b->set->set_storagebuffer(1, 0, p->material_buffer);
+
+			// slots that are not in use are never read, the array is partially bound
+			std::vector<VkDescriptorImageInfo> images;
+			std::vector<VkWriteDescriptorSet> writes;
+			images.reserve(p->textures.capacity());
+			for (auto i = 0; i < p->textures.capacity(); i++)
+			{
+				if (p->textures.generations[i] % 2 == 0)
+					continue;
+				images.push_back({ p->texture_data[i].sampler, p->texture_data[i].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+				VkWriteDescriptorSet w = {};
+				w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				w.dstSet = b->set->_priv->v;
+				w.dstBinding = 2;
+				w.dstArrayElement = i;
+				w.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				w.descriptorCount = 1;
+				writes.push_back(w);
+			}
+			for (auto i = 0; i < writes.size(); i++)
+				writes[i].pImageInfo = &images[i];
+			if (!writes.empty())
+				vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0, nullptr);
+			p->pending_textures.clear();
+		}
+
+		BindlessHandle Bindless::add_texture(Textureview *v, Sampler *s)
+		{
+			auto h = _priv->textures.add();
+			if (h.index >= _priv->texture_data.size())
+				_priv->texture_data.resize(h.index + 1);
+			_priv->texture_data[h.index] = { v->_priv->v, s->_priv->v };
+			_priv->pending_textures.push_back(h.index);
+			return h;
+		}
+
+		void Bindless::remove_texture(const BindlessHandle &h)
+		{
+			if (_priv->textures.remove(h))
+				_priv->texture_removed = true;
+		}
+
+		bool Bindless::is_texture_valid(const BindlessHandle &h)
+		{
+			return _priv->textures.valid(h);
+		}
+
+		BindlessHandle Bindless::add_material(const BindlessMaterial &m)
+		{
+			auto h = _priv->materials.add();
+			if (h.index >= _priv->material_data.size())
+			{
+				_priv->material_sources.resize(h.index + 1);
+				_priv->material_data.resize(h.index + 1);
+			}
+			_priv->material_sources[h.index] = m;
+			_priv->material_data[h.index] = to_data(_priv, m);
+			_priv->dirty_materials.add(h.index);
+			return h;
+		}
+
+		bool Bindless::set_material(const BindlessHandle &h, const BindlessMaterial &m)
+		{
+			if (!_priv->materials.valid(h))
+				return false;
+			_priv->material_sources[h.index] = m;
+			auto d = to_data(_priv, m);
+			if (memcmp(&d, &_priv->material_data[h.index], sizeof(d)) != 0)
+			{
+				_priv->material_data[h.index] = d;
+				_priv->dirty_materials.add(h.index);
+			}
+			return true;
+		}
+
+		void Bindless::remove_material(const BindlessHandle &h)
+		{
+			// material 0 is the default, draws of a removed material fall back to it
+			if (h.index != 0)
+				_priv->materials.remove(h);
+		}
+
+		bool Bindless::is_material_valid(const BindlessHandle &h)
+		{
+			return _priv->materials.valid(h);
+		}
+
+		int Bindless::add_draw(uint instance, const BindlessHandle &material)
+		{
+			auto n = _priv->draw_count.fetch_add(1, std::memory_order_relaxed);
+			if (n >= _priv->draw_capacity)
+			{
+				_priv->draw_overflow = true;
+				return -1;
+			}
+			auto index = _priv->draw_slice * _priv->draw_capacity + n;
+			auto &dd = ((BindlessDrawData*)_priv->draw_buffer->mapped)[index];
+			dd.instance = instance;
+			dd.material = _priv->materials.valid(material) ? material.index : 0;
+			return index;
+		}
+
+		void Bindless::update(Commandbuffer *cb)
+		{
+			auto p = _priv;
+			auto device = p->d->_priv->device;
+
+			p->frame++;
+			p->textures.next_frame(p->frame_count);
+			p->materials.next_frame(p->frame_count);
+
+			{
+				auto n = 0;
+				for (; n < p->retired.size() && p->frame - p->retired[n].frame >= p->frame_count; n++)
+				{
+					auto &r = p->retired[n];
+					if (r.pool)
+					{
+						vkDestroyDescriptorPool(device, r.pool, nullptr);
+						delete r.set->_priv;
+						delete r.set;
+					}
+					if (r.buffer)
+						destroy_buffer(p->d, r.buffer);
+				}
+				p->retired.erase(p->retired.begin(), p->retired.begin() + n);
+			}
+
+			// a removed texture reads as none in the materials that had it
+			if (p->texture_removed)
+			{
+				for (auto i = 0; i < p->materials.capacity(); i++)
+				{
+					if (p->materials.generations[i] % 2 == 0)
+						continue;
+					auto d = to_data(p, p->material_sources[i]);
+					if (memcmp(&d, &p->material_data[i], sizeof(d)) != 0)
+					{
+						p->material_data[i] = d;
+						p->dirty_materials.add(i);
+					}
+				}
+				p->texture_removed = false;
+			}
+
+			auto rebuild = false;
+			auto copied = false;
+			if (p->textures.capacity() > p->texture_capacity)
+			{
+				while (p->texture_capacity < p->textures.capacity())
+					p->texture_capacity *= 2;
+				assert(p->texture_capacity <= p->max_texture_count);
+				rebuild = true;
+			}
+			if (p->materials.capacity() > p->material_capacity)
+			{
+				auto old = p->material_buffer;
+				while (p->material_capacity < p->materials.capacity())
+					p->material_capacity *= 2;
+				p->material_buffer = create_buffer(p->d, p->material_capacity * sizeof(BindlessMaterialData),
+					BufferUsageStorageBuffer | BufferUsageTransferSrc | BufferUsageTransferDst, MemPropDevice);
+				// all that is not dirty is in the old buffer already
+				BufferCopy copy = { 0, 0, old->size };
+				cb->copy_buffer(old, p->material_buffer, 1, &copy);
+				retire(p, 0, nullptr, old);
+				rebuild = true;
+				copied = true;
+			}
+			if (p->draw_overflow)
+			{
+				retire(p, 0, nullptr, p->draw_buffer);
+				p->draw_capacity *= 2;
+				p->draw_buffer = create_buffer(p->d, p->frame_count * p->draw_capacity * sizeof(BindlessDrawData),
+					BufferUsageStorageBuffer, MemPropHost | MemPropHostCoherent);
+				p->draw_buffer->map();
+				p->draw_overflow = false;
+				rebuild = true;
+			}
+			p->draw_slice = (p->draw_slice + 1) % p->frame_count;
+			p->draw_count = 0;
+
+			if (rebuild)
+				make_set(this);
+			else if (!p->pending_textures.empty())
+			{
+				// the textures of the frame in one descriptor update, new slots are not used by the frames in flight
+				std::vector<VkDescriptorImageInfo> images(p->pending_textures.size());
+				std::vector<VkWriteDescriptorSet> writes(p->pending_textures.size());
+				for (auto i = 0; i < writes.size(); i++)
+				{
+					auto idx = p->pending_textures[i];
+					images[i] = { p->texture_data[idx].sampler, p->texture_data[idx].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+					auto &w = writes[i];
+					w = {};
+					w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					w.dstSet = set->_priv->v;
+					w.dstBinding = 2;
+					w.dstArrayElement = idx;
+					w.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+					w.descriptorCount = 1;
+					w.pImageInfo = &images[i];
+				}
+				vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0, nullptr);
+				p->pending_textures.clear();
+			}
+
+			if (!p->dirty_materials.empty())
+			{
+				std::vector<std::pair<uint, uint>> ranges;
+				p->dirty_materials.take(ranges);
+				auto total = 0;
+				for (auto &r : ranges)
+					total += r.second;
+
+				TransientRange staging;
+				if (allocate_transient(p->d, total * sizeof(BindlessMaterialData), 16, &staging))
+				{
+					std::vector<BufferCopy> copies(ranges.size());
+					auto dst = (unsigned char*)staging.mapped;
+					auto offset = staging.offset;
+					for (auto i = 0; i < ranges.size(); i++)
+					{
+						auto size = ranges[i].second * sizeof(BindlessMaterialData);
+						memcpy(dst, &p->material_data[ranges[i].first], size);
+						copies[i] = { offset, (int)(ranges[i].first * sizeof(BindlessMaterialData)), (int)size };
+						dst += size;
+						offset += size;
+					}
+
+					// the frames before must be done reading, and a copy for the growing must be done writing
+					VkMemoryBarrier barrier = {};
+					barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+					barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+					barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+					vkCmdPipelineBarrier(cb->_priv->v, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+						VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+					cb->copy_buffer(staging.buffer, p->material_buffer, copies.size(), copies.data());
+					copied = true;
+				}
+				else
+				{
+					// the slice of this frame is full, next time
+					for (auto &r : ranges)
+					{
+						for (auto i = 0; i < r.second; i++)
+							p->dirty_materials.add(r.first + i);
+					}
+				}
+			}
+
+			if (copied)
+			{
+				VkMemoryBarrier barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier(cb->_priv->v, VK_PIPELINE_STAGE_TRANSFER_BIT,
+					VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+			}
+		}
+
+		Bindless *create_bindless(Device *d, int frame_count, int texture_capacity, int material_capacity, int draw_capacity)
+		{
+			assert(d->features_descriptor_indexing);
+
+			auto b = new Bindless;
+			b->set = nullptr;
+
+			auto p = new BindlessPrivate;
+			b->_priv = p;
+			p->d = d;
+			p->frame_count = frame_count;
+			p->frame = 0;
+			p->pool = 0;
+			p->max_texture_count = std::min(BindlessMaxTextureCount, d->_priv->max_update_after_bind_sampled_images);
+			p->texture_capacity = std::min(std::max(texture_capacity, 1), p->max_texture_count);
+			p->texture_removed = false;
+			p->material_capacity = std::max(material_capacity, 1);
+			p->draw_capacity = std::max(draw_capacity, 1);
+			p->draw_slice = 0;
+			p->draw_count = 0;
+			p->draw_overflow = false;
+
+			b->layout = new Descriptorsetlayout;
+			b->layout->_priv = new DescriptorsetlayoutPrivate;
+			b->layout->_priv->d = d;
+			b->layout->_priv->bindings = {
+				{ ShaderResourceStoragebuffer, 0, 1, ShaderVert | ShaderFrag },
+				{ ShaderResourceStoragebuffer, 1, 1, ShaderVert | ShaderFrag },
+				{ ShaderResourceTexture, 2, p->max_texture_count, ShaderFrag }
+			};
+			VkDescriptorSetLayoutBinding bindings[3];
+			VkDescriptorBindingFlagsEXT binding_flags[3];
+			for (auto i = 0; i < 3; i++)
+			{
+				auto &src = b->layout->_priv->bindings[i];
+				bindings[i].binding = src.binding;
+				bindings[i].descriptorType = Z(src.type);
+				bindings[i].descriptorCount = src.count;
+				bindings[i].stageFlags = Z(ShaderType(src.shader_stage));
+				bindings[i].pImmutableSamplers = nullptr;
+				binding_flags[i] = 0;
+			}
+			// slots are written while the set is in use by frames in flight that do not read them
+			binding_flags[2] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+				VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT;
+			VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flags_info = {};
+			flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+			flags_info.bindingCount = 3;
+			flags_info.pBindingFlags = binding_flags;
+			VkDescriptorSetLayoutCreateInfo layout_info = {};
+			layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			layout_info.pNext = &flags_info;
+			layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+			layout_info.bindingCount = 3;
+			layout_info.pBindings = bindings;
+			vk_chk_res(vkCreateDescriptorSetLayout(d->_priv->device, &layout_info, nullptr, &b->layout->_priv->v));
+
+			p->material_buffer = create_buffer(d, p->material_capacity * sizeof(BindlessMaterialData),
+				BufferUsageStorageBuffer | BufferUsageTransferSrc | BufferUsageTransferDst, MemPropDevice);
+			p->draw_buffer = create_buffer(d, frame_count * p->draw_capacity * sizeof(BindlessDrawData),
+				BufferUsageStorageBuffer, MemPropHost | MemPropHostCoherent);
+			p->draw_buffer->map();
+
+			// material 0, for the draws without one
+			BindlessMaterial m;
+			m.albedo_alpha = Vec4(1.f);
+			m.spec = 0.f;
+			m.roughness = 1.f;
+			b->add_material(m);
+
+			make_set(b);
+
+			return b;
+		}
+
+		void destroy_bindless(Device *d, Bindless *b)
+		{
+			auto p = b->_priv;
+			assert(d == p->d);
+
+			for (auto &r : p->retired)
+			{
+				if (r.pool)
+				{
+					vkDestroyDescriptorPool(d->_priv->device, r.pool, nullptr);
+					delete r.set->_priv;
+					delete r.set;
+				}
+				if (r.buffer)
+					destroy_buffer(d, r.buffer);
+			}
+			vkDestroyDescriptorPool(d->_priv->device, p->pool, nullptr);
+			delete b->set->_priv;
+			delete b->set;
+			destroy_descriptorsetlayout(d, b->layout);
+			p->draw_buffer->unmap();
+			destroy_buffer(d, p->draw_buffer);
+			destroy_buffer(d, p->material_buffer);
+
+			delete p;
+			delete b;
+		}
+#endif
+	}
+}
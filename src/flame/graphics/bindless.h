@@ -0,0 +1,243 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <flame/type.h>
+#include "graphics.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace flame
+{
+	namespace graphics
+	{
+		struct Device;
+		struct Commandbuffer;
+		struct Textureview;
+		struct Sampler;
+		struct Descriptorsetlayout;
+		struct Descriptorset;
+
+		// an index and the generation of its slot, a slot gets a new generation when it is removed,
+		// so an old handle never refers to what took the slot after it
+		struct BindlessHandle
+		{
+			uint index;
+			uint generation; // 0 for no handle
+
+			BindlessHandle() :
+				index(0),
+				generation(0)
+			{
+			}
+
+			BindlessHandle(uint _index, uint _generation) :
+				index(_index),
+				generation(_generation)
+			{
+			}
+		};
+
+		inline bool operator==(const BindlessHandle &lhs, const BindlessHandle &rhs)
+		{
+			return lhs.index == rhs.index && lhs.generation == rhs.generation;
+		}
+
+		inline bool operator!=(const BindlessHandle &lhs, const BindlessHandle &rhs)
+		{
+			return !(lhs == rhs);
+		}
+
+		// slots with full 32-bit indices that grow on demand, a removed slot is given again only after
+		// lag calls of next_frame, when no frame in flight can use it anymore
+		struct BindlessSlots
+		{
+			std::vector<uint> generations; // odd when the slot is in use
+			std::vector<uint> free_list;
+			std::vector<std::pair<uint, int>> retired; // slot and the frame it was removed in
+			int frame;
+			int live_count;
+
+			BindlessSlots() :
+				frame(0),
+				live_count(0)
+			{
+			}
+
+			int capacity() const
+			{
+				return generations.size();
+			}
+
+			BindlessHandle add()
+			{
+				uint index;
+				if (!free_list.empty())
+				{
+					index = free_list.back();
+					free_list.pop_back();
+				}
+				else
+				{
+					index = generations.size();
+					generations.push_back(0);
+				}
+				generations[index]++;
+				live_count++;
+				return BindlessHandle(index, generations[index]);
+			}
+
+			bool valid(const BindlessHandle &h) const
+			{
+				return h.generation != 0 && h.index < generations.size() && generations[h.index] == h.generation;
+			}
+
+			bool remove(const BindlessHandle &h)
+			{
+				if (!valid(h))
+					return false;
+				generations[h.index]++;
+				live_count--;
+				retired.push_back({ h.index, frame });
+				return true;
+			}
+
+			void next_frame(int lag)
+			{
+				frame++;
+				auto n = 0;
+				for (; n < (int)retired.size() && frame - retired[n].second >= lag; n++)
+					free_list.push_back(retired[n].first);
+				retired.erase(retired.begin(), retired.begin() + n);
+			}
+		};
+
+		// the elements changed since the last take, taken as sorted ranges of neighbours
+		struct BindlessDirty
+		{
+			std::vector<bool> flags;
+			std::vector<uint> list;
+
+			void add(uint index)
+			{
+				if (index >= flags.size())
+					flags.resize(index + 1, false);
+				if (flags[index])
+					return;
+				flags[index] = true;
+				list.push_back(index);
+			}
+
+			bool empty() const
+			{
+				return list.empty();
+			}
+
+			// (first, count) pairs
+			void take(std::vector<std::pair<uint, uint>> &out)
+			{
+				out.clear();
+				std::sort(list.begin(), list.end());
+				for (auto i : list)
+				{
+					flags[i] = false;
+					if (!out.empty() && out.back().first + out.back().second == i)
+						out.back().second++;
+					else
+						out.push_back({ i, 1 });
+				}
+				list.clear();
+			}
+		};
+
+		// the layout in the material buffer (std430)
+		struct BindlessMaterialData
+		{
+			Vec4 albedo_alpha;
+			float spec;
+			float roughness;
+			uint albedo_alpha_map; // the texture index + 1, 0 for none
+			uint normal_height_map;
+			uint spec_roughness_map;
+			uint dummy[3];
+		};
+
+		// the layout in the draw buffer (std430), gl_InstanceIndex of a draw is its index
+		struct BindlessDrawData
+		{
+			uint instance;
+			uint material;
+		};
+
+		struct BindlessMaterial
+		{
+			Vec4 albedo_alpha;
+			float spec;
+			float roughness;
+			BindlessHandle albedo_alpha_map;
+			BindlessHandle normal_height_map;
+			BindlessHandle spec_roughness_map;
+		};
+
+		struct BindlessPrivate;
+
+		// all textures, materials and per-draw data in one descriptor set, see shaders/src/bindless.glsl:
+		//  binding 0 - the draws, indexed by the first instance of a draw
+		//  binding 1 - the materials
+		//  binding 2 - the textures, as many as there are slots (descriptor indexing, partially bound)
+		//
+		// changes are kept until update(), which writes the new textures in one descriptor update, copies only
+		// the changed materials and starts the next slice of the draw buffer, the set is made again (set changes)
+		// only when something has to grow
+		struct Bindless
+		{
+			Descriptorsetlayout *layout;
+			Descriptorset *set;
+
+			BindlessPrivate *_priv;
+
+			FLAME_GRAPHICS_EXPORTS BindlessHandle add_texture(Textureview *v, Sampler *s);
+			FLAME_GRAPHICS_EXPORTS void remove_texture(const BindlessHandle &h);
+			FLAME_GRAPHICS_EXPORTS bool is_texture_valid(const BindlessHandle &h);
+
+			FLAME_GRAPHICS_EXPORTS BindlessHandle add_material(const BindlessMaterial &m);
+			// false when the handle is gone, a texture handle that is gone means no texture
+			FLAME_GRAPHICS_EXPORTS bool set_material(const BindlessHandle &h, const BindlessMaterial &m);
+			FLAME_GRAPHICS_EXPORTS void remove_material(const BindlessHandle &h);
+			FLAME_GRAPHICS_EXPORTS bool is_material_valid(const BindlessHandle &h);
+
+			// the first instance for the draw, can be called from any thread while recording, -1 when the slice of
+			// this frame is full (it gets bigger at the next update)
+			FLAME_GRAPHICS_EXPORTS int add_draw(uint instance, const BindlessHandle &material);
+
+			// once a frame, before the draws are added and outside of a renderpass, cb must run before the draws
+			FLAME_GRAPHICS_EXPORTS void update(Commandbuffer *cb);
+		};
+
+		// frame_count - the frames in flight, a removed texture or material slot is given again after that many updates
+		FLAME_GRAPHICS_EXPORTS Bindless *create_bindless(Device *d, int frame_count, int texture_capacity = 1024,
+			int material_capacity = 1024, int draw_capacity = 65536);
+		FLAME_GRAPHICS_EXPORTS void destroy_bindless(Device *d, Bindless *b);
+	}
+}
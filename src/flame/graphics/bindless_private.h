@@ -0,0 +1,85 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include "bindless.h"
+#include "graphics_private.h"
+
+#include <vector>
+#include <atomic>
+
+namespace flame
+{
+	namespace graphics
+	{
+		struct Buffer;
+
+#if defined(FLAME_GRAPHICS_VULKAN)
+		struct BindlessTexture
+		{
+			VkImageView view;
+			VkSampler sampler;
+		};
+
+		// what the frames in flight may still use when the set is made again
+		struct BindlessRetired
+		{
+			int frame;
+			VkDescriptorPool pool;
+			Descriptorset *set;
+			Buffer *buffer;
+		};
+
+		struct BindlessPrivate
+		{
+			Device *d;
+			int frame_count;
+			int frame; // counts the updates
+
+			VkDescriptorPool pool; // for the set only, it is made again with the set
+			int texture_capacity; // of the array in the set
+			int max_texture_count; // of the array in the layout
+
+			BindlessSlots textures;
+			std::vector<BindlessTexture> texture_data;
+			std::vector<uint> pending_textures; // to write at the next update
+			bool texture_removed;
+
+			BindlessSlots materials;
+			std::vector<BindlessMaterial> material_sources;
+			std::vector<BindlessMaterialData> material_data;
+			BindlessDirty dirty_materials;
+			Buffer *material_buffer;
+			int material_capacity;
+
+			Buffer *draw_buffer; // host visible, a slice of draw_capacity for each frame in flight
+			int draw_capacity;
+			int draw_slice;
+			std::atomic<int> draw_count;
+			std::atomic<bool> draw_overflow;
+
+			std::vector<BindlessRetired> retired;
+		};
+#endif
+	}
+}
@@ -0,0 +1,119 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "device_private.h"
+#include "bonepalette_private.h"
+#include "buffer_private.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+namespace flame
+{
+	namespace graphics
+	{
+#if defined(FLAME_GRAPHICS_VULKAN)
+		static Buffer *create_slot_buffer(Device *d, int size)
+		{
+			auto b = create_buffer(d, size, BufferUsageStorageBuffer, MemPropHost | MemPropHostCoherent);
+			b->map();
+			return b;
+		}
+
+		// the slot was used by the frame frame_count frames ago, which is done, so the buffer can go now
+		static bool fit(Device *d, Buffer *&b, int size)
+		{
+			if (size <= b->size)
+				return false;
+			auto new_size = b->size;
+			while (new_size < size)
+				new_size *= 2;
+			b->unmap();
+			destroy_buffer(d, b);
+			b = create_slot_buffer(d, new_size);
+			return true;
+		}
+
+		bool Bonepalette::upload()
+		{
+			auto p = _priv;
+			p->slot = (p->slot + 1) % p->slots.size();
+			auto &s = p->slots[p->slot];
+
+			auto matrices_size = (int)(packer.matrices.size() * sizeof(Mat4));
+			auto instances_size = (int)(packer.instances.size() * sizeof(BonepaletteInstance));
+			auto changed = fit(p->d, s.matrices, matrices_size);
+			changed |= fit(p->d, s.instances, instances_size);
+
+			if (matrices_size)
+				memcpy(s.matrices->mapped, packer.matrices.data(), matrices_size);
+			if (instances_size)
+				memcpy(s.instances->mapped, packer.instances.data(), instances_size);
+			packer.clear();
+
+			matrix_buffer = s.matrices;
+			instance_buffer = s.instances;
+			return changed;
+		}
+
+		Bonepalette *create_bonepalette(Device *d, int frame_count, int matrix_capacity, int instance_capacity)
+		{
+			assert(frame_count > 0);
+
+			auto b = new Bonepalette;
+
+			auto p = new BonepalettePrivate;
+			b->_priv = p;
+			p->d = d;
+			p->slot = 0;
+			p->slots.resize(frame_count);
+			for (auto &s : p->slots)
+			{
+				s.matrices = create_slot_buffer(d, std::max(matrix_capacity, 1) * sizeof(Mat4));
+				s.instances = create_slot_buffer(d, std::max(instance_capacity, 1) * sizeof(BonepaletteInstance));
+			}
+			b->matrix_buffer = p->slots[0].matrices;
+			b->instance_buffer = p->slots[0].instances;
+
+			return b;
+		}
+
+		void destroy_bonepalette(Device *d, Bonepalette *b)
+		{
+			auto p = b->_priv;
+			assert(d == p->d);
+
+			for (auto &s : p->slots)
+			{
+				s.matrices->unmap();
+				destroy_buffer(d, s.matrices);
+				s.instances->unmap();
+				destroy_buffer(d, s.instances);
+			}
+
+			delete p;
+			delete b;
+		}
+#endif
+	}
+}
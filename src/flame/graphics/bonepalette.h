@@ -0,0 +1,182 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <flame/type.h>
+#include "graphics.h"
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+namespace flame
+{
+	namespace graphics
+	{
+		struct Device;
+		struct Buffer;
+
+		// the pose a palette is for, instances with the same key share one palette
+		struct BonepaletteKey
+		{
+			const void *skeleton; // e.g. the model
+			const void *animation; // nullptr for a pose of one instance only (ik, ragdoll), never shared
+			int frame; // the animation frame, quantized by the caller
+
+			BonepaletteKey() :
+				skeleton(nullptr),
+				animation(nullptr),
+				frame(0)
+			{
+			}
+
+			BonepaletteKey(const void *_skeleton, const void *_animation, int _frame) :
+				skeleton(_skeleton),
+				animation(_animation),
+				frame(_frame)
+			{
+			}
+		};
+
+		inline bool operator==(const BonepaletteKey &lhs, const BonepaletteKey &rhs)
+		{
+			return lhs.skeleton == rhs.skeleton && lhs.animation == rhs.animation && lhs.frame == rhs.frame;
+		}
+
+		struct BonepaletteKeyHash
+		{
+			size_t operator()(const BonepaletteKey &k) const
+			{
+				auto h = std::hash<const void*>()(k.skeleton);
+				h ^= std::hash<const void*>()(k.animation) + 0x9e3779b9 + (h << 6) + (h >> 2);
+				h ^= std::hash<int>()(k.frame) + 0x9e3779b9 + (h << 6) + (h >> 2);
+				return h;
+			}
+		};
+
+		// the layout in the instance buffer (std430), gl_InstanceIndex of a skinned draw indexes it
+		struct BonepaletteInstance
+		{
+			Mat4 world;
+			uint bone_offset; // of the palette, in matrices
+			uint dummy[3];
+		};
+
+		// packs the palettes of a frame into one array, each pose once
+		//
+		// acquire() only gives places, a fresh palette is written by the caller through get(), get() pointers stay
+		// valid until the next acquire(), so acquiring all first and then writing the fresh ones can be done on many
+		// threads
+		struct BonepalettePacker
+		{
+			std::vector<Mat4> matrices;
+			std::vector<BonepaletteInstance> instances;
+			std::unordered_map<BonepaletteKey, int, BonepaletteKeyHash> palettes;
+			int shared_count; // acquires of this frame that got a palette that was already there
+
+			BonepalettePacker() :
+				shared_count(0)
+			{
+			}
+
+			// keeps the memory, the sizes of the frames are alike
+			void clear()
+			{
+				matrices.clear();
+				instances.clear();
+				palettes.clear();
+				shared_count = 0;
+			}
+
+			// the offset of the palette, fresh is set when it is new and its bone_count matrices must be written
+			int acquire(const BonepaletteKey &k, int bone_count, bool *fresh)
+			{
+				int offset = matrices.size();
+				if (k.animation)
+				{
+					auto r = palettes.emplace(k, offset);
+					if (!r.second)
+					{
+						shared_count++;
+						*fresh = false;
+						return r.first->second;
+					}
+				}
+				matrices.resize(offset + bone_count);
+				*fresh = true;
+				return offset;
+			}
+
+			Mat4 *get(int offset)
+			{
+				return matrices.data() + offset;
+			}
+
+			// the instances of one instanced draw, returns its first instance
+			int add_instances(int count, const BonepaletteInstance *src)
+			{
+				int first = instances.size();
+				instances.insert(instances.end(), src, src + count);
+				return first;
+			}
+
+			int add_instance(const Mat4 &world, int bone_offset)
+			{
+				BonepaletteInstance i;
+				i.world = world;
+				i.bone_offset = bone_offset;
+				i.dummy[0] = i.dummy[1] = i.dummy[2] = 0;
+				instances.push_back(i);
+				return instances.size() - 1;
+			}
+		};
+
+		struct BonepalettePrivate;
+
+		// the bone matrices of all skinned instances in one storage buffer, see shaders/src/bone_palette.glsl:
+		//  matrix_buffer - the palettes, packed
+		//  instance_buffer - a BonepaletteInstance for each instance, an instanced draw of a model takes
+		//                    the first instance from add_instances()
+		//
+		// the buffers are host visible, one pair for each frame in flight, filled by one upload a frame
+		struct Bonepalette
+		{
+			BonepalettePacker packer;
+
+			Buffer *matrix_buffer; // of the current frame
+			Buffer *instance_buffer;
+
+			BonepalettePrivate *_priv;
+
+			// once a frame after Framecontext::begin_frame, when the packer has all of the frame, the packer is empty
+			// after, returns true when the buffers are not the ones this frame slot had the last time (write them
+			// into the descriptor set again)
+			FLAME_GRAPHICS_EXPORTS bool upload();
+		};
+
+		// frame_count - the frames in flight, the capacities are in matrices and instances and grow on demand
+		FLAME_GRAPHICS_EXPORTS Bonepalette *create_bonepalette(Device *d, int frame_count, int matrix_capacity = 65536,
+			int instance_capacity = 4096);
+		FLAME_GRAPHICS_EXPORTS void destroy_bonepalette(Device *d, Bonepalette *p);
+	}
+}
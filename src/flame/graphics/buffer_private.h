@@ -22,6 +22,7 @@
 
 #include "buffer.h"
 #include "graphics_private.h"
+#include "memory_private.h"
 
 namespace flame
 {
@@ -34,7 +35,9 @@ namespace flame
 			int mem_prop;
 			Device *d;
 			VkBuffer v;
-			VkDeviceMemory m;
+			MemoryAllocation m;
+			int map_offset;
+			int map_size;
 #else
 			GLuint v;
 #endif
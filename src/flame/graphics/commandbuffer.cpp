@@ -28,6 +28,7 @@
 #include "descriptor_private.h"
 #include "buffer_private.h"
 #include "texture_private.h"
+#include "querypool_private.h"
 
 namespace flame
 {
@@ -46,7 +47,29 @@ namespace flame
 			_priv->current_pipeline = nullptr;
 		}
 
-		void Commandbuffer::begin_renderpass(Renderpass *r, Framebuffer *f)
+		void Commandbuffer::begin_secondary(Renderpass *r, int subpass, Framebuffer *f, bool once)
+		{
+			VkCommandBufferInheritanceInfo inheritance;
+			inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritance.pNext = nullptr;
+			inheritance.renderPass = r->_priv->v;
+			inheritance.subpass = subpass;
+			inheritance.framebuffer = f ? f->_priv->v : VK_NULL_HANDLE;
+			inheritance.occlusionQueryEnable = VK_FALSE;
+			inheritance.queryFlags = 0;
+			inheritance.pipelineStatistics = 0;
+
+			VkCommandBufferBeginInfo info;
+			info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+				(once ? VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT : VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
+			info.pNext = nullptr;
+			info.pInheritanceInfo = &inheritance;
+			vk_chk_res(vkBeginCommandBuffer(_priv->v, &info));
+			_priv->current_pipeline = nullptr;
+		}
+
+		void Commandbuffer::begin_renderpass(Renderpass *r, Framebuffer *f, bool secondaries)
 		{
 			VkRenderPassBeginInfo info;
 			info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -60,7 +83,7 @@ namespace flame
 			info.clearValueCount = r->_priv->clear_values.size();
 			info.pClearValues = r->_priv->clear_values.data();
 
-			vkCmdBeginRenderPass(_priv->v, &info, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdBeginRenderPass(_priv->v, &info, secondaries ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 		}
 
 		void Commandbuffer::end_renderpass()
@@ -99,20 +122,20 @@ namespace flame
 			vkCmdBindPipeline(_priv->v, Z(p->type), p->_priv->v);
 		}
 
-		void Commandbuffer::bind_descriptorset(Descriptorset *s)
+		void Commandbuffer::bind_descriptorset(Descriptorset *s, int index)
 		{
-			vkCmdBindDescriptorSets(_priv->v, Z(_priv->current_pipeline->type), _priv->current_pipeline->_priv->pipelinelayout->_priv->v, 0, 1, &s->_priv->v, 0, nullptr);
+			vkCmdBindDescriptorSets(_priv->v, Z(_priv->current_pipeline->type), _priv->current_pipeline->_priv->pipelinelayout->_priv->v, index, 1, &s->_priv->v, 0, nullptr);
 		}
 
-		void Commandbuffer::bind_vertexbuffer(Buffer *b)
+		void Commandbuffer::bind_vertexbuffer(Buffer *b, int offset)
 		{
-			VkDeviceSize offset = 0;
-			vkCmdBindVertexBuffers(_priv->v, 0, 1, &b->_priv->v, &offset);
+			VkDeviceSize vk_offset = offset;
+			vkCmdBindVertexBuffers(_priv->v, 0, 1, &b->_priv->v, &vk_offset);
 		}
 
-		void Commandbuffer::bind_indexbuffer(Buffer *b, IndiceType t)
+		void Commandbuffer::bind_indexbuffer(Buffer *b, IndiceType t, int offset)
 		{
-			vkCmdBindIndexBuffer(_priv->v, b->_priv->v, 0, t == IndiceTypeUint ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16);
+			vkCmdBindIndexBuffer(_priv->v, b->_priv->v, offset, t == IndiceTypeUint ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16);
 		}
 
 		void Commandbuffer::push_constant(int shader_stage, int offset, int size, void *data)
@@ -135,6 +158,16 @@ namespace flame
 			vkCmdDispatch(_priv->v, v.x, v.y, v.z);
 		}
 
+		void Commandbuffer::execute_secondaries(int count, Commandbuffer **cbs)
+		{
+			if (count == 0)
+				return;
+			std::vector<VkCommandBuffer> vk_cbs(count);
+			for (auto i = 0; i < count; i++)
+				vk_cbs[i] = cbs[i]->_priv->v;
+			vkCmdExecuteCommands(_priv->v, count, vk_cbs.data());
+		}
+
 		void Commandbuffer::copy_buffer(Buffer *src, Buffer *dst, int copy_count, BufferCopy *copies)
 		{
 			std::vector<VkBufferCopy> vk_copies(copy_count);
@@ -248,6 +281,17 @@ namespace flame
 				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copy_count, vk_copies.data());
 		}
 
+		void Commandbuffer::reset_querypool(Querypool *q, int first, int count)
+		{
+			vkCmdResetQueryPool(_priv->v, q->_priv->v, first, count);
+		}
+
+		void Commandbuffer::write_timestamp(Querypool *q, int index, bool top_of_pipe)
+		{
+			vkCmdWriteTimestamp(_priv->v, top_of_pipe ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				q->_priv->v, index);
+		}
+
 		void Commandbuffer::end()
 		{
 			vk_chk_res(vkEndCommandBuffer(_priv->v));
@@ -278,7 +322,12 @@ namespace flame
 			delete c;
 		}
 
-		Commandpool *create_commandpool(Device *d)
+		void Commandpool::reset()
+		{
+			vk_chk_res(vkResetCommandPool(_priv->d->_priv->device, _priv->v, 0));
+		}
+
+		Commandpool *create_commandpool(Device *d, int queue_family)
 		{
 			auto p = new Commandpool;
 			p->_priv = new CommandpoolPrivate;
@@ -288,7 +337,7 @@ namespace flame
 			info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 			info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 			info.pNext = nullptr;
-			info.queueFamilyIndex = 0;
+			info.queueFamilyIndex = queue_family;
 
 			vk_chk_res(vkCreateCommandPool(d->_priv->device, &info, nullptr, &p->_priv->v));
 
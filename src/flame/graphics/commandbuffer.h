@@ -36,6 +36,7 @@ namespace flame
 		struct Descriptorset;
 		struct Buffer;
 		struct Texture;
+		struct Querypool;
 
 		struct BufferCopy
 		{
@@ -57,25 +58,33 @@ namespace flame
 			CommandbufferPrivate *_priv;
 
 			FLAME_GRAPHICS_EXPORTS void begin(bool once = false);
+			// a secondary command buffer that is executed inside the subpass of r, f may be null when not known yet
+			FLAME_GRAPHICS_EXPORTS void begin_secondary(Renderpass *r, int subpass, Framebuffer *f, bool once = true);
 
-			FLAME_GRAPHICS_EXPORTS void begin_renderpass(Renderpass *r, Framebuffer *f);
+			// with secondaries, the content of the renderpass comes only from execute_secondaries
+			FLAME_GRAPHICS_EXPORTS void begin_renderpass(Renderpass *r, Framebuffer *f, bool secondaries = false);
 			FLAME_GRAPHICS_EXPORTS void end_renderpass();
 			FLAME_GRAPHICS_EXPORTS void set_viewport(const Ivec2 &pos, const Ivec2 &size);
 			FLAME_GRAPHICS_EXPORTS void set_scissor(const Ivec2 &pos, const Ivec2 &size);
 			FLAME_GRAPHICS_EXPORTS void bind_pipeline(Pipeline *p);
-			FLAME_GRAPHICS_EXPORTS void bind_descriptorset(Descriptorset *s);
-			FLAME_GRAPHICS_EXPORTS void bind_vertexbuffer(Buffer *b);
-			FLAME_GRAPHICS_EXPORTS void bind_indexbuffer(Buffer *b, IndiceType t);
+			FLAME_GRAPHICS_EXPORTS void bind_descriptorset(Descriptorset *s, int index = 0);
+			FLAME_GRAPHICS_EXPORTS void bind_vertexbuffer(Buffer *b, int offset = 0);
+			FLAME_GRAPHICS_EXPORTS void bind_indexbuffer(Buffer *b, IndiceType t, int offset = 0);
 			FLAME_GRAPHICS_EXPORTS void push_constant(int shader_stage, int offset, int size, void *data);
 			FLAME_GRAPHICS_EXPORTS void draw(int count, int instance_count, int first_instance);
 			FLAME_GRAPHICS_EXPORTS void draw_indexed(int count, int first_index, int vertex_offset, int instance_count, int first_instance);
 			FLAME_GRAPHICS_EXPORTS void dispatch(const Ivec3 &v);
+			FLAME_GRAPHICS_EXPORTS void execute_secondaries(int count, Commandbuffer **cbs);
 
 			FLAME_GRAPHICS_EXPORTS void copy_buffer(Buffer *src, Buffer *dst, int copy_count, BufferCopy *copies);
 			FLAME_GRAPHICS_EXPORTS void change_texture_layout(Texture *t, TextureLayout from, TextureLayout to,
 				int base_level = 0, int level_count = 0, int base_layer = 0, int layer_count = 0);
 			FLAME_GRAPHICS_EXPORTS void copy_buffer_to_image(Buffer *src, Texture *dst, int copy_count, BufferImageCopy *copies);
 
+			// reset must be outside of a renderpass, before the queries are written again
+			FLAME_GRAPHICS_EXPORTS void reset_querypool(Querypool *q, int first, int count);
+			FLAME_GRAPHICS_EXPORTS void write_timestamp(Querypool *q, int index, bool top_of_pipe = false);
+
 			FLAME_GRAPHICS_EXPORTS void end();
 		};
 
@@ -87,9 +96,11 @@ namespace flame
 
 			FLAME_GRAPHICS_EXPORTS  Commandbuffer* create_commandbuffer(bool sub = false);
 			FLAME_GRAPHICS_EXPORTS  void destroy_commandbuffer(Commandbuffer *c);
+			// all the command buffers of the pool go back to the initial state, none may be in use by the gpu
+			FLAME_GRAPHICS_EXPORTS  void reset();
 		};
 
-		FLAME_GRAPHICS_EXPORTS Commandpool *create_commandpool(Device *d);
+		FLAME_GRAPHICS_EXPORTS Commandpool *create_commandpool(Device *d, int queue_family = 0);
 		FLAME_GRAPHICS_EXPORTS void destroy_commandpool(Device *d, Commandpool *p);
 	}
 }
@@ -22,6 +22,7 @@
 
 #include "device.h"
 #include "graphics_private.h"
+#include "memory_private.h"
 
 #include <flame/type.h>
 
@@ -38,6 +39,11 @@ namespace flame
 			VkPhysicalDeviceFeatures physical_device_features; 
 			VkPhysicalDeviceMemoryProperties mem_properties;
 			VkDevice device;
+			VkPipelineCache pipeline_cache;
+
+			MemoryAllocator *mem_allocator;
+			TransientRing transient_ring;
+			int max_update_after_bind_sampled_images; // in a set and in a stage, 0 without descriptor indexing
 
 			inline int find_memory_type(uint typeFilter, VkMemoryPropertyFlags properties)
 			{
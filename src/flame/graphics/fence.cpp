@@ -0,0 +1,72 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "device_private.h"
+#include "fence_private.h"
+
+namespace flame
+{
+	namespace graphics
+	{
+#if defined(FLAME_GRAPHICS_VULKAN)
+		bool Fence::signaled()
+		{
+			return vkGetFenceStatus(_priv->d->_priv->device, _priv->v) == VK_SUCCESS;
+		}
+
+		void Fence::wait()
+		{
+			vk_chk_res(vkWaitForFences(_priv->d->_priv->device, 1, &_priv->v, true, UINT64_MAX));
+		}
+
+		void Fence::reset()
+		{
+			vk_chk_res(vkResetFences(_priv->d->_priv->device, 1, &_priv->v));
+		}
+
+		Fence *create_fence(Device *d, bool signaled)
+		{
+			auto f = new Fence;
+			f->_priv = new FencePrivate;
+			f->_priv->d = d;
+
+			VkFenceCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			info.flags = signaled ? VK_FENCE_CREATE_SIGNALED_BIT : 0;
+
+			vk_chk_res(vkCreateFence(d->_priv->device, &info, nullptr, &f->_priv->v));
+
+			return f;
+		}
+
+		void destroy_fence(Device *d, Fence *f)
+		{
+			assert(d == f->_priv->d);
+
+			vkDestroyFence(d->_priv->device, f->_priv->v, nullptr);
+
+			delete f->_priv;
+			delete f;
+		}
+#endif
+	}
+}
@@ -0,0 +1,256 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "device_private.h"
+#include "frame_private.h"
+#include "fence_private.h"
+#include "queue_private.h"
+#include "commandbuffer_private.h"
+#include "semaphore_private.h"
+#include "record_passes.h"
+
+#include <flame/time.h>
+#include <flame/jobs.h>
+
+#include <algorithm>
+
+namespace flame
+{
+	namespace graphics
+	{
+#if defined(FLAME_GRAPHICS_VULKAN)
+		static void run_deferred(FrameSlot &s)
+		{
+			for (auto &f : s.deferred)
+				f();
+			s.deferred.clear();
+		}
+
+		void Framecontext::begin_frame()
+		{
+			auto t0 = get_now_ns();
+			auto frame_time = _priv->begin_time ? t0 - _priv->begin_time : 0;
+			_priv->begin_time = t0;
+
+			frame++;
+			index = frame % frame_count;
+			auto &s = _priv->slots[index];
+			s.fence->wait();
+			s.fence->reset();
+
+			auto t1 = get_now_ns();
+			_priv->work_begin_time = t1;
+			if (frame_time > 0)
+			{
+				// smoothed over some frames
+				const auto k = 0.1f;
+				auto &st = _priv->stats;
+				st.wait_ms += ((t1 - t0) / 1000000.f - st.wait_ms) * k;
+				st.frame_ms += (frame_time / 1000000.f - st.frame_ms) * k;
+				st.overlap = st.frame_ms > 0.f ? 1.f - std::min(st.wait_ms / st.frame_ms, 1.f) : 0.f;
+			}
+
+			run_deferred(s);
+			s.cp->reset();
+			s.used_cb_count = 0;
+			for (auto &w : s.workers)
+			{
+				w.cp->reset();
+				w.used_cb_count = 0;
+			}
+			_priv->record_time = 0;
+			_priv->record_work_time = 0;
+			begin_transient_frame(_priv->d, index);
+
+			cp = s.cp;
+			image_available = s.image_available;
+			render_finished = s.render_finished;
+		}
+
+		Commandbuffer *Framecontext::get_commandbuffer()
+		{
+			auto &s = _priv->slots[index];
+			if (s.used_cb_count == s.cbs.size())
+				s.cbs.push_back(s.cp->create_commandbuffer());
+			return s.cbs[s.used_cb_count++];
+		}
+
+		void Framecontext::record_passes(Commandbuffer *primary, JobSystem *js, int pass_count, RecordPass *passes, int grain)
+		{
+			auto t0 = get_now_ns();
+
+			auto &s = _priv->slots[index];
+			auto worker_count = js->get_worker_count() + 1;
+			while (s.workers.size() < worker_count)
+			{
+				FrameWorker w;
+				w.cp = create_commandpool(_priv->d, _priv->d->q->_priv->family);
+				w.used_cb_count = 0;
+				s.workers.push_back(w);
+			}
+
+			_priv->record_work_time += record_pass_chunks<Commandbuffer>(js, pass_count, passes, grain, [&](int worker, RecordPass &p) {
+				auto &w = s.workers[worker];
+				if (w.used_cb_count == w.cbs.size())
+					w.cbs.push_back(w.cp->create_commandbuffer(true));
+				auto cb = w.cbs[w.used_cb_count++];
+				cb->begin_secondary(p.renderpass, 0, p.framebuffer);
+				return cb;
+			}, [&](int i, int cb_count, Commandbuffer **cbs) {
+				primary->begin_renderpass(passes[i].renderpass, passes[i].framebuffer, true);
+				primary->execute_secondaries(cb_count, cbs);
+				primary->end_renderpass();
+			});
+
+			_priv->record_time += get_now_ns() - t0;
+		}
+
+		void Framecontext::add_submit(Commandbuffer *c, Semaphore *wait_semaphore, Semaphore *signal_semaphore)
+		{
+			auto &batches = _priv->batches;
+			// a wait must come before the batch's command buffers, a signal after all of them
+			if (batches.empty() || !batches.back().signals.empty() || (wait_semaphore && !batches.back().cbs.empty()))
+				batches.emplace_back();
+			auto &b = batches.back();
+			if (wait_semaphore)
+			{
+				b.waits.push_back(wait_semaphore->_priv->v);
+				b.wait_stages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+			}
+			b.cbs.push_back(c->_priv->v);
+			if (signal_semaphore)
+				b.signals.push_back(signal_semaphore->_priv->v);
+		}
+
+		void Framecontext::defer(const std::function<void()> &f)
+		{
+			_priv->slots[index].deferred.push_back(f);
+		}
+
+		void Framecontext::end_frame(Queue *q)
+		{
+			auto &batches = _priv->batches;
+			std::vector<VkSubmitInfo> infos(batches.size());
+			for (auto i = 0; i < batches.size(); i++)
+			{
+				auto &b = batches[i];
+				auto &info = infos[i];
+				info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+				info.pNext = nullptr;
+				info.waitSemaphoreCount = b.waits.size();
+				info.pWaitSemaphores = b.waits.data();
+				info.pWaitDstStageMask = b.wait_stages.data();
+				info.commandBufferCount = b.cbs.size();
+				info.pCommandBuffers = b.cbs.data();
+				info.signalSemaphoreCount = b.signals.size();
+				info.pSignalSemaphores = b.signals.data();
+			}
+
+			{
+				// with nothing to submit the fence still gets signaled
+				std::lock_guard<std::mutex> lock(q->_priv->mtx);
+				vk_chk_res(vkQueueSubmit(q->_priv->v, infos.size(), infos.data(), _priv->slots[index].fence->_priv->v));
+			}
+			batches.clear();
+
+			auto &st = _priv->stats;
+			st.cpu_ms += ((get_now_ns() - _priv->work_begin_time) / 1000000.f - st.cpu_ms) * 0.1f;
+			st.record_ms += (_priv->record_time / 1000000.f - st.record_ms) * 0.1f;
+			st.record_work_ms += (_priv->record_work_time.load() / 1000000.f - st.record_work_ms) * 0.1f;
+		}
+
+		void Framecontext::wait_all()
+		{
+			for (auto &s : _priv->slots)
+			{
+				s.fence->wait();
+				run_deferred(s);
+			}
+		}
+
+		void Framecontext::get_stats(FrameStats *out)
+		{
+			*out = _priv->stats;
+		}
+
+		Framecontext *create_framecontext(Device *d, int frame_count)
+		{
+			auto f = new Framecontext;
+			f->frame_count = frame_count;
+			f->frame = 0;
+			f->index = 0;
+			f->_priv = new FramecontextPrivate;
+			f->_priv->d = d;
+			f->_priv->begin_time = 0;
+			f->_priv->work_begin_time = 0;
+			f->_priv->record_time = 0;
+			f->_priv->record_work_time = 0;
+			f->_priv->stats = {};
+
+			f->_priv->slots.resize(frame_count);
+			for (auto &s : f->_priv->slots)
+			{
+				s.fence = create_fence(d, true); // nothing to wait for the first time around
+				s.cp = create_commandpool(d, d->q->_priv->family);
+				s.used_cb_count = 0;
+				s.image_available = create_semaphore(d);
+				s.render_finished = create_semaphore(d);
+			}
+			f->cp = f->_priv->slots[0].cp;
+			f->image_available = f->_priv->slots[0].image_available;
+			f->render_finished = f->_priv->slots[0].render_finished;
+
+			// a slice of the transient ring for each frame in flight
+			auto &r = d->_priv->transient_ring;
+			if (r.frame_count < frame_count)
+				set_transient_ring_size(d, frame_count, r.frame_size);
+
+			return f;
+		}
+
+		void destroy_framecontext(Device *d, Framecontext *f)
+		{
+			assert(d == f->_priv->d);
+
+			f->wait_all();
+			for (auto &s : f->_priv->slots)
+			{
+				for (auto c : s.cbs)
+					s.cp->destroy_commandbuffer(c);
+				destroy_commandpool(d, s.cp);
+				for (auto &w : s.workers)
+				{
+					for (auto c : w.cbs)
+						w.cp->destroy_commandbuffer(c);
+					destroy_commandpool(d, w.cp);
+				}
+				destroy_fence(d, s.fence);
+				destroy_semaphore(d, s.image_available);
+				destroy_semaphore(d, s.render_finished);
+			}
+
+			delete f->_priv;
+			delete f;
+		}
+#endif
+	}
+}
@@ -0,0 +1,99 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include "graphics.h"
+
+namespace flame
+{
+	struct JobSystem;
+
+	namespace graphics
+	{
+		struct Device;
+		struct Queue;
+		struct Commandpool;
+		struct Commandbuffer;
+		struct Semaphore;
+		struct Renderpass;
+		struct Framebuffer;
+
+		struct FramecontextPrivate;
+
+		struct FrameStats
+		{
+			float cpu_ms; // from begin_frame to end_frame, without the wait
+			float wait_ms; // begin_frame waiting for the gpu to finish the frame that used the slot before
+			float frame_ms; // from a begin_frame to the next
+			float overlap; // the part of a frame the cpu worked instead of waiting for the gpu
+			float record_ms; // in record_passes, from the start to the last secondary
+			float record_work_ms; // the recording time of all secondaries, over record_ms is the speedup of the threads
+		};
+
+		// the items of a pass are split into chunks of at most grain, each is recorded into a secondary command buffer,
+		// which starts with nothing bound and no viewport or scissor set
+		struct RecordPass
+		{
+			Renderpass *renderpass;
+			Framebuffer *framebuffer;
+			int item_count;
+			std::function<void(Commandbuffer *cb, int begin, int end)> record;
+		};
+
+		// frame_count frames in flight: a frame waits only for the gpu to finish the frame frame_count frames ago,
+		// each slot has a fence, a command pool, the semaphores for the swapchain and a slice of the device's
+		// transient ring (allocate_transient), that the gpu is surely done with when the frame begins
+		struct Framecontext
+		{
+			int frame_count;
+			int index; // the slot of the current frame
+			unsigned long long frame; // counts the frames
+
+			// of the current frame
+			Commandpool *cp; // reset every time the slot comes around
+			Semaphore *image_available; // for Swapchain::acquire_image
+			Semaphore *render_finished; // for Queue::present
+
+			FramecontextPrivate *_priv;
+
+			FLAME_GRAPHICS_EXPORTS void begin_frame();
+			// a primary command buffer of this frame's pool, good until the slot comes around again
+			FLAME_GRAPHICS_EXPORTS Commandbuffer *get_commandbuffer();
+			// the chunks of all passes are recorded at the same time on the workers of js, every worker has command pools
+			// of its own, then primary gets the passes in order, each in a renderpass that executes its secondaries
+			FLAME_GRAPHICS_EXPORTS void record_passes(Commandbuffer *primary, JobSystem *js, int pass_count, RecordPass *passes, int grain = 64);
+			// in order, all go in the one vkQueueSubmit of end_frame
+			FLAME_GRAPHICS_EXPORTS void add_submit(Commandbuffer *c, Semaphore *wait_semaphore = nullptr, Semaphore *signal_semaphore = nullptr);
+			// runs when the gpu finished this frame (e.g. destroy what the frame's commands use)
+			FLAME_GRAPHICS_EXPORTS void defer(const std::function<void()> &f);
+			FLAME_GRAPHICS_EXPORTS void end_frame(Queue *q);
+			// waits for all frames in flight and runs their deferred work
+			FLAME_GRAPHICS_EXPORTS void wait_all();
+
+			FLAME_GRAPHICS_EXPORTS void get_stats(FrameStats *out);
+		};
+
+		FLAME_GRAPHICS_EXPORTS Framecontext *create_framecontext(Device *d, int frame_count = 2);
+		FLAME_GRAPHICS_EXPORTS void destroy_framecontext(Device *d, Framecontext *f);
+	}
+}
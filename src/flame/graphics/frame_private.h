@@ -0,0 +1,79 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include "frame.h"
+#include "graphics_private.h"
+
+#include <vector>
+#include <atomic>
+
+namespace flame
+{
+	namespace graphics
+	{
+		struct Fence;
+
+#if defined(FLAME_GRAPHICS_VULKAN)
+		// a pool is used by one thread only, so recording needs no lock
+		struct FrameWorker
+		{
+			Commandpool *cp;
+			std::vector<Commandbuffer*> cbs; // secondaries
+			int used_cb_count;
+		};
+
+		struct FrameSlot
+		{
+			Fence *fence;
+			Commandpool *cp;
+			std::vector<Commandbuffer*> cbs;
+			int used_cb_count;
+			std::vector<FrameWorker> workers; // the first for a thread that is not a worker
+			Semaphore *image_available;
+			Semaphore *render_finished;
+			std::vector<std::function<void()>> deferred;
+		};
+
+		struct FrameSubmitBatch
+		{
+			std::vector<VkCommandBuffer> cbs;
+			std::vector<VkSemaphore> waits;
+			std::vector<VkPipelineStageFlags> wait_stages;
+			std::vector<VkSemaphore> signals;
+		};
+
+		struct FramecontextPrivate
+		{
+			Device *d;
+			std::vector<FrameSlot> slots;
+			std::vector<FrameSubmitBatch> batches;
+			long long begin_time;
+			long long work_begin_time; // after the wait
+			long long record_time; // of this frame
+			std::atomic<long long> record_work_time;
+			FrameStats stats;
+		};
+#endif
+	}
+}
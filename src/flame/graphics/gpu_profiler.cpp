@@ -0,0 +1,165 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "gpu_profiler.h"
+#include "commandbuffer.h"
+#include "querypool.h"
+
+#include <flame/profiler.h>
+
+#include <assert.h>
+#include <vector>
+
+namespace flame
+{
+	namespace graphics
+	{
+#if defined(FLAME_GRAPHICS_VULKAN)
+		struct GpuProfilerFrame
+		{
+			Querypool *q; // 0 is the frame's begin, then a begin and an end for each zone
+			unsigned long long frame_index;
+			std::vector<ProfileZone> zones; // begin and end are query indices until read back
+			bool used;
+		};
+
+		struct GpuProfilerPrivate
+		{
+			Device *d;
+			int max_zones;
+			std::vector<GpuProfilerFrame> frames;
+			int curr_frame;
+			std::vector<int> stack; // zone indices, -1 for the zones over max_zones
+
+			void read_back(GpuProfilerFrame &f)
+			{
+				f.used = false;
+				if (f.zones.empty())
+					return;
+
+				auto query_count = 1 + f.zones.size() * 2;
+				std::vector<long long> times(query_count);
+				// not ready means the gpu is behind more than frame_lag frames, these zones are lost
+				if (!f.q->get_timestamps(0, query_count, times.data()))
+					return;
+				for (auto &z : f.zones)
+				{
+					z.begin = times[z.begin] - times[0];
+					z.end = times[z.end] - times[0];
+				}
+				profile_add_gpu_zones(f.frame_index, f.zones.data(), f.zones.size());
+			}
+		};
+
+		void GpuProfiler::begin_frame(Commandbuffer *cb)
+		{
+			_priv->curr_frame = (_priv->curr_frame + 1) % _priv->frames.size();
+			auto &f = _priv->frames[_priv->curr_frame];
+			if (f.used)
+				_priv->read_back(f);
+
+			f.used = true;
+			f.frame_index = profile_get_frame_index();
+			f.zones.clear();
+			_priv->stack.clear();
+			cb->reset_querypool(f.q, 0, f.q->count);
+			cb->write_timestamp(f.q, 0, true);
+		}
+
+		void GpuProfiler::begin_zone(Commandbuffer *cb, unsigned int hash, const char *name)
+		{
+			auto &f = _priv->frames[_priv->curr_frame];
+			if (!f.used || f.zones.size() >= _priv->max_zones)
+			{
+				_priv->stack.push_back(-1);
+				return;
+			}
+
+			auto index = (int)f.zones.size();
+			ProfileZone z;
+			z.hash = hash;
+			z.name = name;
+			z.begin = 1 + index * 2;
+			z.end = z.begin + 1;
+			z.depth = _priv->stack.size();
+			z.thread = ProfileGpuThread;
+			f.zones.push_back(z);
+			_priv->stack.push_back(index);
+			cb->write_timestamp(f.q, z.begin, true);
+		}
+
+		void GpuProfiler::end_zone(Commandbuffer *cb)
+		{
+			assert(!_priv->stack.empty());
+			if (_priv->stack.empty())
+				return;
+			auto index = _priv->stack.back();
+			_priv->stack.pop_back();
+			if (index == -1)
+				return;
+			auto &f = _priv->frames[_priv->curr_frame];
+			cb->write_timestamp(f.q, f.zones[index].end);
+		}
+
+		void GpuProfiler::begin_renderpass(Commandbuffer *cb, unsigned int hash, const char *name, Renderpass *r, Framebuffer *f)
+		{
+			begin_zone(cb, hash, name);
+			cb->begin_renderpass(r, f);
+		}
+
+		void GpuProfiler::end_renderpass(Commandbuffer *cb)
+		{
+			cb->end_renderpass();
+			end_zone(cb);
+		}
+
+		GpuProfiler *create_gpu_profiler(Device *d, int frame_lag, int max_zones)
+		{
+			auto p = new GpuProfiler;
+			p->_priv = new GpuProfilerPrivate;
+			p->_priv->d = d;
+			p->_priv->max_zones = max_zones;
+			p->_priv->frames.resize(frame_lag);
+			for (auto &f : p->_priv->frames)
+			{
+				f.q = create_querypool(d, 1 + max_zones * 2);
+				f.frame_index = 0;
+				f.used = false;
+			}
+			p->_priv->curr_frame = 0;
+
+			return p;
+		}
+
+		void destroy_gpu_profiler(Device *d, GpuProfiler *p)
+		{
+			assert(d == p->_priv->d);
+
+			for (auto &f : p->_priv->frames)
+				destroy_querypool(d, f.q);
+
+			delete p->_priv;
+			delete p;
+		}
+#endif
+	}
+}
@@ -0,0 +1,57 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include "graphics.h"
+
+namespace flame
+{
+	namespace graphics
+	{
+		struct Device;
+		struct Commandbuffer;
+		struct Renderpass;
+		struct Framebuffer;
+
+		struct GpuProfilerPrivate;
+
+		// timestamp zones of the gpu work of a frame, read back frame_lag frames later (when the gpu
+		// surely finished them) and added to the profiler's history (flame/profiler.h)
+		// zones go in the command buffers in submit order, the names are string literals
+		struct GpuProfiler
+		{
+			GpuProfilerPrivate *_priv;
+
+			// the first thing of the frame's first command buffer, outside of a renderpass
+			FLAME_GRAPHICS_EXPORTS void begin_frame(Commandbuffer *cb);
+			FLAME_GRAPHICS_EXPORTS void begin_zone(Commandbuffer *cb, unsigned int hash, const char *name);
+			FLAME_GRAPHICS_EXPORTS void end_zone(Commandbuffer *cb);
+			// a zone around the renderpass
+			FLAME_GRAPHICS_EXPORTS void begin_renderpass(Commandbuffer *cb, unsigned int hash, const char *name, Renderpass *r, Framebuffer *f);
+			FLAME_GRAPHICS_EXPORTS void end_renderpass(Commandbuffer *cb);
+		};
+
+		FLAME_GRAPHICS_EXPORTS GpuProfiler *create_gpu_profiler(Device *d, int frame_lag = 3, int max_zones = 256);
+		FLAME_GRAPHICS_EXPORTS void destroy_gpu_profiler(Device *d, GpuProfiler *p);
+	}
+}
@@ -56,7 +56,13 @@ namespace flame
 			Format_Swapchain_End = Format_Swapchain_B8G8R8A8_SRGB,
 			Format_R16G16B16A16_UNORM,
 			Format_R16G16B16A16_UNSCALED,
+			Format_RGBA_BC1,
+			Format_RGBA_BC1_SRGB,
 			Format_RGBA_BC3,
+			Format_RGBA_BC3_SRGB,
+			Format_RG_BC5,
+			Format_RGBA_BC7,
+			Format_RGBA_BC7_SRGB,
 			Format_RGBA_ETC2,
 			Format_Color_Begin = Format_R8_UNORM,
 			Format_Color_End = Format_RGBA_ETC2,
@@ -190,6 +196,7 @@ namespace flame
 
 		enum MaterialDescriptorSetBindings
 		{
+			MaterialDrawBufferDescriptorBinding,
 			MaterialBufferDescriptorBinding,
 			MaterialImagesDescriptorBinding
 		};
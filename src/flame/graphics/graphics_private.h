@@ -74,8 +74,20 @@ namespace flame
 					return VK_FORMAT_R16G16B16A16_UNORM;
 				case Format_R16G16B16A16_UNSCALED:
 					return VK_FORMAT_R16G16B16A16_SFLOAT;
+				case Format_RGBA_BC1:
+					return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+				case Format_RGBA_BC1_SRGB:
+					return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
 				case Format_RGBA_BC3:
 					return VK_FORMAT_BC3_UNORM_BLOCK;
+				case Format_RGBA_BC3_SRGB:
+					return VK_FORMAT_BC3_SRGB_BLOCK;
+				case Format_RG_BC5:
+					return VK_FORMAT_BC5_UNORM_BLOCK;
+				case Format_RGBA_BC7:
+					return VK_FORMAT_BC7_UNORM_BLOCK;
+				case Format_RGBA_BC7_SRGB:
+					return VK_FORMAT_BC7_SRGB_BLOCK;
 				case Format_RGBA_ETC2:
 					return VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK;
 
@@ -0,0 +1,378 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "memory_private.h"
+#include "device_private.h"
+#include "buffer_private.h"
+
+#include <algorithm>
+
+namespace flame
+{
+	namespace graphics
+	{
+#if defined(FLAME_GRAPHICS_VULKAN)
+		MemoryAllocator::MemoryAllocator(Device *_d) :
+			d(_d),
+			allocation_count(0)
+		{
+			auto &mem_properties = d->_priv->mem_properties;
+			for (auto i = 0; i < mem_properties.memoryTypeCount; i++)
+			{
+				// 64MB blocks, but small heaps (e.g. the 256MB host visible device local heap) use 1/8 of the heap
+				auto heap_size = (long long)mem_properties.memoryHeaps[mem_properties.memoryTypes[i].heapIndex].size;
+				auto size = 64LL * 1024 * 1024;
+				if (heap_size / 8 < size)
+					size = heap_size / 8;
+				block_size[i] = size;
+			}
+		}
+
+		MemoryAllocator::~MemoryAllocator()
+		{
+			for (auto i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+			{
+				for (auto j = 0; j < 2; j++)
+				{
+					for (auto b : pools[i][j])
+						destroy_block(b);
+				}
+			}
+			for (auto b : dedicated_blocks)
+				destroy_block(b);
+		}
+
+		MemoryBlock *MemoryAllocator::create_block(int type_index, long long size, bool is_image, bool dedicated)
+		{
+			VkMemoryAllocateInfo alloc_info;
+			alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			alloc_info.pNext = nullptr;
+			alloc_info.allocationSize = size;
+			alloc_info.memoryTypeIndex = type_index;
+
+			VkDeviceMemory m;
+			if (vkAllocateMemory(d->_priv->device, &alloc_info, nullptr, &m) != VK_SUCCESS)
+				return nullptr;
+
+			auto b = new MemoryBlock;
+			b->m = m;
+			b->size = size;
+			b->type_index = type_index;
+			b->is_image = is_image;
+			b->dedicated = dedicated;
+			b->ranges.reset(size);
+			b->mapped = nullptr;
+			b->map_count = 0;
+			return b;
+		}
+
+		void MemoryAllocator::destroy_block(MemoryBlock *b)
+		{
+			if (b->mapped)
+				vkUnmapMemory(d->_priv->device, b->m);
+			vkFreeMemory(d->_priv->device, b->m, nullptr);
+			delete b;
+		}
+
+		bool MemoryAllocator::allocate(const VkMemoryRequirements &req, VkMemoryPropertyFlags props, bool is_image, MemoryAllocation &out)
+		{
+			auto type_index = d->_priv->find_memory_type(req.memoryTypeBits, props);
+			if (type_index == -1)
+				return false;
+
+			std::lock_guard<std::mutex> lock(mtx);
+
+			long long size = req.size;
+			long long alignment = req.alignment > 0 ? req.alignment : 1;
+
+			// big resources get their own allocation, they would only waste the blocks
+			if (size > block_size[type_index] / 2)
+			{
+				auto b = create_block(type_index, size, is_image, true);
+				if (!b)
+					return false;
+				b->ranges.allocate(size);
+				dedicated_blocks.push_back(b);
+				allocation_count++;
+
+				out.block = b;
+				out.offset = 0;
+				out.size = size;
+				return true;
+			}
+
+			auto &pool = pools[type_index][is_image ? 1 : 0];
+			for (auto b : pool)
+			{
+				auto offset = b->ranges.allocate(size, alignment);
+				if (offset != -1)
+				{
+					allocation_count++;
+
+					out.block = b;
+					out.offset = offset;
+					out.size = size;
+					return true;
+				}
+			}
+
+			auto b = create_block(type_index, block_size[type_index], is_image, false);
+			if (!b)
+				return false;
+			pool.push_back(b);
+			allocation_count++;
+
+			out.block = b;
+			out.offset = b->ranges.allocate(size, alignment);
+			out.size = size;
+			return true;
+		}
+
+		void MemoryAllocator::free(MemoryAllocation &a)
+		{
+			auto b = a.block;
+			if (!b)
+				return;
+
+			std::lock_guard<std::mutex> lock(mtx);
+
+			allocation_count--;
+			a.block = nullptr;
+
+			if (b->dedicated)
+			{
+				for (auto it = dedicated_blocks.begin(); it != dedicated_blocks.end(); it++)
+				{
+					if (*it == b)
+					{
+						dedicated_blocks.erase(it);
+						break;
+					}
+				}
+				destroy_block(b);
+				return;
+			}
+
+			b->ranges.free(a.offset, a.size);
+
+			// keep one empty block per pool around, so a create/destroy pattern will not hit the driver every time
+			if (b->ranges.get_used() == 0)
+			{
+				auto &pool = pools[b->type_index][b->is_image ? 1 : 0];
+				auto empty_count = 0;
+				for (auto _b : pool)
+				{
+					if (_b->ranges.get_used() == 0)
+						empty_count++;
+				}
+				if (empty_count > 1)
+				{
+					for (auto it = pool.begin(); it != pool.end(); it++)
+					{
+						if (*it == b)
+						{
+							pool.erase(it);
+							break;
+						}
+					}
+					destroy_block(b);
+				}
+			}
+		}
+
+		// a memory object can only be mapped once, so the whole block is mapped and the allocations share it
+		void *MemoryAllocator::map(MemoryAllocation &a)
+		{
+			auto b = a.block;
+
+			std::lock_guard<std::mutex> lock(mtx);
+
+			if (!b->mapped)
+				vk_chk_res(vkMapMemory(d->_priv->device, b->m, 0, VK_WHOLE_SIZE, 0, &b->mapped));
+			b->map_count++;
+			return (char*)b->mapped + a.offset;
+		}
+
+		void MemoryAllocator::unmap(MemoryAllocation &a)
+		{
+			auto b = a.block;
+
+			std::lock_guard<std::mutex> lock(mtx);
+
+			b->map_count--;
+			if (b->map_count == 0)
+			{
+				vkUnmapMemory(d->_priv->device, b->m);
+				b->mapped = nullptr;
+			}
+		}
+
+		void MemoryAllocator::flush(MemoryAllocation &a)
+		{
+			long long atom = d->_priv->physical_device_properties.limits.nonCoherentAtomSize;
+			if (atom < 1)
+				atom = 1;
+			auto begin = a.offset / atom * atom;
+			auto end = (a.offset + a.size + atom - 1) / atom * atom;
+			if (end > a.block->size)
+				end = a.block->size;
+
+			VkMappedMemoryRange range;
+			range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			range.pNext = nullptr;
+			range.memory = a.block->m;
+			range.offset = begin;
+			range.size = end - begin;
+			vk_chk_res(vkFlushMappedMemoryRanges(d->_priv->device, 1, &range));
+		}
+
+		void MemoryAllocator::get_stats(MemoryStats *s)
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+
+			s->bytes_reserved = 0;
+			s->bytes_used = 0;
+			s->block_count = 0;
+			s->dedicated_count = dedicated_blocks.size();
+			s->allocation_count = allocation_count;
+
+			long long free = 0;
+			long long largest_free = 0;
+			for (auto i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+			{
+				for (auto j = 0; j < 2; j++)
+				{
+					for (auto b : pools[i][j])
+					{
+						s->bytes_reserved += b->size;
+						s->bytes_used += b->ranges.get_used();
+						s->block_count++;
+						free += b->size - b->ranges.get_used();
+						auto l = b->ranges.get_largest_free_range();
+						if (l > largest_free)
+							largest_free = l;
+					}
+				}
+			}
+			for (auto b : dedicated_blocks)
+			{
+				s->bytes_reserved += b->size;
+				s->bytes_used += b->size;
+			}
+
+			s->fragmentation = free > 0 ? 1.f - (float)largest_free / free : 0.f;
+		}
+
+		void get_memory_stats(Device *d, MemoryStats *stats)
+		{
+			d->_priv->mem_allocator->get_stats(stats);
+		}
+
+		static Buffer *create_transient_buffer(Device *d, int size)
+		{
+			auto b = create_buffer(d, size, BufferUsageTransferSrc | BufferUsageUniformBuffer |
+				BufferUsageStorageBuffer | BufferUsageVertexBuffer | BufferUsageIndexBuffer | BufferUsageIndirectBuffer,
+				MemPropHost | MemPropHostCoherent);
+			if (b)
+				b->map();
+			return b;
+		}
+
+		static void release_transient_overflows(Device *d, std::vector<Buffer*> &overflows)
+		{
+			for (auto b : overflows)
+				destroy_buffer(d, b);
+			overflows.clear();
+		}
+
+		void set_transient_ring_size(Device *d, int frame_count, int frame_size)
+		{
+			auto &r = d->_priv->transient_ring;
+			if (r.buffer)
+			{
+				destroy_buffer(d, r.buffer);
+				r.buffer = nullptr;
+			}
+			for (auto &o : r.overflows)
+				release_transient_overflows(d, o);
+			r.overflows.resize(frame_count);
+			r.overflow_cursor = 0;
+			r.frame_count = frame_count;
+			r.frame_size = frame_size;
+			r.frame = 0;
+			r.cursor = 0;
+			r.end = frame_size;
+		}
+
+		void begin_transient_frame(Device *d, int frame)
+		{
+			auto &r = d->_priv->transient_ring;
+			r.frame = frame % r.frame_count;
+			r.cursor = r.frame * r.frame_size;
+			r.end = r.cursor + r.frame_size;
+			release_transient_overflows(d, r.overflows[r.frame]);
+			r.overflow_cursor = 0;
+		}
+
+		bool allocate_transient(Device *d, int size, int alignment, TransientRange *out)
+		{
+			auto &r = d->_priv->transient_ring;
+			if (!r.buffer)
+			{
+				r.buffer = create_transient_buffer(d, r.frame_count * r.frame_size);
+				if (!r.buffer)
+					return false;
+			}
+
+			if (alignment < 1)
+				alignment = 1;
+			auto offset = (r.cursor + alignment - 1) / alignment * alignment;
+			if (offset + size <= r.end)
+			{
+				r.cursor = offset + size;
+				out->buffer = r.buffer;
+				out->offset = offset;
+				out->mapped = (char*)r.buffer->mapped + offset;
+				return true;
+			}
+
+			// the slice is full, it grows by another buffer that lives as long as the slice's frame
+			auto &overflows = r.overflows[r.frame];
+			offset = (r.overflow_cursor + alignment - 1) / alignment * alignment;
+			if (overflows.empty() || offset + size > overflows.back()->size)
+			{
+				auto b = create_transient_buffer(d, std::max(size, r.frame_size));
+				if (!b)
+					return false;
+				overflows.push_back(b);
+				offset = 0;
+			}
+			auto b = overflows.back();
+			r.overflow_cursor = offset + size;
+			out->buffer = b;
+			out->offset = offset;
+			out->mapped = (char*)b->mapped + offset;
+			return true;
+		}
+#endif
+	}
+}
@@ -0,0 +1,102 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include "graphics_private.h"
+
+#include <flame/range_allocator.h>
+
+#include <vector>
+#include <mutex>
+
+namespace flame
+{
+	namespace graphics
+	{
+#if defined(FLAME_GRAPHICS_VULKAN)
+		struct Device;
+		struct Buffer;
+		struct MemoryStats;
+
+		struct MemoryBlock
+		{
+			VkDeviceMemory m;
+			long long size;
+			int type_index;
+			bool is_image;
+			bool dedicated;
+			RangeAllocator ranges;
+			void *mapped;
+			int map_count;
+		};
+
+		struct MemoryAllocation
+		{
+			MemoryBlock *block;
+			long long offset;
+			long long size;
+		};
+
+		// sub-allocate device memory from large blocks, every memory type has two pools,
+		// one for buffers and one for images, so we never need to care about bufferImageGranularity
+		struct MemoryAllocator
+		{
+			Device *d;
+			long long block_size[VK_MAX_MEMORY_TYPES];
+			std::vector<MemoryBlock*> pools[VK_MAX_MEMORY_TYPES][2];
+			std::vector<MemoryBlock*> dedicated_blocks;
+			int allocation_count;
+			std::mutex mtx;
+
+			MemoryAllocator(Device *d);
+			~MemoryAllocator();
+
+			bool allocate(const VkMemoryRequirements &req, VkMemoryPropertyFlags props, bool is_image, MemoryAllocation &out);
+			void free(MemoryAllocation &a);
+			void *map(MemoryAllocation &a);
+			void unmap(MemoryAllocation &a);
+			void flush(MemoryAllocation &a);
+			void get_stats(MemoryStats *s);
+
+		private:
+			MemoryBlock *create_block(int type_index, long long size, bool is_image, bool dedicated);
+			void destroy_block(MemoryBlock *b);
+		};
+
+		// a host visible buffer split into per-frame slices, allocations within a frame are linear,
+		// a slice is reused when its frame index comes around again
+		struct TransientRing
+		{
+			Buffer *buffer;
+			int frame_count;
+			int frame_size;
+			int frame;
+			int cursor;
+			int end;
+			// per slice, the buffers that it grew by when it was full, released when the slice comes around again
+			std::vector<std::vector<Buffer*>> overflows;
+			int overflow_cursor; // in the last overflow buffer of the current slice
+		};
+#endif
+	}
+}
@@ -26,6 +26,10 @@
 #include "renderpass_private.h"
 #include "descriptor_private.h"
 
+#include <flame/filesystem.h>
+
+#include <chrono>
+
 namespace flame
 {
 	namespace graphics
@@ -222,45 +226,45 @@ namespace flame
 			_priv->shaders.emplace_back(s);
 		}
 
-		void Pipeline::build_graphics()
-		{
 #if defined(FLAME_GRAPHICS_VULKAN)
+		static void _build_graphics(Pipeline *p)
+		{
 			std::vector<VkVertexInputBindingDescription> vk_vertex_input_state_bindings;
 			std::vector<VkVertexInputAttributeDescription> vk_vertex_input_state_attributes;
 			std::vector<VkPipelineColorBlendAttachmentState> vk_blend_attachment_states;
 			std::vector<VkDynamicState> vk_dynamic_states;
 
-			auto cx = _priv->cx, cy = _priv->cy;
+			auto cx = p->_priv->cx, cy = p->_priv->cy;
 
-			if (_priv->cx == 0 && _priv->cy == 0)
+			if (p->_priv->cx == 0 && p->_priv->cy == 0)
 			{
-				if (std::find(_priv->dynamic_states.begin(), _priv->dynamic_states.end(),
-					DynamicStateViewport) == _priv->dynamic_states.end())
-					_priv->dynamic_states.push_back(DynamicStateViewport);
-				if (std::find(_priv->dynamic_states.begin(), _priv->dynamic_states.end(),
-					DynamicStateScissor) == _priv->dynamic_states.end())
-					_priv->dynamic_states.push_back(DynamicStateScissor);
+				if (std::find(p->_priv->dynamic_states.begin(), p->_priv->dynamic_states.end(),
+					DynamicStateViewport) == p->_priv->dynamic_states.end())
+					p->_priv->dynamic_states.push_back(DynamicStateViewport);
+				if (std::find(p->_priv->dynamic_states.begin(), p->_priv->dynamic_states.end(),
+					DynamicStateScissor) == p->_priv->dynamic_states.end())
+					p->_priv->dynamic_states.push_back(DynamicStateScissor);
 			}
 
 			VkPipelineInputAssemblyStateCreateInfo assembly_state;
 			assembly_state.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 			assembly_state.flags = 0;
 			assembly_state.pNext = nullptr;
-			assembly_state.topology = Z(_priv->primitive_topology);
+			assembly_state.topology = Z(p->_priv->primitive_topology);
 			assembly_state.primitiveRestartEnable = VK_FALSE;
 
 			VkPipelineTessellationStateCreateInfo tess_state = {};
 			tess_state.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
 			tess_state.flags = 0;
 			tess_state.pNext = nullptr;
-			tess_state.patchControlPoints = _priv->patch_control_points;
+			tess_state.patchControlPoints = p->_priv->patch_control_points;
 
 			VkPipelineDepthStencilStateCreateInfo depth_stencil_state;
 			depth_stencil_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 			depth_stencil_state.flags = 0;
 			depth_stencil_state.pNext = nullptr;
-			depth_stencil_state.depthTestEnable = _priv->depth_test;
-			depth_stencil_state.depthWriteEnable = _priv->depth_write;
+			depth_stencil_state.depthTestEnable = p->_priv->depth_test;
+			depth_stencil_state.depthWriteEnable = p->_priv->depth_write;
 			depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS;
 			depth_stencil_state.depthBoundsTestEnable = VK_FALSE;
 			depth_stencil_state.minDepthBounds = 0;
@@ -296,10 +300,10 @@ namespace flame
 			raster_state.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 			raster_state.flags = 0;
 			raster_state.pNext = nullptr;
-			raster_state.polygonMode = Z(_priv->polygon_mode);
-			raster_state.cullMode = Z(_priv->cull_mode);
+			raster_state.polygonMode = Z(p->_priv->polygon_mode);
+			raster_state.cullMode = Z(p->_priv->cull_mode);
 			raster_state.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-			raster_state.depthClampEnable = _priv->depth_clamp;
+			raster_state.depthClampEnable = p->_priv->depth_clamp;
 			raster_state.rasterizerDiscardEnable = VK_FALSE;
 			raster_state.lineWidth = 1.f;
 			raster_state.depthBiasEnable = VK_FALSE;
@@ -307,7 +311,7 @@ namespace flame
 			raster_state.depthBiasConstantFactor = 0.f;
 			raster_state.depthBiasSlopeFactor = 0.f;
 
-			for (auto &b : _priv->attachment_blend_states)
+			for (auto &b : p->_priv->attachment_blend_states)
 			{
 				vk_blend_attachment_states.push_back({ b.enable,
 					Z(b.src_color), Z(b.dst_color), VK_BLEND_OP_ADD,
@@ -339,7 +343,7 @@ namespace flame
 			multisample_state.sampleShadingEnable = VK_FALSE;
 			multisample_state.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
-			for (auto &s : _priv->dynamic_states)
+			for (auto &s : p->_priv->dynamic_states)
 				vk_dynamic_states.push_back(Z(s));
 
 			VkPipelineDynamicStateCreateInfo dynamic_state = {};
@@ -352,7 +356,7 @@ namespace flame
 			{
 				auto location = 0;
 				auto binding = 0;
-				for (auto &v : _priv->vertex_attributes)
+				for (auto &v : p->_priv->vertex_attributes)
 				{
 					auto size = 0;
 					for (auto &a : v)
@@ -396,8 +400,6 @@ namespace flame
 				}
 			}
 
-			release();
-
 			VkPipelineVertexInputStateCreateInfo vertex_input_state;
 			vertex_input_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 			vertex_input_state.flags = 0;
@@ -407,7 +409,7 @@ namespace flame
 			vertex_input_state.vertexAttributeDescriptionCount = vk_vertex_input_state_attributes.size();
 			vertex_input_state.pVertexAttributeDescriptions = vk_vertex_input_state_attributes.data();
 
-			auto vk_stage_infos = _priv->get_stage_info_and_build_layout();
+			auto vk_stage_infos = p->_priv->get_stage_info_and_build_layout();
 
 			VkGraphicsPipelineCreateInfo pipeline_info;
 			pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -415,25 +417,37 @@ namespace flame
 			pipeline_info.pNext = nullptr;
 			pipeline_info.basePipelineHandle = 0;
 			pipeline_info.basePipelineIndex = 0;
-			pipeline_info.layout = _priv->pipelinelayout->_priv->v;
+			pipeline_info.layout = p->_priv->pipelinelayout->_priv->v;
 			pipeline_info.stageCount = vk_stage_infos.size();
 			pipeline_info.pStages = vk_stage_infos.data();
 			pipeline_info.pVertexInputState = &vertex_input_state;
 			pipeline_info.pInputAssemblyState = &assembly_state;
-			pipeline_info.pTessellationState = _priv->patch_control_points > 0 ? &tess_state : nullptr;
+			pipeline_info.pTessellationState = p->_priv->patch_control_points > 0 ? &tess_state : nullptr;
 			pipeline_info.pDepthStencilState = &depth_stencil_state;
 			pipeline_info.pViewportState = &viewport_state;
 			pipeline_info.pRasterizationState = &raster_state;
 			pipeline_info.pColorBlendState = &blend_state;
-			pipeline_info.renderPass = _priv->renderpass->_priv->v;
-			pipeline_info.subpass = _priv->subpass_index;
+			pipeline_info.renderPass = p->_priv->renderpass->_priv->v;
+			pipeline_info.subpass = p->_priv->subpass_index;
 			pipeline_info.pMultisampleState = &multisample_state;
 			pipeline_info.pDynamicState = vk_dynamic_states.size() ? &dynamic_state : nullptr;
 
-			vk_chk_res(vkCreateGraphicsPipelines(_priv->d->_priv->device, 0, 1, &pipeline_info, nullptr, &_priv->v));
+			vk_chk_res(vkCreateGraphicsPipelines(p->_priv->d->_priv->device, p->_priv->d->_priv->pipeline_cache, 1, &pipeline_info, nullptr, &p->_priv->v));
+
+			p->type = PipelineGraphics;
+		}
 #endif
+
+		void Pipeline::build_graphics(bool async)
+		{
 			release();
 
+#if defined(FLAME_GRAPHICS_VULKAN)
+			if (async)
+				_priv->build_future = std::async(std::launch::async, _build_graphics, this);
+			else
+				_build_graphics(this);
+#else
 			_priv->v = glCreateProgram();
 			for (auto s : _priv->shaders)
 				glAttachShader(_priv->v, s->_priv->v);
@@ -453,6 +467,7 @@ namespace flame
 			}
 
 			type = PipelineGraphics;
+#endif
 		}
 
 #if defined(FLAME_GRAPHICS_VULKAN)
@@ -502,9 +517,9 @@ namespace flame
 			_priv->dynamic_states = states;
 		}
 
-		void Pipeline::build_compute()
+		static void _build_compute(Pipeline *p)
 		{
-			auto vk_stage_infos = _priv->get_stage_info_and_build_layout();
+			auto vk_stage_infos = p->_priv->get_stage_info_and_build_layout();
 			assert(vk_stage_infos.size() == 1);
 
 			VkComputePipelineCreateInfo pipeline_info;
@@ -513,12 +528,38 @@ namespace flame
 			pipeline_info.pNext = nullptr;
 			pipeline_info.basePipelineHandle = 0;
 			pipeline_info.basePipelineIndex = 0;
-			pipeline_info.layout = _priv->pipelinelayout->_priv->v;
+			pipeline_info.layout = p->_priv->pipelinelayout->_priv->v;
 			pipeline_info.stage = vk_stage_infos[0];
 
-			vk_chk_res(vkCreateComputePipelines(_priv->d->_priv->device, 0, 1, &pipeline_info, nullptr, &_priv->v));
+			vk_chk_res(vkCreateComputePipelines(p->_priv->d->_priv->device, p->_priv->d->_priv->pipeline_cache, 1, &pipeline_info, nullptr, &p->_priv->v));
+
+			p->type = PipelineCompute;
+		}
+
+		void Pipeline::build_compute(bool async)
+		{
+			release();
+
+			if (async)
+				_priv->build_future = std::async(std::launch::async, _build_compute, this);
+			else
+				_build_compute(this);
+		}
+
+		bool Pipeline::is_ready()
+		{
+			if (!_priv->build_future.valid())
+				return true;
+			if (_priv->build_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				return false;
+			_priv->build_future.get();
+			return true;
+		}
 
-			type = PipelineCompute;
+		void Pipeline::wait_ready()
+		{
+			if (_priv->build_future.valid())
+				_priv->build_future.get();
 		}
 #else
 		int Pipeline::get_uniform_location(const char *name)
@@ -535,6 +576,8 @@ namespace flame
 		void Pipeline::release()
 		{
 #if defined(FLAME_GRAPHICS_VULKAN)
+			wait_ready();
+
 			for (auto l : _priv->descriptorsetlayouts)
 			{
 				l->release();
@@ -601,5 +644,108 @@ namespace flame
 			delete p->_priv;
 			delete p;
 		}
+
+#if defined(FLAME_GRAPHICS_VULKAN)
+		static const char *pipeline_cache_filename = "pipeline.cache";
+
+		// the driver checks its own header of the cache data too, but some drivers crash on
+		// data that comes from another version, so we only hand it over when everything matches
+		struct PipelineCacheFileHeader
+		{
+			uint magic;
+			uint vendor_id;
+			uint device_id;
+			uint driver_version;
+			uchar uuid[VK_UUID_SIZE];
+			uint data_size;
+			uint data_hash;
+		};
+
+		static const uint pipeline_cache_magic = 0x434c5046; // 'FPLC'
+
+		static uint _hash_pipeline_cache_data(const char *data, uint size)
+		{
+			uint h = 2166136261U;
+			for (uint i = 0; i < size; i++)
+			{
+				h ^= (uchar)data[i];
+				h *= 16777619U;
+			}
+			return h;
+		}
+
+		static void _fill_pipeline_cache_header(Device *d, PipelineCacheFileHeader &h)
+		{
+			auto &props = d->_priv->physical_device_properties;
+			h.magic = pipeline_cache_magic;
+			h.vendor_id = props.vendorID;
+			h.device_id = props.deviceID;
+			h.driver_version = props.driverVersion;
+			memcpy(h.uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+			h.data_size = 0;
+			h.data_hash = 0;
+		}
+
+		void create_pipeline_cache(Device *d)
+		{
+			std::unique_ptr<char[]> data;
+			uint data_size = 0;
+
+			auto file = get_file_content(pipeline_cache_filename);
+			if (file.first && file.second >= sizeof(PipelineCacheFileHeader))
+			{
+				PipelineCacheFileHeader expected, h;
+				_fill_pipeline_cache_header(d, expected);
+				memcpy(&h, file.first.get(), sizeof(h));
+				auto p = file.first.get() + sizeof(h);
+				if (h.magic == expected.magic && h.vendor_id == expected.vendor_id && h.device_id == expected.device_id &&
+					h.driver_version == expected.driver_version && memcmp(h.uuid, expected.uuid, VK_UUID_SIZE) == 0 &&
+					h.data_size == file.second - sizeof(h) && h.data_hash == _hash_pipeline_cache_data(p, h.data_size))
+				{
+					data = std::move(file.first);
+					data_size = h.data_size;
+				}
+				else
+					printf("pipeline cache is from another device or driver, or is broken, start with an empty one\n");
+			}
+
+			VkPipelineCacheCreateInfo info;
+			info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+			info.flags = 0;
+			info.pNext = nullptr;
+			info.initialDataSize = data_size;
+			info.pInitialData = data_size ? data.get() + sizeof(PipelineCacheFileHeader) : nullptr;
+			vk_chk_res(vkCreatePipelineCache(d->_priv->device, &info, nullptr, &d->_priv->pipeline_cache));
+		}
+
+		void save_pipeline_cache(Device *d)
+		{
+			size_t size;
+			vk_chk_res(vkGetPipelineCacheData(d->_priv->device, d->_priv->pipeline_cache, &size, nullptr));
+			std::vector<char> data(size);
+			vk_chk_res(vkGetPipelineCacheData(d->_priv->device, d->_priv->pipeline_cache, &size, data.data()));
+
+			PipelineCacheFileHeader h;
+			_fill_pipeline_cache_header(d, h);
+			h.data_size = size;
+			h.data_hash = _hash_pipeline_cache_data(data.data(), size);
+
+			// write to a temp file first, a crash in the middle will not leave a broken cache
+			auto temp_filename = std::string(pipeline_cache_filename) + ".tmp";
+			{
+				std::ofstream file(temp_filename, std::ios::binary);
+				file.write((char*)&h, sizeof(h));
+				file.write(data.data(), size);
+			}
+			std::error_code ec;
+			std::filesystem::rename(temp_filename, pipeline_cache_filename, ec);
+		}
+
+		void destroy_pipeline_cache(Device *d)
+		{
+			save_pipeline_cache(d);
+			vkDestroyPipelineCache(d->_priv->device, d->_priv->pipeline_cache, nullptr);
+		}
+#endif
 	}
 }
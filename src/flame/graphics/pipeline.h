@@ -136,7 +136,8 @@ namespace flame
 				BlendFactor src_color = BlendFactorOne, BlendFactor dst_color = BlendFactorZero,
 				BlendFactor src_alpha = BlendFactorOne, BlendFactor dst_alpha = BlendFactorZero);
 			FLAME_GRAPHICS_EXPORTS void add_shader(Shader *s);
-			FLAME_GRAPHICS_EXPORTS void build_graphics();
+			// with async, the pipeline is compiled on another thread, check is_ready before using it
+			FLAME_GRAPHICS_EXPORTS void build_graphics(bool async = false);
 
 			FLAME_GRAPHICS_EXPORTS void release();
 
@@ -148,7 +149,9 @@ namespace flame
 			FLAME_GRAPHICS_EXPORTS void set_patch_control_points(int v);
 			FLAME_GRAPHICS_EXPORTS void set_output_attachment_count(int count);
 			FLAME_GRAPHICS_EXPORTS void set_dynamic_state(const std::initializer_list<DynamicState> &states);
-			FLAME_GRAPHICS_EXPORTS void build_compute();
+			FLAME_GRAPHICS_EXPORTS void build_compute(bool async = false);
+			FLAME_GRAPHICS_EXPORTS bool is_ready();
+			FLAME_GRAPHICS_EXPORTS void wait_ready();
 #else
 			FLAME_GRAPHICS_EXPORTS int get_uniform_location(const char *name);
 			FLAME_GRAPHICS_EXPORTS int get_vertex_attribute_location(const char *name);
@@ -157,5 +160,10 @@ namespace flame
 
 		FLAME_GRAPHICS_EXPORTS Pipeline *create_pipeline(Device *d);
 		FLAME_GRAPHICS_EXPORTS void destroy_pipeline(Device *d, Pipeline *p);
+
+#if defined(FLAME_GRAPHICS_VULKAN)
+		// it is also saved when the device is destroyed, call this to save it earlier (e.g. after loading a level)
+		FLAME_GRAPHICS_EXPORTS void save_pipeline_cache(Device *d);
+#endif
 	}
 }
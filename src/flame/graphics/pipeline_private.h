@@ -26,6 +26,7 @@
 #include "graphics_private.h"
 
 #include <vector>
+#include <future>
 
 namespace flame
 {
@@ -210,11 +211,19 @@ namespace flame
 			std::vector<Descriptorsetlayout*> descriptorsetlayouts;
 			Pipelinelayout *pipelinelayout;
 			VkPipeline v;
+			std::future<void> build_future;
 
 			std::vector<VkPipelineShaderStageCreateInfo> get_stage_info_and_build_layout();
 #else
 			GLuint v;
 #endif
 		};
+
+#if defined(FLAME_GRAPHICS_VULKAN)
+		// the device keeps one pipeline cache, it is loaded from the disk when the device is created
+		// and written back when the device is destroyed
+		void create_pipeline_cache(Device *d);
+		void destroy_pipeline_cache(Device *d);
+#endif
 	}
 }
@@ -0,0 +1,75 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "device_private.h"
+#include "querypool_private.h"
+
+#include <vector>
+
+namespace flame
+{
+	namespace graphics
+	{
+#if defined(FLAME_GRAPHICS_VULKAN)
+		bool Querypool::get_timestamps(int first, int _count, long long *out)
+		{
+			std::vector<uint64_t> ticks(_count);
+			auto res = vkGetQueryPoolResults(_priv->d->_priv->device, _priv->v, first, _count,
+				sizeof(uint64_t) * _count, ticks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+			if (res == VK_NOT_READY)
+				return false;
+			vk_chk_res(res);
+			for (auto i = 0; i < _count; i++)
+				out[i] = (long long)(ticks[i] * _priv->period);
+			return true;
+		}
+
+		Querypool *create_querypool(Device *d, int count)
+		{
+			auto q = new Querypool;
+			q->count = count;
+			q->_priv = new QuerypoolPrivate;
+			q->_priv->d = d;
+			q->_priv->period = d->_priv->physical_device_properties.limits.timestampPeriod;
+
+			VkQueryPoolCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			info.queryCount = count;
+
+			vk_chk_res(vkCreateQueryPool(d->_priv->device, &info, nullptr, &q->_priv->v));
+
+			return q;
+		}
+
+		void destroy_querypool(Device *d, Querypool *q)
+		{
+			assert(d == q->_priv->d);
+
+			vkDestroyQueryPool(d->_priv->device, q->_priv->v, nullptr);
+
+			delete q->_priv;
+			delete q;
+		}
+#endif
+	}
+}
@@ -23,6 +23,7 @@
 #include "device_private.h"
 #include "queue_private.h"
 #include "semaphore_private.h"
+#include "fence_private.h"
 #include "commandbuffer_private.h"
 #include "swapchain_private.h"
 
@@ -33,10 +34,11 @@ namespace flame
 #if defined(FLAME_GRAPHICS_VULKAN)
 		void Queue::wait_idle()
 		{
+			std::lock_guard<std::mutex> lock(_priv->mtx);
 			vk_chk_res(vkQueueWaitIdle(_priv->v));
 		}
 
-		void Queue::submit(Commandbuffer *c, Semaphore *wait_semaphore, Semaphore *signal_semaphore)
+		void Queue::submit(Commandbuffer *c, Semaphore *wait_semaphore, Semaphore *signal_semaphore, Fence *signal_fence)
 		{
 			VkSubmitInfo info;
 			info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -50,7 +52,8 @@ namespace flame
 			info.signalSemaphoreCount = signal_semaphore ? 1 : 0;
 			info.pSignalSemaphores = signal_semaphore  ? &signal_semaphore->_priv->v : nullptr;
 
-			vk_chk_res(vkQueueSubmit(_priv->v, 1, &info, VK_NULL_HANDLE));
+			std::lock_guard<std::mutex> lock(_priv->mtx);
+			vk_chk_res(vkQueueSubmit(_priv->v, 1, &info, signal_fence ? signal_fence->_priv->v : VK_NULL_HANDLE));
 		}
 
 		void Queue::present(uint index, Swapchain *s, Semaphore *wait_semaphore)
@@ -64,12 +67,13 @@ namespace flame
 			present_info.swapchainCount = 1;
 			present_info.pSwapchains = &s->_priv->swapchain;
 			present_info.pImageIndices = &index;
+			std::lock_guard<std::mutex> lock(_priv->mtx);
 			vk_chk_res(vkQueuePresentKHR(_priv->v, &present_info));
 		}
 
-		static int queue_count = 1;
+		static int queue_count = 2; // the graphics queue and the transfer queue
 
-		Queue *create_queue(Device *d)
+		Queue *create_queue(Device *d, int family)
 		{
 			assert(queue_count > 0);
 
@@ -77,8 +81,9 @@ namespace flame
 
 			q->_priv = new QueuePrivate;
 			q->_priv->d = d;
+			q->_priv->family = family;
 
-			vkGetDeviceQueue(d->_priv->device, 0, 0, &q->_priv->v);
+			vkGetDeviceQueue(d->_priv->device, family, 0, &q->_priv->v);
 
 			queue_count--;
 
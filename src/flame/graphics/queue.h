@@ -34,6 +34,7 @@ namespace flame
 		struct Commandbuffer;
 		struct Swapchain;
 		struct Semaphore;
+		struct Fence;
 
 		struct QueuePrivate;
 
@@ -42,11 +43,12 @@ namespace flame
 			QueuePrivate *_priv;
 
 			FLAME_GRAPHICS_EXPORTS void wait_idle();
-			FLAME_GRAPHICS_EXPORTS void submit(Commandbuffer *c, Semaphore *wait_semaphore, Semaphore *signal_semaphore);
+			// can be called from any thread, the submissions to one queue are serialized
+			FLAME_GRAPHICS_EXPORTS void submit(Commandbuffer *c, Semaphore *wait_semaphore, Semaphore *signal_semaphore, Fence *signal_fence = nullptr);
 			FLAME_GRAPHICS_EXPORTS void present(uint index, Swapchain *s, Semaphore *wait_semaphore);
 		};
 
-		FLAME_GRAPHICS_EXPORTS Queue *create_queue(Device *d);
+		FLAME_GRAPHICS_EXPORTS Queue *create_queue(Device *d, int family = 0);
 		FLAME_GRAPHICS_EXPORTS void destroy_queue(Device *d, Queue *q);
 	}
 }
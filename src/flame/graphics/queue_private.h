@@ -25,6 +25,8 @@
 #include "queue.h"
 #include "graphics_private.h"
 
+#include <mutex>
+
 namespace flame
 {
 	namespace graphics
@@ -33,7 +35,9 @@ namespace flame
 		struct QueuePrivate
 		{
 			Device *d;
+			uint family;
 			VkQueue v;
+			std::mutex mtx;
 		};
 #endif
 	}
@@ -0,0 +1,93 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <flame/time.h>
+#include <flame/jobs.h>
+#include <flame/profiler.h>
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+namespace flame
+{
+	namespace graphics
+	{
+		// the one implementation of record_passes, for Framecontext and for the renderers still on the old api:
+		// the items of the passes are split into chunks of at most grain, the chunks of all passes are recorded at
+		// the same time on the workers of js, get_secondary(worker, pass) gives a begun secondary from the pools of
+		// that worker (0 for a thread that is not a worker of js, the others are get_worker_index() + 1), then
+		// execute(pass_index, cb_count, cbs) is called for the passes in order, returns the summed recording time
+		template <class CB, class Pass, class GetSecondary, class Execute>
+		long long record_pass_chunks(JobSystem *js, int pass_count, Pass *passes, int grain, GetSecondary get_secondary, Execute execute)
+		{
+			struct Chunk
+			{
+				int pass;
+				int begin;
+				int end;
+				CB *cb;
+			};
+
+			grain = std::max(grain, 1);
+			std::vector<Chunk> chunks;
+			for (auto i = 0; i < pass_count; i++)
+			{
+				for (auto b = 0; b < passes[i].item_count; b += grain)
+					chunks.push_back({ i, b, std::min(b + grain, passes[i].item_count), nullptr });
+			}
+
+			std::atomic<long long> work_time(0);
+			js->parallel_for(0, chunks.size(), 1, [&](int begin, int end) {
+				auto w = js->get_worker_index() + 1;
+				for (auto i = begin; i < end; i++)
+				{
+					FLAME_PROFILE("record secondary");
+					auto t = get_now_ns();
+
+					auto &c = chunks[i];
+					auto &p = passes[c.pass];
+					c.cb = get_secondary(w, p);
+					p.record(c.cb, c.begin, c.end);
+					c.cb->end();
+
+					work_time.fetch_add(get_now_ns() - t, std::memory_order_relaxed);
+				}
+			});
+
+			// the chunks of a pass are together and in order
+			std::vector<CB*> cbs;
+			auto c = 0;
+			for (auto i = 0; i < pass_count; i++)
+			{
+				cbs.clear();
+				for (; c < chunks.size() && chunks[c].pass == i; c++)
+					cbs.push_back(chunks[c].cb);
+				execute(i, (int)cbs.size(), cbs.data());
+			}
+
+			return work_time.load();
+		}
+	}
+}
@@ -0,0 +1,140 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "device_private.h"
+#include "texture_private.h"
+#include "commandbuffer_private.h"
+#include "rendergraph_private.h"
+
+#include <assert.h>
+
+namespace flame
+{
+	namespace graphics
+	{
+#if defined(FLAME_GRAPHICS_VULKAN)
+		// a texture no slot took for this many executes is destroyed, which is more than any frames in flight,
+		// so the gpu is done with it
+		static const int RendergraphTextureLife = 8;
+
+		void Rendergraph::execute(Commandbuffer *cb)
+		{
+			auto &c = _priv->compiled;
+			compile(&c);
+
+			// give every slot a texture of its description, the same one as the last time when we can
+			for (auto &t : _priv->textures)
+				t.unused++;
+			_priv->slot_textures.assign(c.slot_count, -1);
+			for (auto i = 0; i < (int)resources.size(); i++)
+			{
+				auto s = c.slots[i];
+				if (s == -1 || _priv->slot_textures[s] != -1)
+					continue;
+				auto &r = resources[i];
+				auto idx = -1;
+				for (auto j = 0; j < (int)_priv->textures.size(); j++)
+				{
+					auto &t = _priv->textures[j];
+					if (t.unused > 0 && t.t->size == r.size && t.t->level == r.level && t.t->layer == r.layer &&
+						t.t->format == r.format && t.usage == r.usage)
+					{
+						idx = j;
+						break;
+					}
+				}
+				if (idx == -1)
+				{
+					idx = _priv->textures.size();
+					_priv->textures.push_back({ create_texture(_priv->d, r.size, r.level, r.layer, r.format, r.usage, MemPropDevice), r.usage, 0 });
+				}
+				_priv->textures[idx].unused = 0;
+				_priv->slot_textures[s] = idx;
+			}
+			for (auto it = _priv->textures.begin(); it != _priv->textures.end(); )
+			{
+				if (it->unused >= RendergraphTextureLife)
+				{
+					destroy_texture(_priv->d, it->t);
+					it = _priv->textures.erase(it);
+					for (auto &idx : _priv->slot_textures)
+					{
+						if (idx > it - _priv->textures.begin())
+							idx--;
+					}
+				}
+				else
+					it++;
+			}
+
+			auto b = 0;
+			auto barriers_before = [&](int pos) {
+				for (; b < (int)c.barriers.size() && c.barriers[b].before == pos; b++)
+				{
+					auto &br = c.barriers[b];
+					auto t = get_texture(br.resource);
+					assert(t);
+					cb->change_texture_layout(t, br.from, br.to);
+				}
+			};
+			for (auto i = 0; i < (int)c.order.size(); i++)
+			{
+				barriers_before(i);
+				auto &p = passes[c.order[i]];
+				if (p.execute)
+					p.execute(cb);
+			}
+			barriers_before(c.order.size());
+		}
+
+		Texture *Rendergraph::get_texture(int resource)
+		{
+			auto &r = resources[resource];
+			if (r.imported)
+				return r.texture;
+			auto s = _priv->compiled.slots[resource];
+			return s == -1 ? nullptr : _priv->textures[_priv->slot_textures[s]].t;
+		}
+
+		Rendergraph *create_rendergraph(Device *d)
+		{
+			auto g = new Rendergraph;
+			g->_priv = new RendergraphPrivate;
+			g->_priv->d = d;
+			g->_priv->compiled.slot_count = 0;
+
+			return g;
+		}
+
+		void destroy_rendergraph(Device *d, Rendergraph *g)
+		{
+			assert(d == g->_priv->d);
+
+			for (auto &t : g->_priv->textures)
+				destroy_texture(d, t.t);
+
+			delete g->_priv;
+			delete g;
+		}
+#endif
+	}
+}
@@ -0,0 +1,348 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include "graphics.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace flame
+{
+	namespace graphics
+	{
+		struct Device;
+		struct Texture;
+		struct Commandbuffer;
+
+		struct RendergraphPrivate;
+
+		struct RendergraphResource
+		{
+			std::string name;
+			Ivec2 size;
+			int level;
+			int layer;
+			Format format;
+			int usage;
+
+			bool imported; // a transient texture is created by the graph
+			Texture *texture; // the imported texture
+			TextureLayout initial_layout; // of an imported texture
+			TextureLayout final_layout; // an imported texture is left in this layout after the graph
+			bool output;
+		};
+
+		struct RendergraphAccess
+		{
+			int resource;
+			TextureLayout layout;
+			bool write;
+		};
+
+		struct RendergraphPass
+		{
+			std::string name;
+			std::vector<RendergraphAccess> accesses;
+			bool side_effect; // never culled
+			std::function<void(Commandbuffer *cb)> execute;
+		};
+
+		// the layout change of one resource, recorded right before the pass at position 'before' of the order,
+		// 'before' equals the order size for the final layouts of imported textures
+		struct RendergraphBarrier
+		{
+			int before;
+			int resource;
+			TextureLayout from;
+			TextureLayout to;
+		};
+
+		struct RendergraphCompiled
+		{
+			std::vector<int> order; // the passes that survived the culling, in the order they were added
+			std::vector<RendergraphBarrier> barriers;
+			std::vector<int> slots; // of each resource, transients in one slot share a texture, -1 for imported or unused
+			int slot_count;
+		};
+
+		// passes declare what they read and write and run in the order they were added, compile() drops the
+		// passes whose results never reach an output, puts a barrier only where the layout of a texture changes
+		// or one pass has to wait for the writes (or reads) of another, and lets transient textures with the
+		// same description and lifetimes that do not overlap use the same texture
+		//
+		// compile() touches no device, so a graph can be built and checked without a gpu, execute() needs
+		// one from create_rendergraph
+		struct Rendergraph
+		{
+			std::vector<RendergraphResource> resources;
+			std::vector<RendergraphPass> passes;
+
+			RendergraphPrivate *_priv;
+
+			Rendergraph() :
+				_priv(nullptr)
+			{
+			}
+
+			int add_texture(const std::string &name, const Ivec2 &size, int level, int layer, Format format, int usage)
+			{
+				RendergraphResource r;
+				r.name = name;
+				r.size = size;
+				r.level = level;
+				r.layer = layer;
+				r.format = format;
+				r.usage = usage;
+				r.imported = false;
+				r.texture = nullptr;
+				r.initial_layout = TextureLayoutUndefined;
+				r.final_layout = TextureLayoutUndefined;
+				r.output = false;
+				resources.push_back(r);
+				return resources.size() - 1;
+			}
+
+			// a texture that lives outside of the graph, it is an output when its content must be kept
+			int import_texture(const std::string &name, Texture *t, TextureLayout initial_layout, TextureLayout final_layout, bool output = true)
+			{
+				RendergraphResource r;
+				r.name = name;
+				r.size = Ivec2(0);
+				r.level = 0;
+				r.layer = 0;
+				r.format = Format_Undefined;
+				r.usage = 0;
+				r.imported = true;
+				r.texture = t;
+				r.initial_layout = initial_layout;
+				r.final_layout = final_layout;
+				r.output = output;
+				resources.push_back(r);
+				return resources.size() - 1;
+			}
+
+			void set_output(int resource)
+			{
+				resources[resource].output = true;
+			}
+
+			int add_pass(const std::string &name, const std::function<void(Commandbuffer *cb)> &execute, bool side_effect = false)
+			{
+				RendergraphPass p;
+				p.name = name;
+				p.side_effect = side_effect;
+				p.execute = execute;
+				passes.push_back(p);
+				return passes.size() - 1;
+			}
+
+			void read(int pass, int resource, TextureLayout layout = TextureLayoutShaderReadOnly)
+			{
+				passes[pass].accesses.push_back({ resource, layout, false });
+			}
+
+			// a pass that writes only a part of the texture (e.g. an attachment that is loaded) must read it too
+			void write(int pass, int resource, TextureLayout layout = TextureLayoutAttachment)
+			{
+				passes[pass].accesses.push_back({ resource, layout, true });
+			}
+
+			void clear()
+			{
+				resources.clear();
+				passes.clear();
+			}
+
+			void compile(RendergraphCompiled *out) const
+			{
+				auto resource_count = (int)resources.size();
+				auto pass_count = (int)passes.size();
+
+				// culling, backwards: a pass lives when it writes something needed later,
+				// then what it writes alone is not needed before it and what it reads is
+				std::vector<bool> alive(pass_count, false);
+				std::vector<bool> needed(resource_count);
+				for (auto i = 0; i < resource_count; i++)
+					needed[i] = resources[i].output;
+				for (auto i = pass_count - 1; i >= 0; i--)
+				{
+					auto &p = passes[i];
+					auto live = p.side_effect;
+					for (auto &a : p.accesses)
+					{
+						if (a.write && needed[a.resource])
+							live = true;
+					}
+					if (!live)
+						continue;
+					alive[i] = true;
+					for (auto &a : p.accesses)
+					{
+						if (a.write && !reads(p, a.resource))
+							needed[a.resource] = false;
+					}
+					for (auto &a : p.accesses)
+					{
+						if (!a.write)
+							needed[a.resource] = true;
+					}
+				}
+
+				out->order.clear();
+				for (auto i = 0; i < pass_count; i++)
+				{
+					if (alive[i])
+						out->order.push_back(i);
+				}
+
+				// barriers, a pass needs one for a texture when the layout changes, or when an earlier pass wrote it,
+				// or when it writes what an earlier pass read, since the last barrier of the texture
+				out->barriers.clear();
+				std::vector<TextureLayout> layouts(resource_count);
+				std::vector<bool> written(resource_count, false), read(resource_count, false);
+				for (auto i = 0; i < resource_count; i++)
+					layouts[i] = resources[i].imported ? resources[i].initial_layout : TextureLayoutUndefined;
+				for (auto i = 0; i < (int)out->order.size(); i++)
+				{
+					auto &p = passes[out->order[i]];
+					auto first_barrier = out->barriers.size();
+					for (auto &a : p.accesses)
+					{
+						auto r = a.resource;
+						auto already = false;
+						for (auto j = first_barrier; j < out->barriers.size(); j++)
+						{
+							if (out->barriers[j].resource == r)
+								already = true;
+						}
+						if (already)
+							continue;
+						if (a.layout != layouts[r] || written[r] || (writes(p, r) && read[r]))
+						{
+							out->barriers.push_back({ i, r, layouts[r], a.layout });
+							written[r] = false;
+							read[r] = false;
+						}
+					}
+					for (auto &a : p.accesses)
+					{
+						layouts[a.resource] = a.layout;
+						if (a.write)
+							written[a.resource] = true;
+						else
+							read[a.resource] = true;
+					}
+				}
+				for (auto i = 0; i < resource_count; i++)
+				{
+					auto &r = resources[i];
+					if (r.imported && layouts[i] != r.final_layout && r.final_layout != TextureLayoutUndefined)
+						out->barriers.push_back({ (int)out->order.size(), i, layouts[i], r.final_layout });
+				}
+
+				// aliasing: the lifetime of a transient is from its first to its last use in the order,
+				// a slot is taken again by a transient of the same description that begins after the slot's last use
+				std::vector<int> first_use(resource_count, -1), last_use(resource_count, -1);
+				for (auto i = 0; i < (int)out->order.size(); i++)
+				{
+					for (auto &a : passes[out->order[i]].accesses)
+					{
+						if (first_use[a.resource] == -1)
+							first_use[a.resource] = i;
+						last_use[a.resource] = i;
+					}
+				}
+				std::vector<int> transients;
+				for (auto i = 0; i < resource_count; i++)
+				{
+					if (!resources[i].imported && first_use[i] != -1)
+						transients.push_back(i);
+				}
+				std::stable_sort(transients.begin(), transients.end(), [&](int a, int b) {
+					return first_use[a] < first_use[b];
+				});
+				out->slots.assign(resource_count, -1);
+				std::vector<int> slot_resource; // the first resource of a slot, for the description
+				std::vector<int> slot_end;
+				for (auto r : transients)
+				{
+					auto slot = -1;
+					for (auto s = 0; s < (int)slot_resource.size(); s++)
+					{
+						if (slot_end[s] < first_use[r] && same_description(resources[slot_resource[s]], resources[r]))
+						{
+							slot = s;
+							break;
+						}
+					}
+					if (slot == -1)
+					{
+						slot = slot_resource.size();
+						slot_resource.push_back(r);
+						slot_end.push_back(-1);
+					}
+					out->slots[r] = slot;
+					slot_end[slot] = last_use[r];
+				}
+				out->slot_count = slot_resource.size();
+			}
+
+			// compiles and records the barriers and the passes into cb, the textures of the slots are kept for
+			// the next time and created again only when the descriptions change
+			FLAME_GRAPHICS_EXPORTS void execute(Commandbuffer *cb);
+			// the texture of a resource, for the passes of the executing graph (e.g. to make their framebuffers)
+			FLAME_GRAPHICS_EXPORTS Texture *get_texture(int resource);
+
+		private:
+			static bool reads(const RendergraphPass &p, int resource)
+			{
+				for (auto &a : p.accesses)
+				{
+					if (!a.write && a.resource == resource)
+						return true;
+				}
+				return false;
+			}
+
+			static bool writes(const RendergraphPass &p, int resource)
+			{
+				for (auto &a : p.accesses)
+				{
+					if (a.write && a.resource == resource)
+						return true;
+				}
+				return false;
+			}
+
+			static bool same_description(const RendergraphResource &a, const RendergraphResource &b)
+			{
+				return a.size == b.size && a.level == b.level && a.layer == b.layer && a.format == b.format && a.usage == b.usage;
+			}
+		};
+
+		FLAME_GRAPHICS_EXPORTS Rendergraph *create_rendergraph(Device *d);
+		FLAME_GRAPHICS_EXPORTS void destroy_rendergraph(Device *d, Rendergraph *g);
+	}
+}
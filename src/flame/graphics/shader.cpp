@@ -29,90 +29,150 @@
 #include <flame/shader/shader.h>
 #endif
 
+#include <thread>
+#include <atomic>
+
 namespace flame
 {
 	namespace graphics
 	{
 		static std::string shader_path("shaders/");
 
-		void Shader::build()
-		{
 #if defined(FLAME_GRAPHICS_VULKAN)
-			std::filesystem::remove("temp.spv"); // glslc cannot write to an existed file. well we did delete it when we finish compiling, but there can be one somehow
+		struct ShaderBuildTask
+		{
+			Shader *s;
+			std::pair<std::unique_ptr<char[]>, size_t> spv;
+			std::string compile_output;
+		};
+
+		static void _compile_output_callback(void *user_data, const char *filename, int line, const char *what)
+		{
+			auto &output = *(std::string*)user_data;
+			if (filename == nullptr && line == -1)
+			{
+				if (strcmp(what, "##start") == 0)
+					output += "\n=====Shader Compile Error=====\n";
+				else if (strcmp(what, "##end") == 0)
+					output += "=============================\n";
+			}
+			else
+				output += std::string(filename) + ":" + std::to_string(line) + ":" + what + "\n";
+		}
 
-			auto glsl_filename = shader_path + "src/" + filename.data;
+		// runs on the worker threads, nothing here touches the device
+		static void _prepare_spv(ShaderBuildTask &t)
+		{
+			auto s = t.s;
+
+			auto glsl_filename = shader_path + "src/" + s->filename.data;
+			auto config_filename = shader_path + "src/shader_compile_config.conf";
 
-			std::string spv_filename(filename.data);
-			for (auto &d : defines)
+			std::string spv_filename(s->filename.data);
+			for (auto &d : s->defines)
 				spv_filename += std::string(".") + d.data;
 			spv_filename += ".spv";
 			spv_filename = shader_path + "bin/" + spv_filename;
 
-			if (!std::filesystem::exists(spv_filename) ||
-				std::filesystem::last_write_time(spv_filename) <= std::filesystem::last_write_time(glsl_filename))
+			char hash_str[32];
+			sprintf(hash_str, "%016llx", get_shader_hash(glsl_filename.c_str(), s->defines.size(), s->defines.data(), config_filename.c_str()));
+			auto cache_filename = shader_path + "bin/cache/" + hash_str + ".spv";
+
+			if (!std::filesystem::exists(cache_filename))
 			{
-				compile_shader(glsl_filename.c_str(), defines.size(), defines.data(),
-					(shader_path + "src/shader_compile_config.conf").c_str(), spv_filename.c_str(), [](const char *filename, int line, const char *what){
-					// shader compile error, try to use previous spv file, we are not going to return here
-					if (filename == nullptr && line == -1)
-					{
-						if (strcmp(what, "##start"))
-							printf("\n=====Shader Compile Error=====\n");
-						else if (strcmp(what, "##end"))
-							printf("=============================\n");
-					}
-					else
-						printf("%s:%d:%s\n", filename, line, what);
-				});
+				// compiled aside and moved in, the name is only this task's
+				auto temp_filename = cache_filename + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+				if (compile_shader(glsl_filename.c_str(), s->defines.size(), s->defines.data(), config_filename.c_str(),
+					temp_filename.c_str(), _compile_output_callback, &t.compile_output))
+				{
+					t.spv = get_file_content(temp_filename);
+
+					// the last good spv of this variant, we use it when a later compile fails
+					std::error_code ec;
+					std::filesystem::copy_file(temp_filename, spv_filename, std::filesystem::copy_options::overwrite_existing, ec);
+
+					// the move fails when another worker (or process) put the same variant there first or the file
+					// is locked, the fresh spv is used anyway and the cache gets it next time
+					std::filesystem::rename(temp_filename, cache_filename, ec);
+					if (ec)
+						std::filesystem::remove(temp_filename, ec);
+					if (t.spv.first)
+						return;
+				}
+				else
+				{
+					t.spv = get_file_content(spv_filename);
+					return;
+				}
 			}
 
-			auto spv_file = get_file_content(spv_filename);
-			if (!spv_file.first)  // missing spv file!
+			t.spv = get_file_content(cache_filename);
+		}
+
+		static void _create_module(ShaderBuildTask &t)
+		{
+			auto s = t.s;
+
+			if (!t.compile_output.empty())
+				printf("%s", t.compile_output.c_str());
+
+			if (!t.spv.first)  // missing spv file!
 			{
-				if (!_priv->v) // if we are running first time and no previous spv
+				if (!s->_priv->v) // if we are running first time and no previous spv
 					assert(0); // we should not having bad shader TODO : maybe we should add a default shader?
 				return;
 			}
 
-			release();
+			s->release();
 
 			VkShaderModuleCreateInfo shader_info;
 			shader_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 			shader_info.flags = 0;
 			shader_info.pNext = nullptr;
-			shader_info.codeSize = spv_file.second;
-			shader_info.pCode = (uint32_t*)spv_file.first.get();
-			vk_chk_res(vkCreateShaderModule(_priv->d->_priv->device, &shader_info, nullptr, &_priv->v));
+			shader_info.codeSize = t.spv.second;
+			shader_info.pCode = (uint32_t*)t.spv.first.get();
+			vk_chk_res(vkCreateShaderModule(s->_priv->d->_priv->device, &shader_info, nullptr, &s->_priv->v));
 
-			auto res_filename = spv_filename + ".res";
-			if (!std::filesystem::exists(res_filename) ||
-				std::filesystem::last_write_time(res_filename) <= std::filesystem::last_write_time(spv_filename))
-				produce_shader_resource_file(spv_filename.c_str(), res_filename.c_str());
+			// reflect the spv we already have in memory, no .res file any more
+			ShaderReflection reflection;
+			reflect_shader(t.spv.first.get(), t.spv.second, &reflection);
 
-			std::ifstream res_file(res_filename, std::ios::binary);
+			s->_priv->resources.clear();
+			for (auto &r : reflection.resources)
+			{
+				if (r.set >= s->_priv->resources.size())
+					s->_priv->resources.resize(r.set + 1);
 
-			auto _read_resource = [&](ShaderResourceType type) {
-				auto count = read<int>(res_file);
-				for (auto i = 0; i < count; i++)
+				ShaderResource sr;
+				switch (r.type)
 				{
-					auto set = read<int>(res_file);
-					if (set >= _priv->resources.size())
-						_priv->resources.resize(set + 1);
-
-					ShaderResource r;
-					r.type = type;
-					r.name = read_string(res_file);
-					r.binding = read<int>(res_file);
-					r.count = read<int>(res_file);
-					_priv->resources[set].push_back(r);
+					case ShaderReflectionUniformbuffer:
+						sr.type = ShaderResourceUniformbuffer;
+						break;
+					case ShaderReflectionStoragebuffer:
+						sr.type = ShaderResourceStoragebuffer;
+						break;
+					case ShaderReflectionTexture:
+						sr.type = ShaderResourceTexture;
+						break;
+					case ShaderReflectionStorageTexture:
+						sr.type = ShaderResourceStorageTexture;
+						break;
 				}
-			};
+				sr.name = r.name.data;
+				sr.binding = r.binding;
+				sr.count = r.count;
+				s->_priv->resources[r.set].push_back(sr);
+			}
+			s->_priv->push_constant_size = reflection.push_constant_size;
+		}
+#endif
 
-			_read_resource(ShaderResourceUniformbuffer);
-			_read_resource(ShaderResourceStoragebuffer);
-			_read_resource(ShaderResourceTexture);
-			_read_resource(ShaderResourceStorageTexture);
-			_priv->push_constant_size = read<int>(res_file);
+		void Shader::build()
+		{
+#if defined(FLAME_GRAPHICS_VULKAN)
+			auto s = this;
+			build_shaders(&s, 1);
 #else
 			release();
 
@@ -143,6 +203,52 @@ namespace flame
 #endif
 		}
 
+		void build_shaders(Shader **shaders, int count)
+		{
+#if defined(FLAME_GRAPHICS_VULKAN)
+			std::vector<ShaderBuildTask> tasks(count);
+			for (auto i = 0; i < count; i++)
+				tasks[i].s = shaders[i];
+
+			int thread_count = std::thread::hardware_concurrency();
+			if (thread_count < 1)
+				thread_count = 1;
+			if (thread_count > count)
+				thread_count = count;
+
+			if (thread_count <= 1)
+			{
+				for (auto &t : tasks)
+					_prepare_spv(t);
+			}
+			else
+			{
+				std::atomic<int> next(0);
+				std::vector<std::thread> threads;
+				for (auto i = 0; i < thread_count; i++)
+				{
+					threads.emplace_back([&]() {
+						while (true)
+						{
+							auto idx = next++;
+							if (idx >= count)
+								break;
+							_prepare_spv(tasks[idx]);
+						}
+					});
+				}
+				for (auto &t : threads)
+					t.join();
+			}
+
+			for (auto &t : tasks)
+				_create_module(t);
+#else
+			for (auto i = 0; i < count; i++)
+				shaders[i]->build();
+#endif
+		}
+
 		void Shader::release()
 		{
 			if (_priv->v)
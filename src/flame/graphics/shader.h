@@ -64,5 +64,9 @@ namespace flame
 
 		FLAME_GRAPHICS_EXPORTS Shader *create_shader(Device *d, const char *filename);
 		FLAME_GRAPHICS_EXPORTS void destroy_shader(Device *d, Shader *s);
+
+		// build many shaders at once, the compiles run on a pool of threads,
+		// spv files are cached by the hash of the source, its includes, the defines and the compiler version
+		FLAME_GRAPHICS_EXPORTS void build_shaders(Shader **shaders, int count);
 	}
 }
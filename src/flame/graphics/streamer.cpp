@@ -0,0 +1,360 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <algorithm>
+#include <string.h>
+
+#include "device_private.h"
+#include "streamer_private.h"
+#include "texture_private.h"
+#include "buffer_private.h"
+#include "commandbuffer_private.h"
+#include "queue_private.h"
+#include "fence_private.h"
+
+namespace flame
+{
+	namespace graphics
+	{
+#if defined(FLAME_GRAPHICS_VULKAN)
+		// hands the texture from the transfer queue to the graphics queue, recorded once on each side
+		static void ownership_barrier(Commandbuffer *cb, Texture *t, uint src_family, uint dst_family, bool acquire)
+		{
+			VkImageMemoryBarrier barrier;
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.pNext = nullptr;
+			barrier.srcAccessMask = acquire ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = acquire ? VK_ACCESS_SHADER_READ_BIT : 0;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcQueueFamilyIndex = src_family;
+			barrier.dstQueueFamilyIndex = dst_family;
+			barrier.image = t->_priv->v;
+			barrier.subresourceRange.aspectMask = Z(format_to_aspect(t->format));
+			barrier.subresourceRange.baseMipLevel = 0;
+			barrier.subresourceRange.levelCount = t->level;
+			barrier.subresourceRange.baseArrayLayer = 0;
+			barrier.subresourceRange.layerCount = t->layer;
+
+			vkCmdPipelineBarrier(cb->_priv->v, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
+		static void call_back(StreamerPrivate *p, StreamRequest *r)
+		{
+			// a cancelled one has already been removed
+			if (r->ticket->cancelled)
+				return;
+			r->ticket->state = r->t ? LoadStateDone : LoadStateFailed;
+			auto callback = r->callback;
+			auto t = r->t;
+			p->requests.erase(r->ticket.get());
+			callback(t);
+		}
+
+		// the textures of the requests that were cancelled during the upload are ours to destroy
+		static void retire_batch(StreamerPrivate *p, StreamBatch *b)
+		{
+			for (auto &r : b->requests)
+			{
+				if (r->ticket->cancelled)
+					destroy_texture(p->d, r->t);
+			}
+			if (b->acquire_cb)
+			{
+				p->d->cp->destroy_commandbuffer(b->acquire_cb);
+				destroy_fence(p->d, b->acquire_fence);
+			}
+			delete b;
+		}
+
+		static void free_transfer(StreamerPrivate *p, StreamBatch *b)
+		{
+			p->transfer_cp->destroy_commandbuffer(b->cb);
+			destroy_buffer(p->d, b->staging);
+			destroy_fence(p->d, b->fence);
+			b->cb = nullptr;
+			b->staging = nullptr;
+			b->fence = nullptr;
+		}
+
+		std::shared_ptr<LoadTicket> Streamer::load_texture(const std::string &filename, int priority,
+			const std::function<void(Texture *t)> &callback, int usage, int mem_prop)
+		{
+			auto p = _priv;
+
+			auto r = std::make_shared<StreamRequest>();
+			r->ticket = std::make_shared<LoadTicket>(priority);
+			r->ok = false;
+			r->callback = callback;
+			r->usage = usage;
+			r->mem_prop = mem_prop;
+			r->t = nullptr;
+
+			r->load_ticket = p->loader->push(priority, [r, filename](LoadTicket &) {
+				if (r->ticket->cancelled)
+					return false;
+				r->ok = load_texture_data(filename, &r->data);
+				return r->ok;
+			}, [p, r](bool ok) {
+				if (r->ticket->cancelled)
+					return;
+				if (ok)
+				{
+					r->ticket->state = LoadStateRunning;
+					p->decoded.push_back(r);
+				}
+				else
+					call_back(p, r.get());
+			});
+			p->requests[r->ticket.get()] = r;
+
+			return r->ticket;
+		}
+
+		void Streamer::set_priority(const std::shared_ptr<LoadTicket> &t, int priority)
+		{
+			auto it = _priv->requests.find(t.get());
+			if (it == _priv->requests.end())
+				return;
+			t->priority = priority;
+			_priv->loader->set_priority(it->second->load_ticket, priority);
+		}
+
+		bool Streamer::cancel(const std::shared_ptr<LoadTicket> &t)
+		{
+			auto it = _priv->requests.find(t.get());
+			if (it == _priv->requests.end())
+				return false;
+			auto r = it->second;
+			t->cancelled = true;
+			t->state = LoadStateCancelled;
+			_priv->requests.erase(it);
+			// not decoded yet: the loader drops it, decoded: update() drops it or destroys its texture
+			_priv->loader->cancel(r->load_ticket);
+			return true;
+		}
+
+		void Streamer::update()
+		{
+			auto p = _priv;
+			auto d = p->d;
+			auto transfer_family = d->tq->_priv->family;
+			auto graphics_family = d->q->_priv->family;
+
+			p->loader->dispatch();
+
+			for (auto it = p->acquiring.begin(); it != p->acquiring.end(); )
+			{
+				auto b = *it;
+				if (!b->acquire_fence->signaled())
+				{
+					it++;
+					continue;
+				}
+				retire_batch(p, b);
+				it = p->acquiring.erase(it);
+			}
+
+			for (auto it = p->uploading.begin(); it != p->uploading.end(); )
+			{
+				auto b = *it;
+				if (!b->fence->signaled())
+				{
+					it++;
+					continue;
+				}
+				free_transfer(p, b);
+				if (transfer_family != graphics_family)
+				{
+					// the graphics queue executes in submission order, the work submitted after this
+					// acquire sees the textures, so they can be handed out right away
+					b->acquire_cb = d->cp->create_commandbuffer();
+					b->acquire_cb->begin(true);
+					for (auto &r : b->requests)
+						ownership_barrier(b->acquire_cb, r->t, transfer_family, graphics_family, true);
+					b->acquire_cb->end();
+					b->acquire_fence = create_fence(d);
+					d->q->submit(b->acquire_cb, nullptr, nullptr, b->acquire_fence);
+					p->acquiring.push_back(b);
+				}
+				for (auto &r : b->requests)
+					call_back(p, r.get());
+				if (transfer_family == graphics_family)
+					retire_batch(p, b);
+				it = p->uploading.erase(it);
+			}
+
+			if (p->decoded.empty())
+				return;
+
+			std::stable_sort(p->decoded.begin(), p->decoded.end(), [](const std::shared_ptr<StreamRequest> &a, const std::shared_ptr<StreamRequest> &b) {
+				return a->ticket->priority > b->ticket->priority;
+			});
+
+			// offsets of compressed formats must be multiples of the block size
+			auto align = [](int v) {
+				return (v + 15) & ~15;
+			};
+
+			auto b = new StreamBatch;
+			b->acquire_cb = nullptr;
+			b->acquire_fence = nullptr;
+			std::vector<std::shared_ptr<StreamRequest>> remain;
+			auto size = 0;
+			for (auto &r : p->decoded)
+			{
+				if (r->ticket->cancelled)
+					continue;
+				auto s = (int)r->data.data.size();
+				if (!b->requests.empty() && size + s > p->upload_budget)
+				{
+					remain.push_back(r);
+					continue;
+				}
+				b->requests.push_back(r);
+				size = align(size + s);
+			}
+			p->decoded = std::move(remain);
+			if (b->requests.empty())
+			{
+				delete b;
+				return;
+			}
+
+			b->staging = create_buffer(d, size, BufferUsageTransferSrc, MemPropHost | MemPropHostCoherent);
+			b->staging->map();
+			b->cb = p->transfer_cp->create_commandbuffer();
+			b->cb->begin(true);
+			auto offset = 0;
+			for (auto &r : b->requests)
+			{
+				auto &data = r->data;
+				memcpy((char*)b->staging->mapped + offset, data.data.data(), data.data.size());
+				for (auto &c : data.regions)
+					c.buffer_offset += offset;
+
+				r->t = create_texture(d, data.size, data.level, data.layer, data.format, r->usage |
+					TextureUsageShaderSampled | TextureUsageTransferDst, r->mem_prop | MemPropDevice);
+				b->cb->change_texture_layout(r->t, TextureLayoutUndefined, TextureLayoutTransferDst);
+				b->cb->copy_buffer_to_image(b->staging, r->t, data.regions.size(), data.regions.data());
+				if (transfer_family == graphics_family)
+					b->cb->change_texture_layout(r->t, TextureLayoutTransferDst, TextureLayoutShaderReadOnly);
+				else
+					ownership_barrier(b->cb, r->t, transfer_family, graphics_family, false);
+
+				offset = align(offset + data.data.size());
+				std::vector<unsigned char>().swap(data.data);
+			}
+			b->staging->unmap();
+			b->cb->end();
+			b->fence = create_fence(d);
+			d->tq->submit(b->cb, nullptr, nullptr, b->fence);
+			p->uploading.push_back(b);
+		}
+
+		int Streamer::get_pending_count()
+		{
+			return _priv->requests.size();
+		}
+
+		Streamer *create_streamer(Device *d, int thread_count, int upload_budget)
+		{
+			auto s = new Streamer;
+
+			s->_priv = new StreamerPrivate;
+			s->_priv->d = d;
+			s->_priv->transfer_cp = create_commandpool(d, d->tq->_priv->family);
+			s->_priv->upload_budget = upload_budget;
+			// decode completions are dispatched in update()
+			s->_priv->loader = new LoadQueue(thread_count);
+
+			s->placeholder = create_texture(d, Ivec2(4), 1, 1, Format_R8G8B8A8_UNORM,
+				TextureUsageShaderSampled | TextureUsageTransferDst, MemPropDevice);
+			{
+				auto staging = create_buffer(d, 4 * 4 * 4, BufferUsageTransferSrc, MemPropHost | MemPropHostCoherent);
+				staging->map();
+				memset(staging->mapped, 0, staging->size);
+				staging->unmap();
+
+				BufferImageCopy c;
+				c.buffer_offset = 0;
+				c.image_width = 4;
+				c.image_height = 4;
+				c.image_level = 0;
+
+				auto cb = d->cp->create_commandbuffer();
+				cb->begin(true);
+				cb->change_texture_layout(s->placeholder, TextureLayoutUndefined, TextureLayoutTransferDst);
+				cb->copy_buffer_to_image(staging, s->placeholder, 1, &c);
+				cb->change_texture_layout(s->placeholder, TextureLayoutTransferDst, TextureLayoutShaderReadOnly);
+				cb->end();
+				d->q->submit(cb, nullptr, nullptr);
+				d->q->wait_idle();
+				d->cp->destroy_commandbuffer(cb);
+				destroy_buffer(d, staging);
+			}
+
+			return s;
+		}
+
+		void destroy_streamer(Device *d, Streamer *s)
+		{
+			auto p = s->_priv;
+			assert(d == p->d);
+
+			delete p->loader;
+
+			for (auto b : p->uploading)
+			{
+				b->fence->wait();
+				free_transfer(p, b);
+				for (auto &r : b->requests)
+				{
+					if (!r->ticket->cancelled)
+					{
+						r->ticket->cancelled = true;
+						r->ticket->state = LoadStateCancelled;
+					}
+				}
+				retire_batch(p, b);
+			}
+			for (auto b : p->acquiring)
+			{
+				b->acquire_fence->wait();
+				retire_batch(p, b);
+			}
+			for (auto &r : p->requests)
+			{
+				r.first->cancelled = true;
+				r.first->state = LoadStateCancelled;
+			}
+
+			destroy_commandpool(d, p->transfer_cp);
+			destroy_texture(d, s->placeholder);
+
+			delete p;
+			delete s;
+		}
+#endif
+	}
+}
@@ -0,0 +1,67 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <functional>
+
+#include <flame/load_queue.h>
+
+#include "graphics.h"
+
+namespace flame
+{
+	namespace graphics
+	{
+		struct Device;
+		struct Texture;
+
+		struct StreamerPrivate;
+
+		// textures are decoded on loader threads and uploaded in batches through the transfer queue,
+		// use the placeholder until the callback comes
+		struct Streamer
+		{
+			Texture *placeholder; // 4x4 R8G8B8A8 of zeros, like the engine's default_color_texture
+
+			StreamerPrivate *_priv;
+
+			// callback gets nullptr when the file cannot be loaded, it is not called when the ticket is cancelled
+			FLAME_GRAPHICS_EXPORTS std::shared_ptr<LoadTicket> load_texture(const std::string &filename, int priority,
+				const std::function<void(Texture *t)> &callback, int usage = 0, int mem_prop = 0);
+			FLAME_GRAPHICS_EXPORTS void set_priority(const std::shared_ptr<LoadTicket> &t, int priority);
+			// returns false when the callback has already been called
+			FLAME_GRAPHICS_EXPORTS bool cancel(const std::shared_ptr<LoadTicket> &t);
+			// call once a frame on the thread that submits to d->q, it starts the uploads of the decoded
+			// textures (up to upload_budget bytes) and calls back the ones whose upload has finished
+			FLAME_GRAPHICS_EXPORTS void update();
+			// requests that have not been called back yet
+			FLAME_GRAPHICS_EXPORTS int get_pending_count();
+		};
+
+		FLAME_GRAPHICS_EXPORTS Streamer *create_streamer(Device *d, int thread_count = 0, int upload_budget = 32 * 1024 * 1024);
+		// waits for the uploads in flight, the queued requests are dropped
+		FLAME_GRAPHICS_EXPORTS void destroy_streamer(Device *d, Streamer *s);
+	}
+}
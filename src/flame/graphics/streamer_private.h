@@ -0,0 +1,78 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include "streamer.h"
+#include "texture.h"
+#include "graphics_private.h"
+
+#include <list>
+#include <map>
+
+namespace flame
+{
+	namespace graphics
+	{
+		struct Commandpool;
+		struct Commandbuffer;
+		struct Buffer;
+		struct Fence;
+
+#if defined(FLAME_GRAPHICS_VULKAN)
+		struct StreamRequest
+		{
+			std::shared_ptr<LoadTicket> ticket; // the one the requester has
+			std::shared_ptr<LoadTicket> load_ticket; // the decode job
+			TextureData data;
+			bool ok;
+			std::function<void(Texture *t)> callback;
+			int usage;
+			int mem_prop;
+			Texture *t;
+		};
+
+		struct StreamBatch
+		{
+			std::vector<std::shared_ptr<StreamRequest>> requests;
+			Buffer *staging;
+			Commandbuffer *cb; // transfer queue
+			Fence *fence;
+			Commandbuffer *acquire_cb; // graphics queue, when the queues are of different families
+			Fence *acquire_fence;
+		};
+
+		struct StreamerPrivate
+		{
+			Device *d;
+			Commandpool *transfer_cp;
+			int upload_budget;
+			LoadQueue *loader;
+			std::map<LoadTicket*, std::shared_ptr<StreamRequest>> requests; // not called back yet
+
+			std::vector<std::shared_ptr<StreamRequest>> decoded;
+			std::list<StreamBatch*> uploading; // waiting for the transfer queue
+			std::list<StreamBatch*> acquiring; // waiting for the graphics queue to take the ownership
+		};
+#endif
+	}
+}
@@ -22,6 +22,7 @@
 
 #include "texture.h"
 #include "graphics_private.h"
+#include "memory_private.h"
 
 namespace flame
 {
@@ -34,7 +35,7 @@ namespace flame
 			int mem_prop;
 			Device *d;
 			VkImage v;
-			VkDeviceMemory m;
+			MemoryAllocation m;
 #else
 			GLuint v;
 #endif
@@ -0,0 +1,376 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/jobs.h>
+
+#include <assert.h>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <algorithm>
+
+namespace flame
+{
+	struct Job
+	{
+		std::function<void()> func;
+		JobCounter *counter;
+	};
+
+	// Chase-Lev work-stealing deque of fixed capacity (a full one makes push fail)
+	// Le, Pop, Cohen, Zappa Nardelli - Correct and Efficient Work-Stealing for Weak Memory Models
+	class JobDeque
+	{
+	public:
+		enum
+		{
+			Capacity = 4096 // must be power of 2
+		};
+
+	private:
+		std::atomic<long long> top;
+		std::atomic<long long> bottom;
+		std::atomic<Job*> buffer[Capacity];
+
+	public:
+		JobDeque() :
+			top(0),
+			bottom(0)
+		{
+		}
+
+		// owner only
+		bool push(Job *j)
+		{
+			auto b = bottom.load(std::memory_order_relaxed);
+			auto t = top.load(std::memory_order_acquire);
+			if (b - t >= Capacity)
+				return false;
+			buffer[b & (Capacity - 1)].store(j, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		// owner only, the newest
+		Job *pop()
+		{
+			auto b = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto t = top.load(std::memory_order_relaxed);
+			if (t > b)
+			{
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			auto j = buffer[b & (Capacity - 1)].load(std::memory_order_relaxed);
+			if (t == b)
+			{
+				// the last one, race the thieves for it
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					j = nullptr;
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			return j;
+		}
+
+		// any thread, the oldest
+		Job *steal()
+		{
+			auto t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto b = bottom.load(std::memory_order_acquire);
+			if (t >= b)
+				return nullptr;
+			auto j = buffer[t & (Capacity - 1)].load(std::memory_order_relaxed);
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return nullptr; // lost to the owner or another thief
+			return j;
+		}
+	};
+
+	struct JobSystemPrivate;
+
+	static thread_local JobSystemPrivate *this_system;
+	static thread_local int this_index = -1;
+	static thread_local unsigned int steal_seed = 1;
+
+	struct JobSystemPrivate
+	{
+		std::vector<std::unique_ptr<JobDeque>> deques; // one for each worker
+		std::vector<std::thread> threads;
+
+		std::mutex shared_mtx;
+		std::deque<Job*> shared; // given by threads that are not workers, or when a deque is full
+
+		std::atomic<int> queued; // pushed and not taken yet
+		std::atomic<int> sleeping;
+		std::mutex sleep_mtx;
+		std::condition_variable sleep_cv;
+		std::atomic<bool> quit;
+
+		int get_index()
+		{
+			return this_system == this ? this_index : -1;
+		}
+
+		void push(Job *j)
+		{
+			queued.fetch_add(1);
+			auto index = get_index();
+			if (index == -1 || !deques[index]->push(j))
+			{
+				std::lock_guard<std::mutex> lock(shared_mtx);
+				shared.push_back(j);
+			}
+			if (sleeping.load() > 0)
+			{
+				std::lock_guard<std::mutex> lock(sleep_mtx);
+				sleep_cv.notify_one();
+			}
+		}
+
+		Job *take(int index)
+		{
+			Job *j = nullptr;
+			if (index != -1)
+				j = deques[index]->pop();
+			if (!j)
+			{
+				std::lock_guard<std::mutex> lock(shared_mtx);
+				if (!shared.empty())
+				{
+					j = shared.front();
+					shared.pop_front();
+				}
+			}
+			if (!j)
+			{
+				// from a random victim on
+				auto n = (int)deques.size();
+				steal_seed = steal_seed * 1103515245 + 12345;
+				auto first = (steal_seed >> 16) % n;
+				for (auto i = 0; i < n && !j; i++)
+				{
+					auto victim = (first + i) % n;
+					if (victim != index)
+						j = deques[victim]->steal();
+				}
+			}
+			if (j)
+				queued.fetch_sub(1);
+			return j;
+		}
+
+		void execute(Job *j)
+		{
+			j->func();
+			if (j->counter)
+				j->counter->count.fetch_sub(1, std::memory_order_acq_rel);
+			delete j;
+		}
+
+		void work(int index)
+		{
+			this_system = this;
+			this_index = index;
+			steal_seed = index + 1;
+
+			auto idle_rounds = 0;
+			while (!quit.load())
+			{
+				auto j = take(index);
+				if (j)
+				{
+					execute(j);
+					idle_rounds = 0;
+					continue;
+				}
+				// spin a little before going to sleep, jobs often come in bursts
+				if (++idle_rounds < 64)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+				idle_rounds = 0;
+				std::unique_lock<std::mutex> lock(sleep_mtx);
+				sleeping.fetch_add(1);
+				sleep_cv.wait(lock, [this]() {
+					return queued.load() > 0 || quit.load();
+				});
+				sleeping.fetch_sub(1);
+			}
+		}
+	};
+
+	int JobSystem::get_worker_count()
+	{
+		return _priv->deques.size();
+	}
+
+	int JobSystem::get_worker_index()
+	{
+		return _priv->get_index();
+	}
+
+	void JobSystem::run(const std::function<void()> &func, JobCounter *counter)
+	{
+		if (counter)
+			counter->count.fetch_add(1, std::memory_order_acq_rel);
+		auto j = new Job;
+		j->func = func;
+		j->counter = counter;
+		_priv->push(j);
+	}
+
+	void JobSystem::wait(JobCounter *counter)
+	{
+		auto index = _priv->get_index();
+		while (!counter->done())
+		{
+			auto j = _priv->take(index);
+			if (j)
+				_priv->execute(j);
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	void JobSystem::parallel_for(int begin, int end, int grain, const std::function<void(int begin, int end)> &func)
+	{
+		grain = std::max(grain, 1);
+		if (end - begin <= grain)
+		{
+			if (end > begin)
+				func(begin, end);
+			return;
+		}
+
+		JobCounter counter;
+		// the calling thread takes the first range itself
+		for (auto b = begin + grain; b < end; b += grain)
+		{
+			auto e = std::min(b + grain, end);
+			run([&func, b, e]() {
+				func(b, e);
+			}, &counter);
+		}
+		func(begin, begin + grain);
+		wait(&counter);
+	}
+
+	void JobSystem::run_graph(TaskGraph &g)
+	{
+		if (g.tasks.empty())
+			return;
+
+		JobCounter counter;
+		counter.count = g.tasks.size();
+		std::vector<int> roots;
+		for (auto i = 0; i < g.tasks.size(); i++)
+		{
+			auto &t = g.tasks[i];
+			t.remaining.store(t.dependency_count, std::memory_order_relaxed);
+			if (t.dependency_count == 0)
+				roots.push_back(i);
+		}
+		assert(!roots.empty());
+		if (roots.empty())
+			return;
+
+		std::function<void(int)> launch;
+		launch = [this, &g, &launch, &counter](int i) {
+			run([&g, &launch, &counter, i]() {
+				auto &t = g.tasks[i];
+				t.func();
+				for (auto s : t.successors)
+				{
+					if (g.tasks[s].remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+						launch(s);
+				}
+				// the last thing, run_graph may return right after
+				counter.count.fetch_sub(1, std::memory_order_acq_rel);
+			});
+		};
+		for (auto i : roots)
+			launch(i);
+		wait(&counter);
+	}
+
+	JobSystem *create_job_system(int worker_count)
+	{
+		if (worker_count <= 0)
+			worker_count = std::max((int)std::thread::hardware_concurrency(), 1);
+
+		auto s = new JobSystem;
+		s->_priv = new JobSystemPrivate;
+		auto p = s->_priv;
+		p->queued = 0;
+		p->sleeping = 0;
+		p->quit = false;
+		for (auto i = 0; i < worker_count; i++)
+			p->deques.emplace_back(new JobDeque);
+
+		this_system = p;
+		this_index = 0;
+		for (auto i = 1; i < worker_count; i++)
+		{
+			p->threads.emplace_back([p, i]() {
+				p->work(i);
+			});
+		}
+
+		return s;
+	}
+
+	void destroy_job_system(JobSystem *s)
+	{
+		auto p = s->_priv;
+		{
+			std::lock_guard<std::mutex> lock(p->sleep_mtx);
+			p->quit = true;
+			p->sleep_cv.notify_all();
+		}
+		for (auto &t : p->threads)
+			t.join();
+
+		// jobs nobody waited for are dropped
+		for (auto &d : p->deques)
+		{
+			while (auto j = d->steal())
+				delete j;
+		}
+		for (auto j : p->shared)
+			delete j;
+
+		if (this_system == p)
+		{
+			this_system = nullptr;
+			this_index = -1;
+		}
+		delete p;
+		delete s;
+	}
+}
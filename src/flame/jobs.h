@@ -0,0 +1,131 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#if defined(_WIN32)
+#ifdef _FLAME_JOBS_EXPORTS
+#define FLAME_JOBS_EXPORTS __declspec(dllexport)
+#else
+#define FLAME_JOBS_EXPORTS __declspec(dllimport)
+#endif
+#else
+#define FLAME_JOBS_EXPORTS
+#endif
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace flame
+{
+	// counts the unfinished jobs it was given to, a job may be given more jobs to the same counter
+	// before it finishes
+	struct JobCounter
+	{
+		std::atomic<int> count;
+
+		JobCounter() :
+			count(0)
+		{
+		}
+
+		bool done() const
+		{
+			return count.load(std::memory_order_acquire) == 0;
+		}
+	};
+
+	// tasks and the order between them, can be run many times (e.g. once a frame)
+	struct TaskGraph
+	{
+		struct Task
+		{
+			std::function<void()> func;
+			std::vector<int> successors;
+			int dependency_count;
+			std::atomic<int> remaining; // while running
+
+			Task(const std::function<void()> &_func) :
+				func(_func),
+				dependency_count(0),
+				remaining(0)
+			{
+			}
+
+			Task(const Task &rhs) :
+				func(rhs.func),
+				successors(rhs.successors),
+				dependency_count(rhs.dependency_count),
+				remaining(0)
+			{
+			}
+		};
+
+		std::vector<Task> tasks;
+
+		int add(const std::function<void()> &func)
+		{
+			tasks.emplace_back(func);
+			return tasks.size() - 1;
+		}
+
+		// task runs after before is finished
+		void depend(int task, int before)
+		{
+			tasks[before].successors.push_back(task);
+			tasks[task].dependency_count++;
+		}
+
+		void clear()
+		{
+			tasks.clear();
+		}
+	};
+
+	struct JobSystemPrivate;
+
+	// a worker thread for each core but one, each worker has a Chase-Lev deque of its own: it pushes and
+	// pops at the bottom, the others steal at the top
+	// the thread that creates the system is a worker too (index 0) and works while it waits, jobs
+	// given by other threads go through a shared queue
+	struct JobSystem
+	{
+		JobSystemPrivate *_priv;
+
+		FLAME_JOBS_EXPORTS int get_worker_count(); // including the creating thread
+		FLAME_JOBS_EXPORTS int get_worker_index(); // of the calling thread, -1 when it is not one of this system
+
+		FLAME_JOBS_EXPORTS void run(const std::function<void()> &func, JobCounter *counter = nullptr);
+		// runs other jobs until the counter is done
+		FLAME_JOBS_EXPORTS void wait(JobCounter *counter);
+
+		// func(begin, end) over ranges of at most grain, returns when all are done
+		FLAME_JOBS_EXPORTS void parallel_for(int begin, int end, int grain, const std::function<void(int begin, int end)> &func);
+		// returns when all tasks are done, the graph must not have cycles
+		FLAME_JOBS_EXPORTS void run_graph(TaskGraph &g);
+	};
+
+	// worker_count - 0 for one for each hardware thread
+	FLAME_JOBS_EXPORTS JobSystem *create_job_system(int worker_count = 0);
+	FLAME_JOBS_EXPORTS void destroy_job_system(JobSystem *s);
+}
@@ -0,0 +1,232 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <flame/type.h>
+#include <flame/math.h>
+#include <flame/time.h>
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+
+namespace flame
+{
+	// clustered light assignment, the view frustum is cut into x * y screen tiles and z depth
+	// slices (exponential, so clusters stay roughly cubic), every cluster gets the list of
+	// lights whose sphere of influence touches it, the shader finds its cluster from the
+	// fragment coord and the linear depth and only loops over that list
+	//
+	// everything is in view space (camera looking down -z), tiles go from the top left of
+	// the screen like gl_FragCoord in vulkan, slice k covers depths near * (far / near) ^ (k / z)
+	// to near * (far / near) ^ ((k + 1) / z)
+	class LightClusterGrid
+	{
+	public:
+		int cx, cy, cz;
+		float near_plane, far_plane;
+		float slice_scale, slice_bias; // slice = floor(log(depth) * slice_scale + slice_bias)
+
+		std::vector<uint> offsets; // per cluster, the offset and the count in indices
+		std::vector<uint> indices;
+
+		int overflow_count; // (cluster, light) pairs that did not fit in max_index_count
+		float bin_time_ms;
+	protected:
+		float tan_x, tan_y;
+		std::vector<Vec3> cluster_min, cluster_max;
+		std::vector<Ivec2> pairs; // (cluster, light)
+	public:
+		LightClusterGrid() :
+			cx(0),
+			cy(0),
+			cz(0),
+			overflow_count(0),
+			bin_time_ms(0.f)
+		{
+		}
+
+		int get_cluster_count() const
+		{
+			return cx * cy * cz;
+		}
+
+		int get_cluster_index(int x, int y, int z) const
+		{
+			return (z * cy + y) * cx + x;
+		}
+
+		int get_slice(float depth) const
+		{
+			if (depth <= near_plane)
+				return 0;
+			return std::min(cz - 1, (int)(logf(depth) * slice_scale + slice_bias));
+		}
+
+		void get_cluster_bounds(int index, Vec3 &out_min, Vec3 &out_max) const
+		{
+			out_min = cluster_min[index];
+			out_max = cluster_max[index];
+		}
+
+		// fovy in radians, call again when the projection changes
+		void setup(int _cx, int _cy, int _cz, float fovy, float aspect, float _near, float _far)
+		{
+			cx = _cx;
+			cy = _cy;
+			cz = _cz;
+			near_plane = _near;
+			far_plane = _far;
+			tan_y = tanf(fovy * 0.5f);
+			tan_x = tan_y * aspect;
+			auto log_ratio = logf(far_plane / near_plane);
+			slice_scale = cz / log_ratio;
+			slice_bias = -cz * logf(near_plane) / log_ratio;
+
+			auto n = get_cluster_count();
+			cluster_min.resize(n);
+			cluster_max.resize(n);
+			offsets.resize(n * 2);
+			for (auto z = 0; z < cz; z++)
+			{
+				float depths[] = {
+					near_plane * powf(far_plane / near_plane, (float)z / cz),
+					near_plane * powf(far_plane / near_plane, (float)(z + 1) / cz)
+				};
+				for (auto y = 0; y < cy; y++)
+				{
+					float ndc_y[] = { 1.f - 2.f * (y + 1) / cy, 1.f - 2.f * y / cy };
+					for (auto x = 0; x < cx; x++)
+					{
+						float ndc_x[] = { -1.f + 2.f * x / cx, -1.f + 2.f * (x + 1) / cx };
+						Vec3 mn(FLT_MAX), mx(-FLT_MAX);
+						for (auto d : depths)
+						{
+							for (auto i = 0; i < 2; i++)
+							{
+								Vec3 p(ndc_x[i] * d * tan_x, ndc_y[i] * d * tan_y, -d);
+								mn = Vec3(std::min(mn.x, p.x), std::min(mn.y, p.y), std::min(mn.z, p.z));
+								mx = Vec3(std::max(mx.x, p.x), std::max(mx.y, p.y), std::max(mx.z, p.z));
+							}
+						}
+						auto idx = get_cluster_index(x, y, z);
+						cluster_min[idx] = mn;
+						cluster_max[idx] = mx;
+					}
+				}
+			}
+		}
+
+		static float axis_distance(float v, float mn, float mx)
+		{
+			return v < mn ? mn - v : (v > mx ? v - mx : 0.f);
+		}
+
+		static bool sphere_touches_box(const Vec3 &c, float r, const Vec3 &mn, const Vec3 &mx)
+		{
+			auto dx = axis_distance(c.x, mn.x, mx.x);
+			auto dy = axis_distance(c.y, mn.y, mx.y);
+			auto dz = axis_distance(c.z, mn.z, mx.z);
+			return dx * dx + dy * dy + dz * dz <= r * r;
+		}
+
+		// lights are (view space position, radius), max_index_count 0 is unlimited
+		void bin(const Vec4 *lights, int light_count, int max_index_count = 0)
+		{
+			auto t0 = get_now_ns();
+
+			pairs.clear();
+			for (auto i = 0; i < light_count; i++)
+			{
+				Vec3 c(lights[i].x, lights[i].y, lights[i].z);
+				auto r = lights[i].w;
+
+				auto d0 = std::max(-c.z - r, near_plane);
+				auto d1 = std::min(-c.z + r, far_plane);
+				if (d0 > d1)
+					continue;
+				auto z0 = get_slice(d0), z1 = get_slice(d1);
+
+				for (auto z = z0; z <= z1; z++)
+				{
+					// the x extents of the clusters in a slice do not depend on y and the other way round,
+					// so find the touched columns and rows first and only test the rectangle
+					auto x0 = 0, x1 = cx - 1;
+					while (x0 <= x1 && cluster_max[get_cluster_index(x0, 0, z)].x < c.x - r)
+						x0++;
+					while (x1 >= x0 && cluster_min[get_cluster_index(x1, 0, z)].x > c.x + r)
+						x1--;
+					auto y0 = 0, y1 = cy - 1; // y goes down the screen, so down in view space
+					while (y0 <= y1 && cluster_min[get_cluster_index(0, y0, z)].y > c.y + r)
+						y0++;
+					while (y1 >= y0 && cluster_max[get_cluster_index(0, y1, z)].y < c.y - r)
+						y1--;
+
+					for (auto y = y0; y <= y1; y++)
+					{
+						for (auto x = x0; x <= x1; x++)
+						{
+							auto idx = get_cluster_index(x, y, z);
+							if (sphere_touches_box(c, r, cluster_min[idx], cluster_max[idx]))
+								pairs.push_back(Ivec2(idx, i));
+						}
+					}
+				}
+			}
+
+			// counting sort by cluster, the lights in a cluster stay in their input order
+			auto n = get_cluster_count();
+			std::fill(offsets.begin(), offsets.end(), 0);
+			for (auto &p : pairs)
+				offsets[p.x * 2 + 1]++;
+			uint offset = 0;
+			overflow_count = 0;
+			for (auto i = 0; i < n; i++)
+			{
+				auto &count = offsets[i * 2 + 1];
+				if (max_index_count > 0 && offset + count > (uint)max_index_count)
+				{
+					auto fit = max_index_count - offset;
+					overflow_count += count - fit;
+					count = fit;
+				}
+				offsets[i * 2] = offset;
+				offset += count;
+			}
+			indices.resize(offset);
+			for (auto i = 0; i < n; i++)
+				offsets[i * 2 + 1] = 0;
+			for (auto &p : pairs)
+			{
+				auto &o = offsets[p.x * 2];
+				auto &c = offsets[p.x * 2 + 1];
+				auto next = p.x + 1 < n ? offsets[p.x * 2 + 2] : offset;
+				if (o + c < next)
+					indices[o + c++] = p.y;
+			}
+
+			bin_time_ms = (get_now_ns() - t0) / 1000000.f;
+		}
+	};
+}
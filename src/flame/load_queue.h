@@ -0,0 +1,341 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace flame
+{
+	enum LoadPriority
+	{
+		LoadPriorityLow,
+		LoadPriorityNormal,
+		LoadPriorityHigh,
+		LoadPriorityCount
+	};
+
+	enum LoadState
+	{
+		LoadStatePending,
+		LoadStateRunning,
+		LoadStateDone,
+		LoadStateFailed,
+		LoadStateCancelled
+	};
+
+	// shared between the requester and the queue, long running work should poll cancelled
+	struct LoadTicket
+	{
+		std::atomic<int> state;
+		std::atomic<int> priority;
+		std::atomic<bool> cancelled;
+
+		LoadTicket(int _priority) :
+			state(LoadStatePending),
+			priority(_priority),
+			cancelled(false)
+		{
+		}
+
+		bool finished() const
+		{
+			return state.load() >= LoadStateDone;
+		}
+	};
+
+	// a pool of loader threads, the work runs on a loader thread, the completion is handed
+	// to post (e.g. the engine's add_after_frame_event) or, with no post, queued until
+	// dispatch() is called, so it always runs on the thread that owns the resources
+	// jobs are taken highest priority first and in request order within a priority
+	class LoadQueue
+	{
+	public:
+		typedef std::function<bool(LoadTicket &)> Work; // returns false when the load failed
+		typedef std::function<void(bool ok)> Completion;
+		typedef std::function<void(const std::function<void()> &)> Post;
+
+	protected:
+		struct Job
+		{
+			std::shared_ptr<LoadTicket> ticket;
+			int priority; // the priority it was queued with, a stale entry is skipped
+			Work work;
+			std::shared_ptr<Completion> completion;
+		};
+
+		Post post;
+
+		std::mutex mtx;
+		std::condition_variable cv;
+		std::condition_variable idle_cv;
+		std::deque<Job> jobs[LoadPriorityCount];
+		int queued_count; // live entries in jobs
+		int running_count;
+		bool quit;
+		std::vector<std::thread> threads;
+
+		std::mutex completion_mtx;
+		std::vector<std::function<void()>> completions;
+
+		void run()
+		{
+			for (;;)
+			{
+				Job job;
+				{
+					std::unique_lock<std::mutex> lock(mtx);
+					for (;;)
+					{
+						if (quit)
+							return;
+						if (take(job))
+							break;
+						cv.wait(lock);
+					}
+					running_count++;
+				}
+
+				auto &t = *job.ticket;
+				auto ok = job.work(t);
+
+				{
+					std::lock_guard<std::mutex> lock(mtx);
+					running_count--;
+					if (t.cancelled)
+						t.state = LoadStateCancelled;
+					else if (!job.completion)
+						t.state = ok ? LoadStateDone : LoadStateFailed;
+					if (queued_count == 0 && running_count == 0)
+						idle_cv.notify_all();
+				}
+
+				if (!t.cancelled && job.completion)
+				{
+					auto ticket = job.ticket;
+					auto completion = job.completion;
+					finish([ticket, completion, ok]() {
+						// cancel() may have come in between
+						if (ticket->cancelled)
+						{
+							ticket->state = LoadStateCancelled;
+							return;
+						}
+						(*completion)(ok);
+						ticket->state = ok ? LoadStateDone : LoadStateFailed;
+					});
+				}
+			}
+		}
+
+		// with mtx held
+		bool take(Job &out)
+		{
+			for (auto p = LoadPriorityCount - 1; p >= 0; p--)
+			{
+				auto &q = jobs[p];
+				while (!q.empty())
+				{
+					auto job = std::move(q.front());
+					q.pop_front();
+					auto &t = *job.ticket;
+					if (job.priority != t.priority || t.state != LoadStatePending)
+						continue; // re-queued with another priority or cancelled
+					queued_count--;
+					if (t.cancelled)
+					{
+						t.state = LoadStateCancelled;
+						continue;
+					}
+					t.state = LoadStateRunning;
+					out = std::move(job);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void finish(const std::function<void()> &f)
+		{
+			if (post)
+				post(f);
+			else
+			{
+				std::lock_guard<std::mutex> lock(completion_mtx);
+				completions.push_back(f);
+			}
+		}
+
+		static int clamp_priority(int p)
+		{
+			return std::min(std::max(p, 0), (int)LoadPriorityCount - 1);
+		}
+
+	public:
+		// thread_count 0 means hardware threads - 1 (at least one)
+		LoadQueue(int thread_count = 0, const Post &_post = nullptr) :
+			post(_post),
+			queued_count(0),
+			running_count(0),
+			quit(false)
+		{
+			if (thread_count <= 0)
+				thread_count = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+			for (auto i = 0; i < thread_count; i++)
+				threads.emplace_back(&LoadQueue::run, this);
+		}
+
+		// the queued jobs are cancelled, the running ones are waited for
+		~LoadQueue()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				quit = true;
+				for (auto &q : jobs)
+				{
+					for (auto &j : q)
+					{
+						if (j.priority == j.ticket->priority && j.ticket->state == LoadStatePending)
+						{
+							j.ticket->cancelled = true;
+							j.ticket->state = LoadStateCancelled;
+						}
+					}
+					q.clear();
+				}
+				queued_count = 0;
+			}
+			cv.notify_all();
+			for (auto &t : threads)
+				t.join();
+		}
+
+		int get_thread_count() const
+		{
+			return threads.size();
+		}
+
+		std::shared_ptr<LoadTicket> push(int priority, const Work &work, const Completion &completion = nullptr)
+		{
+			priority = clamp_priority(priority);
+			auto t = std::make_shared<LoadTicket>(priority);
+			Job job;
+			job.ticket = t;
+			job.priority = priority;
+			job.work = work;
+			if (completion)
+				job.completion = std::make_shared<Completion>(completion);
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				jobs[priority].push_back(std::move(job));
+				queued_count++;
+			}
+			cv.notify_one();
+			return t;
+		}
+
+		// a job that is still queued moves to the back of the new priority
+		void set_priority(const std::shared_ptr<LoadTicket> &t, int priority)
+		{
+			priority = clamp_priority(priority);
+			std::lock_guard<std::mutex> lock(mtx);
+			if (t->priority == priority || t->state != LoadStatePending)
+			{
+				t->priority = priority;
+				return;
+			}
+			auto &q = jobs[t->priority];
+			for (auto it = q.begin(); it != q.end(); it++)
+			{
+				if (it->ticket == t && it->priority == t->priority)
+				{
+					auto job = std::move(*it);
+					q.erase(it);
+					job.priority = priority;
+					t->priority = priority;
+					jobs[priority].push_back(std::move(job));
+					return;
+				}
+			}
+		}
+
+		// a queued job is dropped right away, a running one finishes its work but its completion
+		// is not called, returns false when the job has already completed
+		bool cancel(const std::shared_ptr<LoadTicket> &t)
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if (t->finished())
+				return false;
+			t->cancelled = true;
+			if (t->state == LoadStatePending)
+			{
+				t->state = LoadStateCancelled;
+				queued_count--;
+				if (queued_count == 0 && running_count == 0)
+					idle_cv.notify_all();
+			}
+			return true;
+		}
+
+		// runs the completions collected so far when there is no post, returns how many ran
+		int dispatch(int max_count = -1)
+		{
+			std::vector<std::function<void()>> list;
+			{
+				std::lock_guard<std::mutex> lock(completion_mtx);
+				if (max_count < 0 || max_count >= (int)completions.size())
+					list.swap(completions);
+				else
+				{
+					list.assign(completions.begin(), completions.begin() + max_count);
+					completions.erase(completions.begin(), completions.begin() + max_count);
+				}
+			}
+			for (auto &f : list)
+				f();
+			return list.size();
+		}
+
+		// blocks until no job is queued or running (the completions may still wait for dispatch)
+		void wait_idle()
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			idle_cv.wait(lock, [this]() {
+				return queued_count == 0 && running_count == 0;
+			});
+		}
+
+		int get_pending_count()
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return queued_count + running_count;
+		}
+	};
+}
@@ -0,0 +1,247 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <flame/filesystem.h>
+#include <flame/system.h>
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <regex>
+#include <algorithm>
+#include <string.h>
+
+namespace flame
+{
+	struct LogLine
+	{
+		const char *str; // not null terminated, points into the mapping
+		int length; // without the end of line
+	};
+
+	// the line start offsets of a text file that stays mapped, so memory goes with the line count and not
+	// the text, the first index is built in parallel chunks and update() indexes only appended bytes
+	class LogIndex
+	{
+	protected:
+		std::string filename;
+		FileMapping *file;
+		std::vector<long long> starts; // 0 and every position after a '\n'
+		long long indexed_size;
+		int thread_count;
+
+		// the positions after each '\n' in [begin, end), in order, split over threads when it is big
+		void scan(long long begin, long long end)
+		{
+			const long long min_chunk = 4 * 1024 * 1024;
+			auto size = end - begin;
+			auto n = std::max(1, std::min(thread_count, (int)(size / min_chunk)));
+
+			std::vector<std::vector<long long>> found(n);
+			auto scan_chunk = [&](int i) {
+				auto b = begin + size * i / n;
+				auto e = begin + size * (i + 1) / n;
+				auto &out = found[i];
+				out.reserve((e - b) / 64);
+				auto data = (const char*)file->data;
+				auto p = data + b;
+				auto p_end = data + e;
+				while (p < p_end)
+				{
+					auto nl = (const char*)memchr(p, '\n', p_end - p);
+					if (!nl)
+						break;
+					out.push_back(nl + 1 - data);
+					p = nl + 1;
+				}
+			};
+			if (n == 1)
+				scan_chunk(0);
+			else
+			{
+				std::vector<std::thread> threads;
+				for (auto i = 1; i < n; i++)
+					threads.emplace_back(scan_chunk, i);
+				scan_chunk(0);
+				for (auto &t : threads)
+					t.join();
+			}
+
+			size_t total = starts.size();
+			for (auto &f : found)
+				total += f.size();
+			starts.reserve(total);
+			for (auto &f : found)
+				starts.insert(starts.end(), f.begin(), f.end());
+		}
+
+	public:
+		LogIndex() :
+			file(nullptr),
+			indexed_size(0),
+			thread_count(1)
+		{
+		}
+
+		~LogIndex()
+		{
+			close();
+		}
+
+		// thread_count 0 for every core
+		bool open(const std::string &_filename, int _thread_count = 0)
+		{
+			close();
+			filename = _filename;
+			thread_count = _thread_count > 0 ? _thread_count : std::max(1, (int)std::thread::hardware_concurrency());
+			file = map_file(filename.c_str());
+			if (!file)
+				return false;
+			starts.push_back(0);
+			scan(0, file->size);
+			indexed_size = file->size;
+			return true;
+		}
+
+		void close()
+		{
+			if (file)
+				unmap_file(file);
+			file = nullptr;
+			starts.clear();
+			indexed_size = 0;
+		}
+
+		bool is_open() const
+		{
+			return file != nullptr;
+		}
+
+		// maps the file again when it has grown and indexes the new bytes (a line that was cut short
+		// gets its rest), starts over when it got smaller, returns how many lines were added,
+		// LogLines taken before are invalid after this
+		int update()
+		{
+			if (!file)
+				return 0;
+			std::error_code ec;
+			long long size = std::filesystem::file_size(filename, ec);
+			if (ec || size == indexed_size)
+				return 0;
+			if (size < indexed_size)
+			{
+				auto t = thread_count;
+				auto name = filename;
+				open(name, t);
+				return get_line_count();
+			}
+
+			auto old_count = get_line_count();
+			auto f = map_file(filename.c_str());
+			if (!f)
+				return 0;
+			unmap_file(file);
+			file = f;
+			size = f->size;
+			scan(indexed_size, size);
+			indexed_size = size;
+			return get_line_count() - old_count;
+		}
+
+		long long get_size() const
+		{
+			return indexed_size;
+		}
+
+		int get_line_count() const
+		{
+			if (starts.empty())
+				return 0;
+			return starts.size() - (starts.back() == indexed_size ? 1 : 0);
+		}
+
+		LogLine get_line(int i) const
+		{
+			auto b = starts[i];
+			auto e = i + 1 < (int)starts.size() ? starts[i + 1] - 1 : indexed_size;
+			auto data = (const char*)file->data;
+			if (e > b && data[e - 1] == '\r')
+				e--;
+			LogLine l;
+			l.str = data + b;
+			l.length = e - b;
+			return l;
+		}
+	};
+
+	// a pattern compiled once, matched in place on a line, the columns are the sub matches
+	class LogMatcher
+	{
+	protected:
+		std::regex regex;
+		bool valid;
+	public:
+		LogMatcher() :
+			valid(false)
+		{
+		}
+
+		// returns false (and matches nothing) when the pattern is not a valid regex
+		bool compile(const std::string &pattern)
+		{
+			try
+			{
+				regex = std::regex(pattern, std::regex::ECMAScript | std::regex::optimize);
+				valid = true;
+			}
+			catch (std::regex_error &)
+			{
+				valid = false;
+			}
+			return valid;
+		}
+
+		bool is_valid() const
+		{
+			return valid;
+		}
+
+		// columns[i] gets sub match indices[i] (empty when there is no such group)
+		bool match(const LogLine &l, const int *indices, int count, std::string *columns) const
+		{
+			std::cmatch m;
+			if (!valid || !std::regex_search(l.str, l.str + l.length, m, regex))
+				return false;
+			for (auto i = 0; i < count; i++)
+			{
+				auto idx = indices[i];
+				if (idx >= 0 && idx < (int)m.size())
+					columns[i] = m[idx].str();
+				else
+					columns[i].clear();
+			}
+			return true;
+		}
+	};
+}
@@ -27,6 +27,26 @@
 
 #include <math.h>
 
+// FLAME_MATH_NO_SIMD forces the scalar code, otherwise the simd back end is picked from what the compiler targets
+#if !defined(FLAME_MATH_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLAME_MATH_SSE
+#if defined(__AVX__)
+#define FLAME_MATH_AVX
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define FLAME_MATH_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#if defined(FLAME_MATH_SSE) || defined(FLAME_MATH_NEON)
+#define FLAME_MATH_SIMD
+#endif
+
 #undef min
 #undef max
 
@@ -726,6 +746,162 @@ namespace flame
 		float intersect(const Vec3 &origin, const Vec3 &dir);
 	};
 
+#if defined(FLAME_MATH_SIMD)
+	// the small set of 4-wide operations the simd paths are written in, one block per instruction set
+	namespace math_simd
+	{
+#if defined(FLAME_MATH_SSE)
+		typedef __m128 F4;
+
+		inline F4 load(const float *p)
+		{
+			return _mm_loadu_ps(p);
+		}
+
+		inline void store(float *p, F4 v)
+		{
+			_mm_storeu_ps(p, v);
+		}
+
+		inline F4 splat(float v)
+		{
+			return _mm_set1_ps(v);
+		}
+
+		inline F4 add(F4 a, F4 b)
+		{
+			return _mm_add_ps(a, b);
+		}
+
+		inline F4 sub(F4 a, F4 b)
+		{
+			return _mm_sub_ps(a, b);
+		}
+
+		inline F4 mul(F4 a, F4 b)
+		{
+			return _mm_mul_ps(a, b);
+		}
+
+		inline F4 div(F4 a, F4 b)
+		{
+			return _mm_div_ps(a, b);
+		}
+
+		// (a[i0], a[i1], b[i2], b[i3])
+		template<int i0, int i1, int i2, int i3>
+		inline F4 shuffle(F4 a, F4 b)
+		{
+			return _mm_shuffle_ps(a, b, _MM_SHUFFLE(i3, i2, i1, i0));
+		}
+
+		inline void transpose(F4 &r0, F4 &r1, F4 &r2, F4 &r3)
+		{
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		}
+
+		// all bits set in the lanes where a < b
+		inline F4 less(F4 a, F4 b)
+		{
+			return _mm_cmplt_ps(a, b);
+		}
+
+		inline F4 bit_or(F4 a, F4 b)
+		{
+			return _mm_or_ps(a, b);
+		}
+
+		// the sign bit of lane i to bit i
+		inline int mask(F4 v)
+		{
+			return _mm_movemask_ps(v);
+		}
+#elif defined(FLAME_MATH_NEON)
+		typedef float32x4_t F4;
+
+		inline F4 load(const float *p)
+		{
+			return vld1q_f32(p);
+		}
+
+		inline void store(float *p, F4 v)
+		{
+			vst1q_f32(p, v);
+		}
+
+		inline F4 splat(float v)
+		{
+			return vdupq_n_f32(v);
+		}
+
+		inline F4 add(F4 a, F4 b)
+		{
+			return vaddq_f32(a, b);
+		}
+
+		inline F4 sub(F4 a, F4 b)
+		{
+			return vsubq_f32(a, b);
+		}
+
+		inline F4 mul(F4 a, F4 b)
+		{
+			return vmulq_f32(a, b);
+		}
+
+		inline F4 div(F4 a, F4 b)
+		{
+			return vdivq_f32(a, b);
+		}
+
+		// (a[i0], a[i1], b[i2], b[i3])
+		template<int i0, int i1, int i2, int i3>
+		inline F4 shuffle(F4 a, F4 b)
+		{
+			F4 r = vdupq_n_f32(vgetq_lane_f32(a, i0));
+			r = vsetq_lane_f32(vgetq_lane_f32(a, i1), r, 1);
+			r = vsetq_lane_f32(vgetq_lane_f32(b, i2), r, 2);
+			r = vsetq_lane_f32(vgetq_lane_f32(b, i3), r, 3);
+			return r;
+		}
+
+		inline void transpose(F4 &r0, F4 &r1, F4 &r2, F4 &r3)
+		{
+			auto t01 = vtrnq_f32(r0, r1);
+			auto t23 = vtrnq_f32(r2, r3);
+			r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+			r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+			r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+			r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+		}
+
+		// all bits set in the lanes where a < b
+		inline F4 less(F4 a, F4 b)
+		{
+			return vreinterpretq_f32_u32(vcltq_f32(a, b));
+		}
+
+		inline F4 bit_or(F4 a, F4 b)
+		{
+			return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+		}
+
+		// the sign bit of lane i to bit i
+		inline int mask(F4 v)
+		{
+			auto u = vshrq_n_u32(vreinterpretq_u32_f32(v), 31);
+			return vgetq_lane_u32(u, 0) | (vgetq_lane_u32(u, 1) << 1) | (vgetq_lane_u32(u, 2) << 2) | (vgetq_lane_u32(u, 3) << 3);
+		}
+#endif
+
+		template<int i>
+		inline F4 lane(F4 v)
+		{
+			return shuffle<i, i, i, i>(v, v);
+		}
+	}
+#endif
+
 	namespace math_detail
 	{
 		void rotate(const Vec3 &axis, float rad, Mat3 &m);
@@ -733,7 +909,28 @@ namespace flame
 		void euler_to_mat3(const EulerYawPitchRoll &e, Mat3 &m);
 		void quat_to_euler(const Quat &q, EulerYawPitchRoll &e);
 		void quat_to_mat3(const Quat &q, Mat3 &m);
-	}
+
+		// the scalar versions are always there, they are the reference of the simd versions
+		void mat4_mul_scalar(const Mat4 &lhs, const Mat4 &rhs, Mat4 &ret);
+		void mat4_mul_vec4_scalar(const Mat4 &lhs, const Vec4 &rhs, Vec4 &ret);
+		void mat4_mul_vec3_scalar(const Mat4 &lhs, const Vec3 &rhs, Vec3 &ret);
+		void mat4_transpose_scalar(const Mat4 &m, Mat4 &ret);
+		void mat4_inverse_scalar(const Mat4 &m, Mat4 &ret);
+#if defined(FLAME_MATH_SIMD)
+		void mat4_mul_simd(const Mat4 &lhs, const Mat4 &rhs, Mat4 &ret);
+		void mat4_mul_vec4_simd(const Mat4 &lhs, const Vec4 &rhs, Vec4 &ret);
+		void mat4_mul_vec3_simd(const Mat4 &lhs, const Vec3 &rhs, Vec3 &ret);
+		void mat4_transpose_simd(const Mat4 &m, Mat4 &ret);
+		void mat4_inverse_simd(const Mat4 &m, Mat4 &ret);
+#endif
+	}
+
+	// batched versions, out can be the same array as in,
+	// the results are the same as doing it one by one with the operators
+	void transform_points(const Mat4 &m, const Vec3 *in, Vec3 *out, int count); // w = 1
+	void transform_vec4s(const Mat4 &m, const Vec4 *in, Vec4 *out, int count);
+	void mul_mat4s(const Mat4 *lhs, const Mat4 *rhs, Mat4 *out, int count);
+	void quats_to_mat3s(const Quat *in, Mat3 *out, int count);
 
 	inline Ivec2 mod(int a, int b)
 	{
@@ -2955,12 +3152,12 @@ namespace flame
 
 	inline Vec2 &Mat2::operator[](int i)
 	{
-		return (*this)[i];
+		return cols[i];
 	}
 
 	inline Vec2 const&Mat2::operator[](int i) const
 	{
-		return (*this)[i];
+		return cols[i];
 	}
 
 	inline Mat2 &Mat2::operator=(const Mat2 &v)
@@ -3217,12 +3414,12 @@ namespace flame
 
 	inline Vec3 &Mat3::operator[](int i)
 	{
-		return (*this)[i];
+		return cols[i];
 	}
 
 	inline Vec3 const&Mat3::operator[](int i) const
 	{
-		return (*this)[i];
+		return cols[i];
 	}
 
 	inline Mat3 &Mat3::operator=(const Mat3 &v)
@@ -3622,22 +3819,11 @@ namespace flame
 	inline Mat4 Mat4::get_transpose() const
 	{
 		Mat4 ret;
-		ret[0][0] = (*this)[0][0];
-		ret[0][1] = (*this)[1][0];
-		ret[0][2] = (*this)[2][0];
-		ret[0][3] = (*this)[3][0];
-		ret[1][0] = (*this)[0][1];
-		ret[1][1] = (*this)[1][1];
-		ret[1][2] = (*this)[2][1];
-		ret[1][3] = (*this)[3][1];
-		ret[2][0] = (*this)[0][2];
-		ret[2][1] = (*this)[1][2];
-		ret[2][2] = (*this)[2][2];
-		ret[2][3] = (*this)[3][2];
-		ret[3][0] = (*this)[0][3];
-		ret[3][1] = (*this)[1][3];
-		ret[3][2] = (*this)[2][3];
-		ret[3][3] = (*this)[3][3];
+#if defined(FLAME_MATH_SIMD)
+		math_detail::mat4_transpose_simd(*this, ret);
+#else
+		math_detail::mat4_transpose_scalar(*this, ret);
+#endif
 		return ret;
 	}
 
@@ -3648,59 +3834,13 @@ namespace flame
 
 	inline Mat4 Mat4::get_inverse() const
 	{
-		auto coef00 = (*this)[2][2] * (*this)[3][3] - (*this)[3][2] * (*this)[2][3];
-		auto coef02 = (*this)[1][2] * (*this)[3][3] - (*this)[3][2] * (*this)[1][3];
-		auto coef03 = (*this)[1][2] * (*this)[2][3] - (*this)[2][2] * (*this)[1][3];
-
-		auto coef04 = (*this)[2][1] * (*this)[3][3] - (*this)[3][1] * (*this)[2][3];
-		auto coef06 = (*this)[1][1] * (*this)[3][3] - (*this)[3][1] * (*this)[1][3];
-		auto coef07 = (*this)[1][1] * (*this)[2][3] - (*this)[2][1] * (*this)[1][3];
-
-		auto coef08 = (*this)[2][1] * (*this)[3][2] - (*this)[3][1] * (*this)[2][2];
-		auto coef10 = (*this)[1][1] * (*this)[3][2] - (*this)[3][1] * (*this)[1][2];
-		auto coef11 = (*this)[1][1] * (*this)[2][2] - (*this)[2][1] * (*this)[1][2];
-
-		auto coef12 = (*this)[2][0] * (*this)[3][3] - (*this)[3][0] * (*this)[2][3];
-		auto coef14 = (*this)[1][0] * (*this)[3][3] - (*this)[3][0] * (*this)[1][3];
-		auto coef15 = (*this)[1][0] * (*this)[2][3] - (*this)[2][0] * (*this)[1][3];
-
-		auto coef16 = (*this)[2][0] * (*this)[3][2] - (*this)[3][0] * (*this)[2][2];
-		auto coef18 = (*this)[1][0] * (*this)[3][2] - (*this)[3][0] * (*this)[1][2];
-		auto coef19 = (*this)[1][0] * (*this)[2][2] - (*this)[2][0] * (*this)[1][2];
-
-		auto coef20 = (*this)[2][0] * (*this)[3][1] - (*this)[3][0] * (*this)[2][1];
-		auto coef22 = (*this)[1][0] * (*this)[3][1] - (*this)[3][0] * (*this)[1][1];
-		auto coef23 = (*this)[1][0] * (*this)[2][1] - (*this)[2][0] * (*this)[1][1];
-
-		Vec4 fac0(coef00, coef00, coef02, coef03);
-		Vec4 fac1(coef04, coef04, coef06, coef07);
-		Vec4 fac2(coef08, coef08, coef10, coef11);
-		Vec4 fac3(coef12, coef12, coef14, coef15);
-		Vec4 fac4(coef16, coef16, coef18, coef19);
-		Vec4 fac5(coef20, coef20, coef22, coef23);
-
-		Vec4 vec0((*this)[1][0], (*this)[0][0], (*this)[0][0], (*this)[0][0]);
-		Vec4 vec1((*this)[1][1], (*this)[0][1], (*this)[0][1], (*this)[0][1]);
-		Vec4 vec2((*this)[1][2], (*this)[0][2], (*this)[0][2], (*this)[0][2]);
-		Vec4 vec3((*this)[1][3], (*this)[0][3], (*this)[0][3], (*this)[0][3]);
-
-		Vec4 inv0(vec1 * fac0 - vec2 * fac1 + vec3 * fac2);
-		Vec4 inv1(vec0 * fac0 - vec2 * fac3 + vec3 * fac4);
-		Vec4 inv2(vec0 * fac1 - vec1 * fac3 + vec3 * fac5);
-		Vec4 inv3(vec0 * fac2 - vec1 * fac4 + vec2 * fac5);
-
-		Vec4 signA(+1, -1, +1, -1);
-		Vec4 signB(-1, +1, -1, +1);
-		Mat4 inverse(inv0 * signA, inv1 * signB, inv2 * signA, inv3 * signB);
-
-		Vec4 row0(inverse[0][0], inverse[1][0], inverse[2][0], inverse[3][0]);
-
-		Vec4 dot0((*this)[0] * row0);
-		auto dot1 = (dot0.x + dot0.y) + (dot0.z + dot0.w);
-
-		auto det_inv = 1.f / dot1;
-
-		return inverse * det_inv;
+		Mat4 ret;
+#if defined(FLAME_MATH_SIMD)
+		math_detail::mat4_inverse_simd(*this, ret);
+#else
+		math_detail::mat4_inverse_scalar(*this, ret);
+#endif
+		return ret;
 	}
 
 	inline Mat4 operator+(const Mat4 &lhs, const Mat4 &rhs)
@@ -3720,41 +3860,33 @@ namespace flame
 	inline Mat4 operator*(const Mat4 &lhs, const Mat4 &rhs)
 	{
 		Mat4 ret;
-		ret[0][0] = lhs[0][0] * rhs[0][0] + lhs[1][0] * rhs[0][1] + lhs[2][0] * rhs[0][2] + lhs[3][0] * rhs[0][3];
-		ret[0][1] = lhs[0][1] * rhs[0][0] + lhs[1][1] * rhs[0][1] + lhs[2][1] * rhs[0][2] + lhs[3][1] * rhs[0][3];
-		ret[0][2] = lhs[0][2] * rhs[0][0] + lhs[1][2] * rhs[0][1] + lhs[2][2] * rhs[0][2] + lhs[3][2] * rhs[0][3];
-		ret[0][3] = lhs[0][3] * rhs[0][0] + lhs[1][3] * rhs[0][1] + lhs[2][3] * rhs[0][2] + lhs[3][3] * rhs[0][3];
-		ret[1][0] = lhs[0][0] * rhs[1][0] + lhs[1][0] * rhs[1][1] + lhs[2][0] * rhs[1][2] + lhs[3][0] * rhs[1][3];
-		ret[1][1] = lhs[0][1] * rhs[1][0] + lhs[1][1] * rhs[1][1] + lhs[2][1] * rhs[1][2] + lhs[3][1] * rhs[1][3];
-		ret[1][2] = lhs[0][2] * rhs[1][0] + lhs[1][2] * rhs[1][1] + lhs[2][2] * rhs[1][2] + lhs[3][2] * rhs[1][3];
-		ret[1][3] = lhs[0][3] * rhs[1][0] + lhs[1][3] * rhs[1][1] + lhs[2][3] * rhs[1][2] + lhs[3][3] * rhs[1][3];
-		ret[2][0] = lhs[0][0] * rhs[2][0] + lhs[1][0] * rhs[2][1] + lhs[2][0] * rhs[2][2] + lhs[3][0] * rhs[2][3];
-		ret[2][1] = lhs[0][1] * rhs[2][0] + lhs[1][1] * rhs[2][1] + lhs[2][1] * rhs[2][2] + lhs[3][1] * rhs[2][3];
-		ret[2][2] = lhs[0][2] * rhs[2][0] + lhs[1][2] * rhs[2][1] + lhs[2][2] * rhs[2][2] + lhs[3][2] * rhs[2][3];
-		ret[2][3] = lhs[0][3] * rhs[2][0] + lhs[1][3] * rhs[2][1] + lhs[2][3] * rhs[2][2] + lhs[3][3] * rhs[2][3];
-		ret[3][0] = lhs[0][0] * rhs[3][0] + lhs[1][0] * rhs[3][1] + lhs[2][0] * rhs[3][2] + lhs[3][0] * rhs[3][3];
-		ret[3][1] = lhs[0][1] * rhs[3][0] + lhs[1][1] * rhs[3][1] + lhs[2][1] * rhs[3][2] + lhs[3][1] * rhs[3][3];
-		ret[3][2] = lhs[0][2] * rhs[3][0] + lhs[1][2] * rhs[3][1] + lhs[2][2] * rhs[3][2] + lhs[3][2] * rhs[3][3];
-		ret[2][3] = lhs[0][3] * rhs[3][0] + lhs[1][3] * rhs[3][1] + lhs[2][3] * rhs[3][2] + lhs[3][3] * rhs[3][3];
+#if defined(FLAME_MATH_SIMD)
+		math_detail::mat4_mul_simd(lhs, rhs, ret);
+#else
+		math_detail::mat4_mul_scalar(lhs, rhs, ret);
+#endif
 		return ret;
 	}
 
 	inline Vec4 operator*(const Mat4 &lhs, const Vec4 &rhs)
 	{
 		Vec4 ret;
-		ret.x = lhs[0][0] * rhs.x + lhs[1][0] * rhs.y + lhs[2][0] * rhs.z + lhs[3][0] * rhs.w;
-		ret.y = lhs[0][1] * rhs.x + lhs[1][1] * rhs.y + lhs[2][1] * rhs.z + lhs[3][1] * rhs.w;
-		ret.z = lhs[0][2] * rhs.x + lhs[1][2] * rhs.y + lhs[2][2] * rhs.z + lhs[3][2] * rhs.w;
-		ret.w = lhs[0][3] * rhs.x + lhs[1][3] * rhs.y + lhs[2][3] * rhs.z + lhs[3][3] * rhs.w;
+#if defined(FLAME_MATH_SIMD)
+		math_detail::mat4_mul_vec4_simd(lhs, rhs, ret);
+#else
+		math_detail::mat4_mul_vec4_scalar(lhs, rhs, ret);
+#endif
 		return ret;
 	}
 
 	inline Vec3 operator*(const Mat4 &lhs, const Vec3 &rhs)
 	{
 		Vec3 ret;
-		ret.x = lhs[0][0] * rhs.x + lhs[1][0] * rhs.y + lhs[2][0] * rhs.z + lhs[3][0];
-		ret.y = lhs[0][1] * rhs.x + lhs[1][1] * rhs.y + lhs[2][1] * rhs.z + lhs[3][1];
-		ret.z = lhs[0][2] * rhs.x + lhs[1][2] * rhs.y + lhs[2][2] * rhs.z + lhs[3][2];
+#if defined(FLAME_MATH_SIMD)
+		math_detail::mat4_mul_vec3_simd(lhs, rhs, ret);
+#else
+		math_detail::mat4_mul_vec3_scalar(lhs, rhs, ret);
+#endif
 		return ret;
 	}
 
@@ -3888,7 +4020,7 @@ namespace flame
 		Quat ret;
 		ret.x = lhs.w * rhs.x + lhs.x * rhs.w + lhs.y * rhs.z - lhs.z * rhs.y;
 		ret.y = lhs.w * rhs.y - lhs.x * rhs.z + lhs.y * rhs.w + lhs.z * rhs.x;
-		ret.z = lhs.w * rhs.z + lhs.x * rhs.y + lhs.y * rhs.w + lhs.z * rhs.x;
+		ret.z = lhs.w * rhs.z + lhs.x * rhs.y - lhs.y * rhs.x + lhs.z * rhs.w;
 		ret.w = lhs.w * rhs.w - lhs.x * rhs.x - lhs.y * rhs.y - lhs.z * rhs.z;
 		return ret;
 	}
@@ -4241,6 +4373,417 @@ namespace flame
 			m[1][2] = yz + wx;
 			m[2][2] = 1.f - (xx + yy);
 		}
+
+		inline void mat4_mul_scalar(const Mat4 &lhs, const Mat4 &rhs, Mat4 &ret)
+		{
+			ret[0][0] = lhs[0][0] * rhs[0][0] + lhs[1][0] * rhs[0][1] + lhs[2][0] * rhs[0][2] + lhs[3][0] * rhs[0][3];
+			ret[0][1] = lhs[0][1] * rhs[0][0] + lhs[1][1] * rhs[0][1] + lhs[2][1] * rhs[0][2] + lhs[3][1] * rhs[0][3];
+			ret[0][2] = lhs[0][2] * rhs[0][0] + lhs[1][2] * rhs[0][1] + lhs[2][2] * rhs[0][2] + lhs[3][2] * rhs[0][3];
+			ret[0][3] = lhs[0][3] * rhs[0][0] + lhs[1][3] * rhs[0][1] + lhs[2][3] * rhs[0][2] + lhs[3][3] * rhs[0][3];
+			ret[1][0] = lhs[0][0] * rhs[1][0] + lhs[1][0] * rhs[1][1] + lhs[2][0] * rhs[1][2] + lhs[3][0] * rhs[1][3];
+			ret[1][1] = lhs[0][1] * rhs[1][0] + lhs[1][1] * rhs[1][1] + lhs[2][1] * rhs[1][2] + lhs[3][1] * rhs[1][3];
+			ret[1][2] = lhs[0][2] * rhs[1][0] + lhs[1][2] * rhs[1][1] + lhs[2][2] * rhs[1][2] + lhs[3][2] * rhs[1][3];
+			ret[1][3] = lhs[0][3] * rhs[1][0] + lhs[1][3] * rhs[1][1] + lhs[2][3] * rhs[1][2] + lhs[3][3] * rhs[1][3];
+			ret[2][0] = lhs[0][0] * rhs[2][0] + lhs[1][0] * rhs[2][1] + lhs[2][0] * rhs[2][2] + lhs[3][0] * rhs[2][3];
+			ret[2][1] = lhs[0][1] * rhs[2][0] + lhs[1][1] * rhs[2][1] + lhs[2][1] * rhs[2][2] + lhs[3][1] * rhs[2][3];
+			ret[2][2] = lhs[0][2] * rhs[2][0] + lhs[1][2] * rhs[2][1] + lhs[2][2] * rhs[2][2] + lhs[3][2] * rhs[2][3];
+			ret[2][3] = lhs[0][3] * rhs[2][0] + lhs[1][3] * rhs[2][1] + lhs[2][3] * rhs[2][2] + lhs[3][3] * rhs[2][3];
+			ret[3][0] = lhs[0][0] * rhs[3][0] + lhs[1][0] * rhs[3][1] + lhs[2][0] * rhs[3][2] + lhs[3][0] * rhs[3][3];
+			ret[3][1] = lhs[0][1] * rhs[3][0] + lhs[1][1] * rhs[3][1] + lhs[2][1] * rhs[3][2] + lhs[3][1] * rhs[3][3];
+			ret[3][2] = lhs[0][2] * rhs[3][0] + lhs[1][2] * rhs[3][1] + lhs[2][2] * rhs[3][2] + lhs[3][2] * rhs[3][3];
+			ret[3][3] = lhs[0][3] * rhs[3][0] + lhs[1][3] * rhs[3][1] + lhs[2][3] * rhs[3][2] + lhs[3][3] * rhs[3][3];
+		}
+
+		inline void mat4_mul_vec4_scalar(const Mat4 &lhs, const Vec4 &rhs, Vec4 &ret)
+		{
+			ret.x = lhs[0][0] * rhs.x + lhs[1][0] * rhs.y + lhs[2][0] * rhs.z + lhs[3][0] * rhs.w;
+			ret.y = lhs[0][1] * rhs.x + lhs[1][1] * rhs.y + lhs[2][1] * rhs.z + lhs[3][1] * rhs.w;
+			ret.z = lhs[0][2] * rhs.x + lhs[1][2] * rhs.y + lhs[2][2] * rhs.z + lhs[3][2] * rhs.w;
+			ret.w = lhs[0][3] * rhs.x + lhs[1][3] * rhs.y + lhs[2][3] * rhs.z + lhs[3][3] * rhs.w;
+		}
+
+		inline void mat4_mul_vec3_scalar(const Mat4 &lhs, const Vec3 &rhs, Vec3 &ret)
+		{
+			ret.x = lhs[0][0] * rhs.x + lhs[1][0] * rhs.y + lhs[2][0] * rhs.z + lhs[3][0];
+			ret.y = lhs[0][1] * rhs.x + lhs[1][1] * rhs.y + lhs[2][1] * rhs.z + lhs[3][1];
+			ret.z = lhs[0][2] * rhs.x + lhs[1][2] * rhs.y + lhs[2][2] * rhs.z + lhs[3][2];
+		}
+
+		inline void mat4_transpose_scalar(const Mat4 &m, Mat4 &ret)
+		{
+			ret[0][0] = m[0][0];
+			ret[0][1] = m[1][0];
+			ret[0][2] = m[2][0];
+			ret[0][3] = m[3][0];
+			ret[1][0] = m[0][1];
+			ret[1][1] = m[1][1];
+			ret[1][2] = m[2][1];
+			ret[1][3] = m[3][1];
+			ret[2][0] = m[0][2];
+			ret[2][1] = m[1][2];
+			ret[2][2] = m[2][2];
+			ret[2][3] = m[3][2];
+			ret[3][0] = m[0][3];
+			ret[3][1] = m[1][3];
+			ret[3][2] = m[2][3];
+			ret[3][3] = m[3][3];
+		}
+
+		inline void mat4_inverse_scalar(const Mat4 &m, Mat4 &ret)
+		{
+			auto coef00 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+			auto coef02 = m[1][2] * m[3][3] - m[3][2] * m[1][3];
+			auto coef03 = m[1][2] * m[2][3] - m[2][2] * m[1][3];
+
+			auto coef04 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+			auto coef06 = m[1][1] * m[3][3] - m[3][1] * m[1][3];
+			auto coef07 = m[1][1] * m[2][3] - m[2][1] * m[1][3];
+
+			auto coef08 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+			auto coef10 = m[1][1] * m[3][2] - m[3][1] * m[1][2];
+			auto coef11 = m[1][1] * m[2][2] - m[2][1] * m[1][2];
+
+			auto coef12 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+			auto coef14 = m[1][0] * m[3][3] - m[3][0] * m[1][3];
+			auto coef15 = m[1][0] * m[2][3] - m[2][0] * m[1][3];
+
+			auto coef16 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+			auto coef18 = m[1][0] * m[3][2] - m[3][0] * m[1][2];
+			auto coef19 = m[1][0] * m[2][2] - m[2][0] * m[1][2];
+
+			auto coef20 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+			auto coef22 = m[1][0] * m[3][1] - m[3][0] * m[1][1];
+			auto coef23 = m[1][0] * m[2][1] - m[2][0] * m[1][1];
+
+			Vec4 fac0(coef00, coef00, coef02, coef03);
+			Vec4 fac1(coef04, coef04, coef06, coef07);
+			Vec4 fac2(coef08, coef08, coef10, coef11);
+			Vec4 fac3(coef12, coef12, coef14, coef15);
+			Vec4 fac4(coef16, coef16, coef18, coef19);
+			Vec4 fac5(coef20, coef20, coef22, coef23);
+
+			Vec4 vec0(m[1][0], m[0][0], m[0][0], m[0][0]);
+			Vec4 vec1(m[1][1], m[0][1], m[0][1], m[0][1]);
+			Vec4 vec2(m[1][2], m[0][2], m[0][2], m[0][2]);
+			Vec4 vec3(m[1][3], m[0][3], m[0][3], m[0][3]);
+
+			Vec4 inv0(vec1 * fac0 - vec2 * fac1 + vec3 * fac2);
+			Vec4 inv1(vec0 * fac0 - vec2 * fac3 + vec3 * fac4);
+			Vec4 inv2(vec0 * fac1 - vec1 * fac3 + vec3 * fac5);
+			Vec4 inv3(vec0 * fac2 - vec1 * fac4 + vec2 * fac5);
+
+			Vec4 signA(+1, -1, +1, -1);
+			Vec4 signB(-1, +1, -1, +1);
+			Mat4 inverse(inv0 * signA, inv1 * signB, inv2 * signA, inv3 * signB);
+
+			Vec4 row0(inverse[0][0], inverse[1][0], inverse[2][0], inverse[3][0]);
+
+			Vec4 dot0(m[0] * row0);
+			auto dot1 = (dot0.x + dot0.y) + (dot0.z + dot0.w);
+
+			auto det_inv = 1.f / dot1;
+
+			ret = inverse * det_inv;
+		}
+
+#if defined(FLAME_MATH_SIMD)
+		// the simd versions do the same operations in the same order as the scalar ones, so the results are identical
+
+		inline void mat4_mul_simd(const Mat4 &lhs, const Mat4 &rhs, Mat4 &ret)
+		{
+			using namespace math_simd;
+
+#if defined(FLAME_MATH_AVX)
+			// two columns of the result at a time
+			auto c0 = _mm256_broadcast_ps((const __m128*)&lhs[0]);
+			auto c1 = _mm256_broadcast_ps((const __m128*)&lhs[1]);
+			auto c2 = _mm256_broadcast_ps((const __m128*)&lhs[2]);
+			auto c3 = _mm256_broadcast_ps((const __m128*)&lhs[3]);
+			for (auto i = 0; i < 4; i += 2)
+			{
+				auto r = _mm256_loadu_ps(&rhs[i].x);
+				auto v = _mm256_mul_ps(c0, _mm256_permute_ps(r, _MM_SHUFFLE(0, 0, 0, 0)));
+				v = _mm256_add_ps(v, _mm256_mul_ps(c1, _mm256_permute_ps(r, _MM_SHUFFLE(1, 1, 1, 1))));
+				v = _mm256_add_ps(v, _mm256_mul_ps(c2, _mm256_permute_ps(r, _MM_SHUFFLE(2, 2, 2, 2))));
+				v = _mm256_add_ps(v, _mm256_mul_ps(c3, _mm256_permute_ps(r, _MM_SHUFFLE(3, 3, 3, 3))));
+				_mm256_storeu_ps(&ret[i].x, v);
+			}
+#else
+			auto c0 = load(&lhs[0].x);
+			auto c1 = load(&lhs[1].x);
+			auto c2 = load(&lhs[2].x);
+			auto c3 = load(&lhs[3].x);
+			for (auto i = 0; i < 4; i++)
+			{
+				auto r = load(&rhs[i].x);
+				auto v = mul(c0, lane<0>(r));
+				v = add(v, mul(c1, lane<1>(r)));
+				v = add(v, mul(c2, lane<2>(r)));
+				v = add(v, mul(c3, lane<3>(r)));
+				store(&ret[i].x, v);
+			}
+#endif
+		}
+
+		inline void mat4_mul_vec4_simd(const Mat4 &lhs, const Vec4 &rhs, Vec4 &ret)
+		{
+			using namespace math_simd;
+
+			auto v = mul(load(&lhs[0].x), splat(rhs.x));
+			v = add(v, mul(load(&lhs[1].x), splat(rhs.y)));
+			v = add(v, mul(load(&lhs[2].x), splat(rhs.z)));
+			v = add(v, mul(load(&lhs[3].x), splat(rhs.w)));
+			store(&ret.x, v);
+		}
+
+		inline void mat4_mul_vec3_simd(const Mat4 &lhs, const Vec3 &rhs, Vec3 &ret)
+		{
+			using namespace math_simd;
+
+			auto v = mul(load(&lhs[0].x), splat(rhs.x));
+			v = add(v, mul(load(&lhs[1].x), splat(rhs.y)));
+			v = add(v, mul(load(&lhs[2].x), splat(rhs.z)));
+			v = add(v, load(&lhs[3].x));
+			float t[4];
+			store(t, v);
+			ret.x = t[0];
+			ret.y = t[1];
+			ret.z = t[2];
+		}
+
+		inline void mat4_transpose_simd(const Mat4 &m, Mat4 &ret)
+		{
+			using namespace math_simd;
+
+			auto c0 = load(&m[0].x);
+			auto c1 = load(&m[1].x);
+			auto c2 = load(&m[2].x);
+			auto c3 = load(&m[3].x);
+			transpose(c0, c1, c2, c3);
+			store(&ret[0].x, c0);
+			store(&ret[1].x, c1);
+			store(&ret[2].x, c2);
+			store(&ret[3].x, c3);
+		}
+
+		// (m2[r1] * m3[r2] - m3[r1] * m2[r2], same, m1[r1] * m3[r2] - m3[r1] * m1[r2], m1[r1] * m2[r2] - m2[r1] * m1[r2]),
+		// the fac vectors of the scalar version
+		template<int r1, int r2>
+		inline math_simd::F4 mat4_inverse_fac(math_simd::F4 c1, math_simd::F4 c2, math_simd::F4 c3)
+		{
+			using namespace math_simd;
+
+			auto a = shuffle<r1, r1, r1, r1>(c2, c1);
+			auto t = shuffle<r2, r2, r2, r2>(c3, c2);
+			auto b = shuffle<0, 0, 0, 2>(t, t);
+			t = shuffle<r1, r1, r1, r1>(c3, c2);
+			auto c = shuffle<0, 0, 0, 2>(t, t);
+			auto d = shuffle<r2, r2, r2, r2>(c2, c1);
+			return sub(mul(a, b), mul(c, d));
+		}
+
+		// (m1[r], m0[r], m0[r], m0[r])
+		template<int r>
+		inline math_simd::F4 mat4_inverse_vec(math_simd::F4 c0, math_simd::F4 c1)
+		{
+			using namespace math_simd;
+
+			auto t = shuffle<r, r, r, r>(c1, c0);
+			return shuffle<0, 2, 2, 2>(t, t);
+		}
+
+		inline void mat4_inverse_simd(const Mat4 &m, Mat4 &ret)
+		{
+			using namespace math_simd;
+
+			auto c0 = load(&m[0].x);
+			auto c1 = load(&m[1].x);
+			auto c2 = load(&m[2].x);
+			auto c3 = load(&m[3].x);
+
+			auto fac0 = mat4_inverse_fac<2, 3>(c1, c2, c3);
+			auto fac1 = mat4_inverse_fac<1, 3>(c1, c2, c3);
+			auto fac2 = mat4_inverse_fac<1, 2>(c1, c2, c3);
+			auto fac3 = mat4_inverse_fac<0, 3>(c1, c2, c3);
+			auto fac4 = mat4_inverse_fac<0, 2>(c1, c2, c3);
+			auto fac5 = mat4_inverse_fac<0, 1>(c1, c2, c3);
+
+			auto vec0 = mat4_inverse_vec<0>(c0, c1);
+			auto vec1 = mat4_inverse_vec<1>(c0, c1);
+			auto vec2 = mat4_inverse_vec<2>(c0, c1);
+			auto vec3 = mat4_inverse_vec<3>(c0, c1);
+
+			auto sign_a = shuffle<0, 1, 0, 1>(splat(1.f), splat(-1.f));
+			auto sign_b = shuffle<0, 1, 0, 1>(splat(-1.f), splat(1.f));
+			sign_a = shuffle<0, 2, 0, 2>(sign_a, sign_a);
+			sign_b = shuffle<0, 2, 0, 2>(sign_b, sign_b);
+
+			auto inv0 = mul(add(sub(mul(vec1, fac0), mul(vec2, fac1)), mul(vec3, fac2)), sign_a);
+			auto inv1 = mul(add(sub(mul(vec0, fac0), mul(vec2, fac3)), mul(vec3, fac4)), sign_b);
+			auto inv2 = mul(add(sub(mul(vec0, fac1), mul(vec1, fac3)), mul(vec3, fac5)), sign_a);
+			auto inv3 = mul(add(sub(mul(vec0, fac2), mul(vec1, fac4)), mul(vec2, fac5)), sign_b);
+
+			auto t0 = shuffle<0, 0, 0, 0>(inv0, inv1);
+			auto t1 = shuffle<0, 0, 0, 0>(inv2, inv3);
+			auto row0 = shuffle<0, 2, 0, 2>(t0, t1);
+
+			auto dot0 = mul(c0, row0);
+			auto dot1 = add(dot0, shuffle<1, 0, 3, 2>(dot0, dot0)); // (x + y, y + x, z + w, w + z)
+			dot1 = add(dot1, shuffle<2, 3, 0, 1>(dot1, dot1));
+
+			auto det_inv = div(splat(1.f), dot1);
+
+			store(&ret[0].x, mul(inv0, det_inv));
+			store(&ret[1].x, mul(inv1, det_inv));
+			store(&ret[2].x, mul(inv2, det_inv));
+			store(&ret[3].x, mul(inv3, det_inv));
+		}
+#endif
+	}
+
+	inline void transform_points(const Mat4 &m, const Vec3 *in, Vec3 *out, int count)
+	{
+		auto i = 0;
+#if defined(FLAME_MATH_SIMD)
+		using namespace math_simd;
+
+		auto m00 = splat(m[0][0]), m01 = splat(m[0][1]), m02 = splat(m[0][2]);
+		auto m10 = splat(m[1][0]), m11 = splat(m[1][1]), m12 = splat(m[1][2]);
+		auto m20 = splat(m[2][0]), m21 = splat(m[2][1]), m22 = splat(m[2][2]);
+		auto m30 = splat(m[3][0]), m31 = splat(m[3][1]), m32 = splat(m[3][2]);
+
+		// four points are three F4s, turn them into (x0 x1 x2 x3), (y0 ..), (z0 ..) and back
+		for (; i + 4 <= count; i += 4)
+		{
+			auto src = &in[i].x;
+			auto a = load(src);
+			auto b = load(src + 4);
+			auto c = load(src + 8);
+
+			auto t = shuffle<2, 3, 1, 1>(b, c);
+			auto x = shuffle<0, 3, 0, 2>(a, t);
+			auto t0 = shuffle<1, 1, 0, 0>(a, b);
+			auto t1 = shuffle<3, 3, 2, 2>(b, c);
+			auto y = shuffle<0, 2, 0, 2>(t0, t1);
+			t0 = shuffle<2, 2, 1, 1>(a, b);
+			t1 = shuffle<0, 0, 3, 3>(c, c);
+			auto z = shuffle<0, 2, 0, 2>(t0, t1);
+
+			auto rx = add(add(add(mul(m00, x), mul(m10, y)), mul(m20, z)), m30);
+			auto ry = add(add(add(mul(m01, x), mul(m11, y)), mul(m21, z)), m31);
+			auto rz = add(add(add(mul(m02, x), mul(m12, y)), mul(m22, z)), m32);
+
+			t0 = shuffle<0, 0, 0, 0>(rx, ry);
+			t1 = shuffle<0, 0, 1, 1>(rz, rx);
+			a = shuffle<0, 2, 0, 2>(t0, t1);
+			t0 = shuffle<1, 1, 1, 1>(ry, rz);
+			t1 = shuffle<2, 2, 2, 2>(rx, ry);
+			b = shuffle<0, 2, 0, 2>(t0, t1);
+			t0 = shuffle<2, 2, 3, 3>(rz, rx);
+			t1 = shuffle<3, 3, 3, 3>(ry, rz);
+			c = shuffle<0, 2, 0, 2>(t0, t1);
+
+			auto dst = &out[i].x;
+			store(dst, a);
+			store(dst + 4, b);
+			store(dst + 8, c);
+		}
+#endif
+		for (; i < count; i++)
+			out[i] = m * in[i];
+	}
+
+	inline void transform_vec4s(const Mat4 &m, const Vec4 *in, Vec4 *out, int count)
+	{
+#if defined(FLAME_MATH_SIMD)
+		using namespace math_simd;
+
+		auto c0 = load(&m[0].x);
+		auto c1 = load(&m[1].x);
+		auto c2 = load(&m[2].x);
+		auto c3 = load(&m[3].x);
+		for (auto i = 0; i < count; i++)
+		{
+			auto r = load(&in[i].x);
+			auto v = mul(c0, lane<0>(r));
+			v = add(v, mul(c1, lane<1>(r)));
+			v = add(v, mul(c2, lane<2>(r)));
+			v = add(v, mul(c3, lane<3>(r)));
+			store(&out[i].x, v);
+		}
+#else
+		for (auto i = 0; i < count; i++)
+			out[i] = m * in[i];
+#endif
+	}
+
+	inline void mul_mat4s(const Mat4 *lhs, const Mat4 *rhs, Mat4 *out, int count)
+	{
+		for (auto i = 0; i < count; i++)
+		{
+#if defined(FLAME_MATH_SIMD)
+			math_detail::mat4_mul_simd(lhs[i], rhs[i], out[i]);
+#else
+			out[i] = lhs[i] * rhs[i];
+#endif
+		}
+	}
+
+	inline void quats_to_mat3s(const Quat *in, Mat3 *out, int count)
+	{
+		auto i = 0;
+#if defined(FLAME_MATH_SIMD)
+		using namespace math_simd;
+
+		// four quaternions at a time, as (x0 x1 x2 x3), (y0 ..), (z0 ..), (w0 ..)
+		auto one = splat(1.f);
+		auto two = splat(2.f);
+		for (; i + 4 <= count; i += 4)
+		{
+			auto x = load(&in[i].x);
+			auto y = load(&in[i + 1].x);
+			auto z = load(&in[i + 2].x);
+			auto w = load(&in[i + 3].x);
+			transpose(x, y, z, w);
+
+			auto x2 = mul(two, x);
+			auto y2 = mul(two, y);
+			auto z2 = mul(two, z);
+
+			auto xx = mul(x, x2);
+			auto xy = mul(x, y2);
+			auto xz = mul(x, z2);
+
+			auto yy = mul(y, y2);
+			auto yz = mul(y, z2);
+			auto zz = mul(z, z2);
+
+			auto wx = mul(w, x2);
+			auto wy = mul(w, y2);
+			auto wz = mul(w, z2);
+
+			float r[9][4];
+			store(r[0], sub(one, add(yy, zz)));
+			store(r[1], add(xy, wz));
+			store(r[2], sub(xz, wy));
+			store(r[3], sub(xy, wz));
+			store(r[4], sub(one, add(xx, zz)));
+			store(r[5], add(yz, wx));
+			store(r[6], add(xz, wy));
+			store(r[7], sub(yz, wx));
+			store(r[8], sub(one, add(xx, yy)));
+
+			for (auto j = 0; j < 4; j++)
+			{
+				auto &m = out[i + j];
+				m[0][0] = r[0][j]; m[0][1] = r[1][j]; m[0][2] = r[2][j];
+				m[1][0] = r[3][j]; m[1][1] = r[4][j]; m[1][2] = r[5][j];
+				m[2][0] = r[6][j]; m[2][1] = r[7][j]; m[2][2] = r[8][j];
+			}
+		}
+#endif
+		for (; i < count; i++)
+			math_detail::quat_to_mat3(in[i], out[i]);
 	}
 }
 
@@ -0,0 +1,282 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+
+namespace flame
+{
+	// find vertexs that are the same within eps on every component (abs(a - b) < eps),
+	// the result is exactly what a linear scan over the added vertexs would return:
+	// the first added one that matches, but it only visits the neighbor cells of a spatial hash
+	// T needs 'float operator[](int) const', N is the component count to compare
+	template<class T, int N>
+	class VertexWelder
+	{
+	protected:
+		struct CellKey
+		{
+			long long c[N];
+
+			bool operator==(const CellKey &rhs) const
+			{
+				for (auto i = 0; i < N; i++)
+				{
+					if (c[i] != rhs.c[i])
+						return false;
+				}
+				return true;
+			}
+		};
+
+		struct CellHash
+		{
+			size_t operator()(const CellKey &k) const
+			{
+				size_t h = 0;
+				for (auto i = 0; i < N; i++)
+					h ^= (size_t)k.c[i] * 0x9e3779b97f4a7c15ULL + 0x9e3779b9 + (h << 6) + (h >> 2);
+				return h;
+			}
+		};
+
+		float eps;
+		float inv_cell_size;
+		std::vector<T> unique;
+		std::unordered_map<CellKey, std::pair<int, int>, CellHash> cells; // first and last vertex in the cell
+		std::vector<int> next_in_cell;
+
+		long long get_cell(float v) const
+		{
+			return (long long)floor(v * inv_cell_size);
+		}
+
+		bool is_same(const T &a, const T &b) const
+		{
+			for (auto i = 0; i < N; i++)
+			{
+				auto d = a[i] - b[i];
+				if (!(d < eps && -d < eps))
+					return false;
+			}
+			return true;
+		}
+
+		template<class F>
+		int find_in_cells(const T &v, F &equal) const
+		{
+			// a cell is twice as large as eps, so that there are at most 2 cells to visit on each component
+			long long lo[N], hi[N];
+			for (auto i = 0; i < N; i++)
+			{
+				lo[i] = get_cell(v[i] - eps);
+				hi[i] = get_cell(v[i] + eps);
+			}
+
+			auto ret = -1;
+			CellKey k;
+			for (auto i = 0; i < N; i++)
+				k.c[i] = lo[i];
+			while (true)
+			{
+				auto it = cells.find(k);
+				if (it != cells.end())
+				{
+					for (auto idx = it->second.first; idx != -1; idx = next_in_cell[idx])
+					{
+						if (ret != -1 && idx > ret)
+							break;
+						if (is_same(unique[idx], v) && equal(idx))
+						{
+							ret = idx;
+							break;
+						}
+					}
+				}
+
+				auto i = 0;
+				for (; i < N; i++)
+				{
+					if (k.c[i] < hi[i])
+					{
+						k.c[i]++;
+						break;
+					}
+					k.c[i] = lo[i];
+				}
+				if (i == N)
+					break;
+			}
+			return ret;
+		}
+
+		static bool always_equal(int)
+		{
+			return true;
+		}
+
+	public:
+		VertexWelder(float _eps, int reserve_count = 0) :
+			eps(_eps),
+			inv_cell_size(_eps > 0.f ? 0.5f / _eps : 1.f)
+		{
+			unique.reserve(reserve_count);
+			next_in_cell.reserve(reserve_count);
+			cells.reserve(reserve_count);
+		}
+
+		int get_count() const
+		{
+			return unique.size();
+		}
+
+		const std::vector<T> &get_unique() const
+		{
+			return unique;
+		}
+
+		int find(const T &v) const
+		{
+			return find_in_cells(v, always_equal);
+		}
+
+		// equal(index) can reject a candidate whose key matches, to weld by more attributes than the key
+		template<class F>
+		int find(const T &v, F equal) const
+		{
+			return find_in_cells(v, equal);
+		}
+
+		int add(const T &v)
+		{
+			return add(v, always_equal);
+		}
+
+		// append without looking for a match
+		int push(const T &v)
+		{
+			auto idx = (int)unique.size();
+			unique.push_back(v);
+			next_in_cell.push_back(-1);
+			CellKey k;
+			for (auto i = 0; i < N; i++)
+				k.c[i] = get_cell(v[i]);
+			auto it = cells.find(k);
+			if (it == cells.end())
+				cells.emplace(k, std::make_pair(idx, idx));
+			else
+			{
+				next_in_cell[it->second.second] = idx;
+				it->second.second = idx;
+			}
+			return idx;
+		}
+
+		// returns the index of the matched one, or the index of the newly added one
+		template<class F>
+		int add(const T &v, F equal)
+		{
+			auto idx = find_in_cells(v, equal);
+			if (idx != -1)
+				return idx;
+			return push(v);
+		}
+	};
+
+	// weld count vertexs, out_remap[i] is the index of vertex i in the unique list, returns the unique list
+	template<class T, int N>
+	inline std::vector<T> weld_vertexs(const T *vertexs, int count, float eps, int *out_remap)
+	{
+		VertexWelder<T, N> w(eps, count);
+		for (auto i = 0; i < count; i++)
+			out_remap[i] = w.add(vertexs[i]);
+		return w.get_unique();
+	}
+
+	// for edge j of triangle i (from indices[i * 3 + j] to indices[i * 3 + (j + 1) % 3]),
+	// out_adjacency[i * 3 + j] is { the triangle that shares the edge, the vertex (0-2) opposite to the edge in that triangle }
+	// or { -1, -1 } if there is none, an edge pairs with at most one edge that goes the reverse way,
+	// the pairing is the same as testing every edge against every other triangle in order, but takes O(n log n) with a sorted edge list
+	inline void build_triangle_adjacency(const int *indices, int triangle_count, std::pair<int, int> *out_adjacency)
+	{
+		auto edge_count = triangle_count * 3;
+
+		auto get_key = [&](int e) {
+			auto t = e / 3;
+			return ((unsigned long long)(unsigned int)indices[e] << 32) | (unsigned int)indices[t * 3 + (e % 3 + 1) % 3];
+		};
+
+		// sorted by key, then by edge, so that the edges of a key are in ascending order
+		std::vector<std::pair<unsigned long long, int>> edges(edge_count);
+		for (auto i = 0; i < edge_count; i++)
+		{
+			edges[i] = { get_key(i), i };
+			out_adjacency[i] = { -1, -1 };
+		}
+		std::sort(edges.begin(), edges.end());
+
+		// where the edges of the reverse key start, the start moves forward once the front edges are paired
+		std::vector<int> reverse_begin(edge_count, -1);
+		std::vector<int> group_cursor(edge_count);
+		for (auto i = 0; i < edge_count; i++)
+			group_cursor[i] = i;
+		for (auto i = 0; i < edge_count; )
+		{
+			auto key = edges[i].first;
+			auto reverse_key = (key << 32) | (key >> 32);
+			auto it = std::lower_bound(edges.begin(), edges.end(), std::make_pair(reverse_key, -1));
+			auto begin = (it != edges.end() && it->first == reverse_key) ? int(it - edges.begin()) : -1;
+			for (; i < edge_count && edges[i].first == key; i++)
+				reverse_begin[edges[i].second] = begin;
+		}
+
+		for (auto i = 0; i < edge_count; i++)
+		{
+			if (out_adjacency[i].first != -1)
+				continue;
+
+			if (reverse_begin[i] == -1)
+				continue;
+			auto &begin = group_cursor[reverse_begin[i]];
+
+			auto t = i / 3;
+			auto key = edges[begin].first;
+			while (begin < edge_count && edges[begin].first == key && out_adjacency[edges[begin].second].first != -1)
+				begin++;
+			for (auto k = begin; k < edge_count && edges[k].first == key; k++)
+			{
+				auto e = edges[k].second;
+				if (e / 3 == t || out_adjacency[e].first != -1)
+					continue;
+
+				out_adjacency[e] = { t, (i % 3 + 2) % 3 };
+				out_adjacency[i] = { e / 3, (e % 3 + 2) % 3 };
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,324 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/profiler.h>
+#include <flame/time.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <string>
+#include <algorithm>
+
+namespace flame
+{
+	struct ProfileThread
+	{
+		// single producer (the owning thread), single consumer (the frame thread)
+		ProfileZone ring[ProfileRingSize];
+		std::atomic<unsigned int> head;
+		std::atomic<unsigned int> tail;
+		std::atomic<int> dropped;
+		std::atomic<bool> alive;
+
+		short index;
+		std::string name; // under threads_mtx
+
+		// owning thread only
+		int depth;
+		unsigned int hashes[ProfileMaxDepth];
+		const char *names[ProfileMaxDepth];
+		long long begins[ProfileMaxDepth];
+
+		ProfileThread(short _index) :
+			head(0),
+			tail(0),
+			dropped(0),
+			alive(true),
+			index(_index),
+			depth(0)
+		{
+			name = "thread " + std::to_string(index);
+		}
+	};
+
+	static std::mutex threads_mtx;
+	static std::vector<ProfileThread*> threads; // a slot is taken over when its thread ended and was drained
+	static std::vector<std::string> thread_names; // outlive the threads, for the history
+
+	struct ProfileThreadHolder
+	{
+		ProfileThread *t;
+
+		ProfileThreadHolder() :
+			t(nullptr)
+		{
+		}
+
+		~ProfileThreadHolder()
+		{
+			if (t)
+				t->alive.store(false, std::memory_order_release);
+		}
+	};
+
+	static thread_local ProfileThreadHolder this_thread;
+
+	static ProfileThread *get_this_thread()
+	{
+		auto t = this_thread.t;
+		if (t)
+			return t;
+
+		std::lock_guard<std::mutex> lock(threads_mtx);
+		auto slot = -1;
+		for (auto i = 0; i < threads.size(); i++)
+		{
+			if (!threads[i])
+			{
+				slot = i;
+				break;
+			}
+		}
+		if (slot == -1)
+		{
+			slot = threads.size();
+			threads.push_back(nullptr);
+			thread_names.emplace_back();
+		}
+		t = new ProfileThread(slot);
+		threads[slot] = t;
+		thread_names[slot] = t->name;
+		this_thread.t = t;
+		return t;
+	}
+
+	void profile_begin(unsigned int hash, const char *name)
+	{
+		auto t = get_this_thread();
+		if (t->depth < ProfileMaxDepth)
+		{
+			t->hashes[t->depth] = hash;
+			t->names[t->depth] = name;
+			t->begins[t->depth] = get_now_ns();
+		}
+		t->depth++;
+	}
+
+	void profile_end()
+	{
+		auto t = get_this_thread();
+		if (t->depth == 0)
+			return;
+		t->depth--;
+		if (t->depth >= ProfileMaxDepth)
+			return;
+
+		auto head = t->head.load(std::memory_order_relaxed);
+		if (head - t->tail.load(std::memory_order_acquire) >= ProfileRingSize)
+		{
+			t->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		auto &z = t->ring[head & (ProfileRingSize - 1)];
+		z.hash = t->hashes[t->depth];
+		z.name = t->names[t->depth];
+		z.begin = t->begins[t->depth];
+		z.end = get_now_ns();
+		z.depth = t->depth;
+		z.thread = t->index;
+		t->head.store(head + 1, std::memory_order_release);
+	}
+
+	void profile_set_thread_name(const char *name)
+	{
+		auto t = get_this_thread();
+		std::lock_guard<std::mutex> lock(threads_mtx);
+		t->name = name;
+		thread_names[t->index] = name;
+	}
+
+	static std::deque<ProfileFrame> frames;
+	static unsigned long long frame_index;
+	static long long frame_begin;
+
+	void profile_begin_frame()
+	{
+		frame_begin = get_now_ns();
+	}
+
+	void profile_end_frame()
+	{
+		if (frames.size() >= ProfileHistoryFrames)
+			frames.pop_front();
+		frames.emplace_back();
+		auto &f = frames.back();
+		f.index = frame_index++;
+		f.begin = frame_begin;
+		f.end = get_now_ns();
+		f.dropped = 0;
+
+		{
+			std::lock_guard<std::mutex> lock(threads_mtx);
+			for (auto &t : threads)
+			{
+				if (!t)
+					continue;
+				// read alive first, so a dead thread's last zones are surely visible below
+				auto alive = t->alive.load(std::memory_order_acquire);
+				auto tail = t->tail.load(std::memory_order_relaxed);
+				auto head = t->head.load(std::memory_order_acquire);
+				for (; tail != head; tail++)
+					f.zones.push_back(t->ring[tail & (ProfileRingSize - 1)]);
+				t->tail.store(tail, std::memory_order_release);
+				f.dropped += t->dropped.exchange(0, std::memory_order_relaxed);
+				if (!alive)
+				{
+					delete t;
+					t = nullptr;
+				}
+			}
+		}
+
+		std::sort(f.zones.begin(), f.zones.end(), [](const ProfileZone &a, const ProfileZone &b) {
+			if (a.thread != b.thread)
+				return a.thread < b.thread;
+			if (a.begin != b.begin)
+				return a.begin < b.begin;
+			return a.depth < b.depth;
+		});
+
+		frame_begin = f.end;
+	}
+
+	unsigned long long profile_get_frame_index()
+	{
+		return frame_index;
+	}
+
+	void profile_add_gpu_zones(unsigned long long index, const ProfileZone *zones, int count)
+	{
+		if (frames.empty() || index < frames.front().index || index > frames.back().index)
+			return;
+		auto &f = frames[index - frames.front().index];
+		for (auto i = 0; i < count; i++)
+		{
+			f.gpu_zones.push_back(zones[i]);
+			f.gpu_zones.back().thread = ProfileGpuThread;
+		}
+	}
+
+	int profile_get_frame_count()
+	{
+		return frames.size();
+	}
+
+	const ProfileFrame *profile_get_frame(int i)
+	{
+		return &frames[i];
+	}
+
+	int profile_get_thread_count()
+	{
+		std::lock_guard<std::mutex> lock(threads_mtx);
+		return thread_names.size();
+	}
+
+	const char *profile_get_thread_name(int thread)
+	{
+		if (thread == ProfileGpuThread)
+			return "gpu";
+		std::lock_guard<std::mutex> lock(threads_mtx);
+		return thread_names[thread].c_str();
+	}
+
+	static void write_json_string(FILE *f, const char *s)
+	{
+		fputc('"', f);
+		for (; *s; s++)
+		{
+			if (*s == '"' || *s == '\\')
+				fputc('\\', f);
+			if ((unsigned char)*s < 0x20)
+				fprintf(f, "\\u%04x", *s);
+			else
+				fputc(*s, f);
+		}
+		fputc('"', f);
+	}
+
+	bool profile_save_chrome_trace(const char *filename)
+	{
+		auto f = fopen(filename, "wb");
+		if (!f)
+			return false;
+
+		std::vector<std::string> names;
+		{
+			std::lock_guard<std::mutex> lock(threads_mtx);
+			names = thread_names;
+		}
+		// the gpu and the frames get the tids after the threads
+		auto gpu_tid = (int)names.size();
+		auto frame_tid = gpu_tid + 1;
+		names.push_back("gpu");
+		names.push_back("frames");
+
+		fputs("{\"traceEvents\":[\n", f);
+		for (auto i = 0; i < names.size(); i++)
+		{
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":", i == 0 ? "" : ",\n", i);
+			write_json_string(f, names[i].c_str());
+			fputs("}}", f);
+		}
+
+		auto base = frames.empty() ? 0 : frames.front().begin;
+		auto write_zone = [&](const char *name, int tid, long long begin, long long end) {
+			fputs(",\n{\"name\":", f);
+			write_json_string(f, name);
+			fprintf(f, ",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", tid,
+				(begin - base) / 1000.0, (end - begin) / 1000.0);
+		};
+		for (auto &fr : frames)
+		{
+			char frame_name[32];
+			sprintf(frame_name, "frame %llu", fr.index);
+			write_zone(frame_name, frame_tid, fr.begin, fr.end);
+			for (auto &z : fr.zones)
+				write_zone(z.name, z.thread, z.begin, z.end);
+			for (auto &z : fr.gpu_zones)
+				write_zone(z.name, gpu_tid, fr.begin + z.begin, fr.begin + z.end);
+		}
+		fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+
+		auto ok = !ferror(f);
+		fclose(f);
+		return ok;
+	}
+
+	void profile_clear()
+	{
+		frames.clear();
+	}
+}
@@ -0,0 +1,106 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#ifdef _FLAME_SYSTEM_EXPORTS
+#define FLAME_SYSTEM_EXPORTS __declspec(dllexport)
+#else
+#define FLAME_SYSTEM_EXPORTS __declspec(dllimport)
+#endif
+
+#include <flame/string.h>
+
+#include <vector>
+
+namespace flame
+{
+	// frame profiler: zones are recorded by any thread into a ring of its own (no locks on the
+	// recording side) and collected by the frame thread at profile_end_frame, the last
+	// ProfileHistoryFrames frames are kept
+	// the names are string literals, the hash is computed at compile time (see FLAME_PROFILE)
+
+	enum
+	{
+		ProfileHistoryFrames = 120,
+		ProfileRingSize = 8192, // zones per thread between two collects, must be power of 2
+		ProfileMaxDepth = 64,
+		ProfileGpuThread = -1
+	};
+
+	struct ProfileZone
+	{
+		unsigned int hash;
+		const char *name;
+		long long begin; // ns
+		long long end;
+		short depth;
+		short thread; // index in profile_get_thread_name, or ProfileGpuThread
+	};
+
+	struct ProfileFrame
+	{
+		unsigned long long index;
+		long long begin; // ns
+		long long end;
+		std::vector<ProfileZone> zones; // cpu zones that ended in this frame, by thread and then by begin
+		std::vector<ProfileZone> gpu_zones; // arrive some frames later, relative to the frame's begin
+		int dropped; // zones lost because a thread's ring was full
+	};
+
+	// can be called from any thread, zones must be properly nested in a thread
+	FLAME_SYSTEM_EXPORTS void profile_begin(unsigned int hash, const char *name);
+	FLAME_SYSTEM_EXPORTS void profile_end();
+	FLAME_SYSTEM_EXPORTS void profile_set_thread_name(const char *name);
+
+	// the functions below are for the frame thread only
+	FLAME_SYSTEM_EXPORTS void profile_begin_frame();
+	FLAME_SYSTEM_EXPORTS void profile_end_frame();
+	FLAME_SYSTEM_EXPORTS unsigned long long profile_get_frame_index(); // the frame being recorded
+	// gpu zones are times in ns from the frame's first timestamp, frames that left the history are ignored
+	FLAME_SYSTEM_EXPORTS void profile_add_gpu_zones(unsigned long long frame_index, const ProfileZone *zones, int count);
+	FLAME_SYSTEM_EXPORTS int profile_get_frame_count();
+	FLAME_SYSTEM_EXPORTS const ProfileFrame *profile_get_frame(int i); // 0 is the oldest
+	FLAME_SYSTEM_EXPORTS int profile_get_thread_count();
+	FLAME_SYSTEM_EXPORTS const char *profile_get_thread_name(int thread);
+	// chrome://tracing (or perfetto) json of the whole history
+	FLAME_SYSTEM_EXPORTS bool profile_save_chrome_trace(const char *filename);
+	FLAME_SYSTEM_EXPORTS void profile_clear();
+
+	struct ProfileScope
+	{
+		ProfileScope(unsigned int hash, const char *name)
+		{
+			profile_begin(hash, name);
+		}
+
+		~ProfileScope()
+		{
+			profile_end();
+		}
+	};
+}
+
+#define _FLAME_PROFILE_CAT2(a, b) a##b
+#define _FLAME_PROFILE_CAT(a, b) _FLAME_PROFILE_CAT2(a, b)
+// a zone to the end of the scope, name must be a string literal
+#define FLAME_PROFILE(name) flame::ProfileScope _FLAME_PROFILE_CAT(_profile_scope_, __LINE__)(CHASH(name), name)
@@ -0,0 +1,154 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <map>
+
+namespace flame
+{
+	// sub-allocate ranges from [0, capacity), the free ranges are kept in address order,
+	// allocation takes the first one that fits, and a freed range merges with its free neighbors
+	class RangeAllocator
+	{
+	protected:
+		long long capacity;
+		long long used;
+		std::map<long long, long long> free_ranges; // offset to size
+
+	public:
+		RangeAllocator(long long _capacity = 0)
+		{
+			reset(_capacity);
+		}
+
+		long long get_capacity() const
+		{
+			return capacity;
+		}
+
+		long long get_used() const
+		{
+			return used;
+		}
+
+		int get_free_range_count() const
+		{
+			return free_ranges.size();
+		}
+
+		long long get_largest_free_range() const
+		{
+			long long ret = 0;
+			for (auto &r : free_ranges)
+			{
+				if (r.second > ret)
+					ret = r.second;
+			}
+			return ret;
+		}
+
+		// 0 when all free space is in one piece, close to 1 when it is scattered in small pieces
+		float get_fragmentation() const
+		{
+			auto free = capacity - used;
+			if (free == 0)
+				return 0.f;
+			return 1.f - (float)get_largest_free_range() / free;
+		}
+
+		void reset(long long new_capacity)
+		{
+			capacity = new_capacity;
+			used = 0;
+			free_ranges.clear();
+			if (capacity > 0)
+				free_ranges[0] = capacity;
+		}
+
+		// returns -1 if there is no free range that fits
+		long long allocate(long long size, long long alignment = 1)
+		{
+			if (size <= 0)
+				return 0;
+
+			for (auto it = free_ranges.begin(); it != free_ranges.end(); it++)
+			{
+				auto offset = it->first;
+				auto range_size = it->second;
+				auto aligned = (offset + alignment - 1) / alignment * alignment;
+				auto padding = aligned - offset;
+				if (range_size < padding + size)
+					continue;
+
+				free_ranges.erase(it);
+				if (padding > 0)
+					free_ranges[offset] = padding;
+				auto remain = range_size - padding - size;
+				if (remain > 0)
+					free_ranges[aligned + size] = remain;
+
+				used += size;
+				return aligned;
+			}
+
+			return -1;
+		}
+
+		void free(long long offset, long long size)
+		{
+			if (size <= 0)
+				return;
+
+			used -= size;
+
+			auto it = free_ranges.emplace(offset, size).first;
+			auto next = std::next(it);
+			if (next != free_ranges.end() && offset + size == next->first)
+			{
+				it->second += next->second;
+				free_ranges.erase(next);
+			}
+			if (it != free_ranges.begin())
+			{
+				auto prev = std::prev(it);
+				if (prev->first + prev->second == offset)
+				{
+					prev->second += it->second;
+					free_ranges.erase(it);
+				}
+			}
+		}
+
+		// extend the capacity, existing allocations stay where they are
+		void grow(long long new_capacity)
+		{
+			if (new_capacity <= capacity)
+				return;
+
+			auto old_capacity = capacity;
+			capacity = new_capacity;
+			used += new_capacity - old_capacity;
+			free(old_capacity, new_capacity - old_capacity);
+		}
+	};
+}
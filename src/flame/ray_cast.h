@@ -0,0 +1,357 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <flame/aabb_tree.h>
+
+#include <vector>
+#include <algorithm>
+
+namespace flame
+{
+	struct RayHit
+	{
+		float t;
+		int triangle; // index into the indices given to build, divided by 3
+		float u; // barycentrics of the 2nd and 3rd vertex
+		float v;
+		int user;
+	};
+
+	// two-sided moller-trumbore
+	inline bool ray_triangle(const Ray &r, const Vec3 &a, const Vec3 &b, const Vec3 &c, float t_max,
+		float &t, float &u, float &v)
+	{
+		auto e1 = b - a;
+		auto e2 = c - a;
+		auto p = cross(r.dir, e2);
+		auto det = dot(e1, p);
+		if (det > -1e-12f && det < 1e-12f)
+			return false;
+		auto inv_det = 1.f / det;
+		auto s = r.origin - a;
+		u = dot(s, p) * inv_det;
+		if (u < 0.f || u > 1.f)
+			return false;
+		auto q = cross(s, e1);
+		v = dot(r.dir, q) * inv_det;
+		if (v < 0.f || u + v > 1.f)
+			return false;
+		t = dot(e2, q) * inv_det;
+		return t >= 0.f && t < t_max;
+	}
+
+	// static bounding volume hierarchy over the triangles of a mesh, built top-down with binned sah,
+	// the triangle corners are copied in leaf order so the source arrays can go away
+	class TriangleBVH
+	{
+	public:
+		struct Node
+		{
+			AABB box;
+			int first; // the first triangle for leaves, the left child for inner nodes (right is left + 1)
+			int count; // 0 for inner nodes
+		};
+	protected:
+		std::vector<Node> nodes;
+		std::vector<Vec3> corners; // 3 per triangle
+		std::vector<int> triangle_ids;
+
+		enum { BinCount = 12, MaxSahDepth = 32, StackSize = 64 };
+
+		struct BuildTriangle
+		{
+			AABB box;
+			Vec3 center;
+			int id;
+		};
+
+		static AABB empty_box()
+		{
+			return AABB(Vec3(FLT_MAX), Vec3(-FLT_MAX));
+		}
+
+		static void grow(AABB &b, const Vec3 &p)
+		{
+			for (auto i = 0; i < 3; i++)
+			{
+				b.min[i] = std::min(b.min[i], p[i]);
+				b.max[i] = std::max(b.max[i], p[i]);
+			}
+		}
+
+		// area without the 2x, empty boxes give 0
+		static float half_area(const AABB &b)
+		{
+			if (b.min.x > b.max.x)
+				return 0.f;
+			auto d = b.max - b.min;
+			return d.x * d.y + d.y * d.z + d.z * d.x;
+		}
+
+		// returns the split position in [begin, end), or -1 to make a leaf
+		int split(std::vector<BuildTriangle> &tris, int begin, int end, const AABB &box, int max_leaf, int depth)
+		{
+			auto count = end - begin;
+			if (count <= 1)
+				return -1;
+			// keeps the tree within the traversal stack whatever the sah does
+			if (depth >= MaxSahDepth)
+				return count <= max_leaf ? -1 : begin + count / 2;
+
+			auto centers = empty_box();
+			for (auto i = begin; i < end; i++)
+				grow(centers, tris[i].center);
+
+			auto best_cost = FLT_MAX;
+			auto best_axis = -1;
+			auto best_bin = 0;
+			for (auto axis = 0; axis < 3; axis++)
+			{
+				auto lo = centers.min[axis];
+				auto extent = centers.max[axis] - lo;
+				if (extent <= 0.f)
+					continue;
+				auto scale = BinCount / extent;
+
+				AABB bin_boxes[BinCount];
+				int bin_counts[BinCount] = {};
+				for (auto k = 0; k < BinCount; k++)
+					bin_boxes[k] = empty_box();
+				for (auto i = begin; i < end; i++)
+				{
+					auto k = std::min(BinCount - 1, (int)((tris[i].center[axis] - lo) * scale));
+					bin_counts[k]++;
+					bin_boxes[k] = merge(bin_boxes[k], tris[i].box);
+				}
+
+				// sweep from the right for the right side costs, then from the left
+				float right_cost[BinCount];
+				auto acc_box = empty_box();
+				auto acc_count = 0;
+				for (auto k = BinCount - 1; k > 0; k--)
+				{
+					acc_box = merge(acc_box, bin_boxes[k]);
+					acc_count += bin_counts[k];
+					right_cost[k] = acc_count * half_area(acc_box);
+				}
+				acc_box = empty_box();
+				acc_count = 0;
+				for (auto k = 0; k < BinCount - 1; k++)
+				{
+					acc_box = merge(acc_box, bin_boxes[k]);
+					acc_count += bin_counts[k];
+					auto cost = acc_count * half_area(acc_box) + right_cost[k + 1];
+					if (acc_count > 0 && acc_count < count && cost < best_cost)
+					{
+						best_cost = cost;
+						best_axis = axis;
+						best_bin = k;
+					}
+				}
+			}
+
+			// a leaf costs one test per triangle, traversing costs about one more box test
+			auto leaf_cost = count * half_area(box);
+			if (best_axis == -1 || (count <= max_leaf && best_cost + half_area(box) >= leaf_cost))
+			{
+				if (count <= max_leaf || (best_axis == -1 && count <= 64))
+					return -1;
+				// all centers in one point (or a bad split on a big node), halve it
+				return begin + count / 2;
+			}
+
+			auto lo = centers.min[best_axis];
+			auto scale = BinCount / (centers.max[best_axis] - lo);
+			auto mid = std::partition(tris.begin() + begin, tris.begin() + end, [&](const BuildTriangle &t) {
+				return std::min(BinCount - 1, (int)((t.center[best_axis] - lo) * scale)) <= best_bin;
+			});
+			return mid - tris.begin();
+		}
+
+	public:
+		// positions are read with stride bytes between vertices, so the position of an interleaved
+		// vertex can be pointed to directly
+		void build(const void *positions, int stride, const int *indices, int index_count, int max_leaf = 4)
+		{
+			nodes.clear();
+			corners.clear();
+			triangle_ids.clear();
+
+			auto pos = [&](int i) {
+				return *(const Vec3*)((const char*)positions + (size_t)i * stride);
+			};
+
+			auto triangle_count = index_count / 3;
+			if (triangle_count == 0)
+				return;
+
+			std::vector<BuildTriangle> tris(triangle_count);
+			for (auto i = 0; i < triangle_count; i++)
+			{
+				auto &t = tris[i];
+				t.box = empty_box();
+				for (auto j = 0; j < 3; j++)
+					grow(t.box, pos(indices[i * 3 + j]));
+				t.center = (t.box.min + t.box.max) * 0.5f;
+				t.id = i;
+			}
+
+			struct Task
+			{
+				int node;
+				int begin;
+				int end;
+				int depth;
+			};
+			std::vector<Task> tasks;
+			nodes.reserve(triangle_count * 2);
+			nodes.emplace_back();
+			tasks.push_back({ 0, 0, triangle_count, 0 });
+			while (!tasks.empty())
+			{
+				auto task = tasks.back();
+				tasks.pop_back();
+
+				auto box = empty_box();
+				for (auto i = task.begin; i < task.end; i++)
+					box = merge(box, tris[i].box);
+				nodes[task.node].box = box;
+
+				auto mid = split(tris, task.begin, task.end, box, max_leaf, task.depth);
+				if (mid == -1)
+				{
+					nodes[task.node].first = task.begin;
+					nodes[task.node].count = task.end - task.begin;
+					continue;
+				}
+				int left = nodes.size();
+				nodes[task.node].first = left;
+				nodes[task.node].count = 0;
+				nodes.emplace_back();
+				nodes.emplace_back();
+				tasks.push_back({ left, task.begin, mid, task.depth + 1 });
+				tasks.push_back({ left + 1, mid, task.end, task.depth + 1 });
+			}
+			nodes.shrink_to_fit();
+
+			corners.resize(triangle_count * 3);
+			triangle_ids.resize(triangle_count);
+			for (auto i = 0; i < triangle_count; i++)
+			{
+				auto id = tris[i].id;
+				triangle_ids[i] = id;
+				for (auto j = 0; j < 3; j++)
+					corners[i * 3 + j] = pos(indices[id * 3 + j]);
+			}
+		}
+
+		bool empty() const
+		{
+			return nodes.empty();
+		}
+
+		int get_triangle_count() const
+		{
+			return triangle_ids.size();
+		}
+
+		int get_node_count() const
+		{
+			return nodes.size();
+		}
+
+		const Node &get_node(int id) const
+		{
+			return nodes[id];
+		}
+
+		// the box of the whole mesh
+		const AABB &get_box() const
+		{
+			return nodes[0].box;
+		}
+
+		// the nearest hit before t_max, hit->user is left alone
+		bool ray_cast(const Ray &r, float t_max, RayHit *hit) const
+		{
+			float t;
+			if (nodes.empty() || !ray_aabb(r, nodes[0].box, t_max, t))
+				return false;
+
+			auto found = false;
+			int stack[StackSize];
+			auto top = 0;
+			stack[top++] = 0;
+			while (top > 0)
+			{
+				auto &n = nodes[stack[--top]];
+				if (!ray_aabb(r, n.box, t_max, t))
+					continue;
+				if (n.count > 0)
+				{
+					for (auto i = n.first; i < n.first + n.count; i++)
+					{
+						float u, v;
+						auto c = &corners[i * 3];
+						if (ray_triangle(r, c[0], c[1], c[2], t_max, t, u, v))
+						{
+							t_max = t;
+							hit->t = t;
+							hit->triangle = triangle_ids[i];
+							hit->u = u;
+							hit->v = v;
+							found = true;
+						}
+					}
+					continue;
+				}
+				float t1, t2;
+				auto hit1 = ray_aabb(r, nodes[n.first].box, t_max, t1);
+				auto hit2 = ray_aabb(r, nodes[n.first + 1].box, t_max, t2);
+				if (hit1 && hit2)
+				{
+					stack[top++] = t1 < t2 ? n.first + 1 : n.first;
+					stack[top++] = t1 < t2 ? n.first : n.first + 1;
+				}
+				else if (hit1)
+					stack[top++] = n.first;
+				else if (hit2)
+					stack[top++] = n.first + 1;
+			}
+			return found;
+		}
+	};
+
+	// the ray is taken into the mesh space with the inverse of the world matrix, the direction is not
+	// renormalized so hit->t stays a world distance along world_ray
+	inline bool ray_cast(const TriangleBVH &bvh, const Mat4 &inv_world, const Ray &world_ray, float t_max, RayHit *hit)
+	{
+		auto &m = inv_world;
+		auto &d = world_ray.dir;
+		Vec3 local_dir(m[0][0] * d.x + m[1][0] * d.y + m[2][0] * d.z,
+			m[0][1] * d.x + m[1][1] * d.y + m[2][1] * d.z,
+			m[0][2] * d.x + m[1][2] * d.y + m[2][2] * d.z);
+		return bvh.ray_cast(Ray(inv_world * world_ray.origin, local_dir), t_max, hit);
+	}
+}
@@ -24,9 +24,13 @@
 
 #include <flame/filesystem.h>
 #include <flame/system.h>
+#include <flame/time.h>
 
 #include <spirv_glsl.hpp>
 #include <assert.h>
+#include <atomic>
+#include <mutex>
+#include <set>
 
 namespace flame
 {
@@ -39,21 +43,126 @@ namespace flame
 		"#version 450 core\n"
 		"#extension GL_ARB_shading_language_420pack : enable\n"; // Allows the setting of Uniform Buffer Object and sampler binding points directly from GLSL
 
-	void compile_shader(const char *glsl_file_in, int shader_define_count,
-		ShortString *shader_defines, const char *config_file, const char *spv_file_out, void(*compile_output_callback)(const char *filename, int line, const char *what))
+	static std::string get_glslc_path()
 	{
 		std::string vk_sdk_path(getenv("VK_SDK_PATH"));
 		assert(vk_sdk_path != "");
+		return vk_sdk_path + "/Bin/glslc.exe";
+	}
+
+	static const char *get_additional_lines(const std::filesystem::path &glsl_path)
+	{
+		if (glsl_path.extension().string() == ".comp")
+			return additional_lines_compute;
+		return additional_lines_graphics;
+	}
+
+	// FNV-1a
+	static void hash_bytes(unsigned long long &h, const void *data, size_t size)
+	{
+		auto p = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			h ^= p[i];
+			h *= 0x100000001b3ULL;
+		}
+	}
+
+	static void hash_string(unsigned long long &h, const std::string &s)
+	{
+		hash_bytes(h, s.c_str(), s.size() + 1);
+	}
+
+	// the file and everything it includes, every file is counted once
+	static void hash_file(unsigned long long &h, const std::filesystem::path &path, std::set<std::string> &visited)
+	{
+		auto fn = std::filesystem::absolute(path).lexically_normal().string();
+		if (!visited.insert(fn).second)
+			return;
+
+		auto file = get_file_content(fn);
+		hash_string(h, fn);
+		if (!file.first)
+			return;
+		hash_bytes(h, file.first.get(), file.second);
+
+		auto dir = path.parent_path();
+		auto p = file.first.get();
+		while (true)
+		{
+			p = strstr(p, "#include");
+			if (!p)
+				break;
+			p += 8;
+			while (*p == ' ' || *p == '\t')
+				p++;
+			char close;
+			if (*p == '"')
+				close = '"';
+			else if (*p == '<')
+				close = '>';
+			else
+				continue;
+			auto begin = p + 1;
+			auto end = strchr(begin, close);
+			if (!end)
+				break;
+			hash_file(h, dir / std::string(begin, end), visited);
+			p = end + 1;
+		}
+	}
+
+	static const std::string &get_compiler_version()
+	{
+		static std::string version;
+		static std::once_flag flag;
+		std::call_once(flag, []() {
+			LongString output;
+			exec(get_glslc_path().c_str(), " --version", &output);
+			version = output.data;
+		});
+		return version;
+	}
+
+	unsigned long long get_shader_hash(const char *glsl_file_in, int shader_define_count,
+		ShortString *shader_defines, const char *config_file)
+	{
+		auto h = 0xcbf29ce484222325ULL;
+
+		hash_string(h, get_compiler_version());
+		hash_string(h, get_additional_lines(glsl_file_in));
 
+		std::set<std::string> visited;
+		hash_file(h, glsl_file_in, visited);
+
+		for (auto i = 0; i < shader_define_count; i++)
+			hash_string(h, shader_defines[i].data);
+
+		if (config_file)
+		{
+			auto file = get_file_content(config_file);
+			if (file.first)
+				hash_bytes(h, file.first.get(), file.second);
+		}
+
+		return h;
+	}
+
+	static std::atomic<int> temp_id(0);
+
+	bool compile_shader(const char *glsl_file_in, int shader_define_count, ShortString *shader_defines, const char *config_file, 
+		const char *spv_file_out, void(*compile_output_callback)(void *user_data, const char *filename, int line, const char *what), void *user_data)
+	{
 		std::filesystem::path glsl_path(glsl_file_in);
 
-		const char *additional_lines;
-		if (glsl_path.extension().string() == ".comp")
-			additional_lines = additional_lines_compute;
-		else
-			additional_lines = additional_lines_graphics;
+		auto additional_lines = get_additional_lines(glsl_path);
 		auto additional_lines_len = strlen(additional_lines);
-		auto temp_filename = glsl_path.parent_path().string() + "/temp." + glsl_path.filename().string();
+
+		// every compile has its own temp files, so they can run at the same time,
+		// the temp source stays next to the original so that the includes still work
+		auto unique = std::to_string(get_now_ns()) + "." + std::to_string(temp_id++);
+		auto temp_filename = glsl_path.parent_path().string() + "/temp." + unique + "." + glsl_path.filename().string();
+		auto temp_spv_filename = std::string(spv_file_out) + "." + unique + ".tmp";
 		{
 			std::ofstream ofile(temp_filename);
 			auto file = get_file_content(glsl_file_in);
@@ -61,6 +170,12 @@ namespace flame
 			ofile.write(file.first.get(), file.second);
 			ofile.close();
 		}
+
+		std::filesystem::path spv_path(spv_file_out);
+		std::filesystem::path spv_dir = spv_path.parent_path();
+		if (!spv_dir.empty() && !std::filesystem::exists(spv_dir))
+			std::filesystem::create_directories(spv_dir);
+
 		std::string command_line(" " + temp_filename + " ");
 		for (auto i = 0; i < shader_define_count; i++)
 			command_line += "-D" + std::string(shader_defines[i].data) + " ";
@@ -69,14 +184,14 @@ namespace flame
 			command_line += " -flimit-file ";
 			command_line += config_file;
 		}
-		command_line += " -o temp.spv";
+		command_line += " -o " + temp_spv_filename;
 		LongString output;
-		exec((vk_sdk_path + "/Bin/glslc.exe").c_str(), command_line.c_str(), &output);
+		exec(get_glslc_path().c_str(), command_line.c_str(), &output);
 		std::filesystem::remove(temp_filename);
-		if (!std::filesystem::exists("temp.spv"))
+		if (!std::filesystem::exists(temp_spv_filename))
 		{
 			auto additional_lines_count = std::count(additional_lines, additional_lines + additional_lines_len, '\n');
-			compile_output_callback(nullptr, -1, "##start"); // this tag means this is the start
+			compile_output_callback(user_data, nullptr, -1, "##start"); // this tag means this is the start
 			auto p = (char*)output.data;
 			while (true)
 			{
@@ -94,64 +209,92 @@ namespace flame
 				if (p)
 					*p = 0;
 				auto what = p1 + 1;
-				compile_output_callback(filename, line, what);
+				compile_output_callback(user_data, filename, line, what);
 				if (!p)
 					break;
+				p++;
 			}
-			compile_output_callback(nullptr, -1, "##end"); // this tag means this is the end
+			compile_output_callback(user_data, nullptr, -1, "##end"); // this tag means this is the end
+			return false;
 		}
-		else
+
+		std::error_code ec;
+		std::filesystem::rename(temp_spv_filename, spv_path, ec);
+		if (ec)
 		{
-			std::filesystem::path spv_path(spv_file_out);
-			std::filesystem::path spv_dir = spv_path.parent_path();
-			if (!std::filesystem::exists(spv_dir))
-				std::filesystem::create_directories(spv_dir);
-			std::filesystem::copy_file("temp.spv", spv_path, std::filesystem::copy_options::overwrite_existing);
-			std::filesystem::remove("temp.spv");
+			std::filesystem::remove(temp_spv_filename, ec);
+			compile_output_callback(user_data, nullptr, -1, "##start");
+			compile_output_callback(user_data, spv_file_out, 0, " cannot write the spv file");
+			compile_output_callback(user_data, nullptr, -1, "##end");
+			return false;
 		}
+		return true;
 	}
 
-	void produce_shader_resource_file(const char *spv_file_in, const char *res_file_out)
+	void reflect_shader(const void *spv, int spv_size, ShaderReflection *out)
 	{
-		auto spv_file = get_file_content(spv_file_in);
-
-		std::vector<unsigned int> spv_vec(spv_file.second / sizeof(unsigned int));
-		memcpy(spv_vec.data(), spv_file.first.get(), spv_file.second);
+		std::vector<unsigned int> spv_vec(spv_size / sizeof(unsigned int));
+		memcpy(spv_vec.data(), spv, spv_vec.size() * sizeof(unsigned int));
 
 		spirv_cross::CompilerGLSL glsl(std::move(spv_vec));
 
 		spirv_cross::ShaderResources resources = glsl.get_shader_resources();
 
-		std::ofstream res_file(res_file_out, std::ios::binary);
+		out->resources.clear();
+		auto _add_resources = [&](ShaderReflectionResourceType type, std::vector<spirv_cross::Resource> &list) {
+			for (auto &r : list)
+			{
+				ShaderReflectionResource res;
+				res.type = type;
+				res.set = glsl.get_decoration(r.id, spv::DecorationDescriptorSet);
+				res.binding = glsl.get_decoration(r.id, spv::DecorationBinding);
+				auto _type = glsl.get_type(r.type_id);
+				res.count = _type.array.size() > 0 ? _type.array[0] : 1;
+				strncpy(res.name.data, r.name.c_str(), sizeof(res.name.data) - 1);
+				res.name.data[sizeof(res.name.data) - 1] = 0;
+				out->resources.push_back(res);
+			}
+		};
 
-		auto _write_resource = [&](spirv_cross::Resource &r) {
-			write<int>(res_file, (int)glsl.get_decoration(r.id, spv::DecorationDescriptorSet));
+		_add_resources(ShaderReflectionUniformbuffer, resources.uniform_buffers);
+		_add_resources(ShaderReflectionStoragebuffer, resources.storage_buffers);
+		_add_resources(ShaderReflectionTexture, resources.sampled_images);
+		_add_resources(ShaderReflectionStorageTexture, resources.storage_images);
 
-			auto _type = glsl.get_type(r.type_id);
-			int count = _type.array.size() > 0 ? _type.array[0] : 1;
+		out->push_constant_size = 0;
+		for (auto &r : resources.push_constant_buffers)
+			out->push_constant_size = glsl.get_declared_struct_size(glsl.get_type(r.type_id));
+	}
 
-			write_string(res_file, r.name);
-			write<int>(res_file, (int)glsl.get_decoration(r.id, spv::DecorationBinding));
+	void produce_shader_resource_file(const char *spv_file_in, const char *res_file_out)
+	{
+		auto spv_file = get_file_content(spv_file_in);
+
+		ShaderReflection reflection;
+		reflect_shader(spv_file.first.get(), spv_file.second, &reflection);
+
+		std::ofstream res_file(res_file_out, std::ios::binary);
+
+		for (auto t = 0; t < 4; t++)
+		{
+			auto count = 0;
+			for (auto &r : reflection.resources)
+			{
+				if (r.type == t)
+					count++;
+			}
 			write<int>(res_file, count);
-		};
+			for (auto &r : reflection.resources)
+			{
+				if (r.type != t)
+					continue;
+				write<int>(res_file, r.set);
+				write_string(res_file, r.name.data);
+				write<int>(res_file, r.binding);
+				write<int>(res_file, r.count);
+			}
+		}
 
-		write<int>(res_file, resources.uniform_buffers.size());
-		for (auto &r : resources.uniform_buffers)
-			_write_resource(r);
-		write<int>(res_file, resources.storage_buffers.size());
-		for (auto &r : resources.storage_buffers)
-			_write_resource(r);
-		write<int>(res_file, resources.sampled_images.size());
-		for (auto &r : resources.sampled_images)
-			_write_resource(r);
-		write<int>(res_file, resources.storage_images.size());
-		for (auto &r : resources.storage_images)
-			_write_resource(r);
-
-		int push_constant_size;
-		for (auto &r : resources.push_constant_buffers)
-			push_constant_size = glsl.get_declared_struct_size(glsl.get_type(r.type_id));
-		write<int>(res_file, push_constant_size);
+		write<int>(res_file, reflection.push_constant_size);
 	}
 }
-
@@ -0,0 +1,227 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <flame/type.h>
+#include <flame/math.h>
+#include <flame/aabb_tree.h>
+
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+
+namespace flame
+{
+	// cascaded shadow maps for parallax lights, the view frustum is split along the depth and
+	// each slice gets its own orthographic box in light space
+	//
+	// the box of a slice is sized from the bounding sphere of the slice, which does not change
+	// when the camera turns, and its center is snapped to whole texels, so a static scene keeps
+	// exactly the same boxes (and shadow maps) while the camera moves inside a texel and never
+	// shimmers when it moves further
+	//
+	// light space: z points to the light, depth 0 is the side nearest to the light
+
+	enum { MaxShadowCascadeCount = 4 };
+
+	// splits[0] is near, splits[count] is far, lambda 0 is uniform and 1 is logarithmic
+	inline void get_shadow_cascade_splits(int count, float near_plane, float far_plane, float lambda, float *splits)
+	{
+		splits[0] = near_plane;
+		for (auto i = 1; i < count; i++)
+		{
+			auto f = (float)i / count;
+			auto log_split = near_plane * powf(far_plane / near_plane, f);
+			auto uniform_split = near_plane + (far_plane - near_plane) * f;
+			splits[i] = uniform_split + (log_split - uniform_split) * lambda;
+		}
+		splits[count] = far_plane;
+	}
+
+	// the eight world space corners of the view frustum between depth d0 and d1, the camera
+	// looks down -z_axis
+	inline void get_frustum_slice_corners(const Vec3 &coord, const Vec3 &x_axis, const Vec3 &y_axis, const Vec3 &z_axis,
+		float tan_hf_fovy, float aspect, float d0, float d1, Vec3 *out)
+	{
+		float depths[] = { d0, d1 };
+		for (auto i = 0; i < 2; i++)
+		{
+			auto d = depths[i];
+			auto hy = d * tan_hf_fovy;
+			auto hx = hy * aspect;
+			auto c = coord - z_axis * d;
+			out[i * 4 + 0] = c - x_axis * hx - y_axis * hy;
+			out[i * 4 + 1] = c + x_axis * hx - y_axis * hy;
+			out[i * 4 + 2] = c + x_axis * hx + y_axis * hy;
+			out[i * 4 + 3] = c - x_axis * hx + y_axis * hy;
+		}
+	}
+
+	struct ShadowLightSpace
+	{
+		Vec3 x_axis;
+		Vec3 y_axis;
+		Vec3 z_axis;
+
+		// dir is where the light goes
+		void set_direction(const Vec3 &dir)
+		{
+			z_axis = dir.get_normalize() * -1.f;
+			auto up = fabsf(z_axis.y) < 0.99f ? Vec3(0.f, 1.f, 0.f) : Vec3(1.f, 0.f, 0.f);
+			x_axis = cross(up, z_axis).get_normalize();
+			y_axis = cross(z_axis, x_axis);
+		}
+
+		Vec3 to_light(const Vec3 &p) const
+		{
+			return Vec3(dot(p, x_axis), dot(p, y_axis), dot(p, z_axis));
+		}
+
+		// the light space box around a world space box
+		void to_light(const AABB &b, Vec3 &out_min, Vec3 &out_max) const
+		{
+			auto c = to_light((b.min + b.max) * 0.5f);
+			auto e = (b.max - b.min) * 0.5f;
+			Vec3 le(
+				fabsf(x_axis.x) * e.x + fabsf(x_axis.y) * e.y + fabsf(x_axis.z) * e.z,
+				fabsf(y_axis.x) * e.x + fabsf(y_axis.y) * e.y + fabsf(y_axis.z) * e.z,
+				fabsf(z_axis.x) * e.x + fabsf(z_axis.y) * e.y + fabsf(z_axis.z) * e.z
+			);
+			out_min = c - le;
+			out_max = c + le;
+		}
+	};
+
+	struct ShadowCascade
+	{
+		float split_near;
+		float split_far;
+		float texel_size;
+		Vec3 min; // light space box
+		Vec3 max;
+		float caster_min_z;
+		float caster_max_z;
+		int caster_count;
+		uint caster_hash; // of the caster ids, so a swapped caster also counts as a change
+
+		bool same_box(const ShadowCascade &o) const
+		{
+			return min.x == o.min.x && min.y == o.min.y && min.z == o.min.z &&
+				max.x == o.max.x && max.y == o.max.y && max.z == o.max.z;
+		}
+	};
+
+	// step 1, the box of the receivers (the frustum slice), x and y are final after this
+	inline void begin_shadow_cascade(const ShadowLightSpace &ls, const Vec3 *corners, int map_size,
+		float split_near, float split_far, ShadowCascade &out)
+	{
+		auto c = Vec3(0.f);
+		for (auto i = 0; i < 8; i++)
+			c += corners[i];
+		c *= 0.125f;
+		auto r = 0.f;
+		for (auto i = 0; i < 8; i++)
+			r = std::max(r, (corners[i] - c).length());
+		// round up so float noise from turning the camera does not change the size
+		r = ceilf(r * 16.f) / 16.f;
+
+		out.split_near = split_near;
+		out.split_far = split_far;
+		out.texel_size = r * 2.f / map_size;
+		auto lc = ls.to_light(c);
+		lc.x = floorf(lc.x / out.texel_size) * out.texel_size;
+		lc.y = floorf(lc.y / out.texel_size) * out.texel_size;
+		out.min = Vec3(lc.x - r, lc.y - r, lc.z - r);
+		out.max = Vec3(lc.x + r, lc.y + r, lc.z + r);
+		out.caster_min_z = FLT_MAX;
+		out.caster_max_z = -FLT_MAX;
+		out.caster_count = 0;
+		out.caster_hash = 0;
+	}
+
+	// the world space planes (as in frustum_test) that a caster has to touch to matter: inside the
+	// x and y of the box and not entirely under the receivers, the side towards the light is open,
+	// AABBTree keeps fat boxes so check what it gives with shadow_cascade_overlaps
+	inline void get_shadow_cascade_planes(const ShadowLightSpace &ls, const ShadowCascade &c, Vec4 *planes)
+	{
+		auto &x = ls.x_axis, &y = ls.y_axis, &z = ls.z_axis;
+		planes[0] = Vec4(x.x, x.y, x.z, -c.min.x);
+		planes[1] = Vec4(-x.x, -x.y, -x.z, c.max.x);
+		planes[2] = Vec4(y.x, y.y, y.z, -c.min.y);
+		planes[3] = Vec4(-y.x, -y.y, -y.z, c.max.y);
+		planes[4] = Vec4(z.x, z.y, z.z, -c.min.z);
+		planes[5] = Vec4(0.f, 0.f, 0.f, 1.f);
+	}
+
+	inline bool shadow_cascade_overlaps(const ShadowLightSpace &ls, const ShadowCascade &c, const AABB &caster)
+	{
+		Vec3 mn, mx;
+		ls.to_light(caster, mn, mx);
+		return mx.x >= c.min.x && mn.x <= c.max.x && mx.y >= c.min.y && mn.y <= c.max.y && mx.z >= c.min.z;
+	}
+
+	// step 2, every caster that overlaps
+	inline void add_shadow_caster(const ShadowLightSpace &ls, const AABB &caster, uint id, ShadowCascade &c)
+	{
+		Vec3 mn, mx;
+		ls.to_light(caster, mn, mx);
+		c.caster_min_z = std::min(c.caster_min_z, mn.z);
+		c.caster_max_z = std::max(c.caster_max_z, mx.z);
+		c.caster_count++;
+		c.caster_hash = (c.caster_hash ^ (id + 0x9e3779b9 + (c.caster_hash << 6) + (c.caster_hash >> 2)));
+	}
+
+	// step 3, the light side of the depth range is tightened to the casters (nothing nearer to the light
+	// can be shadowed by them), the far side stays at the receivers since not every receiver is a caster
+	// (terrain), then it is snapped (to 16 texels) so it only moves in steps
+	inline void end_shadow_cascade(ShadowCascade &c)
+	{
+		if (c.caster_count > 0)
+			c.max.z = c.caster_max_z;
+		auto step = c.texel_size * 16.f;
+		c.min.z = floorf(c.min.z / step) * step;
+		c.max.z = std::max(ceilf(c.max.z / step) * step, c.min.z + step);
+	}
+
+	// column major, x and y of the box go to [-1, 1] and the depth to [0, 1]
+	inline void get_shadow_cascade_matrix(const ShadowLightSpace &ls, const ShadowCascade &c, float *out)
+	{
+		auto sx = 2.f / (c.max.x - c.min.x);
+		auto sy = 2.f / (c.max.y - c.min.y);
+		auto sz = 1.f / (c.max.z - c.min.z);
+		auto mx = (c.max.x + c.min.x) * 0.5f;
+		auto my = (c.max.y + c.min.y) * 0.5f;
+		auto &x = ls.x_axis, &y = ls.y_axis, &z = ls.z_axis;
+		float rows[4][4] = {
+			{ x.x * sx, x.y * sx, x.z * sx, -mx * sx },
+			{ y.x * sy, y.y * sy, y.z * sy, -my * sy },
+			{ -z.x * sz, -z.y * sz, -z.z * sz, c.max.z * sz },
+			{ 0.f, 0.f, 0.f, 1.f }
+		};
+		for (auto col = 0; col < 4; col++)
+		{
+			for (auto row = 0; row < 4; row++)
+				out[col * 4 + row] = rows[row][col];
+		}
+	}
+}
@@ -22,25 +22,135 @@
 
 #pragma once
 
-#include <map>
 #include <vector>
-#include <list>
 #include <functional>
+#include <stdint.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace flame
 {
+	// a slot is referenced by its index (which is what the shaders see) plus the generation of
+	// the slot when it was taken, a handle of a removed object will not match a reused slot
+	struct SlotHandle
+	{
+		int index;
+		unsigned int generation;
+	};
+
+	// fixed capacity slots: O(1) add/remove with no allocation after construction, the live
+	// objects are packed in dense arrays so iterating is a linear walk, a pointer-to-slot hash
+	// table (open addressing) keeps the old add(p)/remove(p) interface
 	class SpareList
 	{
 	protected:
 		unsigned int capacity;
-		std::map<void*, int> map;
-		std::list<int> spare_list;
+
+		// per slot
+		std::vector<unsigned int> generations;
+		std::vector<int> slot_to_dense; // -1 when the slot is free
+		std::vector<int> free_slots; // a stack, the lowest index is on the top at the beginning
+
+		// packed live objects
+		std::vector<void*> dense_ptrs;
+		std::vector<int> dense_slots;
+
+		// objects that changed since the last iterate_dirty, one bit per slot
+		std::vector<uint64_t> dirty_bits;
+
+		// hash table of pointer -> slot
+		unsigned int table_mask;
+		std::vector<void*> table_keys;
+		std::vector<int> table_slots;
+
+		unsigned int hash(void *p) const
+		{
+			auto v = (uint64_t)p;
+			v ^= v >> 33;
+			v *= 0xff51afd7ed558ccdULL;
+			v ^= v >> 33;
+			return (unsigned int)v & table_mask;
+		}
+
+		int table_find(void *p) const
+		{
+			for (auto i = hash(p); ; i = (i + 1) & table_mask)
+			{
+				if (table_keys[i] == p)
+					return i;
+				if (!table_keys[i])
+					return -1;
+			}
+		}
+
+		void table_insert(void *p, int slot)
+		{
+			auto i = hash(p);
+			while (table_keys[i])
+				i = (i + 1) & table_mask;
+			table_keys[i] = p;
+			table_slots[i] = slot;
+		}
+
+		void table_erase(int i)
+		{
+			// backward shift deletion, keeps the probe chains intact without tombstones
+			auto j = i;
+			while (true)
+			{
+				j = (j + 1) & table_mask;
+				if (!table_keys[j])
+					break;
+				auto k = (int)hash(table_keys[j]);
+				if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+					continue;
+				table_keys[i] = table_keys[j];
+				table_slots[i] = table_slots[j];
+				i = j;
+			}
+			table_keys[i] = nullptr;
+		}
+
+		void remove_slot(int slot, int table_index)
+		{
+			auto d = slot_to_dense[slot];
+			auto last = (int)dense_ptrs.size() - 1;
+			if (d != last)
+			{
+				dense_ptrs[d] = dense_ptrs[last];
+				dense_slots[d] = dense_slots[last];
+				slot_to_dense[dense_slots[d]] = d;
+			}
+			dense_ptrs.pop_back();
+			dense_slots.pop_back();
+
+			table_erase(table_index);
+			slot_to_dense[slot] = -1;
+			generations[slot]++;
+			dirty_bits[slot >> 6] &= ~(1ULL << (slot & 63));
+			free_slots.push_back(slot);
+		}
 	public:
 		SpareList(unsigned int _capacity) :
 			capacity(_capacity)
 		{
-			for (int i = 0; i < capacity; i++)
-				spare_list.push_back(i);
+			generations.resize(capacity, 0);
+			slot_to_dense.resize(capacity, -1);
+			free_slots.resize(capacity);
+			for (auto i = 0u; i < capacity; i++)
+				free_slots[i] = capacity - 1 - i;
+			dense_ptrs.reserve(capacity);
+			dense_slots.reserve(capacity);
+			dirty_bits.resize((capacity + 63) / 64, 0);
+
+			// keep the load factor at most 1/2
+			auto table_size = 16U;
+			while (table_size < capacity * 2)
+				table_size *= 2;
+			table_mask = table_size - 1;
+			table_keys.resize(table_size, nullptr);
+			table_slots.resize(table_size, -1);
 		}
 
 		int get_capacity() const
@@ -50,55 +160,125 @@ namespace flame
 
 		int get_size() const
 		{
-			return map.size();
+			return dense_ptrs.size();
 		}
 
+		// -2 if already added, -1 if full, otherwise the slot index
 		int add(void *p)
 		{
-			{
-				auto it = map.find(p);
-				if (it != map.end())
-					return -2;
-			}
+			if (table_find(p) != -1)
+				return -2;
 
-			if (spare_list.size() == 0)
+			if (free_slots.empty())
 				return -1;
 
-			{
-				auto it = spare_list.begin();
-				auto index = *it;
-				map[p] = index;
-				spare_list.erase(it);
-				return index;
-			}
+			auto slot = free_slots.back();
+			free_slots.pop_back();
+			slot_to_dense[slot] = dense_ptrs.size();
+			dense_ptrs.push_back(p);
+			dense_slots.push_back(slot);
+			table_insert(p, slot);
+			mark_dirty(slot);
+			return slot;
+		}
+
+		SlotHandle add_handle(void *p)
+		{
+			SlotHandle h;
+			h.index = add(p);
+			h.generation = h.index >= 0 ? generations[h.index] : 0;
+			return h;
 		}
 
 		void remove(void *p)
 		{
-			auto it = map.find(p);
-			if (it == map.end())
+			auto i = table_find(p);
+			if (i == -1)
 				return;
+			remove_slot(table_slots[i], i);
+		}
+
+		void remove(const SlotHandle &h)
+		{
+			auto p = get(h);
+			if (p)
+				remove(p);
+		}
+
+		int find(void *p) const
+		{
+			auto i = table_find(p);
+			return i == -1 ? -1 : table_slots[i];
+		}
 
-			auto index = it->second;
-			map.erase(it);
-			spare_list.push_back(index);
+		bool is_valid(const SlotHandle &h) const
+		{
+			return h.index >= 0 && h.index < (int)capacity && slot_to_dense[h.index] != -1 && 
+				generations[h.index] == h.generation;
+		}
+
+		void *get(const SlotHandle &h) const
+		{
+			return is_valid(h) ? dense_ptrs[slot_to_dense[h.index]] : nullptr;
+		}
+
+		void *get(int index) const
+		{
+			return index >= 0 && index < (int)capacity && slot_to_dense[index] != -1 ? dense_ptrs[slot_to_dense[index]] : nullptr;
+		}
+
+		// dense view, the order changes when objects are removed
+		void *const *get_dense_ptrs() const
+		{
+			return dense_ptrs.data();
+		}
+
+		const int *get_dense_slots() const
+		{
+			return dense_slots.data();
+		}
+
+		void mark_dirty(int slot)
+		{
+			dirty_bits[slot >> 6] |= 1ULL << (slot & 63);
+		}
+
+		// visits dirty slots in index order and clears them
+		template <class F>
+		void iterate_dirty(const F &callback)
+		{
+			for (auto w = 0; w < (int)dirty_bits.size(); w++)
+			{
+				auto bits = dirty_bits[w];
+				dirty_bits[w] = 0;
+				while (bits)
+				{
+#if defined(_MSC_VER)
+					unsigned long b;
+					_BitScanForward64(&b, bits);
+#else
+					auto b = __builtin_ctzll(bits);
+#endif
+					bits &= bits - 1;
+					auto slot = w * 64 + b;
+					callback(slot, dense_ptrs[slot_to_dense[slot]]);
+				}
+			}
 		}
 
 		void iterate(const std::function<bool(int index, void *p, bool &remove)> 
 			&callback)
 		{
-			for (auto it = map.begin(); it != map.end(); )
+			for (auto d = 0; d < (int)dense_ptrs.size(); )
 			{
 				bool remove = false;
-				auto index = it->second;
-				auto _continue = callback(index, it->first, remove);
+				auto slot = dense_slots[d];
+				auto p = dense_ptrs[d];
+				auto _continue = callback(slot, p, remove);
 				if (remove)
-				{
-					it = map.erase(it);
-					spare_list.push_back(index);
-				}
+					remove_slot(slot, table_find(p)); // the last one is moved to d, visit it next
 				else
-					it++;
+					d++;
 				if (!_continue)
 					break;
 			}
@@ -237,6 +237,66 @@ namespace flame
 		SetEvent(w->hEventExpired);
 	}
 
+	FileMapping *map_file(const char *filename, bool copy_on_write)
+	{
+		// FILE_SHARE_WRITE lets a file that another process is still appending to (a log) be mapped
+		auto file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file_handle == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file_handle, &size))
+		{
+			CloseHandle(file_handle);
+			return nullptr;
+		}
+
+		if (size.QuadPart == 0) // an empty file cannot be mapped, it gets no view
+		{
+			auto m = new FileMapping;
+			m->data = nullptr;
+			m->size = 0;
+			m->file_handle = file_handle;
+			m->mapping_handle = nullptr;
+			return m;
+		}
+
+		auto mapping_handle = CreateFileMappingA(file_handle, NULL, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+		if (!mapping_handle)
+		{
+			CloseHandle(file_handle);
+			return nullptr;
+		}
+
+		auto data = MapViewOfFile(mapping_handle, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+		if (!data)
+		{
+			CloseHandle(mapping_handle);
+			CloseHandle(file_handle);
+			return nullptr;
+		}
+
+		auto m = new FileMapping;
+		m->data = data;
+		m->size = size.QuadPart;
+		m->file_handle = file_handle;
+		m->mapping_handle = mapping_handle;
+
+		return m;
+	}
+
+	void unmap_file(FileMapping *m)
+	{
+		if (m->mapping_handle)
+		{
+			UnmapViewOfFile(m->data);
+			CloseHandle(m->mapping_handle);
+		}
+		CloseHandle(m->file_handle);
+		delete m;
+	}
+
 	void read_process_memory(void *process, void *address, int size, void *dst)
 	{
 		SIZE_T ret_byte;
@@ -66,6 +66,20 @@ namespace flame
 		const std::function<void(FileChangeType type, const char *filename)> &callback);
 	FLAME_SYSTEM_EXPORTS void remove_file_watcher(FileWatcher *w);
 
+	struct FileMapping
+	{
+		void *data;
+		long long size;
+
+		void *file_handle;
+		void *mapping_handle;
+	};
+
+	// a read-only view of a whole file, the pages are loaded by the os on demand, an empty file maps to data nullptr and size 0
+	// copy_on_write: pages may be written in place, the changes stay private and never go back to the file
+	FLAME_SYSTEM_EXPORTS FileMapping *map_file(const char *filename, bool copy_on_write = false);
+	FLAME_SYSTEM_EXPORTS void unmap_file(FileMapping *m);
+
 	FLAME_SYSTEM_EXPORTS void read_process_memory(void *process, void *address, int size, void *dst);
 
 	FLAME_SYSTEM_EXPORTS void *add_global_key_listener(int key, const std::function<void()> &callback);
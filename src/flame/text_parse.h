@@ -0,0 +1,429 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+namespace flame
+{
+	// number parsing without locale, allocation or std::string, all functions take [p, end) and
+	// move p past what they read
+
+	inline bool is_space(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline void skip_spaces(const char *&p, const char *end)
+	{
+		while (p < end && is_space(*p))
+			p++;
+	}
+
+	inline void skip_whitespaces(const char *&p, const char *end)
+	{
+		while (p < end && (is_space(*p) || *p == '\n'))
+			p++;
+	}
+
+	inline void skip_line(const char *&p, const char *end)
+	{
+		while (p < end && *p != '\n')
+			p++;
+		if (p < end)
+			p++;
+	}
+
+	inline bool parse_int(const char *&p, const char *end, int &out)
+	{
+		auto s = p;
+		auto neg = false;
+		if (s < end && (*s == '-' || *s == '+'))
+		{
+			neg = *s == '-';
+			s++;
+		}
+		if (s == end || (unsigned)(*s - '0') > 9)
+			return false;
+		auto v = 0;
+		while (s < end && (unsigned)(*s - '0') <= 9)
+			v = v * 10 + (*s++ - '0');
+		out = neg ? -v : v;
+		p = s;
+		return true;
+	}
+
+	// decimal and scientific notation, up to 19 significant digits are exact in the mantissa,
+	// the result is within one ulp of strtof, anything else (inf, nan, hex) goes to strtof
+	inline bool parse_float(const char *&p, const char *end, float &out)
+	{
+		static const double pow10[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+			1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		auto s = p;
+		auto neg = false;
+		if (s < end && (*s == '-' || *s == '+'))
+		{
+			neg = *s == '-';
+			s++;
+		}
+
+		unsigned long long mantissa = 0;
+		auto digits = 0;
+		auto exponent = 0;
+		auto any = false;
+		while (s < end && (unsigned)(*s - '0') <= 9)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*s - '0');
+				if (mantissa)
+					digits++;
+			}
+			else
+				exponent++;
+			s++;
+			any = true;
+		}
+		if (s < end && *s == '.')
+		{
+			s++;
+			while (s < end && (unsigned)(*s - '0') <= 9)
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + (*s - '0');
+					if (mantissa)
+						digits++;
+					exponent--;
+				}
+				s++;
+				any = true;
+			}
+		}
+		if (!any)
+		{
+			// inf, nan and the like, rare enough to go the slow way
+			char buf[32];
+			auto n = std::min((int)(end - p), 31);
+			memcpy(buf, p, n);
+			buf[n] = 0;
+			char *e;
+			out = strtof(buf, &e);
+			if (e == buf)
+				return false;
+			p += e - buf;
+			return true;
+		}
+		if (s < end && (*s == 'e' || *s == 'E'))
+		{
+			auto e = s + 1;
+			int v;
+			if (parse_int(e, end, v))
+			{
+				exponent += v;
+				s = e;
+			}
+		}
+
+		double v = mantissa;
+		if (exponent < 0)
+		{
+			if (exponent >= -22)
+				v /= pow10[-exponent];
+			else
+			{
+				for (; exponent < -22; exponent += 22)
+					v /= 1e22;
+				v /= pow10[-exponent];
+			}
+		}
+		else if (exponent > 0)
+		{
+			for (; exponent > 22; exponent -= 22)
+				v *= 1e22;
+			v *= pow10[exponent];
+		}
+		out = (float)(neg ? -v : v);
+		p = s;
+		return true;
+	}
+
+	// whitespace separated lists, as in COLLADA's <float_array> and <p>, returns the number read
+	inline int parse_floats(const char *p, const char *end, float *out, int max_count)
+	{
+		auto n = 0;
+		skip_whitespaces(p, end);
+		while (n < max_count && parse_float(p, end, out[n]))
+		{
+			n++;
+			skip_whitespaces(p, end);
+		}
+		return n;
+	}
+
+	inline int parse_ints(const char *p, const char *end, int *out, int max_count)
+	{
+		auto n = 0;
+		skip_whitespaces(p, end);
+		while (n < max_count && parse_int(p, end, out[n]))
+		{
+			n++;
+			skip_whitespaces(p, end);
+		}
+		return n;
+	}
+
+	// OBJ text to flat arrays, faces are triangulated as fans, each corner is three 0-based
+	// indices (position, uv, normal), -1 for a missing one
+	struct ObjGroup
+	{
+		std::string material;
+		int corner_begin; // index of the first corner, a group ends where the next begins
+	};
+
+	struct ObjData
+	{
+		std::vector<float> positions; // xyz
+		std::vector<float> uvs; // uv
+		std::vector<float> normals; // xyz
+		std::vector<int> corners; // position, uv, normal
+		std::vector<ObjGroup> groups;
+		std::vector<std::string> mtllibs;
+	};
+
+	struct _ObjChunk
+	{
+		ObjData d;
+		std::vector<int> relative_corners; // corner components with negative indices, they need the global counts
+	};
+
+	inline void _parse_obj_chunk(const char *p, const char *end, _ObjChunk &c)
+	{
+		auto &d = c.d;
+		auto read_name = [&](std::string &out) {
+			skip_spaces(p, end);
+			auto b = p;
+			while (p < end && *p != '\n')
+				p++;
+			auto e = p;
+			while (e > b && is_space(e[-1]))
+				e--;
+			out.assign(b, e);
+		};
+
+		while (p < end)
+		{
+			skip_whitespaces(p, end);
+			if (p == end)
+				break;
+
+			auto c0 = p[0];
+			auto c1 = p + 1 < end ? p[1] : 0;
+			if (c0 == 'v' && is_space(c1))
+			{
+				p += 2;
+				for (auto i = 0; i < 3; i++)
+				{
+					float v = 0.f;
+					skip_spaces(p, end);
+					parse_float(p, end, v);
+					d.positions.push_back(v);
+				}
+			}
+			else if (c0 == 'v' && c1 == 't')
+			{
+				p += 2;
+				for (auto i = 0; i < 2; i++)
+				{
+					float v = 0.f;
+					skip_spaces(p, end);
+					parse_float(p, end, v);
+					d.uvs.push_back(v);
+				}
+			}
+			else if (c0 == 'v' && c1 == 'n')
+			{
+				p += 2;
+				for (auto i = 0; i < 3; i++)
+				{
+					float v = 0.f;
+					skip_spaces(p, end);
+					parse_float(p, end, v);
+					d.normals.push_back(v);
+				}
+			}
+			else if (c0 == 'f' && is_space(c1))
+			{
+				p += 2;
+				int counts[] = { (int)d.positions.size() / 3, (int)d.uvs.size() / 2, (int)d.normals.size() / 3 };
+				struct Corner
+				{
+					int v[3];
+					bool relative[3]; // negative index in the file, relative to the end of this chunk's part
+				}first, prev, curr;
+				auto n = 0;
+				while (true)
+				{
+					skip_spaces(p, end);
+					if (p == end || *p == '\n')
+						break;
+					for (auto j = 0; j < 3; j++)
+					{
+						curr.v[j] = -1;
+						curr.relative[j] = false;
+					}
+					for (auto j = 0; j < 3; j++)
+					{
+						int v;
+						if (parse_int(p, end, v) && v != 0)
+						{
+							if (v > 0)
+								curr.v[j] = v - 1;
+							else
+							{
+								curr.v[j] = counts[j] + v;
+								curr.relative[j] = true;
+							}
+						}
+						if (p < end && *p == '/')
+							p++;
+						else
+							break;
+					}
+					while (p < end && !is_space(*p) && *p != '\n')
+						p++;
+
+					if (n == 0)
+						first = curr;
+					else if (n >= 2)
+					{
+						for (auto k : { &first, &prev, &curr })
+						{
+							for (auto j = 0; j < 3; j++)
+							{
+								if (k->relative[j])
+									c.relative_corners.push_back(d.corners.size());
+								d.corners.push_back(k->v[j]);
+							}
+						}
+					}
+					prev = curr;
+					n++;
+				}
+			}
+			else if (end - p > 6 && strncmp(p, "usemtl", 6) == 0 && is_space(p[6]))
+			{
+				p += 6;
+				ObjGroup g;
+				read_name(g.material);
+				g.corner_begin = d.corners.size() / 3;
+				d.groups.push_back(g);
+			}
+			else if (end - p > 6 && strncmp(p, "mtllib", 6) == 0 && is_space(p[6]))
+			{
+				p += 6;
+				std::string name;
+				read_name(name);
+				d.mtllibs.push_back(name);
+			}
+			skip_line(p, end);
+		}
+	}
+
+	// the text is cut into chunks at line ends and parsed in parallel, then the chunks are
+	// concatenated in order, with the counts of the preceding chunks added to relative indices
+	inline void parse_obj(const char *data, size_t size, ObjData &out, int thread_count = 0)
+	{
+		const size_t min_chunk_size = 1024 * 1024;
+
+		if (thread_count <= 0)
+			thread_count = std::max(1U, std::thread::hardware_concurrency());
+		thread_count = std::max(1, (int)std::min((size_t)thread_count, size / min_chunk_size));
+
+		std::vector<const char*> bounds;
+		bounds.push_back(data);
+		for (auto i = 1; i < thread_count; i++)
+		{
+			auto p = std::max(data + size * i / thread_count, bounds.back());
+			auto end = data + size;
+			while (p < end && *p != '\n')
+				p++;
+			bounds.push_back(p);
+		}
+		bounds.push_back(data + size);
+
+		std::vector<_ObjChunk> chunks(thread_count);
+		if (thread_count == 1)
+			_parse_obj_chunk(bounds[0], bounds[1], chunks[0]);
+		else
+		{
+			std::vector<std::thread> threads;
+			for (auto i = 0; i < thread_count; i++)
+				threads.emplace_back([&, i]() {
+					_parse_obj_chunk(bounds[i], bounds[i + 1], chunks[i]);
+				});
+			for (auto &t : threads)
+				t.join();
+		}
+
+		size_t position_count = 0, uv_count = 0, normal_count = 0, corner_count = 0;
+		for (auto &c : chunks)
+		{
+			position_count += c.d.positions.size();
+			uv_count += c.d.uvs.size();
+			normal_count += c.d.normals.size();
+			corner_count += c.d.corners.size();
+		}
+		out.positions.reserve(out.positions.size() + position_count);
+		out.uvs.reserve(out.uvs.size() + uv_count);
+		out.normals.reserve(out.normals.size() + normal_count);
+		out.corners.reserve(out.corners.size() + corner_count);
+
+		for (auto &c : chunks)
+		{
+			int bases[] = { (int)out.positions.size() / 3, (int)out.uvs.size() / 2, (int)out.normals.size() / 3 };
+			int corner_base = out.corners.size();
+			for (auto i : c.relative_corners)
+				c.d.corners[i] += bases[i % 3];
+			for (auto &g : c.d.groups)
+			{
+				g.corner_begin += corner_base / 3;
+				out.groups.push_back(std::move(g));
+			}
+			for (auto &n : c.d.mtllibs)
+				out.mtllibs.push_back(std::move(n));
+			out.positions.insert(out.positions.end(), c.d.positions.begin(), c.d.positions.end());
+			out.uvs.insert(out.uvs.end(), c.d.uvs.begin(), c.d.uvs.end());
+			out.normals.insert(out.normals.end(), c.d.normals.begin(), c.d.normals.end());
+			out.corners.insert(out.corners.end(), c.d.corners.begin(), c.d.corners.end());
+		}
+	}
+}
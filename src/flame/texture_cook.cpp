@@ -0,0 +1,976 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/filesystem.h>
+#include <flame/image.h>
+#include <flame/texture_cook.h>
+#include <flame/math.h>
+
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace flame
+{
+	struct SRGBTables
+	{
+		float to_linear[256];
+		unsigned char to_srgb[4096];
+
+		SRGBTables()
+		{
+			for (auto i = 0; i < 256; i++)
+			{
+				auto v = i / 255.f;
+				to_linear[i] = v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+			}
+			for (auto i = 0; i < 4096; i++)
+			{
+				auto v = i / 4095.f;
+				v = v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.f / 2.4f) - 0.055f;
+				to_srgb[i] = (unsigned char)(v * 255.f + 0.5f);
+			}
+		}
+	};
+
+	static const SRGBTables &srgb_tables()
+	{
+		static SRGBTables t;
+		return t;
+	}
+
+	static void downsample_box(const float *src, int scx, int scy, float *dst, int dcx, int dcy)
+	{
+		for (auto y = 0; y < dcy; y++)
+		{
+			auto r0 = src + std::min(y * 2, scy - 1) * scx * 4;
+			auto r1 = src + std::min(y * 2 + 1, scy - 1) * scx * 4;
+			for (auto x = 0; x < dcx; x++)
+			{
+				auto x0 = std::min(x * 2, scx - 1) * 4;
+				auto x1 = std::min(x * 2 + 1, scx - 1) * 4;
+				auto d = dst + (y * dcx + x) * 4;
+#if defined(FLAME_MATH_SIMD)
+				using namespace math_simd;
+				auto sum = add(add(load(r0 + x0), load(r0 + x1)), add(load(r1 + x0), load(r1 + x1)));
+				store(d, mul(sum, splat(0.25f)));
+#else
+				for (auto c = 0; c < 4; c++)
+					d[c] = (r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c]) * 0.25f;
+#endif
+			}
+		}
+	}
+
+	// kaiser windowed sinc, 3 destination pixels each side
+	enum { KaiserTapCount = 12 };
+
+	static float bessel_i0(float x)
+	{
+		auto sum = 1.f, term = 1.f;
+		for (auto k = 1; k < 20; k++)
+		{
+			term *= (x * 0.5f / k) * (x * 0.5f / k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	static const float *kaiser_weights()
+	{
+		static float w[KaiserTapCount];
+		static bool inited = false;
+		if (!inited)
+		{
+			const auto radius = 3.f, beta = 4.f;
+			auto sum = 0.f;
+			for (auto i = 0; i < KaiserTapCount; i++)
+			{
+				// distance in destination pixels from the center, the taps sit at 2x - 5 ... 2x + 6
+				auto d = (i - KaiserTapCount / 2 + 0.5f) * 0.5f;
+				auto t = d / radius;
+				auto pi_d = 3.14159265f * d;
+				auto sinc = d == 0.f ? 1.f : sinf(pi_d) / pi_d;
+				w[i] = sinc * bessel_i0(beta * sqrtf(std::max(0.f, 1.f - t * t))) / bessel_i0(beta);
+				sum += w[i];
+			}
+			for (auto i = 0; i < KaiserTapCount; i++)
+				w[i] /= sum;
+			inited = true;
+		}
+		return w;
+	}
+
+	// stride is in pixels between taps, count pixels are written to dst
+	static void kaiser_pass(const float *src, int src_len, int src_stride, float *dst, int dst_len, int dst_stride)
+	{
+		auto w = kaiser_weights();
+		for (auto x = 0; x < dst_len; x++)
+		{
+			auto d = dst + x * dst_stride * 4;
+#if defined(FLAME_MATH_SIMD)
+			using namespace math_simd;
+			auto sum = splat(0.f);
+			for (auto i = 0; i < KaiserTapCount; i++)
+			{
+				auto s = std::min(std::max(x * 2 - KaiserTapCount / 2 + 1 + i, 0), src_len - 1);
+				sum = add(sum, mul(load(src + s * src_stride * 4), splat(w[i])));
+			}
+			store(d, sum);
+#else
+			d[0] = d[1] = d[2] = d[3] = 0.f;
+			for (auto i = 0; i < KaiserTapCount; i++)
+			{
+				auto s = std::min(std::max(x * 2 - KaiserTapCount / 2 + 1 + i, 0), src_len - 1);
+				for (auto c = 0; c < 4; c++)
+					d[c] += src[s * src_stride * 4 + c] * w[i];
+			}
+#endif
+		}
+	}
+
+	static void downsample_kaiser(const float *src, int scx, int scy, float *dst, int dcx, int dcy)
+	{
+		std::vector<float> tmp(dcx * scy * 4);
+		for (auto y = 0; y < scy; y++)
+		{
+			if (dcx == scx)
+				memcpy(tmp.data() + y * dcx * 4, src + y * scx * 4, sizeof(float) * scx * 4);
+			else
+				kaiser_pass(src + y * scx * 4, scx, 1, tmp.data() + y * dcx * 4, dcx, 1);
+		}
+		for (auto x = 0; x < dcx; x++)
+		{
+			if (dcy == scy)
+			{
+				for (auto y = 0; y < dcy; y++)
+					memcpy(dst + (y * dcx + x) * 4, tmp.data() + (y * dcx + x) * 4, sizeof(float) * 4);
+			}
+			else
+				kaiser_pass(tmp.data() + x * 4, scy, dcx, dst + x * 4, dcy, dcx);
+		}
+	}
+
+	void generate_mips(const unsigned char *rgba, int cx, int cy, bool srgb, MipFilter filter, std::vector<CookedLevel> &out)
+	{
+		auto &tables = srgb_tables();
+
+		out.clear();
+		out.resize(1);
+		out[0].cx = cx;
+		out[0].cy = cy;
+		out[0].data.assign(rgba, rgba + cx * cy * 4);
+
+		// filtering happens on linear floats, each level comes from the float version of the last one
+		std::vector<float> src(cx * cy * 4), dst;
+		for (auto i = 0; i < cx * cy * 4; i++)
+			src[i] = (srgb && (i & 3) != 3) ? tables.to_linear[rgba[i]] : rgba[i] / 255.f;
+
+		auto scx = cx, scy = cy;
+		while (scx > 1 || scy > 1)
+		{
+			auto dcx = std::max(1, scx / 2), dcy = std::max(1, scy / 2);
+			dst.resize(dcx * dcy * 4);
+			if (filter == MipFilterKaiser)
+				downsample_kaiser(src.data(), scx, scy, dst.data(), dcx, dcy);
+			else
+				downsample_box(src.data(), scx, scy, dst.data(), dcx, dcy);
+
+			CookedLevel l;
+			l.cx = dcx;
+			l.cy = dcy;
+			l.data.resize(dcx * dcy * 4);
+			for (auto i = 0; i < dcx * dcy * 4; i++)
+			{
+				auto v = std::min(std::max(dst[i], 0.f), 1.f);
+				l.data[i] = (srgb && (i & 3) != 3) ? tables.to_srgb[(int)(v * 4095.f + 0.5f)] : (unsigned char)(v * 255.f + 0.5f);
+			}
+			out.push_back(std::move(l));
+
+			std::swap(src, dst);
+			scx = dcx;
+			scy = dcy;
+		}
+	}
+
+	// bc1 color endpoints
+
+	static unsigned short to_565(const float *c)
+	{
+		auto r = std::min(std::max((int)(c[0] * 31.f / 255.f + 0.5f), 0), 31);
+		auto g = std::min(std::max((int)(c[1] * 63.f / 255.f + 0.5f), 0), 63);
+		auto b = std::min(std::max((int)(c[2] * 31.f / 255.f + 0.5f), 0), 31);
+		return (r << 11) | (g << 5) | b;
+	}
+
+	static void from_565(unsigned short v, int *c)
+	{
+		auto r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+		c[0] = (r << 3) | (r >> 2);
+		c[1] = (g << 2) | (g >> 4);
+		c[2] = (b << 3) | (b >> 2);
+	}
+
+	static void get_bc1_palette(unsigned short c0, unsigned short c1, int (*palette)[3])
+	{
+		from_565(c0, palette[0]);
+		from_565(c1, palette[1]);
+		for (auto k = 0; k < 3; k++)
+		{
+			if (c0 > c1)
+			{
+				palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+				palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+			}
+			else
+			{
+				palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+				palette[3][k] = 0;
+			}
+		}
+	}
+
+	// picks the nearest palette entry for every pixel, transparent pixels get 3 in three color mode
+	static int fit_bc1_indices(const unsigned char *rgba, unsigned short c0, unsigned short c1, bool transparent, int *indices)
+	{
+		int palette[4][3];
+		get_bc1_palette(c0, c1, palette);
+		auto choices = c0 > c1 ? 4 : 3;
+		auto error = 0;
+		for (auto i = 0; i < 16; i++)
+		{
+			auto p = rgba + i * 4;
+			if (transparent && p[3] < 128)
+			{
+				indices[i] = 3;
+				continue;
+			}
+			auto best = INT_MAX;
+			for (auto j = 0; j < choices; j++)
+			{
+				auto dr = p[0] - palette[j][0], dg = p[1] - palette[j][1], db = p[2] - palette[j][2];
+				auto e = dr * dr + dg * dg + db * db;
+				if (e < best)
+				{
+					best = e;
+					indices[i] = j;
+				}
+			}
+			error += best;
+		}
+		return error;
+	}
+
+	// the principal axis of a set of points by power iteration, n is 3 or 4
+	static void principal_axis(const float (*pts)[4], int count, int n, float *mean, float *axis)
+	{
+		for (auto k = 0; k < n; k++)
+		{
+			mean[k] = 0.f;
+			for (auto i = 0; i < count; i++)
+				mean[k] += pts[i][k];
+			mean[k] /= count;
+		}
+		float cov[4][4] = {};
+		for (auto i = 0; i < count; i++)
+		{
+			for (auto a = 0; a < n; a++)
+			{
+				for (auto b = 0; b < n; b++)
+					cov[a][b] += (pts[i][a] - mean[a]) * (pts[i][b] - mean[b]);
+			}
+		}
+		for (auto k = 0; k < n; k++)
+			axis[k] = 1.f;
+		for (auto it = 0; it < 8; it++)
+		{
+			float v[4] = {};
+			for (auto a = 0; a < n; a++)
+			{
+				for (auto b = 0; b < n; b++)
+					v[a] += cov[a][b] * axis[b];
+			}
+			auto len = 0.f;
+			for (auto k = 0; k < n; k++)
+				len += v[k] * v[k];
+			if (len < 1e-12f)
+				break;
+			len = 1.f / sqrtf(len);
+			for (auto k = 0; k < n; k++)
+				axis[k] = v[k] * len;
+		}
+	}
+
+	// the endpoints at the ends of the projections on the axis
+	static void axis_endpoints(const float (*pts)[4], int count, int n, float *e0, float *e1)
+	{
+		float mean[4], axis[4];
+		principal_axis(pts, count, n, mean, axis);
+		auto t_min = FLT_MAX, t_max = -FLT_MAX;
+		for (auto i = 0; i < count; i++)
+		{
+			auto t = 0.f;
+			for (auto k = 0; k < n; k++)
+				t += (pts[i][k] - mean[k]) * axis[k];
+			t_min = std::min(t_min, t);
+			t_max = std::max(t_max, t);
+		}
+		for (auto k = 0; k < n; k++)
+		{
+			e0[k] = std::min(std::max(mean[k] + axis[k] * t_max, 0.f), 255.f);
+			e1[k] = std::min(std::max(mean[k] + axis[k] * t_min, 0.f), 255.f);
+		}
+	}
+
+	static void encode_bc1_color(const unsigned char *rgba, unsigned char *dst, bool allow_transparent)
+	{
+		float pts[16][4];
+		auto count = 0;
+		auto transparent = false;
+		for (auto i = 0; i < 16; i++)
+		{
+			auto p = rgba + i * 4;
+			if (allow_transparent && p[3] < 128)
+			{
+				transparent = true;
+				continue;
+			}
+			pts[count][0] = p[0];
+			pts[count][1] = p[1];
+			pts[count][2] = p[2];
+			count++;
+		}
+
+		unsigned short c0 = 0, c1 = 0;
+		int indices[16];
+		if (count > 0)
+		{
+			float e0[4], e1[4];
+			axis_endpoints(pts, count, 3, e0, e1);
+			c0 = to_565(e0);
+			c1 = to_565(e1);
+
+			// one least squares pass over the picked indices, kept when it is better
+			auto order = [&](unsigned short &a, unsigned short &b) {
+				// four color mode wants c0 > c1, three color mode (transparent pixels) wants c0 <= c1
+				if (transparent ? a > b : a < b)
+					std::swap(a, b);
+			};
+			order(c0, c1);
+			auto error = fit_bc1_indices(rgba, c0, c1, transparent, indices);
+			if (!transparent && c0 != c1)
+			{
+				static const float weights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+				float aa = 0.f, bb = 0.f, ab = 0.f, ax[3] = {}, bx[3] = {};
+				for (auto i = 0; i < 16; i++)
+				{
+					auto a = weights[indices[i]], b = 1.f - a;
+					aa += a * a;
+					bb += b * b;
+					ab += a * b;
+					for (auto k = 0; k < 3; k++)
+					{
+						ax[k] += a * rgba[i * 4 + k];
+						bx[k] += b * rgba[i * 4 + k];
+					}
+				}
+				auto det = aa * bb - ab * ab;
+				if (fabsf(det) > 1e-6f)
+				{
+					float n0[3], n1[3];
+					for (auto k = 0; k < 3; k++)
+					{
+						n0[k] = (ax[k] * bb - bx[k] * ab) / det;
+						n1[k] = (bx[k] * aa - ax[k] * ab) / det;
+					}
+					auto d0 = to_565(n0), d1 = to_565(n1);
+					order(d0, d1);
+					int new_indices[16];
+					auto new_error = fit_bc1_indices(rgba, d0, d1, false, new_indices);
+					if (new_error < error)
+					{
+						c0 = d0;
+						c1 = d1;
+						memcpy(indices, new_indices, sizeof(indices));
+					}
+				}
+			}
+		}
+		else
+		{
+			for (auto i = 0; i < 16; i++)
+				indices[i] = 3;
+		}
+
+		dst[0] = c0 & 0xff;
+		dst[1] = c0 >> 8;
+		dst[2] = c1 & 0xff;
+		dst[3] = c1 >> 8;
+		unsigned int bits = 0;
+		for (auto i = 0; i < 16; i++)
+			bits |= indices[i] << (i * 2);
+		memcpy(dst + 4, &bits, 4);
+	}
+
+	// one channel, eight value mode
+	static void encode_bc4_channel(const unsigned char *rgba, int channel, unsigned char *dst)
+	{
+		int mn = 255, mx = 0;
+		for (auto i = 0; i < 16; i++)
+		{
+			mn = std::min(mn, (int)rgba[i * 4 + channel]);
+			mx = std::max(mx, (int)rgba[i * 4 + channel]);
+		}
+		dst[0] = mx;
+		dst[1] = mn;
+		unsigned long long bits = 0;
+		if (mx > mn)
+		{
+			for (auto i = 0; i < 16; i++)
+			{
+				// position along mx -> mn in sevenths, 0 and 7 are the endpoints (indices 0 and 1)
+				auto t = (mx - rgba[i * 4 + channel]) * 7;
+				auto pos = (t + (mx - mn) / 2) / (mx - mn);
+				auto index = pos == 0 ? 0 : (pos == 7 ? 1 : pos + 1);
+				bits |= (unsigned long long)index << (i * 3);
+			}
+		}
+		for (auto i = 0; i < 6; i++)
+			dst[2 + i] = (bits >> (i * 8)) & 0xff;
+	}
+
+	void encode_bc1_block(const unsigned char *rgba, unsigned char *dst)
+	{
+		encode_bc1_color(rgba, dst, true);
+	}
+
+	void encode_bc3_block(const unsigned char *rgba, unsigned char *dst)
+	{
+		encode_bc4_channel(rgba, 3, dst);
+		encode_bc1_color(rgba, dst + 8, false);
+	}
+
+	void encode_bc5_block(const unsigned char *rgba, unsigned char *dst)
+	{
+		encode_bc4_channel(rgba, 0, dst);
+		encode_bc4_channel(rgba, 1, dst + 8);
+	}
+
+	// bc7 mode 6 only: one subset, rgba 7 bit endpoints with a p bit each, 4 bit indices, which
+	// is the mode most encoders pick for smooth color and alpha
+
+	static const int bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	static int fit_bc7_indices(const unsigned char *rgba, const int *v0, const int *v1, int *indices)
+	{
+		int palette[16][4];
+		for (auto j = 0; j < 16; j++)
+		{
+			for (auto k = 0; k < 4; k++)
+				palette[j][k] = ((64 - bc7_weights4[j]) * v0[k] + bc7_weights4[j] * v1[k] + 32) >> 6;
+		}
+		float dir[4], len = 0.f;
+		for (auto k = 0; k < 4; k++)
+		{
+			dir[k] = v1[k] - v0[k];
+			len += dir[k] * dir[k];
+		}
+		auto error = 0;
+		for (auto i = 0; i < 16; i++)
+		{
+			auto p = rgba + i * 4;
+			// start from the projection and look at the neighbours
+			auto guess = 0;
+			if (len > 0.f)
+			{
+				auto t = 0.f;
+				for (auto k = 0; k < 4; k++)
+					t += (p[k] - v0[k]) * dir[k];
+				guess = std::min(std::max((int)(t / len * 15.f + 0.5f), 0), 15);
+			}
+			auto best = INT_MAX;
+			for (auto j = std::max(guess - 1, 0); j <= std::min(guess + 1, 15); j++)
+			{
+				auto e = 0;
+				for (auto k = 0; k < 4; k++)
+				{
+					auto d = p[k] - palette[j][k];
+					e += d * d;
+				}
+				if (e < best)
+				{
+					best = e;
+					indices[i] = j;
+				}
+			}
+			error += best;
+		}
+		return error;
+	}
+
+	// the best p bits for the float endpoints, returns the error
+	static int quantize_bc7_endpoints(const unsigned char *rgba, const float *e0, const float *e1, int *q0, int *q1, int *p, int *indices)
+	{
+		auto best = INT_MAX;
+		for (auto pb = 0; pb < 4; pb++)
+		{
+			int p0 = pb & 1, p1 = pb >> 1;
+			int a[4], b[4], v0[4], v1[4], idx[16];
+			for (auto k = 0; k < 4; k++)
+			{
+				a[k] = std::min(std::max((int)((e0[k] - p0) * 0.5f + 0.5f), 0), 127);
+				b[k] = std::min(std::max((int)((e1[k] - p1) * 0.5f + 0.5f), 0), 127);
+				v0[k] = (a[k] << 1) | p0;
+				v1[k] = (b[k] << 1) | p1;
+			}
+			auto error = fit_bc7_indices(rgba, v0, v1, idx);
+			if (error < best)
+			{
+				best = error;
+				memcpy(q0, a, sizeof(a));
+				memcpy(q1, b, sizeof(b));
+				p[0] = p0;
+				p[1] = p1;
+				memcpy(indices, idx, sizeof(idx));
+			}
+		}
+		return best;
+	}
+
+	struct BitWriter
+	{
+		unsigned char *dst;
+		int pos;
+
+		void write(unsigned int v, int n)
+		{
+			for (auto i = 0; i < n; i++, pos++)
+			{
+				if ((v >> i) & 1)
+					dst[pos >> 3] |= 1 << (pos & 7);
+			}
+		}
+	};
+
+	void encode_bc7_block(const unsigned char *rgba, unsigned char *dst)
+	{
+		float pts[16][4];
+		for (auto i = 0; i < 16; i++)
+		{
+			for (auto k = 0; k < 4; k++)
+				pts[i][k] = rgba[i * 4 + k];
+		}
+		float e0[4], e1[4];
+		axis_endpoints(pts, 16, 4, e0, e1);
+
+		int q0[4], q1[4], p[2], indices[16];
+		auto error = quantize_bc7_endpoints(rgba, e0, e1, q0, q1, p, indices);
+
+		// least squares on the weights that came out, a few rounds
+		for (auto it = 0; it < 3; it++)
+		{
+			float aa = 0.f, bb = 0.f, ab = 0.f, ax[4] = {}, bx[4] = {};
+			for (auto i = 0; i < 16; i++)
+			{
+				auto b = bc7_weights4[indices[i]] / 64.f, a = 1.f - b;
+				aa += a * a;
+				bb += b * b;
+				ab += a * b;
+				for (auto k = 0; k < 4; k++)
+				{
+					ax[k] += a * rgba[i * 4 + k];
+					bx[k] += b * rgba[i * 4 + k];
+				}
+			}
+			auto det = aa * bb - ab * ab;
+			if (fabsf(det) > 1e-6f)
+			{
+				float n0[4], n1[4];
+				for (auto k = 0; k < 4; k++)
+				{
+					n0[k] = std::min(std::max((ax[k] * bb - bx[k] * ab) / det, 0.f), 255.f);
+					n1[k] = std::min(std::max((bx[k] * aa - ax[k] * ab) / det, 0.f), 255.f);
+				}
+				int r0[4], r1[4], rp[2], ri[16];
+				auto new_error = quantize_bc7_endpoints(rgba, n0, n1, r0, r1, rp, ri);
+				if (new_error >= error)
+					break;
+				error = new_error;
+				memcpy(q0, r0, sizeof(q0));
+				memcpy(q1, r1, sizeof(q1));
+				memcpy(p, rp, sizeof(rp));
+				memcpy(indices, ri, sizeof(indices));
+			}
+			else
+				break;
+		}
+
+		// the first index is stored with 3 bits, so its top bit has to be 0
+		if (indices[0] >= 8)
+		{
+			for (auto k = 0; k < 4; k++)
+				std::swap(q0[k], q1[k]);
+			std::swap(p[0], p[1]);
+			for (auto i = 0; i < 16; i++)
+				indices[i] = 15 - indices[i];
+		}
+
+		memset(dst, 0, 16);
+		BitWriter w = { dst, 0 };
+		w.write(1 << 6, 7);
+		for (auto k = 0; k < 4; k++)
+		{
+			w.write(q0[k], 7);
+			w.write(q1[k], 7);
+		}
+		w.write(p[0], 1);
+		w.write(p[1], 1);
+		w.write(indices[0], 3);
+		for (auto i = 1; i < 16; i++)
+			w.write(indices[i], 4);
+	}
+
+	int get_cooked_block_size(TextureCookFormat format)
+	{
+		switch (format)
+		{
+			case TextureCookBC1:
+				return 8;
+			case TextureCookBC3: case TextureCookBC5: case TextureCookBC7:
+				return 16;
+			default:
+				return 0;
+		}
+	}
+
+	void compress_levels(std::vector<CookedLevel> &levels, TextureCookFormat format, int thread_count)
+	{
+		auto block_size = get_cooked_block_size(format);
+		if (block_size == 0)
+			return;
+		void(*encode)(const unsigned char*, unsigned char*) = nullptr;
+		switch (format)
+		{
+			case TextureCookBC1:
+				encode = encode_bc1_block;
+				break;
+			case TextureCookBC3:
+				encode = encode_bc3_block;
+				break;
+			case TextureCookBC5:
+				encode = encode_bc5_block;
+				break;
+			default:
+				encode = encode_bc7_block;
+		}
+
+		// every block row of every level is one job
+		struct Row
+		{
+			int level;
+			int by;
+		};
+		std::vector<Row> rows;
+		std::vector<std::vector<unsigned char>> outputs(levels.size());
+		for (auto i = 0; i < levels.size(); i++)
+		{
+			auto bx = (levels[i].cx + 3) / 4, by = (levels[i].cy + 3) / 4;
+			outputs[i].resize(bx * by * block_size);
+			for (auto y = 0; y < by; y++)
+				rows.push_back({ i, y });
+		}
+
+		std::atomic<int> next(0);
+		auto worker = [&]() {
+			unsigned char block[64];
+			while (true)
+			{
+				auto r = next.fetch_add(1);
+				if (r >= rows.size())
+					break;
+				auto &l = levels[rows[r].level];
+				auto by = rows[r].by;
+				auto bx_count = (l.cx + 3) / 4;
+				auto out = outputs[rows[r].level].data() + by * bx_count * block_size;
+				for (auto bx = 0; bx < bx_count; bx++)
+				{
+					// pixels past the edge repeat the last row and column
+					for (auto y = 0; y < 4; y++)
+					{
+						auto sy = std::min(by * 4 + y, l.cy - 1);
+						for (auto x = 0; x < 4; x++)
+						{
+							auto sx = std::min(bx * 4 + x, l.cx - 1);
+							memcpy(block + (y * 4 + x) * 4, l.data.data() + (sy * l.cx + sx) * 4, 4);
+						}
+					}
+					encode(block, out + bx * block_size);
+				}
+			}
+		};
+
+		if (thread_count <= 0)
+			thread_count = std::max(1u, std::thread::hardware_concurrency());
+		thread_count = std::min(thread_count, (int)rows.size());
+		std::vector<std::thread> threads;
+		for (auto i = 1; i < thread_count; i++)
+			threads.emplace_back(worker);
+		worker();
+		for (auto &t : threads)
+			t.join();
+
+		for (auto i = 0; i < levels.size(); i++)
+			levels[i].data = std::move(outputs[i]);
+	}
+
+	template <class T>
+	static void put(std::vector<unsigned char> &buf, const T &v)
+	{
+		auto p = (const unsigned char*)&v;
+		buf.insert(buf.end(), p, p + sizeof(T));
+	}
+
+	static bool write_file(const std::string &filename, const std::vector<unsigned char> &buf)
+	{
+		// write next to it and rename, a half written texture is never picked up
+		auto tmp = filename + ".tmp";
+		auto f = fopen(tmp.c_str(), "wb");
+		if (!f)
+			return false;
+		auto ok = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+		fclose(f);
+		if (!ok)
+			return false;
+		remove(filename.c_str());
+		return rename(tmp.c_str(), filename.c_str()) == 0;
+	}
+
+	bool save_ktx(const CookedTexture &t, const std::string &filename)
+	{
+		unsigned int gl_type = 0, gl_type_size = 1, gl_format = 0, gl_internal_format = 0, gl_base_internal_format = 0x1908; // GL_RGBA
+		switch (t.format)
+		{
+			case TextureCookRGBA8:
+				gl_type = 0x1401; // GL_UNSIGNED_BYTE
+				gl_format = 0x1908;
+				gl_internal_format = t.srgb ? 0x8C43 : 0x8058; // GL_SRGB8_ALPHA8, GL_RGBA8
+				break;
+			case TextureCookBC1:
+				gl_internal_format = t.srgb ? 0x8C4D : 0x83F1; // GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+				break;
+			case TextureCookBC3:
+				gl_internal_format = t.srgb ? 0x8C4F : 0x83F3; // ..._DXT5_EXT
+				break;
+			case TextureCookBC5:
+				gl_internal_format = 0x8DBD; // GL_COMPRESSED_RG_RGTC2
+				gl_base_internal_format = 0x8227; // GL_RG
+				break;
+			case TextureCookBC7:
+				gl_internal_format = t.srgb ? 0x8E8D : 0x8E8C; // GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, GL_COMPRESSED_RGBA_BPTC_UNORM
+				break;
+		}
+
+		std::vector<unsigned char> buf;
+		static const unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+		buf.insert(buf.end(), identifier, identifier + 12);
+		unsigned int header[] = {
+			0x04030201,
+			gl_type,
+			gl_type_size,
+			gl_format,
+			gl_internal_format,
+			gl_base_internal_format,
+			(unsigned int)t.levels[0].cx,
+			(unsigned int)t.levels[0].cy,
+			0, // depth
+			0, // array elements
+			1, // faces
+			(unsigned int)t.levels.size(),
+			0  // key value bytes
+		};
+		for (auto v : header)
+			put(buf, v);
+		for (auto &l : t.levels)
+		{
+			put(buf, (unsigned int)l.data.size());
+			buf.insert(buf.end(), l.data.begin(), l.data.end());
+			while (buf.size() % 4)
+				buf.push_back(0);
+		}
+		return write_file(filename, buf);
+	}
+
+	bool save_dds(const CookedTexture &t, const std::string &filename)
+	{
+		unsigned int dxgi_format = 0;
+		switch (t.format)
+		{
+			case TextureCookRGBA8:
+				dxgi_format = t.srgb ? 29 : 28;
+				break;
+			case TextureCookBC1:
+				dxgi_format = t.srgb ? 72 : 71;
+				break;
+			case TextureCookBC3:
+				dxgi_format = t.srgb ? 78 : 77;
+				break;
+			case TextureCookBC5:
+				dxgi_format = 83;
+				break;
+			case TextureCookBC7:
+				dxgi_format = t.srgb ? 99 : 98;
+				break;
+		}
+
+		std::vector<unsigned char> buf;
+		put(buf, 0x20534444u); // "DDS "
+		unsigned int header[31] = {};
+		header[0] = 124; // size
+		header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip count, linear size
+		header[2] = t.levels[0].cy;
+		header[3] = t.levels[0].cx;
+		header[4] = t.levels[0].data.size();
+		header[6] = t.levels.size();
+		// pixel format at 18
+		header[18] = 32;
+		header[19] = 0x4; // fourcc
+		header[20] = 0x30315844; // "DX10"
+		header[26] = 0x1000 | (t.levels.size() > 1 ? 0x8 | 0x400000 : 0); // texture, complex, mipmap
+		for (auto v : header)
+			put(buf, v);
+		unsigned int dx10[] = {
+			dxgi_format,
+			3, // texture 2d
+			0,
+			1, // array size
+			0
+		};
+		for (auto v : dx10)
+			put(buf, v);
+		for (auto &l : t.levels)
+			buf.insert(buf.end(), l.data.begin(), l.data.end());
+		return write_file(filename, buf);
+	}
+
+	unsigned long long get_cook_hash(const std::string &src, const TextureCookOptions &options)
+	{
+		auto f = fopen(src.c_str(), "rb");
+		if (!f)
+			return 0;
+		auto hash = 14695981039346656037ULL;
+		auto feed = [&](const unsigned char *p, size_t n) {
+			for (auto i = 0; i < n; i++)
+			{
+				hash ^= p[i];
+				hash *= 1099511628211ULL;
+			}
+		};
+		unsigned char chunk[64 * 1024];
+		size_t n;
+		while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+			feed(chunk, n);
+		fclose(f);
+
+		// bump the version when the encoders change so everything cooks again
+		int settings[] = { 1, options.format, options.srgb, options.mips, options.mip_filter };
+		feed((const unsigned char*)settings, sizeof(settings));
+		return hash;
+	}
+
+	CookResult cook_texture(const std::string &src, const std::string &dst, const TextureCookOptions &options)
+	{
+		auto hash = get_cook_hash(src, options);
+		if (hash == 0)
+			return CookFailed;
+		char hash_str[32];
+		sprintf(hash_str, "%016llx", hash);
+
+		auto hash_filename = dst + ".hash";
+		if (std::filesystem::exists(dst))
+		{
+			std::ifstream hash_file(hash_filename);
+			std::string old;
+			if (hash_file.good() && (hash_file >> old) && old == hash_str)
+				return CookSkipped;
+		}
+
+		auto image = load_image(src);
+		if (!image)
+			return CookFailed;
+		// stb gives tightly packed rows
+		std::vector<unsigned char> rgba(image->cx * image->cy * 4);
+		for (auto i = 0; i < image->cx * image->cy; i++)
+		{
+			auto s = image->data + i * image->channel;
+			auto d = rgba.data() + i * 4;
+			switch (image->channel)
+			{
+				case 1:
+					d[0] = d[1] = d[2] = s[0];
+					d[3] = 255;
+					break;
+				case 2:
+					d[0] = d[1] = d[2] = s[0];
+					d[3] = s[1];
+					break;
+				case 3:
+					d[0] = s[0];
+					d[1] = s[1];
+					d[2] = s[2];
+					d[3] = 255;
+					break;
+				default:
+					memcpy(d, s, 4);
+			}
+		}
+
+		CookedTexture t;
+		t.format = options.format;
+		t.srgb = options.srgb && options.format != TextureCookBC5;
+		if (options.mips)
+			generate_mips(rgba.data(), image->cx, image->cy, t.srgb, options.mip_filter, t.levels);
+		else
+		{
+			t.levels.resize(1);
+			t.levels[0].cx = image->cx;
+			t.levels[0].cy = image->cy;
+			t.levels[0].data = std::move(rgba);
+		}
+		release_image(image);
+
+		compress_levels(t.levels, t.format, options.thread_count);
+
+		auto ext = std::filesystem::path(dst).extension().string();
+		auto ok = ext == ".dds" ? save_dds(t, dst) : save_ktx(t, dst);
+		if (!ok)
+			return CookFailed;
+
+		std::ofstream hash_file(hash_filename);
+		hash_file << hash_str;
+		return CookDone;
+	}
+}
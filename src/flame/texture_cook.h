@@ -0,0 +1,123 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#ifdef _FLAME_IMAGE_EXPORTS
+#define FLAME_IMAGE_EXPORTS __declspec(dllexport)
+#else
+#define FLAME_IMAGE_EXPORTS __declspec(dllimport)
+#endif
+
+#include <vector>
+#include <string>
+
+namespace flame
+{
+	// offline texture cooking: a png/jpg/tga goes in, a mip chain compressed to a block format
+	// comes out as ktx or dds (by the extension of the output), which gli loads straight into
+	// a texture in create_texture_from_file
+
+	enum TextureCookFormat
+	{
+		TextureCookRGBA8,
+		TextureCookBC1, // rgb, 1 bit alpha
+		TextureCookBC3, // rgba
+		TextureCookBC5, // rg, for normal maps
+		TextureCookBC7  // rgba, best quality
+	};
+
+	enum MipFilter
+	{
+		MipFilterBox,
+		MipFilterKaiser
+	};
+
+	struct TextureCookOptions
+	{
+		TextureCookFormat format;
+		bool srgb; // color data, mips are filtered in linear space and the format is tagged as srgb
+		bool mips;
+		MipFilter mip_filter;
+		int thread_count; // 0 for every core
+
+		TextureCookOptions() :
+			format(TextureCookBC7),
+			srgb(true),
+			mips(true),
+			mip_filter(MipFilterBox),
+			thread_count(0)
+		{
+		}
+	};
+
+	struct CookedLevel
+	{
+		int cx;
+		int cy;
+		std::vector<unsigned char> data;
+	};
+
+	struct CookedTexture
+	{
+		TextureCookFormat format;
+		bool srgb;
+		std::vector<CookedLevel> levels;
+	};
+
+	// the mip chain of a rgba8 image down to 1x1, level 0 is a copy
+	FLAME_IMAGE_EXPORTS void generate_mips(const unsigned char *rgba, int cx, int cy, bool srgb, MipFilter filter,
+		std::vector<CookedLevel> &out);
+
+	// one 4x4 block of rgba8 (16 pixels, row by row) to 8 (bc1) or 16 bytes
+	FLAME_IMAGE_EXPORTS void encode_bc1_block(const unsigned char *rgba, unsigned char *dst);
+	FLAME_IMAGE_EXPORTS void encode_bc3_block(const unsigned char *rgba, unsigned char *dst);
+	FLAME_IMAGE_EXPORTS void encode_bc5_block(const unsigned char *rgba, unsigned char *dst);
+	FLAME_IMAGE_EXPORTS void encode_bc7_block(const unsigned char *rgba, unsigned char *dst);
+
+	FLAME_IMAGE_EXPORTS int get_cooked_block_size(TextureCookFormat format); // bytes per 4x4 block, 0 for rgba8
+
+	// compresses every level of the rgba8 chain in place, the blocks are spread over threads
+	FLAME_IMAGE_EXPORTS void compress_levels(std::vector<CookedLevel> &levels, TextureCookFormat format, int thread_count);
+
+	FLAME_IMAGE_EXPORTS bool save_ktx(const CookedTexture &t, const std::string &filename);
+	FLAME_IMAGE_EXPORTS bool save_dds(const CookedTexture &t, const std::string &filename);
+
+	// fnv-1a of the source file and the options, an output with the same hash is up to date
+	FLAME_IMAGE_EXPORTS unsigned long long get_cook_hash(const std::string &src, const TextureCookOptions &options);
+
+	enum CookResult
+	{
+		CookFailed,
+		CookSkipped, // the output is up to date
+		CookDone
+	};
+
+	// the hash goes next to the output as dst + ".hash"
+	FLAME_IMAGE_EXPORTS CookResult cook_texture(const std::string &src, const std::string &dst, const TextureCookOptions &options);
+
+	// where create_texture_from_file looks for the cooked version of a source image
+	inline std::string get_cooked_texture_filename(const std::string &src)
+	{
+		return src + ".ktx";
+	}
+}
@@ -0,0 +1,174 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/filesystem.h>
+#include <flame/thumbnail.h>
+
+#include <stb_image.h>
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
+
+#include <thread>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+
+namespace flame
+{
+	static const int thumbnail_magic = 0x42485446; // FTHB
+	static const int thumbnail_version = 1;
+
+	static unsigned long long _fnv1a(unsigned long long h, const void *data, size_t size)
+	{
+		auto p = (const unsigned char*)data;
+		for (auto i = 0; i < size; i++)
+		{
+			h ^= p[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	static std::string _thumbnail_cache_filename(const std::string &filename, int size, const std::string &cache_dir)
+	{
+		std::error_code ec;
+		auto path = std::filesystem::absolute(filename).generic_string();
+		long long mtime = std::filesystem::last_write_time(filename, ec).time_since_epoch().count();
+		long long length = std::filesystem::file_size(filename, ec);
+
+		auto h = 14695981039346656037ULL;
+		h = _fnv1a(h, path.data(), path.size());
+		h = _fnv1a(h, &mtime, sizeof(mtime));
+		h = _fnv1a(h, &length, sizeof(length));
+		h = _fnv1a(h, &size, sizeof(size));
+
+		char name[32];
+		sprintf(name, "%016llx.thumb", h);
+		return (std::filesystem::path(cache_dir) / name).string();
+	}
+
+	static bool _read_thumbnail(const std::string &filename, int size, Thumbnail *out)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.good())
+			return false;
+		if (read<int>(file) != thumbnail_magic || read<int>(file) != thumbnail_version)
+			return false;
+		auto cx = read<int>(file);
+		auto cy = read<int>(file);
+		if (!file.good() || cx <= 0 || cy <= 0 || cx > size || cy > size)
+			return false;
+		out->cx = cx;
+		out->cy = cy;
+		out->data.resize(cx * cy * 4);
+		file.read((char*)out->data.data(), out->data.size());
+		return file.gcount() == out->data.size();
+	}
+
+	bool get_thumbnail(const std::string &filename, int size, const std::string &cache_dir, Thumbnail *out)
+	{
+		auto cache_filename = _thumbnail_cache_filename(filename, size, cache_dir);
+		if (_read_thumbnail(cache_filename, size, out))
+			return true;
+
+		int cx, cy, channel;
+		auto img = stbi_load(filename.c_str(), &cx, &cy, &channel, 4);
+		if (!img)
+			return false;
+
+		if (cx <= size && cy <= size)
+		{
+			out->cx = cx;
+			out->cy = cy;
+			out->data.assign(img, img + cx * cy * 4);
+		}
+		else
+		{
+			auto scale = (float)size / std::max(cx, cy);
+			out->cx = std::max(1, std::min(size, (int)(cx * scale + 0.5f)));
+			out->cy = std::max(1, std::min(size, (int)(cy * scale + 0.5f)));
+			out->data.resize(out->cx * out->cy * 4);
+			stbir_resize_uint8_srgb(img, cx, cy, 0, out->data.data(), out->cx, out->cy, 0, 4, 3, 0);
+		}
+		stbi_image_free(img);
+
+		// written aside and renamed, so another thread or a crash never leaves half a file under the key
+		std::error_code ec;
+		std::filesystem::create_directories(cache_dir, ec);
+		auto tmp_filename = cache_filename + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+		{
+			std::ofstream file(tmp_filename, std::ios::binary);
+			if (!file.good())
+				return true;
+			write(file, thumbnail_magic);
+			write(file, thumbnail_version);
+			write(file, out->cx);
+			write(file, out->cy);
+			file.write((char*)out->data.data(), out->data.size());
+		}
+		std::filesystem::rename(tmp_filename, cache_filename, ec);
+		if (ec)
+			std::filesystem::remove(tmp_filename, ec);
+
+		return true;
+	}
+
+	void trim_thumbnail_cache(const std::string &cache_dir, long long max_bytes)
+	{
+		struct Entry
+		{
+			std::filesystem::file_time_type time;
+			long long size;
+			std::filesystem::path path;
+		};
+		std::vector<Entry> entries;
+		long long total = 0;
+
+		std::error_code ec;
+		for (std::filesystem::directory_iterator it(cache_dir, ec), end; !ec && it != end; it.increment(ec))
+		{
+			if (it->path().extension() != ".thumb")
+				continue;
+			Entry e;
+			e.time = std::filesystem::last_write_time(it->path(), ec);
+			e.size = std::filesystem::file_size(it->path(), ec);
+			e.path = it->path();
+			if (ec)
+				continue;
+			total += e.size;
+			entries.push_back(e);
+		}
+		if (total <= max_bytes)
+			return;
+
+		std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+			return a.time < b.time;
+		});
+		for (auto &e : entries)
+		{
+			if (total <= max_bytes)
+				break;
+			if (std::filesystem::remove(e.path, ec))
+				total -= e.size;
+		}
+	}
+}
@@ -0,0 +1,171 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#ifdef _FLAME_IMAGE_EXPORTS
+#define FLAME_IMAGE_EXPORTS __declspec(dllexport)
+#else
+#define FLAME_IMAGE_EXPORTS __declspec(dllimport)
+#endif
+
+#include <flame/math.h>
+
+#include <vector>
+#include <string>
+#include <list>
+#include <unordered_map>
+
+namespace flame
+{
+	// thumbnails for file browsers: an image is shrunk to fit in size x size and kept as a small file
+	// in a cache directory, keyed by the path, the file's modification time and length and the size
+
+	struct Thumbnail
+	{
+		int cx;
+		int cy;
+		std::vector<unsigned char> data; // rgba8, tightly packed
+	};
+
+	// thread-safe, reads the cached file when there is one, otherwise decodes and shrinks the image and
+	// writes the cache, returns false when the file is not an image that can be read
+	FLAME_IMAGE_EXPORTS bool get_thumbnail(const std::string &filename, int size, const std::string &cache_dir, Thumbnail *out);
+	// removes the least recently written cache files until the directory is under max_bytes
+	FLAME_IMAGE_EXPORTS void trim_thumbnail_cache(const std::string &cache_dir, long long max_bytes);
+
+	// the cells of a square grid in an atlas texture, handed out by key, the least recently used
+	// cell is taken over when all are in use
+	class ThumbnailAtlas
+	{
+	protected:
+		int atlas_size;
+		int cell_size;
+		int columns;
+		std::vector<std::string> cell_keys;
+		std::list<int> lru; // most recently used first
+		std::vector<std::list<int>::iterator> lru_its;
+		std::unordered_map<std::string, int> cells;
+		int used_count;
+	public:
+		ThumbnailAtlas(int _atlas_size, int _cell_size) :
+			atlas_size(_atlas_size),
+			cell_size(_cell_size),
+			columns(_atlas_size / _cell_size),
+			used_count(0)
+		{
+			auto count = columns * columns;
+			cell_keys.resize(count);
+			lru_its.resize(count);
+			for (auto i = 0; i < count; i++)
+				lru_its[i] = lru.insert(lru.end(), i);
+		}
+
+		int get_cell_count() const
+		{
+			return columns * columns;
+		}
+
+		int get_used_count() const
+		{
+			return used_count;
+		}
+
+		int get_cell_size() const
+		{
+			return cell_size;
+		}
+
+		// marks the cell as used, returns -1 when the key has none
+		int find(const std::string &key)
+		{
+			auto it = cells.find(key);
+			if (it == cells.end())
+				return -1;
+			lru.splice(lru.begin(), lru, lru_its[it->second]);
+			return it->second;
+		}
+
+		// a free cell or the least recently used one, evicted gets the key that lost its cell
+		int add(const std::string &key, std::string *evicted = nullptr)
+		{
+			auto id = find(key);
+			if (id != -1)
+				return id;
+
+			id = lru.back();
+			auto &old = cell_keys[id];
+			if (!old.empty())
+			{
+				if (evicted)
+					*evicted = old;
+				cells.erase(old);
+			}
+			else
+			{
+				if (evicted)
+					evicted->clear();
+				used_count++;
+			}
+			old = key;
+			cells[key] = id;
+			lru.splice(lru.begin(), lru, lru_its[id]);
+			return id;
+		}
+
+		void remove(const std::string &key)
+		{
+			auto it = cells.find(key);
+			if (it == cells.end())
+				return;
+			auto id = it->second;
+			cell_keys[id].clear();
+			cells.erase(it);
+			// a free cell is the first one taken
+			lru.splice(lru.end(), lru, lru_its[id]);
+			used_count--;
+		}
+
+		void clear()
+		{
+			for (auto i = 0; i < (int)cell_keys.size(); i++)
+			{
+				if (!cell_keys[i].empty())
+					remove(std::string(cell_keys[i]));
+			}
+		}
+
+		// the pixel position of the cell's corner in the atlas
+		Ivec2 get_cell_pos(int id) const
+		{
+			return Ivec2((id % columns) * cell_size, (id / columns) * cell_size);
+		}
+
+		// the uv rect (x0, y0, x1, y1) of a cx x cy thumbnail at the cell's corner
+		Vec4 get_uv(int id, int cx, int cy) const
+		{
+			auto pos = get_cell_pos(id);
+			auto s = 1.f / atlas_size;
+			return Vec4(pos.x * s, pos.y * s, (pos.x + cx) * s, (pos.y + cy) * s);
+		}
+	};
+}
@@ -33,6 +33,7 @@
 #include <flame/graphics/commandbuffer.h>
 #include <flame/graphics/semaphore.h>
 #include <flame/graphics/queue.h>
+#include <flame/graphics/frame.h>
 #include <flame/UI/instance.h>
 
 #include <Windows.h>
@@ -56,20 +57,14 @@ int main(int argc, char **args)
 	rp_ui->build();
 
 	graphics::Framebuffer *fbs_ui[2];
-	graphics::Commandbuffer *cbs_ui[2];
 	for (auto i = 0; i < 2; i++)
 	{
 		fbs_ui[i] = create_framebuffer(d, res.x, res.y, rp_ui);
 		fbs_ui[i]->set_view_swapchain(0, sc, i);
 		fbs_ui[i]->build();
-
-		cbs_ui[i] = d->cp->create_commandbuffer();
-		cbs_ui[i]->begin();
-		cbs_ui[i]->end();
 	}
 
-	auto image_avalible = graphics::create_semaphore(d);
-	auto ui_finished = graphics::create_semaphore(d);
+	auto fc = graphics::create_framecontext(d, 2);
 
 	auto ui = UI::create_instance(d, rp_ui, s);
 
@@ -132,28 +127,34 @@ int main(int argc, char **args)
 			need_reload_fun = false;
 		}
 
+		fc->begin_frame();
+
 		ui->begin(res.x, res.y, sm->elapsed_time);
 		fun(ui);
 		ui->end();
 
-		for (auto i = 0; i < 2; i++)
-		{
-			cbs_ui[i]->begin();
-			ui->record_commandbuffer(cbs_ui[i], rp_ui, fbs_ui[i]);
-			cbs_ui[i]->end();
-		}
+		auto index = sc->acquire_image(fc->image_available);
 
-		auto index = sc->acquire_image(image_avalible);
+		auto cb = fc->get_commandbuffer();
+		cb->begin(true);
+		ui->record_commandbuffer(cb, rp_ui, fbs_ui[index]);
+		cb->end();
 
-		d->q->submit(cbs_ui[index], image_avalible, ui_finished);
-		d->q->wait_idle();
-		d->q->present(index, sc, ui_finished);
+		fc->add_submit(cb, fc->image_available, fc->render_finished);
+		fc->end_frame(d->q);
+		d->q->present(index, sc, fc->render_finished);
 
 		static long long last_fps = 0;
 		if (last_fps != sm->fps)
-			printf("%lld\n", sm->fps);
+		{
+			graphics::FrameStats st;
+			fc->get_stats(&st);
+			printf("%lld fps, cpu %.2fms, waiting for gpu %.2fms, overlap %d%%\n", sm->fps, st.cpu_ms, st.wait_ms, int(st.overlap * 100.f));
+		}
 		last_fps = sm->fps;
 	});
 
+	graphics::destroy_framecontext(d, fc);
+
 	return 0;
 }
@@ -0,0 +1,116 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/graphics/bindless.h>
+
+// the checks run in release builds too
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+
+using namespace flame;
+using namespace graphics;
+
+static void test_handles()
+{
+	BindlessSlots s;
+
+	auto a = s.add();
+	auto b = s.add();
+	assert(a.index == 0 && b.index == 1);
+	assert(s.valid(a) && s.valid(b));
+	assert(!s.valid(BindlessHandle()));
+	assert(!s.valid(BindlessHandle(7, 1)));
+
+	auto removed = s.remove(a);
+	assert(removed);
+	assert(!s.valid(a));
+	removed = s.remove(a);
+	assert(!removed);
+	assert(s.live_count == 1);
+
+	// the slot waits for the frames in flight
+	auto lag = 2;
+	auto c = s.add();
+	assert(c.index == 2);
+	s.next_frame(lag);
+	auto d = s.add();
+	assert(d.index == 3);
+	s.next_frame(lag);
+	auto e = s.add();
+	assert(e.index == 0);
+	// same slot, but the old handle stays gone
+	assert(s.valid(e) && !s.valid(a));
+	assert(e.generation != a.generation);
+	assert(s.capacity() == 4);
+
+	// many times around the same slot never brings an old handle back
+	std::vector<BindlessHandle> olds;
+	for (auto i = 0; i < 100; i++)
+	{
+		auto h = s.add();
+		olds.push_back(h);
+		s.remove(h);
+		s.next_frame(1);
+	}
+	for (auto &h : olds)
+		assert(!s.valid(h));
+	assert(s.capacity() <= 5);
+}
+
+static void test_dirty()
+{
+	BindlessDirty d;
+	std::vector<std::pair<uint, uint>> ranges;
+
+	d.take(ranges);
+	assert(ranges.empty());
+
+	uint indices[] = { 9, 3, 4, 100000, 5, 3, 10, 20 };
+	for (auto i : indices)
+		d.add(i);
+	d.take(ranges);
+	assert(ranges.size() == 4);
+	assert(ranges[0].first == 3 && ranges[0].second == 3);
+	assert(ranges[1].first == 9 && ranges[1].second == 2);
+	assert(ranges[2].first == 20 && ranges[2].second == 1);
+	assert(ranges[3].first == 100000 && ranges[3].second == 1);
+	assert(d.empty());
+
+	// only what changed after the take
+	d.add(4);
+	d.take(ranges);
+	assert(ranges.size() == 1 && ranges[0].first == 4 && ranges[0].second == 1);
+}
+
+int main(int argc, char **args)
+{
+	static_assert(sizeof(BindlessMaterialData) == 48, "the material layout of the shaders");
+	static_assert(sizeof(BindlessDrawData) == 8, "the draw layout of the shaders");
+
+	test_handles();
+	test_dirty();
+
+	printf("ok\n");
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/time.h>
+#include <flame/graphics/bonepalette.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <random>
+
+using namespace flame;
+using namespace graphics;
+
+static void test_packer()
+{
+	BonepalettePacker p;
+	int skeleton_a, skeleton_b, walk, run;
+
+	bool fresh;
+	auto o0 = p.acquire(BonepaletteKey(&skeleton_a, &walk, 3), 10, &fresh);
+	assert(fresh && o0 == 0);
+	auto o1 = p.acquire(BonepaletteKey(&skeleton_a, &walk, 4), 10, &fresh);
+	assert(fresh && o1 == 10);
+	// same pose, same palette
+	auto o2 = p.acquire(BonepaletteKey(&skeleton_a, &walk, 3), 10, &fresh);
+	assert(!fresh && o2 == o0);
+	auto o3 = p.acquire(BonepaletteKey(&skeleton_a, &run, 3), 10, &fresh);
+	assert(fresh && o3 == 20);
+	auto o4 = p.acquire(BonepaletteKey(&skeleton_b, &walk, 3), 4, &fresh);
+	assert(fresh && o4 == 30);
+	// a pose of its own is never shared
+	auto o5 = p.acquire(BonepaletteKey(&skeleton_a, nullptr, 3), 10, &fresh);
+	assert(fresh && o5 == 34);
+	auto o6 = p.acquire(BonepaletteKey(&skeleton_a, nullptr, 3), 10, &fresh);
+	assert(fresh && o6 == 44);
+	assert(p.matrices.size() == 54);
+	assert(p.shared_count == 1);
+
+	p.get(o4)[3] = Mat4(2.f);
+	assert(p.matrices[33][1][1] == 2.f);
+
+	// instances of a draw are in a row
+	auto first = p.add_instance(Mat4(1.f), o0);
+	assert(first == 0);
+	BonepaletteInstance is[3];
+	for (auto i = 0; i < 3; i++)
+	{
+		is[i].world = Mat4(1.f);
+		is[i].bone_offset = o3;
+	}
+	first = p.add_instances(3, is);
+	assert(first == 1 && p.instances.size() == 4);
+	assert(p.instances[3].bone_offset == (uint)o3);
+
+	p.clear();
+	assert(p.matrices.empty() && p.instances.empty() && p.shared_count == 0);
+	auto o7 = p.acquire(BonepaletteKey(&skeleton_a, &walk, 3), 10, &fresh);
+	assert(fresh && o7 == 0);
+
+	printf("packer ok\n");
+}
+
+struct BenchSkeleton
+{
+	int bone_count;
+	std::vector<int> parents;
+	std::vector<Mat4> locals;
+};
+
+static void fill_pose(const BenchSkeleton &s, int frame, Mat4 *dst)
+{
+	for (auto i = 0; i < s.bone_count; i++)
+	{
+		auto l = s.locals[i];
+		l[3][0] += frame * 0.01f;
+		dst[i] = s.parents[i] == -1 ? l : dst[s.parents[i]] * l;
+	}
+}
+
+static void benchmark()
+{
+	const auto bone_count = 64;
+	const auto skeleton_count = 2;
+	const auto animation_count = 8;
+	const auto frame_count = 30; // a second of animation at 30fps, the frames are quantized to it
+
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> dist(-1.f, 1.f);
+	BenchSkeleton skeletons[skeleton_count];
+	for (auto &s : skeletons)
+	{
+		s.bone_count = bone_count;
+		s.parents.resize(bone_count);
+		s.locals.resize(bone_count);
+		for (auto i = 0; i < bone_count; i++)
+		{
+			s.parents[i] = i == 0 ? -1 : (int)(rng() % i);
+			s.locals[i] = Mat4(1.f);
+			s.locals[i][3] = Vec4(dist(rng), dist(rng), dist(rng), 1.f);
+		}
+	}
+	int animations[animation_count];
+
+	printf("characters  per instance   packed unique   packed shared   palettes   upload\n");
+	for (auto n : { 1000, 4000, 16000 })
+	{
+		struct Character
+		{
+			int skeleton;
+			int animation;
+			int frame;
+			Mat4 world;
+		};
+		std::vector<Character> characters(n);
+		for (auto &c : characters)
+		{
+			c.skeleton = rng() % skeleton_count;
+			c.animation = rng() % animation_count;
+			c.frame = rng() % frame_count;
+			c.world = Mat4(1.f);
+			c.world[3] = Vec4(dist(rng) * 100.f, 0.f, dist(rng) * 100.f, 1.f);
+		}
+
+		// the old way: a palette and an upload for each instance
+		std::vector<std::vector<Mat4>> own(n, std::vector<Mat4>(bone_count));
+		std::vector<std::vector<unsigned char>> own_gpu(n, std::vector<unsigned char>(bone_count * sizeof(Mat4)));
+		auto t0 = get_now_ns();
+		for (auto i = 0; i < n; i++)
+		{
+			auto &c = characters[i];
+			fill_pose(skeletons[c.skeleton], c.frame, own[i].data());
+			memcpy(own_gpu[i].data(), own[i].data(), bone_count * sizeof(Mat4));
+		}
+		auto t_own = get_now_ns() - t0;
+
+		std::vector<unsigned char> gpu; // stands for the mapped buffer
+		auto palette_count = 0;
+		auto pack = [&](bool share) {
+			BonepalettePacker p;
+			long long t = 0;
+			// the second pass is timed, a packer that keeps its memory as in the frames after the first
+			for (auto pass = 0; pass < 2; pass++)
+			{
+				auto t0 = get_now_ns();
+				p.clear();
+				for (auto &c : characters)
+				{
+					bool fresh;
+					auto offset = p.acquire(BonepaletteKey(&skeletons[c.skeleton], share ? &animations[c.animation] : nullptr,
+						c.frame), bone_count, &fresh);
+					if (fresh)
+						fill_pose(skeletons[c.skeleton], c.frame, p.get(offset));
+					p.add_instance(c.world, offset);
+				}
+				// the single upload
+				gpu.resize(p.matrices.size() * sizeof(Mat4));
+				memcpy(gpu.data(), p.matrices.data(), p.matrices.size() * sizeof(Mat4));
+				t = get_now_ns() - t0;
+			}
+			palette_count = p.matrices.size() / bone_count;
+			return t;
+		};
+
+		auto t_unique = pack(false);
+		auto t_shared = pack(true);
+
+		printf("%10d %12.3fms %13.3fms %13.3fms %10d %6.2fMB\n", n, t_own / 1000000.0, t_unique / 1000000.0,
+			t_shared / 1000000.0, palette_count, gpu.size() / 1048576.0);
+	}
+}
+
+int main(int argc, char **args)
+{
+	test_packer();
+	benchmark();
+
+	return 0;
+}
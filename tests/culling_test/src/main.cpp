@@ -0,0 +1,208 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/time.h>
+#include <flame/aabb_tree.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <random>
+#include <math.h>
+
+using namespace flame;
+
+// a camera at the origin looking down -z, 90 degrees, near 0.1, far 1000
+static const Vec4 planes[] = {
+	Vec4(1.f, 0.f, -1.f, 0.f),
+	Vec4(-1.f, 0.f, -1.f, 0.f),
+	Vec4(0.f, 1.f, -1.f, 0.f),
+	Vec4(0.f, -1.f, -1.f, 0.f),
+	Vec4(0.f, 0.f, -1.f, -0.1f),
+	Vec4(0.f, 0.f, 1.f, 1000.f)
+};
+
+static std::mt19937 rng(1);
+
+static AABB rand_box(float extent)
+{
+	std::uniform_real_distribution<float> pos(-extent, extent);
+	std::uniform_real_distribution<float> size(0.1f, 5.f);
+	Vec3 c(pos(rng), pos(rng), pos(rng));
+	Vec3 h(size(rng), size(rng), size(rng));
+	return AABB(c - h, c + h);
+}
+
+static int check_node(const AABBTree &t, int id, int parent)
+{
+	auto &n = t.get_node(id);
+	assert(n.parent == parent);
+	if (n.child1 == -1)
+		return 0;
+	auto h1 = check_node(t, n.child1, id);
+	auto h2 = check_node(t, n.child2, id);
+	assert(n.height == 1 + std::max(h1, h2));
+	assert(n.box.contains(t.get_node(n.child1).box) && n.box.contains(t.get_node(n.child2).box));
+	return n.height;
+}
+
+static void test_tree()
+{
+	const auto N = 5000;
+	AABBTree t;
+	std::vector<AABB> boxes(N);
+	std::vector<int> proxies(N, -1);
+	for (auto i = 0; i < N; i++)
+	{
+		boxes[i] = rand_box(500.f);
+		proxies[i] = t.insert(boxes[i], i);
+	}
+	check_node(t, t.get_root(), -1);
+	// the rotations do not make it strictly balanced, but it must stay near log2(n)
+	assert(t.get_height() < 3 * log2(N));
+
+	std::uniform_int_distribution<int> pick(0, N - 1);
+	for (auto r = 0; r < 20000; r++)
+	{
+		auto i = pick(rng);
+		switch (r % 3)
+		{
+			case 0:
+				if (proxies[i] != -1)
+				{
+					t.remove(proxies[i]);
+					proxies[i] = -1;
+				}
+				break;
+			case 1:
+				if (proxies[i] == -1)
+				{
+					boxes[i] = rand_box(500.f);
+					proxies[i] = t.insert(boxes[i], i);
+				}
+				break;
+			case 2:
+				if (proxies[i] != -1)
+				{
+					// mostly small moves, sometimes a jump
+					auto d = (r % 10 == 0) ? Vec3(100.f, -50.f, 30.f) : Vec3(0.05f, 0.f, -0.05f);
+					boxes[i] = AABB(boxes[i].min + d, boxes[i].max + d);
+					t.update(proxies[i], boxes[i]);
+				}
+				break;
+		}
+	}
+	check_node(t, t.get_root(), -1);
+	assert(t.get_height() < 3 * log2(N));
+
+	// the tree gives exactly the leaves whose (fattened) box is not outside
+	std::vector<bool> expected(N, false), got(N, false);
+	auto expected_count = 0;
+	for (auto i = 0; i < N; i++)
+	{
+		if (proxies[i] != -1 && frustum_test(planes, t.get_node(proxies[i]).box) != FrustumOutside)
+		{
+			expected[i] = true;
+			expected_count++;
+		}
+	}
+	auto got_count = 0;
+	t.query_frustum(planes, [&](int user) {
+		assert(!got[user]);
+		got[user] = true;
+		got_count++;
+	});
+	assert(got_count == expected_count && got == expected);
+	assert(expected_count > 0 && expected_count < t.get_leaf_count());
+
+	printf("tree: ok, %d leaves, height %d, %d visible\n", t.get_leaf_count(), t.get_height(), got_count);
+}
+
+static void benchmark()
+{
+	printf("boxes     brute(scalar)  brute(soa)   tree query   tree build   refit 10%%   visible\n");
+	for (auto n : { 10000, 100000, 1000000 })
+	{
+		std::vector<AABB> boxes(n);
+		std::vector<float> soa[6];
+		for (auto k = 0; k < 6; k++)
+			soa[k].resize(n);
+		auto extent = 20.f * powf((float)n, 1.f / 3.f);
+		for (auto i = 0; i < n; i++)
+		{
+			auto &b = boxes[i] = rand_box(extent);
+			soa[0][i] = b.min.x; soa[1][i] = b.min.y; soa[2][i] = b.min.z;
+			soa[3][i] = b.max.x; soa[4][i] = b.max.y; soa[5][i] = b.max.z;
+		}
+		const float *soa_ptrs[] = { soa[0].data(), soa[1].data(), soa[2].data(), soa[3].data(), soa[4].data(), soa[5].data() };
+		std::vector<int> out(n);
+
+		auto t0 = get_now_ns();
+		auto visible_scalar = 0;
+		for (auto i = 0; i < n; i++)
+		{
+			if (frustum_test(planes, boxes[i]) != FrustumOutside)
+				out[visible_scalar++] = i;
+		}
+		auto t1 = get_now_ns();
+		auto visible_soa = frustum_cull_aabbs(planes, soa_ptrs, n, nullptr, out.data());
+		auto t2 = get_now_ns();
+		assert(visible_soa == visible_scalar);
+
+		AABBTree tree(0.f);
+		for (auto i = 0; i < n; i++)
+			tree.insert(boxes[i], i);
+		auto t3 = get_now_ns();
+		auto visible_tree = 0;
+		tree.query_frustum(planes, [&](int) {
+			visible_tree++;
+		});
+		auto t4 = get_now_ns();
+		assert(visible_tree == visible_scalar);
+
+		// move 10% of them a bit, with a margin most stay in their leaves
+		AABBTree fat_tree(0.5f);
+		std::vector<int> proxies(n);
+		for (auto i = 0; i < n; i++)
+			proxies[i] = fat_tree.insert(boxes[i], i);
+		auto t5 = get_now_ns();
+		for (auto i = 0; i < n; i += 10)
+		{
+			auto d = Vec3(0.2f, 0.f, 0.1f);
+			fat_tree.update(proxies[i], AABB(boxes[i].min + d, boxes[i].max + d));
+		}
+		auto t6 = get_now_ns();
+
+		printf("%7d %12.3fms %10.3fms %10.3fms %10.3fms %10.3fms %9d\n", n,
+			(t1 - t0) / 1000000.0, (t2 - t1) / 1000000.0, (t4 - t3) / 1000000.0,
+			(t3 - t2) / 1000000.0, (t6 - t5) / 1000000.0, visible_tree);
+	}
+}
+
+int main(int argc, char **args)
+{
+	test_tree();
+	benchmark();
+
+	return 0;
+}
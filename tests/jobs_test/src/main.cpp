@@ -0,0 +1,220 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/jobs.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+
+using namespace flame;
+
+static long long now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void test_run(JobSystem *s)
+{
+	std::atomic<int> sum(0);
+	JobCounter c;
+	// more than a deque holds
+	for (auto i = 0; i < 10000; i++)
+	{
+		s->run([&sum, i]() {
+			sum += i;
+		}, &c);
+	}
+	s->wait(&c);
+	assert(c.done() && sum == 10000 * 9999 / 2);
+
+	// jobs giving more jobs to the same counter
+	std::atomic<int> leaves(0);
+	std::function<void(int)> split;
+	split = [&](int depth) {
+		if (depth == 0)
+		{
+			leaves++;
+			return;
+		}
+		for (auto i = 0; i < 2; i++)
+			s->run([&, depth]() { split(depth - 1); }, &c);
+	};
+	s->run([&]() { split(12); }, &c);
+	s->wait(&c);
+	assert(leaves == 1 << 12);
+	printf("run: ok\n");
+}
+
+static void test_parallel_for(JobSystem *s)
+{
+	for (auto grain : { 1, 7, 1000, 100000, 2000000 })
+	{
+		const int n = 1000000;
+		std::unique_ptr<std::atomic<char>[]> visited(new std::atomic<char>[n]);
+		for (auto i = 0; i < n; i++)
+			visited[i] = 0;
+		s->parallel_for(0, n, grain, [&](int b, int e) {
+			assert(e - b <= grain && b < e);
+			for (auto i = b; i < e; i++)
+				visited[i]++;
+		});
+		for (auto i = 0; i < n; i++)
+			assert(visited[i] == 1);
+	}
+	s->parallel_for(5, 5, 1, [](int, int) {
+		assert(0);
+	});
+
+	// nested
+	std::atomic<long long> sum(0);
+	s->parallel_for(0, 100, 1, [&](int b, int e) {
+		s->parallel_for(0, 1000, 10, [&](int b2, int e2) {
+			sum += e2 - b2;
+		});
+	});
+	assert(sum == 100 * 1000);
+	printf("parallel_for: ok\n");
+}
+
+static void test_graph(JobSystem *s)
+{
+	// a -> (b, c) -> d -> e, with f independent
+	std::atomic<int> seq(0);
+	int order[6];
+	TaskGraph g;
+	auto a = g.add([&]() { order[0] = seq++; });
+	auto b = g.add([&]() { order[1] = seq++; });
+	auto c = g.add([&]() { order[2] = seq++; });
+	auto d = g.add([&]() { order[3] = seq++; });
+	auto e = g.add([&]() { order[4] = seq++; });
+	auto f = g.add([&]() { order[5] = seq++; });
+	g.depend(b, a);
+	g.depend(c, a);
+	g.depend(d, b);
+	g.depend(d, c);
+	g.depend(e, d);
+
+	for (auto round = 0; round < 100; round++)
+	{
+		seq = 0;
+		s->run_graph(g);
+		assert(seq == 6);
+		assert(order[a] < order[b] && order[a] < order[c]);
+		assert(order[b] < order[d] && order[c] < order[d] && order[d] < order[e]);
+		(void)f;
+	}
+
+	// wide fan-in
+	TaskGraph g2;
+	std::atomic<int> done(0);
+	auto last = g2.add([&]() { assert(done == 1000); });
+	for (auto i = 0; i < 1000; i++)
+		g2.depend(last, g2.add([&]() { done++; }));
+	s->run_graph(g2);
+	printf("graph: ok\n");
+}
+
+static void test_other_thread(JobSystem *s)
+{
+	// a thread that is not a worker gives jobs and waits for them
+	std::atomic<int> sum(0);
+	std::thread t([&]() {
+		assert(s->get_worker_index() == -1);
+		JobCounter c;
+		for (auto i = 0; i < 1000; i++)
+			s->run([&]() { sum++; }, &c);
+		s->wait(&c);
+		s->parallel_for(0, 1000, 10, [&](int b, int e) {
+			sum += e - b;
+		});
+	});
+	t.join();
+	assert(sum == 2000);
+	assert(s->get_worker_index() == 0);
+	printf("other thread: ok\n");
+}
+
+static double work(int i)
+{
+	auto v = 0.0;
+	for (auto j = 0; j < 200; j++)
+		v += sin(i * 0.001 + j);
+	return v;
+}
+
+static void benchmark()
+{
+	const int n = 200000;
+	std::vector<double> out(n);
+	auto hw = std::max((int)std::thread::hardware_concurrency(), 1);
+	double base_time = 0.0;
+	for (auto workers = 1; ; workers *= 2)
+	{
+		workers = std::min(workers, hw);
+		auto s = create_job_system(workers);
+		auto t0 = now_ns();
+		s->parallel_for(0, n, 256, [&](int b, int e) {
+			for (auto i = b; i < e; i++)
+				out[i] = work(i);
+		});
+		auto t1 = now_ns();
+		auto ms = (t1 - t0) / 1000000.0;
+		if (workers == 1)
+			base_time = ms;
+		printf("parallel_for, %2d workers: %.2fms, x%.2f\n", workers, ms, base_time / ms);
+
+		// the cost of a job itself
+		JobCounter c;
+		const int m = 100000;
+		t0 = now_ns();
+		for (auto i = 0; i < m; i++)
+			s->run([]() {}, &c);
+		s->wait(&c);
+		t1 = now_ns();
+		printf("  %.0fns per empty job\n", double(t1 - t0) / m);
+
+		destroy_job_system(s);
+		if (workers == hw)
+			break;
+	}
+}
+
+int main(int argc, char **args)
+{
+	auto s = create_job_system(4);
+	assert(s->get_worker_count() == 4 && s->get_worker_index() == 0);
+	test_run(s);
+	test_parallel_for(s);
+	test_graph(s);
+	test_other_thread(s);
+	destroy_job_system(s);
+
+	benchmark();
+
+	return 0;
+}
@@ -0,0 +1,177 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/light_cluster.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <random>
+
+using namespace flame;
+
+static std::mt19937 rng(1);
+
+static std::vector<Vec4> rand_lights(int n, float far_plane, float max_radius)
+{
+	std::uniform_real_distribution<float> xy(-1.f, 1.f);
+	std::uniform_real_distribution<float> depth(-2.f, far_plane * 1.1f);
+	std::uniform_real_distribution<float> radius(0.1f, max_radius);
+	std::vector<Vec4> lights(n);
+	for (auto &l : lights)
+	{
+		auto d = depth(rng);
+		l = Vec4(xy(rng) * (fabsf(d) + 1.f), xy(rng) * (fabsf(d) + 1.f), -d, radius(rng));
+	}
+	return lights;
+}
+
+// every cluster against every light
+static void brute_force(const LightClusterGrid &g, const std::vector<Vec4> &lights, std::vector<std::vector<int>> &out)
+{
+	out.clear();
+	out.resize(g.get_cluster_count());
+	for (auto c = 0; c < g.get_cluster_count(); c++)
+	{
+		Vec3 mn, mx;
+		g.get_cluster_bounds(c, mn, mx);
+		for (auto i = 0; i < (int)lights.size(); i++)
+		{
+			auto &l = lights[i];
+			if (LightClusterGrid::sphere_touches_box(Vec3(l.x, l.y, l.z), l.w, mn, mx))
+				out[c].push_back(i);
+		}
+	}
+}
+
+static void test_against_brute_force()
+{
+	LightClusterGrid g;
+	g.setup(16, 9, 24, 1.0f, 16.f / 9.f, 0.1f, 500.f);
+	auto lights = rand_lights(500, 500.f, 30.f);
+	g.bin(lights.data(), lights.size());
+	assert(g.overflow_count == 0);
+
+	std::vector<std::vector<int>> expected;
+	brute_force(g, lights, expected);
+	for (auto c = 0; c < g.get_cluster_count(); c++)
+	{
+		auto offset = g.offsets[c * 2];
+		auto count = g.offsets[c * 2 + 1];
+		assert(count == expected[c].size());
+		for (auto i = 0; i < (int)count; i++)
+			assert(g.indices[offset + i] == (uint)expected[c][i]);
+	}
+	printf("binning matches brute force: ok, %d pairs, %.3fms\n", (int)g.indices.size(), g.bin_time_ms);
+}
+
+static void test_slices()
+{
+	LightClusterGrid g;
+	g.setup(4, 4, 16, 1.0f, 1.f, 0.5f, 200.f);
+	for (auto z = 0; z < 16; z++)
+	{
+		Vec3 mn, mx;
+		g.get_cluster_bounds(g.get_cluster_index(0, 0, z), mn, mx);
+		// the middle of a slice maps back to it
+		auto mid = sqrtf(-mn.z * -mx.z);
+		assert(g.get_slice(mid) == z);
+	}
+	assert(g.get_slice(0.1f) == 0 && g.get_slice(1000.f) == 15);
+
+	// a small light in the middle of the screen only touches the middle tiles
+	Vec4 l(0.f, 0.f, -10.f, 0.1f);
+	g.bin(&l, 1);
+	for (auto y = 0; y < 4; y++)
+	{
+		for (auto x = 0; x < 4; x++)
+		{
+			auto n = 0;
+			for (auto z = 0; z < 16; z++)
+				n += g.offsets[g.get_cluster_index(x, y, z) * 2 + 1];
+			auto center = (x == 1 || x == 2) && (y == 1 || y == 2);
+			assert(center ? n > 0 : n == 0);
+		}
+	}
+
+	// a light above the camera is in the top row, tiles start at the top of the screen
+	l = Vec4(0.f, 8.f, -10.f, 0.5f);
+	g.bin(&l, 1);
+	for (auto z = 0; z < 16; z++)
+	{
+		assert(g.offsets[g.get_cluster_index(1, 3, z) * 2 + 1] == 0);
+	}
+	auto top = 0;
+	for (auto z = 0; z < 16; z++)
+		top += g.offsets[g.get_cluster_index(1, 0, z) * 2 + 1];
+	assert(top > 0);
+
+	// behind the camera or beyond far touches nothing
+	Vec4 hidden[] = { Vec4(0.f, 0.f, 5.f, 1.f), Vec4(0.f, 0.f, -300.f, 1.f) };
+	g.bin(hidden, 2);
+	assert(g.indices.empty());
+	printf("slices and tiles: ok\n");
+}
+
+static void test_overflow()
+{
+	LightClusterGrid g;
+	g.setup(8, 8, 8, 1.0f, 1.f, 0.1f, 100.f);
+	auto lights = rand_lights(300, 100.f, 50.f);
+	g.bin(lights.data(), lights.size());
+	auto total = (int)g.indices.size();
+	g.bin(lights.data(), lights.size(), total / 2);
+	assert((int)g.indices.size() == total / 2 && (int)g.overflow_count == total - total / 2);
+	for (auto c = 0; c < g.get_cluster_count(); c++)
+		assert(g.offsets[c * 2] + g.offsets[c * 2 + 1] <= (uint)(total / 2));
+	printf("overflow: ok\n");
+}
+
+static void benchmark()
+{
+	LightClusterGrid g;
+	g.setup(16, 9, 24, 1.0f, 16.f / 9.f, 0.1f, 1000.f);
+	for (auto n : { 256, 1024, 4096, 16384 })
+	{
+		auto lights = rand_lights(n, 1000.f, 20.f);
+		g.bin(lights.data(), lights.size());
+		auto t = 0.f;
+		const auto R = 10;
+		for (auto r = 0; r < R; r++)
+		{
+			g.bin(lights.data(), lights.size());
+			t += g.bin_time_ms;
+		}
+		printf("%6d lights: %8.3fms, %8d pairs, %.1f lights per cluster\n", n, t / R, (int)g.indices.size(),
+			g.indices.size() / (float)g.get_cluster_count());
+	}
+}
+
+int main(int argc, char **args)
+{
+	test_against_brute_force();
+	test_slices();
+	test_overflow();
+	benchmark();
+
+	return 0;
+}
@@ -0,0 +1,400 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/image.h>
+#include <flame/text_parse.h>
+#include <flame/load_queue.h>
+#include <flame/time.h>
+
+// the checks run in release builds too
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <random>
+#include <map>
+
+using namespace flame;
+
+static std::mt19937 rng(1);
+
+static const int image_count = 300;
+static const int model_count = 100;
+
+static std::string image_name(int i)
+{
+	return "load_queue_test_" + std::to_string(i) + ".png";
+}
+
+static std::string model_name(int i)
+{
+	return "load_queue_test_" + std::to_string(i) + ".obj";
+}
+
+static unsigned int checksum(const unsigned char *p, size_t size)
+{
+	auto h = 2166136261U;
+	for (size_t i = 0; i < size; i++)
+		h = (h ^ p[i]) * 16777619U;
+	return h;
+}
+
+static unsigned int load_image_checksum(const std::string &filename)
+{
+	auto i = load_image(filename);
+	if (!i)
+		return 0;
+	auto h = checksum(i->data, i->size) ^ (i->cx * 31 + i->cy);
+	release_image(i);
+	return h;
+}
+
+static unsigned int load_model_checksum(const std::string &filename)
+{
+	auto f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return 0;
+	fseek(f, 0, SEEK_END);
+	std::vector<char> text(ftell(f));
+	fseek(f, 0, SEEK_SET);
+	fread(text.data(), 1, text.size(), f);
+	fclose(f);
+
+	ObjData d;
+	parse_obj(text.data(), text.size(), d, 1);
+	return checksum((unsigned char*)d.positions.data(), d.positions.size() * sizeof(float)) ^
+		checksum((unsigned char*)d.corners.data(), d.corners.size() * sizeof(int));
+}
+
+static void make_assets()
+{
+	std::uniform_int_distribution<int> byte(0, 255);
+	std::uniform_int_distribution<int> dim(8, 96);
+	for (auto i = 0; i < image_count; i++)
+	{
+		auto cx = dim(rng), cy = dim(rng);
+		std::vector<unsigned char> data(cx * cy * 4);
+		for (auto &v : data)
+			v = byte(rng);
+		save_image(cx, cy, 4, 32, data.data(), image_name(i));
+	}
+
+	std::uniform_real_distribution<float> coord(-10.f, 10.f);
+	for (auto i = 0; i < model_count; i++)
+	{
+		auto f = fopen(model_name(i).c_str(), "wb");
+		auto vertex_count = 100 + i * 20;
+		for (auto j = 0; j < vertex_count; j++)
+			fprintf(f, "v %f %f %f\n", coord(rng), coord(rng), coord(rng));
+		for (auto j = 0; j + 2 < vertex_count; j++)
+			fprintf(f, "f %d %d %d\n", j + 1, j + 2, j + 3);
+		fclose(f);
+	}
+}
+
+static void remove_assets()
+{
+	for (auto i = 0; i < image_count; i++)
+		remove(image_name(i).c_str());
+	for (auto i = 0; i < model_count; i++)
+		remove(model_name(i).c_str());
+}
+
+// hundreds of decodes at mixed priorities, some cancelled, completions dispatched on this thread
+static void test_stress()
+{
+	std::vector<unsigned int> expected(image_count + model_count);
+	auto t0 = get_now_ns();
+	for (auto i = 0; i < image_count; i++)
+		expected[i] = load_image_checksum(image_name(i));
+	for (auto i = 0; i < model_count; i++)
+		expected[image_count + i] = load_model_checksum(model_name(i));
+	auto serial_ms = (get_now_ns() - t0) / 1000000.0;
+
+	for (auto v : expected)
+		assert(v != 0);
+
+	LoadQueue q(8);
+	auto main_thread = std::this_thread::get_id();
+
+	std::vector<unsigned int> results(expected.size(), 0);
+	std::vector<int> completed(expected.size(), 0);
+	std::vector<std::shared_ptr<LoadTicket>> tickets(expected.size());
+	std::vector<bool> cancelled(expected.size(), false);
+	std::uniform_int_distribution<int> priority(0, LoadPriorityCount - 1);
+
+	t0 = get_now_ns();
+	for (auto i = 0; i < (int)expected.size(); i++)
+	{
+		auto out = std::make_shared<unsigned int>(0);
+		auto is_image = i < image_count;
+		auto filename = is_image ? image_name(i) : model_name(i - image_count);
+		tickets[i] = q.push(priority(rng), [=](LoadTicket &t) {
+			*out = is_image ? load_image_checksum(filename) : load_model_checksum(filename);
+			return *out != 0;
+		}, [&, i, out, main_thread](bool ok) {
+			assert(ok);
+			assert(std::this_thread::get_id() == main_thread);
+			results[i] = *out;
+			completed[i]++;
+		});
+		if (i % 7 == 3)
+		{
+			q.cancel(tickets[i]);
+			cancelled[i] = true;
+		}
+		else if (i % 11 == 5)
+			q.set_priority(tickets[i], LoadPriorityHigh);
+	}
+
+	for (;;)
+	{
+		q.dispatch();
+		auto all = true;
+		for (auto &t : tickets)
+		{
+			if (!t->finished())
+			{
+				all = false;
+				break;
+			}
+		}
+		if (all)
+			break;
+		std::this_thread::yield();
+	}
+	auto async_ms = (get_now_ns() - t0) / 1000000.0;
+
+	auto done_count = 0;
+	for (auto i = 0; i < (int)expected.size(); i++)
+	{
+		auto s = tickets[i]->state.load();
+		if (cancelled[i])
+		{
+			// a cancel that came after the work started still suppresses the completion
+			assert(s == LoadStateCancelled);
+			assert(completed[i] == 0);
+		}
+		else
+		{
+			assert(s == LoadStateDone);
+			assert(completed[i] == 1);
+			assert(results[i] == expected[i]);
+			done_count++;
+		}
+	}
+	assert(q.get_pending_count() == 0);
+	auto dispatched = q.dispatch();
+	assert(dispatched == 0);
+
+	printf("stress: %d assets, %d loaded, serial %.1fms, %d threads %.1fms\n", (int)expected.size(), done_count,
+		serial_ms, q.get_thread_count(), async_ms);
+}
+
+// one loader thread held by a gate, the rest must come out highest priority first, fifo within a priority
+static void test_priority()
+{
+	LoadQueue q(1);
+
+	std::mutex gate_mtx;
+	std::condition_variable gate_cv;
+	auto gate_open = false;
+	std::atomic<bool> gate_entered(false);
+	q.push(LoadPriorityNormal, [&](LoadTicket &) {
+		gate_entered = true;
+		std::unique_lock<std::mutex> lock(gate_mtx);
+		gate_cv.wait(lock, [&]() { return gate_open; });
+		return true;
+	});
+	while (!gate_entered)
+		std::this_thread::yield();
+
+	std::vector<int> order;
+	std::mutex order_mtx;
+	auto job = [&](int id) {
+		return [&, id](LoadTicket &) {
+			std::lock_guard<std::mutex> lock(order_mtx);
+			order.push_back(id);
+			return true;
+		};
+	};
+	q.push(LoadPriorityLow, job(0));
+	q.push(LoadPriorityNormal, job(1));
+	auto t2 = q.push(LoadPriorityLow, job(2));
+	q.push(LoadPriorityHigh, job(3));
+	q.push(LoadPriorityNormal, job(4));
+	auto t5 = q.push(LoadPriorityHigh, job(5));
+	q.push(LoadPriorityHigh, job(6));
+	auto t7 = q.push(LoadPriorityNormal, job(7));
+
+	q.set_priority(t2, LoadPriorityHigh); // goes behind 3 and 6
+	q.set_priority(t5, LoadPriorityLow); // goes behind 0
+	q.cancel(t7);
+	assert(t7->state == LoadStateCancelled);
+
+	{
+		std::lock_guard<std::mutex> lock(gate_mtx);
+		gate_open = true;
+	}
+	gate_cv.notify_all();
+	q.wait_idle();
+
+	int expected[] = { 3, 6, 2, 1, 4, 0, 5 };
+	assert(order.size() == sizeof(expected) / sizeof(expected[0]));
+	for (auto i = 0; i < (int)order.size(); i++)
+		assert(order[i] == expected[i]);
+	assert(t2->state == LoadStateDone);
+	auto cancelled = q.cancel(t2);
+	assert(!cancelled);
+}
+
+// long running work polls the cancel flag
+static void test_cancel_running()
+{
+	LoadQueue q(2);
+
+	std::atomic<bool> started(false);
+	auto called = false;
+	auto t = q.push(LoadPriorityNormal, [&](LoadTicket &t) {
+		started = true;
+		while (!t.cancelled)
+			std::this_thread::yield();
+		return true;
+	}, [&](bool) {
+		called = true;
+	});
+	while (!started)
+		std::this_thread::yield();
+	assert(t->state == LoadStateRunning);
+	auto cancelled = q.cancel(t);
+	assert(cancelled);
+	q.wait_idle();
+	assert(t->state == LoadStateCancelled);
+	q.dispatch();
+	assert(!called);
+
+	// cancelled after the work finished but before the completion was dispatched
+	t = q.push(LoadPriorityNormal, [](LoadTicket &) {
+		return true;
+	}, [&](bool) {
+		called = true;
+	});
+	q.wait_idle();
+	assert(!t->finished());
+	cancelled = q.cancel(t);
+	assert(cancelled);
+	auto dispatched = q.dispatch();
+	assert(dispatched == 1);
+	assert(!called);
+	assert(t->state == LoadStateCancelled);
+
+	// failed work still reports back
+	auto result = true;
+	t = q.push(LoadPriorityNormal, [](LoadTicket &) {
+		return false;
+	}, [&](bool ok) {
+		result = ok;
+	});
+	q.wait_idle();
+	q.dispatch();
+	assert(!result);
+	assert(t->state == LoadStateFailed);
+}
+
+// completions handed to a post function, the way the engine uses add_after_frame_event
+static void test_post()
+{
+	std::mutex mtx;
+	std::vector<std::function<void()>> after_frame_events;
+	auto count = 0;
+	{
+		LoadQueue q(4, [&](const std::function<void()> &f) {
+			std::lock_guard<std::mutex> lock(mtx);
+			after_frame_events.push_back(f);
+		});
+		for (auto i = 0; i < 200; i++)
+		{
+			q.push(i % LoadPriorityCount, [](LoadTicket &) {
+				return true;
+			}, [&](bool ok) {
+				count++;
+			});
+		}
+		q.wait_idle();
+		auto dispatched = q.dispatch();
+		assert(dispatched == 0);
+	}
+	assert(count == 0);
+	assert(after_frame_events.size() == 200);
+	for (auto &e : after_frame_events)
+		e();
+	assert(count == 200);
+}
+
+// the queued jobs are cancelled when the queue goes away, the running one is waited for
+static void test_destroy()
+{
+	std::vector<std::shared_ptr<LoadTicket>> tickets;
+	std::atomic<int> ran(0);
+	{
+		LoadQueue q(1);
+		std::atomic<bool> started(false);
+		tickets.push_back(q.push(LoadPriorityNormal, [&](LoadTicket &) {
+			started = true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			ran++;
+			return true;
+		}));
+		while (!started)
+			std::this_thread::yield();
+		for (auto i = 0; i < 50; i++)
+		{
+			tickets.push_back(q.push(LoadPriorityNormal, [&](LoadTicket &) {
+				ran++;
+				return true;
+			}));
+		}
+	}
+	assert(ran == 1);
+	assert(tickets[0]->state == LoadStateDone);
+	for (auto i = 1; i < (int)tickets.size(); i++)
+		assert(tickets[i]->state == LoadStateCancelled);
+}
+
+int main(int argc, char **args)
+{
+	make_assets();
+
+	test_stress();
+	test_priority();
+	test_cancel_running();
+	test_post();
+	test_destroy();
+
+	remove_assets();
+
+	printf("load queue test passed\n");
+
+	return 0;
+}
@@ -0,0 +1,212 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/log_index.h>
+#include <flame/time.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <random>
+
+using namespace flame;
+
+static const char *log_filename = "log_index_test.log";
+
+static std::mt19937 rng(1);
+
+static const char *levels[] = { "INFO", "DEBUG", "WARNING", "ERROR" };
+
+static std::string make_line(int i)
+{
+	char buf[256];
+	auto n = sprintf(buf, "[12:%02d:%02d] %s: message %d", i / 60 % 60, i % 60, levels[rng() % 4], i);
+	auto pad = rng() % 80;
+	std::string s(buf, n);
+	s.append(pad, 'x');
+	return s;
+}
+
+static std::vector<std::string> split_lines(const std::string &text)
+{
+	std::vector<std::string> lines;
+	size_t b = 0;
+	while (b < text.size())
+	{
+		auto e = text.find('\n', b);
+		if (e == std::string::npos)
+			e = text.size();
+		auto l = text.substr(b, e - b);
+		if (!l.empty() && l.back() == '\r')
+			l.pop_back();
+		lines.push_back(l);
+		b = e + 1;
+	}
+	return lines;
+}
+
+static void check(const LogIndex &idx, const std::string &text)
+{
+	auto expected = split_lines(text);
+	assert(idx.get_line_count() == (int)expected.size());
+	for (auto i = 0; i < (int)expected.size(); i++)
+	{
+		auto l = idx.get_line(i);
+		assert(std::string(l.str, l.length) == expected[i]);
+	}
+}
+
+static void append(const std::string &s, std::string &text)
+{
+	std::ofstream f(log_filename, std::ios::binary | std::ios::app);
+	f << s;
+	text += s;
+}
+
+static void test_index()
+{
+	std::string text;
+	{
+		std::ofstream f(log_filename, std::ios::binary);
+	}
+
+	LogIndex idx;
+	assert(idx.open(log_filename, 4));
+	assert(idx.get_line_count() == 0);
+
+	// mixed line ends, empty lines, no end of line at the end
+	append("first\r\n\nthird\n\r\nfifth", text);
+	assert(idx.update() == 5);
+	check(idx, text);
+
+	// the cut line gets its rest, nothing is added for it
+	append(" continued\n", text);
+	assert(idx.update() == 0);
+	check(idx, text);
+	assert(idx.update() == 0);
+
+	std::string more;
+	for (auto i = 0; i < 1000; i++)
+		more += make_line(i) + (i % 3 ? "\n" : "\r\n");
+	append(more, text);
+	assert(idx.update() == 1000);
+	check(idx, text);
+
+	// a fresh open over the same file with threads gives the same
+	LogIndex idx2;
+	assert(idx2.open(log_filename, 8));
+	check(idx2, text);
+
+	// a smaller file (rotated) starts over
+	{
+		std::ofstream f(log_filename, std::ios::binary);
+		f << "new\nlog\n";
+	}
+	text = "new\nlog\n";
+	assert(idx.update() == 2);
+	check(idx, text);
+
+	assert(!idx.open("log_index_test_missing.log"));
+	assert(!idx.is_open() && idx.get_line_count() == 0 && idx.update() == 0);
+
+	idx.close();
+	idx2.close();
+	remove(log_filename);
+	printf("index: ok\n");
+}
+
+static void test_matcher()
+{
+	LogMatcher m;
+	assert(!m.compile("(unclosed"));
+	assert(m.compile(R"((\[[\w\s:]+\])[\s]*(INFO|DEBUG|WARNING|ERROR)[:\s]*(.*))"));
+
+	std::string s = "[12:00:01] ERROR: disk full";
+	LogLine l = { s.c_str(), (int)s.size() };
+	int indices[] = { 1, 2, 3, 7 };
+	std::string columns[4];
+	assert(m.match(l, indices, 4, columns));
+	assert(columns[0] == "[12:00:01]" && columns[1] == "ERROR" && columns[2] == "disk full" && columns[3].empty());
+
+	// only the line's own range is looked at
+	std::string s2 = "[12:00:02] no level here[1:2] INFO: after";
+	LogLine l2 = { s2.c_str(), 24 };
+	assert(!m.match(l2, indices, 3, columns));
+	printf("matcher: ok\n");
+}
+
+static void benchmark()
+{
+	auto n = 1000000;
+	{
+		std::ofstream f(log_filename, std::ios::binary);
+		std::string chunk;
+		for (auto i = 0; i < n; i++)
+		{
+			chunk += make_line(i);
+			chunk += '\n';
+			if (chunk.size() > 1024 * 1024)
+			{
+				f << chunk;
+				chunk.clear();
+			}
+		}
+		f << chunk;
+	}
+
+	for (auto threads : { 1, 0 })
+	{
+		LogIndex idx;
+		auto t0 = get_now_ns();
+		idx.open(log_filename, threads);
+		auto t1 = get_now_ns();
+		assert(idx.get_line_count() == n);
+		printf("index %.1fMB, %d lines, %s: %.3fms, %zu bytes of offsets\n", idx.get_size() / 1048576.0, n,
+			threads == 1 ? "1 thread" : "all cores", (t1 - t0) / 1000000.0, n * sizeof(long long));
+	}
+
+	// a visible page is what gets matched
+	LogIndex idx;
+	idx.open(log_filename);
+	LogMatcher m;
+	m.compile(R"((\[[\w\s:]+\])[\s]*(INFO|DEBUG|WARNING|ERROR)[:\s]*(.*))");
+	int indices[] = { 1, 2, 3 };
+	std::string columns[3];
+	auto t0 = get_now_ns();
+	for (auto i = 0; i < 50; i++)
+		assert(m.match(idx.get_line(n / 2 + i), indices, 3, columns));
+	auto t1 = get_now_ns();
+	printf("match a page of 50 lines: %.3fms\n", (t1 - t0) / 1000000.0);
+
+	idx.close();
+	remove(log_filename);
+}
+
+int main(int argc, char **args)
+{
+	test_index();
+	test_matcher();
+	benchmark();
+
+	return 0;
+}
@@ -0,0 +1,311 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/time.h>
+#include <flame/math.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace flame;
+
+static float rand_float()
+{
+	return ::rand() / (float)RAND_MAX * 2.f - 1.f;
+}
+
+static Mat4 rand_mat4()
+{
+	Mat4 m;
+	for (auto i = 0; i < 4; i++)
+		m[i] = Vec4(rand_float(), rand_float(), rand_float(), rand_float());
+	return m;
+}
+
+static Quat rand_quat()
+{
+	Quat q(rand_float(), rand_float(), rand_float(), rand_float());
+	q.normalize();
+	return q;
+}
+
+// with fma contraction the compiler may fuse the scalar and the simd code differently,
+// then we can only ask for the results to be close, otherwise they must be the same bits,
+// the inverse gets a looser bound because of the cancellation in the ill-conditioned matrices
+#if defined(__FMA__)
+static const float tolerance = 1e-5f;
+static const float inverse_tolerance = 1e-3f;
+#else
+static const float tolerance = 0.f;
+static const float inverse_tolerance = 0.f;
+#endif
+
+static int fail_count = 0;
+
+static void check(const char *name, const float *a, const float *b, int n, float tol = tolerance)
+{
+	auto scale = 1.f;
+	for (auto i = 0; i < n; i++)
+		scale = max(scale, flame::abs(b[i]));
+	for (auto i = 0; i < n; i++)
+	{
+		if (flame::abs(a[i] - b[i]) > tol * scale && !(a[i] != a[i] && b[i] != b[i]))
+		{
+			printf("%s: mismatch at %d, %.9g vs %.9g\n", name, i, a[i], b[i]);
+			fail_count++;
+			return;
+		}
+	}
+}
+
+static void test_exactness()
+{
+	const auto N = 10000;
+
+	for (auto i = 0; i < N; i++)
+	{
+		auto a = rand_mat4();
+		auto b = rand_mat4();
+		Vec4 v4(rand_float(), rand_float(), rand_float(), rand_float());
+		Vec3 v3(rand_float(), rand_float(), rand_float());
+
+		Mat4 ref;
+		math_detail::mat4_mul_scalar(a, b, ref);
+		auto res = a * b;
+		check("mat4 * mat4", &res[0].x, &ref[0].x, 16);
+
+		Vec4 ref_v4;
+		math_detail::mat4_mul_vec4_scalar(a, v4, ref_v4);
+		auto res_v4 = a * v4;
+		check("mat4 * vec4", &res_v4.x, &ref_v4.x, 4);
+
+		Vec3 ref_v3;
+		math_detail::mat4_mul_vec3_scalar(a, v3, ref_v3);
+		auto res_v3 = a * v3;
+		check("mat4 * vec3", &res_v3.x, &ref_v3.x, 3);
+
+		math_detail::mat4_transpose_scalar(a, ref);
+		res = a.get_transpose();
+		check("transpose", &res[0].x, &ref[0].x, 16);
+
+		math_detail::mat4_inverse_scalar(a, ref);
+		res = a.get_inverse();
+		check("inverse", &res[0].x, &ref[0].x, 16, inverse_tolerance);
+	}
+
+	// the scalar reference itself, m * m^-1 must be close to identity
+	for (auto i = 0; i < 100; i++)
+	{
+		auto a = rand_mat4();
+		Mat4 inv, id;
+		math_detail::mat4_inverse_scalar(a, inv);
+		math_detail::mat4_mul_scalar(a, inv, id);
+		for (auto c = 0; c < 4; c++)
+		{
+			for (auto r = 0; r < 4; r++)
+			{
+				if (flame::abs(id[c][r] - (c == r ? 1.f : 0.f)) > 1e-2f)
+				{
+					printf("inverse: m * m^-1 is not identity\n");
+					fail_count++;
+					c = 4;
+					break;
+				}
+			}
+		}
+	}
+
+	// rotating by q1 * q2 is rotating by q2 and then by q1
+	for (auto i = 0; i < 100; i++)
+	{
+		auto q1 = rand_quat();
+		auto q2 = rand_quat();
+		Mat3 m1, m2, m12;
+		math_detail::quat_to_mat3(q1, m1);
+		math_detail::quat_to_mat3(q2, m2);
+		math_detail::quat_to_mat3(q1 * q2, m12);
+		auto m = m1 * m2;
+		for (auto c = 0; c < 3; c++)
+		{
+			for (auto r = 0; r < 3; r++)
+			{
+				if (flame::abs(m[c][r] - m12[c][r]) > 1e-4f)
+				{
+					printf("quat * quat: does not match the matrix product\n");
+					fail_count++;
+					c = 3;
+					break;
+				}
+			}
+		}
+	}
+
+	// the batched versions, odd counts so that the tails are covered
+	const auto M = 1003;
+	std::vector<Vec3> points(M), points_ref(M), points_out(M);
+	std::vector<Vec4> vec4s(M), vec4s_ref(M), vec4s_out(M);
+	std::vector<Mat4> lhs(M), rhs(M), mats_ref(M), mats_out(M);
+	std::vector<Quat> quats(M);
+	std::vector<Mat3> mat3s_ref(M), mat3s_out(M);
+	auto m = rand_mat4();
+	for (auto i = 0; i < M; i++)
+	{
+		points[i] = Vec3(rand_float(), rand_float(), rand_float());
+		vec4s[i] = Vec4(rand_float(), rand_float(), rand_float(), rand_float());
+		lhs[i] = rand_mat4();
+		rhs[i] = rand_mat4();
+		quats[i] = rand_quat();
+
+		math_detail::mat4_mul_vec3_scalar(m, points[i], points_ref[i]);
+		math_detail::mat4_mul_vec4_scalar(m, vec4s[i], vec4s_ref[i]);
+		math_detail::mat4_mul_scalar(lhs[i], rhs[i], mats_ref[i]);
+		math_detail::quat_to_mat3(quats[i], mat3s_ref[i]);
+	}
+
+	transform_points(m, points.data(), points_out.data(), M);
+	check("transform_points", &points_out[0].x, &points_ref[0].x, M * 3);
+	transform_vec4s(m, vec4s.data(), vec4s_out.data(), M);
+	check("transform_vec4s", &vec4s_out[0].x, &vec4s_ref[0].x, M * 4);
+	mul_mat4s(lhs.data(), rhs.data(), mats_out.data(), M);
+	check("mul_mat4s", &mats_out[0][0].x, &mats_ref[0][0].x, M * 16);
+	quats_to_mat3s(quats.data(), mat3s_out.data(), M);
+	check("quats_to_mat3s", &mat3s_out[0][0].x, &mat3s_ref[0][0].x, M * 9);
+
+	// in place
+	transform_points(m, points.data(), points.data(), M);
+	check("transform_points in place", &points[0].x, &points_ref[0].x, M * 3);
+	mul_mat4s(lhs.data(), rhs.data(), lhs.data(), M);
+	check("mul_mat4s in place", &lhs[0][0].x, &mats_ref[0][0].x, M * 16);
+}
+
+template<class F>
+static double time_ms(int rounds, F f)
+{
+	auto t0 = get_now_ns();
+	for (auto i = 0; i < rounds; i++)
+		f();
+	return (get_now_ns() - t0) / 1000000.0;
+}
+
+static volatile float sink;
+
+static void benchmark()
+{
+	const auto N = 100000;
+	const auto R = 20;
+
+	std::vector<Vec3> points(N), points_out(N);
+	std::vector<Vec4> vec4s(N), vec4s_out(N);
+	std::vector<Mat4> lhs(N), rhs(N), mats_out(N);
+	std::vector<Quat> quats(N);
+	std::vector<Mat3> mat3s_out(N);
+	auto m = rand_mat4();
+	for (auto i = 0; i < N; i++)
+	{
+		points[i] = Vec3(rand_float(), rand_float(), rand_float());
+		vec4s[i] = Vec4(rand_float(), rand_float(), rand_float(), rand_float());
+		lhs[i] = rand_mat4();
+		rhs[i] = rand_mat4();
+		quats[i] = rand_quat();
+	}
+
+	printf("%d elements x %d rounds     scalar      simd/batched\n", N, R);
+
+	auto t_scalar = time_ms(R, [&]() {
+		for (auto i = 0; i < N; i++)
+			math_detail::mat4_mul_scalar(lhs[i], rhs[i], mats_out[i]);
+		sink = mats_out[N - 1][3][3];
+	});
+	auto t_simd = time_ms(R, [&]() {
+		mul_mat4s(lhs.data(), rhs.data(), mats_out.data(), N);
+		sink = mats_out[N - 1][3][3];
+	});
+	printf("mat4 * mat4        %10.3fms %10.3fms\n", t_scalar, t_simd);
+
+	t_scalar = time_ms(R, [&]() {
+		for (auto i = 0; i < N; i++)
+			math_detail::mat4_inverse_scalar(lhs[i], mats_out[i]);
+		sink = mats_out[N - 1][3][3];
+	});
+	t_simd = time_ms(R, [&]() {
+		for (auto i = 0; i < N; i++)
+			mats_out[i] = lhs[i].get_inverse();
+		sink = mats_out[N - 1][3][3];
+	});
+	printf("mat4 inverse       %10.3fms %10.3fms\n", t_scalar, t_simd);
+
+	t_scalar = time_ms(R, [&]() {
+		for (auto i = 0; i < N; i++)
+			math_detail::mat4_mul_vec3_scalar(m, points[i], points_out[i]);
+		sink = points_out[N - 1].x;
+	});
+	t_simd = time_ms(R, [&]() {
+		transform_points(m, points.data(), points_out.data(), N);
+		sink = points_out[N - 1].x;
+	});
+	printf("transform points   %10.3fms %10.3fms\n", t_scalar, t_simd);
+
+	t_scalar = time_ms(R, [&]() {
+		for (auto i = 0; i < N; i++)
+			math_detail::mat4_mul_vec4_scalar(m, vec4s[i], vec4s_out[i]);
+		sink = vec4s_out[N - 1].x;
+	});
+	t_simd = time_ms(R, [&]() {
+		transform_vec4s(m, vec4s.data(), vec4s_out.data(), N);
+		sink = vec4s_out[N - 1].x;
+	});
+	printf("transform vec4s    %10.3fms %10.3fms\n", t_scalar, t_simd);
+
+	t_scalar = time_ms(R, [&]() {
+		for (auto i = 0; i < N; i++)
+			math_detail::quat_to_mat3(quats[i], mat3s_out[i]);
+		sink = mat3s_out[N - 1][2][2];
+	});
+	t_simd = time_ms(R, [&]() {
+		quats_to_mat3s(quats.data(), mat3s_out.data(), N);
+		sink = mat3s_out[N - 1][2][2];
+	});
+	printf("quat to mat3       %10.3fms %10.3fms\n", t_scalar, t_simd);
+}
+
+int main(int argc, char **args)
+{
+#if defined(FLAME_MATH_AVX)
+	printf("back end: avx\n");
+#elif defined(FLAME_MATH_SSE)
+	printf("back end: sse\n");
+#elif defined(FLAME_MATH_NEON)
+	printf("back end: neon\n");
+#else
+	printf("back end: scalar\n");
+#endif
+
+	test_exactness();
+	printf(fail_count == 0 ? "exactness: ok\n" : "exactness: %d failed\n", fail_count);
+
+	benchmark();
+
+	return fail_count == 0 ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/time.h>
+#include <flame/graphics/device.h>
+#include <flame/graphics/buffer.h>
+#include <flame/graphics/texture.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+
+// no window is needed, so this runs on a software ICD (e.g. swiftshader or lavapipe) as well
+static void print_stats(flame::graphics::Device *d, const char *title)
+{
+	flame::graphics::MemoryStats s;
+	flame::graphics::get_memory_stats(d, &s);
+	printf("%s: reserved %lldKB, used %lldKB, %d blocks, %d dedicated, %d allocations, fragmentation %.2f\n", title,
+		s.bytes_reserved / 1024, s.bytes_used / 1024, s.block_count, s.dedicated_count, s.allocation_count, s.fragmentation);
+}
+
+int main(int argc, char **args)
+{
+	using namespace flame;
+	using namespace graphics;
+
+	auto d = create_device(false);
+
+	const auto N = 10000;
+
+	// thousands of small uniform buffers, used to be one vkAllocateMemory each
+	std::vector<Buffer*> buffers(N);
+	auto t0 = get_now_ns();
+	for (auto i = 0; i < N; i++)
+		buffers[i] = create_buffer(d, 256 + (i % 7) * 64, BufferUsageUniformBuffer | BufferUsageTransferDst, MemPropHost | MemPropHostCoherent);
+	auto t1 = get_now_ns();
+	printf("create %d buffers: %.3fms\n", N, (t1 - t0) / 1000000.0);
+	print_stats(d, "after create");
+
+	MemoryStats s;
+	get_memory_stats(d, &s);
+	assert(s.allocation_count == N);
+	assert(s.block_count < 10);
+
+	// every buffer gets its own bytes, even though they share the mapping of a block
+	for (auto i = 0; i < N; i++)
+	{
+		buffers[i]->map();
+		memset(buffers[i]->mapped, i & 0xff, buffers[i]->size);
+	}
+	for (auto i = 0; i < N; i++)
+	{
+		auto p = (unsigned char*)buffers[i]->mapped;
+		for (auto j = 0; j < buffers[i]->size; j++)
+			assert(p[j] == (i & 0xff));
+		buffers[i]->unmap();
+	}
+
+	// free every other buffer and fill the holes with textures and a big one that goes dedicated
+	for (auto i = 0; i < N; i += 2)
+	{
+		destroy_buffer(d, buffers[i]);
+		buffers[i] = nullptr;
+	}
+	print_stats(d, "after free half");
+
+	auto t = create_texture(d, Ivec2(256), 1, 1, Format_R8G8B8A8_UNORM, TextureUsageShaderSampled | TextureUsageTransferDst, MemPropDevice);
+	auto big = create_buffer(d, 128 * 1024 * 1024, BufferUsageStorageBuffer, MemPropDevice);
+	print_stats(d, "after texture and big buffer");
+
+	destroy_texture(d, t);
+	destroy_buffer(d, big);
+	for (auto b : buffers)
+	{
+		if (b)
+			destroy_buffer(d, b);
+	}
+	print_stats(d, "after free all");
+
+	get_memory_stats(d, &s);
+	assert(s.allocation_count == 0);
+	assert(s.bytes_used == 0);
+	assert(s.dedicated_count == 0);
+
+	// the transient ring, linear within a frame and reused when the frame comes around again
+	TransientRange first;
+	begin_transient_frame(d, 0);
+	auto ok = allocate_transient(d, 1000, 256, &first);
+	assert(ok && first.offset == 0);
+	TransientRange r;
+	ok = allocate_transient(d, 1000, 256, &r);
+	assert(ok && r.offset == 1024);
+	begin_transient_frame(d, 1);
+	ok = allocate_transient(d, 1000, 256, &r);
+	assert(ok && r.buffer == first.buffer && r.offset == 4 * 1024 * 1024);
+	// past the slice, it grows by a buffer of its own and the slice keeps serving what fits
+	ok = allocate_transient(d, 8 * 1024 * 1024, 256, &r);
+	assert(ok && r.buffer != first.buffer && r.offset == 0);
+	ok = allocate_transient(d, 1000, 256, &r);
+	assert(ok && r.buffer == first.buffer && r.offset == 4 * 1024 * 1024 + 1024);
+	begin_transient_frame(d, 3);
+	ok = allocate_transient(d, 1000, 256, &r);
+	assert(ok && r.offset == 0);
+
+	// a little more than a slice holds every frame, the rest goes to overflow buffers
+	const auto per_frame = 20000;
+	t0 = get_now_ns();
+	for (auto f = 0; f < 100; f++)
+	{
+		begin_transient_frame(d, f);
+		for (auto i = 0; i < per_frame; i++)
+		{
+			ok = allocate_transient(d, 256, 256, &r);
+			assert(ok);
+		}
+	}
+	t1 = get_now_ns();
+	printf("%d transient allocations: %.3fms\n", 100 * per_frame, (t1 - t0) / 1000000.0);
+
+	destroy_device(d);
+
+	printf("ok\n");
+
+	return 0;
+}
@@ -0,0 +1,195 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/time.h>
+#include <flame/mesh.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+
+struct Position
+{
+	float v[3];
+
+	float operator[](int i) const
+	{
+		return v[i];
+	}
+};
+
+// a bumpy grid with every triangle owning its vertexs, like what comes out of an OBJ importer
+static void make_grid(int triangle_count, std::vector<Position> &positions)
+{
+	auto n = 1;
+	while (n * n * 2 < triangle_count)
+		n++;
+	positions.clear();
+	auto p = [&](int x, int z) {
+		Position r;
+		r.v[0] = x * 0.1f;
+		r.v[1] = ((x * 7 + z * 13) % 5) * 0.01f;
+		r.v[2] = z * 0.1f;
+		return r;
+	};
+	for (auto z = 0; z < n; z++)
+	{
+		for (auto x = 0; x < n; x++)
+		{
+			if ((int)positions.size() / 3 >= triangle_count)
+				return;
+			positions.push_back(p(x, z)); positions.push_back(p(x, z + 1)); positions.push_back(p(x + 1, z));
+			if ((int)positions.size() / 3 >= triangle_count)
+				return;
+			positions.push_back(p(x + 1, z)); positions.push_back(p(x, z + 1)); positions.push_back(p(x + 1, z + 1));
+		}
+	}
+}
+
+static bool same(const Position &a, const Position &b, float eps)
+{
+	for (auto i = 0; i < 3; i++)
+	{
+		auto d = a.v[i] - b.v[i];
+		if (!(d < eps && -d < eps))
+			return false;
+	}
+	return true;
+}
+
+// the O(n^2) versions that the welder and the edge map replace
+static void weld_naive(const std::vector<Position> &positions, float eps, std::vector<int> &remap, std::vector<Position> &unique)
+{
+	for (auto &v : positions)
+	{
+		auto idx = -1;
+		for (auto k = 0; k < (int)unique.size(); k++)
+		{
+			if (same(unique[k], v, eps))
+			{
+				idx = k;
+				break;
+			}
+		}
+		if (idx == -1)
+		{
+			idx = unique.size();
+			unique.push_back(v);
+		}
+		remap.push_back(idx);
+	}
+}
+
+static void adjacency_naive(const int *indices, int triangle_count, std::pair<int, int> *adj)
+{
+	for (auto i = 0; i < triangle_count * 3; i++)
+		adj[i] = { -1, -1 };
+	for (auto i = 0; i < triangle_count; i++)
+	{
+		for (auto j = 0; j < 3; j++)
+		{
+			if (adj[i * 3 + j].first != -1)
+				continue;
+			auto i0 = indices[i * 3 + j];
+			auto i1 = indices[i * 3 + (j + 1) % 3];
+			auto ok = false;
+			for (auto k = 0; k < triangle_count && !ok; k++)
+			{
+				if (i == k)
+					continue;
+				for (auto l = 0; l < 3; l++)
+				{
+					if (adj[k * 3 + l].first == -1 && indices[k * 3 + l] == i1 && indices[k * 3 + (l + 1) % 3] == i0)
+					{
+						adj[k * 3 + l] = { i, (j + 2) % 3 };
+						adj[i * 3 + j] = { k, (l + 2) % 3 };
+						ok = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char **args)
+{
+	using namespace flame;
+
+	const auto eps = 0.000001f;
+
+	// exactness against the linear scans
+	{
+		std::vector<Position> positions;
+		make_grid(2000, positions);
+		// some points that are within eps of each other, and some that are just outside
+		positions.push_back({ 0.f, 0.f, 0.0000005f });
+		positions.push_back({ 0.f, 0.f, 0.0000015f });
+		positions.push_back({ 0.0000009f, 0.f, 0.f });
+
+		std::vector<int> remap_a;
+		std::vector<Position> unique_a;
+		weld_naive(positions, eps, remap_a, unique_a);
+
+		std::vector<int> remap_b(positions.size());
+		auto unique_b = weld_vertexs<Position, 3>(positions.data(), positions.size(), eps, remap_b.data());
+		assert(unique_a.size() == unique_b.size());
+		assert(remap_a == remap_b);
+
+		auto tc = (int)remap_a.size() / 3;
+		std::vector<std::pair<int, int>> adj_a(tc * 3), adj_b(tc * 3);
+		adjacency_naive(remap_a.data(), tc, adj_a.data());
+		build_triangle_adjacency(remap_b.data(), tc, adj_b.data());
+		assert(adj_a == adj_b);
+
+		printf("exactness: ok (%d vertexs -> %d unique)\n", (int)positions.size(), (int)unique_b.size());
+	}
+
+	printf("%10s %12s %12s %14s\n", "triangles", "weld(ms)", "adjacency(ms)", "naive weld(ms)");
+	for (auto tc = 1000; tc <= 1000000; tc *= 10)
+	{
+		std::vector<Position> positions;
+		make_grid(tc, positions);
+
+		std::vector<int> remap(positions.size());
+		auto t0 = get_now_ns();
+		auto unique = weld_vertexs<Position, 3>(positions.data(), positions.size(), eps, remap.data());
+		auto t1 = get_now_ns();
+		std::vector<std::pair<int, int>> adj(tc * 3);
+		build_triangle_adjacency(remap.data(), tc, adj.data());
+		auto t2 = get_now_ns();
+
+		if (tc <= 10000)
+		{
+			std::vector<int> remap_n;
+			std::vector<Position> unique_n;
+			auto t3 = get_now_ns();
+			weld_naive(positions, eps, remap_n, unique_n);
+			auto t4 = get_now_ns();
+			printf("%10d %12.3f %12.3f %14.3f\n", tc, (t1 - t0) / 1000000.0, (t2 - t1) / 1000000.0, (t4 - t3) / 1000000.0);
+		}
+		else
+			printf("%10d %12.3f %12.3f %14s\n", tc, (t1 - t0) / 1000000.0, (t2 - t1) / 1000000.0, "-");
+	}
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/time.h>
+#include <flame/filesystem.h>
+#include <flame/model/model.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+// compare the load time of the assimp path and the cooked path, the files are cooked and loaded again, so the cooked
+// load is a warm one (the file was just written and is in the file cache)
+// for the cold numbers, run it again with -cooked after a reboot (or after the file cache is flushed), it loads the
+// .fmdl files that the first run left, without cooking
+// usage: model_test [-cooked] [files...], res/cube.dae when no file is given, pass a large rigged mesh for the bones
+// and the animations
+int main(int argc, char **args)
+{
+	using namespace flame;
+
+	auto cooked_only = false;
+	std::vector<std::string> filenames;
+	for (auto i = 1; i < argc; i++)
+	{
+		if (strcmp(args[i], "-cooked") == 0)
+			cooked_only = true;
+		else
+			filenames.push_back(args[i]);
+	}
+	if (filenames.empty())
+		filenames.push_back("res/cube.dae");
+
+	ModelDescription desc;
+	desc.set_to_default();
+
+	auto failed = 0;
+	for (auto &fn : filenames)
+	{
+		auto cooked_fn = fn + ".fmdl";
+
+		if (cooked_only)
+		{
+			auto t0 = get_now_ns();
+			auto cm = load_model(&desc, cooked_fn.c_str());
+			auto t1 = get_now_ns();
+			if (!cm || !cm->cooked_file)
+			{
+				printf("%s: cannot load the cooked file\n", cooked_fn.c_str());
+				failed++;
+				if (cm)
+					destroy_model(cm);
+				continue;
+			}
+			printf("%s: %d vertexs, %d indices, %d bones, %d animations\n", cooked_fn.c_str(), cm->vertex_count, cm->indice_count, cm->bone_count, cm->animation_count);
+			printf("  cooked (cold if the cache was flushed): %.3fms\n", (t1 - t0) / 1000000.0);
+			destroy_model(cm);
+			continue;
+		}
+
+		std::filesystem::remove(cooked_fn);
+
+		auto t0 = get_now_ns();
+		auto m = load_model(&desc, fn.c_str());
+		auto t1 = get_now_ns();
+		if (!m)
+		{
+			printf("%s: cannot load\n", fn.c_str());
+			failed++;
+			continue;
+		}
+
+		save_model(m, cooked_fn.c_str());
+
+		auto t2 = get_now_ns();
+		auto cm = load_model(&desc, fn.c_str());
+		auto t3 = get_now_ns();
+		if (!cm || !cm->cooked_file)
+		{
+			printf("%s: the cooked file is not used\n", fn.c_str());
+			failed++;
+			if (cm)
+				destroy_model(cm);
+			destroy_model(m);
+			continue;
+		}
+
+		auto ok = cm->vertex_count == m->vertex_count && cm->indice_count == m->indice_count &&
+			cm->bone_count == m->bone_count && cm->animation_count == m->animation_count &&
+			cm->vertex_buffer_count == m->vertex_buffer_count;
+		for (auto i = 0; ok && i < m->vertex_buffer_count; i++)
+			ok = memcmp(cm->vertex_buffers[i].pVertex, m->vertex_buffers[i].pVertex, m->vertex_count * m->vertex_buffers[i].size * sizeof(float)) == 0;
+		if (!ok)
+			failed++;
+
+		printf("%s: %d vertexs, %d indices, %d bones, %d animations\n", fn.c_str(), m->vertex_count, m->indice_count, m->bone_count, m->animation_count);
+		printf("  assimp: %.3fms\n", (t1 - t0) / 1000000.0);
+		printf("  cooked (warm): %.3fms (geometry blob %lld bytes) %s\n", (t3 - t2) / 1000000.0, cm->geometry_size, ok ? "" : "MISMATCH");
+
+		destroy_model(cm);
+		destroy_model(m);
+	}
+
+	if (failed)
+		printf("%d file(s) failed\n", failed);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,276 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/profiler.h>
+#include <flame/time.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
+using namespace flame;
+
+static const ProfileFrame *last_frame()
+{
+	return profile_get_frame(profile_get_frame_count() - 1);
+}
+
+static void test_nesting()
+{
+	profile_clear();
+	profile_set_thread_name("main");
+
+	profile_begin_frame();
+	{
+		FLAME_PROFILE("update");
+		{
+			FLAME_PROFILE("physics");
+		}
+		{
+			FLAME_PROFILE("animation");
+		}
+	}
+	{
+		FLAME_PROFILE("render");
+	}
+	profile_end_frame();
+
+	auto f = last_frame();
+	assert(f->zones.size() == 4 && f->dropped == 0);
+	assert(f->begin <= f->end);
+	auto &update = f->zones[0];
+	assert(update.hash == CHASH("update") && strcmp(update.name, "update") == 0 && update.depth == 0);
+	assert(f->zones[1].hash == CHASH("physics") && f->zones[1].depth == 1);
+	assert(f->zones[2].hash == CHASH("animation") && f->zones[2].depth == 1);
+	assert(f->zones[3].hash == CHASH("render") && f->zones[3].depth == 0);
+	for (auto i = 1; i < 3; i++)
+		assert(f->zones[i].begin >= update.begin && f->zones[i].end <= update.end);
+	assert(strcmp(profile_get_thread_name(update.thread), "main") == 0);
+
+	// a zone open across the frame end belongs to the frame it ends in
+	profile_begin(CHASH("long"), "long");
+	profile_begin_frame();
+	profile_end_frame();
+	assert(last_frame()->zones.empty());
+	profile_begin_frame();
+	profile_end();
+	profile_end_frame();
+	assert(last_frame()->zones.size() == 1 && last_frame()->zones[0].hash == CHASH("long"));
+
+	// unbalanced ends are ignored
+	profile_end();
+	profile_begin_frame();
+	profile_end_frame();
+	assert(last_frame()->zones.empty());
+	printf("nesting: ok\n");
+}
+
+static void test_threads()
+{
+	profile_clear();
+	const int thread_count = 4;
+	const int zone_count = 2000;
+
+	std::atomic<int> finished(0);
+	std::vector<std::thread> workers;
+	for (auto i = 0; i < thread_count; i++)
+	{
+		workers.emplace_back([&, i]() {
+			profile_set_thread_name(("worker " + std::to_string(i)).c_str());
+			for (auto j = 0; j < zone_count; j++)
+			{
+				FLAME_PROFILE("job");
+				FLAME_PROFILE("inner");
+			}
+			finished++;
+		});
+	}
+
+	// collect while the workers record
+	int jobs = 0, inners = 0;
+	auto collect = [&]() {
+		profile_begin_frame();
+		profile_end_frame();
+		for (auto &z : last_frame()->zones)
+		{
+			if (z.hash == CHASH("job"))
+			{
+				assert(z.depth == 0);
+				jobs++;
+			}
+			else if (z.hash == CHASH("inner"))
+			{
+				assert(z.depth == 1);
+				inners++;
+			}
+			assert(z.thread != ProfileGpuThread);
+		}
+		assert(last_frame()->dropped == 0);
+	};
+	while (finished.load() < thread_count)
+	{
+		collect();
+		std::this_thread::yield();
+	}
+	for (auto &t : workers)
+		t.join();
+	collect();
+	assert(jobs == thread_count * zone_count && inners == thread_count * zone_count);
+
+	// the ended threads gave their slots back, a new thread takes one over
+	auto thread_count_before = profile_get_thread_count();
+	std::thread([]() {
+		FLAME_PROFILE("late");
+	}).join();
+	collect();
+	assert(profile_get_thread_count() == thread_count_before);
+	printf("threads: ok\n");
+}
+
+static void test_overflow()
+{
+	profile_clear();
+	profile_begin_frame();
+	for (auto i = 0; i < ProfileRingSize + 100; i++)
+	{
+		FLAME_PROFILE("spam");
+	}
+	profile_end_frame();
+	assert(last_frame()->zones.size() == ProfileRingSize && last_frame()->dropped == 100);
+
+	// the ring is usable again after the collect
+	profile_begin_frame();
+	{
+		FLAME_PROFILE("after");
+	}
+	profile_end_frame();
+	assert(last_frame()->zones.size() == 1 && last_frame()->dropped == 0);
+	printf("overflow: ok\n");
+}
+
+static void test_history_and_gpu()
+{
+	profile_clear();
+	auto first = profile_get_frame_index();
+	for (auto i = 0; i < ProfileHistoryFrames + 10; i++)
+	{
+		profile_begin_frame();
+		profile_end_frame();
+	}
+	assert(profile_get_frame_count() == ProfileHistoryFrames);
+	assert(profile_get_frame(0)->index == first + 10);
+	assert(last_frame()->index == first + ProfileHistoryFrames + 9);
+	for (auto i = 1; i < profile_get_frame_count(); i++)
+		assert(profile_get_frame(i)->index == profile_get_frame(i - 1)->index + 1);
+
+	// gpu results of a few frames ago
+	ProfileZone z[2];
+	z[0] = { CHASH("scene pass"), "scene pass", 0, 2000000, 0, 0 };
+	z[1] = { CHASH("shadow"), "shadow", 100000, 500000, 1, 0 };
+	auto index = profile_get_frame_index() - 3;
+	profile_add_gpu_zones(index, z, 2);
+	auto f = profile_get_frame(profile_get_frame_count() - 3);
+	assert(f->index == index && f->gpu_zones.size() == 2 && f->gpu_zones[1].thread == ProfileGpuThread);
+	// too old or not ended yet
+	profile_add_gpu_zones(first, z, 2);
+	profile_add_gpu_zones(profile_get_frame_index(), z, 2);
+	auto gpu_zone_count = 0;
+	for (auto i = 0; i < profile_get_frame_count(); i++)
+		gpu_zone_count += profile_get_frame(i)->gpu_zones.size();
+	assert(gpu_zone_count == 2);
+	printf("history and gpu: ok\n");
+}
+
+static int count(const std::string &s, const char *what)
+{
+	auto n = 0;
+	for (auto p = s.find(what); p != std::string::npos; p = s.find(what, p + 1))
+		n++;
+	return n;
+}
+
+static void test_chrome_trace()
+{
+	profile_clear();
+	for (auto i = 0; i < 3; i++)
+	{
+		profile_begin_frame();
+		{
+			FLAME_PROFILE("frame \"work\"");
+		}
+		profile_end_frame();
+	}
+	ProfileZone z = { CHASH("pass"), "pass", 0, 1000, 0, 0 };
+	profile_add_gpu_zones(profile_get_frame_index() - 1, &z, 1);
+
+	assert(profile_save_chrome_trace("profiler_test.json"));
+	std::ifstream file("profiler_test.json");
+	std::stringstream ss;
+	ss << file.rdbuf();
+	auto s = ss.str();
+	// 3 frame zones, 3 cpu zones and 1 gpu zone
+	assert(count(s, "\"ph\":\"X\"") == 7);
+	assert(count(s, "\"ph\":\"M\"") == profile_get_thread_count() + 2);
+	assert(count(s, "frame \\\"work\\\"") == 3);
+	assert(count(s, "{") == count(s, "}") && count(s, "[") == count(s, "]"));
+	assert(s.find("{\"traceEvents\":[") == 0);
+	file.close();
+	remove("profiler_test.json");
+	printf("chrome trace: ok\n");
+}
+
+static void benchmark()
+{
+	profile_clear();
+	const int n = 1000000;
+	auto t0 = get_now_ns();
+	for (auto i = 0; i < n; i++)
+	{
+		if (i % 4096 == 0)
+		{
+			profile_end_frame();
+			profile_begin_frame();
+		}
+		FLAME_PROFILE("bench");
+	}
+	auto t1 = get_now_ns();
+	profile_end_frame();
+	printf("%.1fns per zone (begin, end and collect)\n", double(t1 - t0) / n);
+}
+
+int main(int argc, char **args)
+{
+	test_nesting();
+	test_threads();
+	test_overflow();
+	test_history_and_gpu();
+	test_chrome_trace();
+	benchmark();
+
+	return 0;
+}
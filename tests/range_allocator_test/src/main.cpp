@@ -0,0 +1,216 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/range_allocator.h>
+
+// the checks run in release builds too
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <random>
+
+using namespace flame;
+
+static void test_allocate()
+{
+	RangeAllocator a(1024);
+	assert(a.get_capacity() == 1024 && a.get_used() == 0);
+	assert(a.get_free_range_count() == 1 && a.get_largest_free_range() == 1024);
+
+	// first fit, in address order
+	auto o0 = a.allocate(100);
+	auto o1 = a.allocate(200);
+	auto o2 = a.allocate(24);
+	assert(o0 == 0 && o1 == 100 && o2 == 300);
+	assert(a.get_used() == 324);
+	assert(a.get_free_range_count() == 1 && a.get_largest_free_range() == 700);
+
+	auto o3 = a.allocate(0);
+	assert(o3 == 0 && a.get_used() == 324);
+
+	printf("allocate: ok\n");
+}
+
+static void test_alignment()
+{
+	RangeAllocator a(1024);
+	auto o0 = a.allocate(10);
+	assert(o0 == 0);
+
+	// the padding before an aligned range stays free
+	auto o1 = a.allocate(64, 256);
+	assert(o1 == 256);
+	assert(a.get_used() == 74);
+	assert(a.get_free_range_count() == 2);
+
+	// and is used by a later allocation that fits in it
+	auto o2 = a.allocate(100, 4);
+	assert(o2 == 12);
+	auto o3 = a.allocate(16, 16);
+	assert(o3 == 112);
+
+	// an alignment that does not fit in any range
+	auto o4 = a.allocate(1, 2048);
+	assert(o4 == -1);
+	assert(a.get_used() == 190);
+
+	printf("alignment: ok\n");
+}
+
+static void test_free()
+{
+	RangeAllocator a(400);
+	auto o0 = a.allocate(100);
+	auto o1 = a.allocate(100);
+	auto o2 = a.allocate(100);
+	auto o3 = a.allocate(100);
+	assert(a.get_free_range_count() == 0 && a.get_used() == 400);
+	assert(a.get_fragmentation() == 0.f);
+
+	// no neighbors are free
+	a.free(o1, 100);
+	assert(a.get_free_range_count() == 1 && a.get_largest_free_range() == 100);
+	a.free(o3, 100);
+	assert(a.get_free_range_count() == 2 && a.get_largest_free_range() == 100);
+	assert(a.get_fragmentation() == 0.5f);
+
+	// merges with the free range before and after it
+	a.free(o2, 100);
+	assert(a.get_free_range_count() == 1 && a.get_largest_free_range() == 300);
+	assert(a.get_fragmentation() == 0.f);
+
+	// merges with the free range after it only
+	a.free(o0, 100);
+	assert(a.get_free_range_count() == 1 && a.get_largest_free_range() == 400);
+	assert(a.get_used() == 0);
+
+	auto o4 = a.allocate(400);
+	assert(o4 == 0);
+
+	printf("free: ok\n");
+}
+
+static void test_out_of_space()
+{
+	RangeAllocator a(256);
+	auto o0 = a.allocate(128);
+	auto o1 = a.allocate(64);
+	auto o2 = a.allocate(64);
+	assert(o0 == 0 && o1 == 128 && o2 == 192);
+
+	auto o3 = a.allocate(1);
+	assert(o3 == -1);
+	assert(a.get_used() == 256);
+
+	// enough free in total, but not in one piece
+	a.free(o0, 64);
+	a.free(o1, 64);
+	assert(a.get_used() == 128 && a.get_free_range_count() == 2);
+	o3 = a.allocate(128);
+	assert(o3 == -1);
+	assert(a.get_used() == 128);
+
+	// grow keeps the allocations and merges with the free range at the end
+	a.free(o2, 64);
+	a.grow(512);
+	assert(a.get_capacity() == 512 && a.get_used() == 64);
+	assert(a.get_free_range_count() == 2 && a.get_largest_free_range() == 384);
+	o3 = a.allocate(384);
+	assert(o3 == 128);
+
+	RangeAllocator empty;
+	auto o4 = empty.allocate(1);
+	assert(o4 == -1);
+
+	a.reset(64);
+	assert(a.get_capacity() == 64 && a.get_used() == 0 && a.get_free_range_count() == 1);
+
+	printf("out of space: ok\n");
+}
+
+// random allocations against a map of the bytes
+static void test_random()
+{
+	const auto capacity = 4096;
+	RangeAllocator a(capacity);
+	std::vector<int> owner(capacity, -1);
+	struct Live
+	{
+		long long offset;
+		long long size;
+	};
+	std::vector<Live> live;
+	std::mt19937 rng(3);
+
+	for (auto step = 0; step < 20000; step++)
+	{
+		if (live.empty() || rng() % 3 != 0)
+		{
+			auto size = 1 + (long long)(rng() % 200);
+			auto alignment = 1ll << (rng() % 6);
+			auto offset = a.allocate(size, alignment);
+			if (offset == -1)
+				continue;
+			assert(offset % alignment == 0 && offset + size <= capacity);
+			for (auto i = offset; i < offset + size; i++)
+			{
+				assert(owner[i] == -1);
+				owner[i] = step;
+			}
+			live.push_back({ offset, size });
+		}
+		else
+		{
+			auto idx = rng() % live.size();
+			auto l = live[idx];
+			live[idx] = live.back();
+			live.pop_back();
+			for (auto i = l.offset; i < l.offset + l.size; i++)
+				owner[i] = -1;
+			a.free(l.offset, l.size);
+		}
+
+		long long used = 0;
+		for (auto &l : live)
+			used += l.size;
+		assert(a.get_used() == used);
+	}
+
+	for (auto &l : live)
+		a.free(l.offset, l.size);
+	assert(a.get_used() == 0 && a.get_free_range_count() == 1 && a.get_largest_free_range() == capacity);
+
+	printf("random: ok\n");
+}
+
+int main(int argc, char **args)
+{
+	test_allocate();
+	test_alignment();
+	test_free();
+	test_out_of_space();
+	test_random();
+
+	return 0;
+}
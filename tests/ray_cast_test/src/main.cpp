@@ -0,0 +1,341 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/time.h>
+#include <flame/ray_cast.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <random>
+#include <math.h>
+
+using namespace flame;
+
+static std::mt19937 rng(1);
+
+struct Mesh
+{
+	std::vector<Vec3> positions;
+	std::vector<int> indices;
+};
+
+// a uv sphere with some noise on the radius, plus a few loose triangles inside
+static Mesh make_mesh(int rings, int segments)
+{
+	Mesh m;
+	std::uniform_real_distribution<float> noise(0.9f, 1.1f);
+	for (auto i = 0; i <= rings; i++)
+	{
+		auto phi = 3.1415926f * i / rings;
+		for (auto j = 0; j < segments; j++)
+		{
+			auto theta = 2.f * 3.1415926f * j / segments;
+			auto r = noise(rng);
+			m.positions.push_back(Vec3(r * sinf(phi) * cosf(theta), r * cosf(phi), r * sinf(phi) * sinf(theta)));
+		}
+	}
+	for (auto i = 0; i < rings; i++)
+	{
+		for (auto j = 0; j < segments; j++)
+		{
+			auto a = i * segments + j;
+			auto b = i * segments + (j + 1) % segments;
+			auto c = a + segments;
+			auto d = b + segments;
+			int quad[] = { a, c, b, b, c, d };
+			m.indices.insert(m.indices.end(), quad, quad + 6);
+		}
+	}
+	std::uniform_real_distribution<float> inner(-0.5f, 0.5f);
+	for (auto i = 0; i < 50; i++)
+	{
+		for (auto j = 0; j < 3; j++)
+		{
+			m.indices.push_back(m.positions.size());
+			m.positions.push_back(Vec3(inner(rng), inner(rng), inner(rng)));
+		}
+	}
+	return m;
+}
+
+static bool brute_force(const Mesh &m, const Ray &r, float t_max, RayHit *hit)
+{
+	auto found = false;
+	for (auto i = 0; i < (int)m.indices.size() / 3; i++)
+	{
+		float t, u, v;
+		if (ray_triangle(r, m.positions[m.indices[i * 3]], m.positions[m.indices[i * 3 + 1]],
+			m.positions[m.indices[i * 3 + 2]], t_max, t, u, v))
+		{
+			t_max = t;
+			hit->t = t;
+			hit->triangle = i;
+			found = true;
+		}
+	}
+	return found;
+}
+
+static Vec3 rand_dir()
+{
+	std::normal_distribution<float> n;
+	return Vec3(n(rng), n(rng), n(rng)).get_normalize();
+}
+
+static int check_node(const TriangleBVH &bvh, int id, std::vector<int> &seen)
+{
+	auto &n = bvh.get_node(id);
+	if (n.count > 0)
+	{
+		for (auto i = n.first; i < n.first + n.count; i++)
+			seen[i]++;
+		return 1;
+	}
+	assert(n.box.contains(bvh.get_node(n.first).box) && n.box.contains(bvh.get_node(n.first + 1).box));
+	return 1 + std::max(check_node(bvh, n.first, seen), check_node(bvh, n.first + 1, seen));
+}
+
+static void test_bvh()
+{
+	auto m = make_mesh(40, 60);
+	TriangleBVH bvh;
+	bvh.build(m.positions.data(), sizeof(Vec3), m.indices.data(), m.indices.size());
+	assert(bvh.get_triangle_count() == (int)m.indices.size() / 3);
+
+	// every triangle sits in exactly one leaf
+	std::vector<int> seen(bvh.get_triangle_count(), 0);
+	auto depth = check_node(bvh, 0, seen);
+	for (auto s : seen)
+		assert(s == 1);
+
+	auto hits = 0;
+	std::uniform_real_distribution<float> pos(-3.f, 3.f);
+	for (auto i = 0; i < 20000; i++)
+	{
+		// from outside and from inside, some aimed at the mesh
+		auto origin = i % 2 ? Vec3(pos(rng), pos(rng), pos(rng)) : Vec3(pos(rng), pos(rng), pos(rng)) * 0.1f;
+		auto dir = i % 3 ? rand_dir() : (Vec3(0.f) - origin) * 2.f;
+		Ray r(origin, dir);
+		RayHit a, b;
+		auto ha = bvh.ray_cast(r, FLT_MAX, &a);
+		auto hb = brute_force(m, r, FLT_MAX, &b);
+		assert(ha == hb);
+		if (ha)
+		{
+			assert(fabs(a.t - b.t) < 1e-5f);
+			hits++;
+		}
+
+		// a t_max before the nearest hit gives nothing
+		if (hb && b.t > 0.01f)
+			assert(!bvh.ray_cast(r, b.t * 0.99f, &a));
+	}
+	assert(hits > 10000);
+
+	printf("bvh: ok, %d triangles, %d nodes, depth %d, %d hits\n", bvh.get_triangle_count(),
+		bvh.get_node_count(), depth, hits);
+
+	// an interleaved layout, the positions are pointed to with a stride
+	struct Vertex
+	{
+		float uv[2];
+		Vec3 position;
+		float pad;
+	};
+	std::vector<Vertex> vertices(m.positions.size());
+	for (auto i = 0; i < (int)m.positions.size(); i++)
+		vertices[i].position = m.positions[i];
+	TriangleBVH bvh2;
+	bvh2.build(&vertices[0].position, sizeof(Vertex), m.indices.data(), m.indices.size());
+	Ray r(Vec3(0.f, 0.f, 5.f), Vec3(0.f, 0.f, -1.f));
+	RayHit a, b;
+	assert(bvh.ray_cast(r, FLT_MAX, &a) && bvh2.ray_cast(r, FLT_MAX, &b));
+	assert(a.t == b.t && a.triangle == b.triangle);
+}
+
+struct Instance
+{
+	const TriangleBVH *bvh;
+	const Mesh *mesh;
+	Mat4 world;
+	Mat4 inv_world;
+};
+
+static AABB transform_box(const Mat4 &m, const AABB &b)
+{
+	AABB ret(Vec3(FLT_MAX), Vec3(-FLT_MAX));
+	for (auto i = 0; i < 8; i++)
+	{
+		auto p = m * Vec3(i & 1 ? b.max.x : b.min.x, i & 2 ? b.max.y : b.min.y, i & 4 ? b.max.z : b.min.z);
+		ret = merge(ret, AABB(p, p));
+	}
+	return ret;
+}
+
+static Mat4 rand_transform(float extent)
+{
+	std::uniform_real_distribution<float> pos(-extent, extent);
+	std::uniform_real_distribution<float> scale(0.5f, 3.f);
+	auto x = rand_dir();
+	auto y = cross(x, rand_dir()).get_normalize();
+	auto z = cross(x, y);
+	auto s = scale(rng);
+	return Mat4(Vec4(x * s, 0.f), Vec4(y * s * 0.5f, 0.f), Vec4(z * s, 0.f), Vec4(pos(rng), pos(rng), pos(rng), 1.f));
+}
+
+// instances in an AABBTree by world box, each tested in its own space, against all triangles in world space
+static void test_instances()
+{
+	Mesh meshes[] = { make_mesh(10, 16), make_mesh(30, 40) };
+	TriangleBVH bvhs[2];
+	for (auto i = 0; i < 2; i++)
+		bvhs[i].build(meshes[i].positions.data(), sizeof(Vec3), meshes[i].indices.data(), meshes[i].indices.size());
+
+	const auto N = 300;
+	std::vector<Instance> instances(N);
+	AABBTree tree(0.f);
+	for (auto i = 0; i < N; i++)
+	{
+		auto &ins = instances[i];
+		ins.bvh = &bvhs[i % 2];
+		ins.mesh = &meshes[i % 2];
+		ins.world = rand_transform(50.f);
+		ins.inv_world = ins.world.get_inverse();
+		tree.insert(transform_box(ins.world, ins.bvh->get_box()), i);
+	}
+
+	std::vector<Mesh> world_meshes(N);
+	for (auto i = 0; i < N; i++)
+	{
+		auto &src = *instances[i].mesh;
+		world_meshes[i].indices = src.indices;
+		for (auto &p : src.positions)
+			world_meshes[i].positions.push_back(instances[i].world * p);
+	}
+
+	std::uniform_real_distribution<float> pos(-60.f, 60.f);
+	auto hits = 0;
+	long long tree_ns = 0, brute_ns = 0;
+	for (auto i = 0; i < 500; i++)
+	{
+		auto origin = Vec3(pos(rng), pos(rng), pos(rng));
+		// aim at a random instance half of the time
+		auto dir = i % 2 ? rand_dir() * 3.f : instances[i % N].world * Vec3(0.f) - origin;
+		Ray r(origin, dir);
+
+		auto t0 = get_now_ns();
+		RayHit best;
+		best.user = -1;
+		tree.query_ray(r, FLT_MAX, [&](int user, float t_max) {
+			auto &ins = instances[user];
+			RayHit h;
+			if (ray_cast(*ins.bvh, ins.inv_world, r, t_max, &h))
+			{
+				best = h;
+				best.user = user;
+				return h.t;
+			}
+			return t_max;
+		});
+		auto t1 = get_now_ns();
+
+		RayHit expected;
+		expected.user = -1;
+		auto t_max = FLT_MAX;
+		for (auto j = 0; j < N; j++)
+		{
+			RayHit h;
+			if (brute_force(world_meshes[j], r, t_max, &h))
+			{
+				t_max = h.t;
+				expected = h;
+				expected.user = j;
+			}
+		}
+		auto t2 = get_now_ns();
+		tree_ns += t1 - t0;
+		brute_ns += t2 - t1;
+
+		assert((best.user == -1) == (expected.user == -1));
+		if (best.user != -1)
+		{
+			// the local space test and the world space one round differently
+			assert(fabs(best.t - expected.t) < 1e-3f * std::max(1.f, expected.t));
+			hits++;
+		}
+	}
+	assert(hits > 150);
+
+	printf("instances: ok, %d instances, %d hits, tree+bvh %.3fms, brute force %.3fms (500 rays)\n", N, hits,
+		tree_ns / 1000000.0, brute_ns / 1000000.0);
+}
+
+static void benchmark()
+{
+	printf("triangles   build        1000 rays bvh   100 rays brute\n");
+	for (auto rings : { 50, 150, 400 })
+	{
+		auto m = make_mesh(rings, rings * 2);
+		auto t0 = get_now_ns();
+		TriangleBVH bvh;
+		bvh.build(m.positions.data(), sizeof(Vec3), m.indices.data(), m.indices.size());
+		auto t1 = get_now_ns();
+		std::vector<Ray> rays;
+		for (auto i = 0; i < 1000; i++)
+			rays.push_back(Ray(rand_dir() * 3.f, rand_dir()));
+		auto hits = 0;
+		for (auto &r : rays)
+		{
+			RayHit h;
+			hits += bvh.ray_cast(r, FLT_MAX, &h);
+		}
+		auto t2 = get_now_ns();
+		auto brute_hits = 0;
+		for (auto i = 0; i < 100; i++)
+		{
+			RayHit h;
+			brute_hits += brute_force(m, rays[i], FLT_MAX, &h);
+		}
+		auto t3 = get_now_ns();
+		auto bvh_hits = 0;
+		for (auto i = 0; i < 100; i++)
+		{
+			RayHit h;
+			bvh_hits += bvh.ray_cast(rays[i], FLT_MAX, &h);
+		}
+		assert(bvh_hits == brute_hits);
+
+		printf("%9d %8.3fms %14.3fms %15.3fms\n", bvh.get_triangle_count(),
+			(t1 - t0) / 1000000.0, (t2 - t1) / 1000000.0, (t3 - t2) / 1000000.0);
+	}
+}
+
+int main(int argc, char **args)
+{
+	test_bvh();
+	test_instances();
+	benchmark();
+
+	return 0;
+}
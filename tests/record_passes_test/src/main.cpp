@@ -0,0 +1,153 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/time.h>
+#include <flame/jobs.h>
+#include <flame/graphics/device.h>
+#include <flame/graphics/buffer.h>
+#include <flame/graphics/texture.h>
+#include <flame/graphics/renderpass.h>
+#include <flame/graphics/framebuffer.h>
+#include <flame/graphics/shader.h>
+#include <flame/graphics/pipeline.h>
+#include <flame/graphics/descriptor.h>
+#include <flame/graphics/commandbuffer.h>
+#include <flame/graphics/frame.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// no window is needed, so this runs on a software ICD (e.g. swiftshader or lavapipe) as well
+int main(int argc, char **args)
+{
+	using namespace flame;
+	using namespace graphics;
+
+	auto d = create_device(false);
+	auto fc = create_framecontext(d, 2);
+
+	const auto size = Ivec2(256);
+	auto t = create_texture(d, size, 1, 1, Format_R8G8B8A8_UNORM, TextureUsageAttachment, MemPropDevice);
+	auto tv = create_textureview(d, t);
+
+	auto rp = create_renderpass(d);
+	rp->add_attachment(t->format, true);
+	rp->add_subpass({ 0 }, -1);
+	rp->build();
+
+	auto fb = create_framebuffer(d, size, rp);
+	fb->set_view(0, tv);
+	fb->build();
+
+	auto vert = create_shader(d, "fullscreen.vert");
+	auto frag = create_shader(d, "test.frag");
+	Shader *shaders[] = { vert, frag };
+	build_shaders(shaders, 2);
+
+	auto pl = create_pipeline(d);
+	pl->set_size(size);
+	pl->set_cull_mode(CullModeNone);
+	pl->add_shader(vert);
+	pl->add_shader(frag);
+	pl->set_renderpass(rp, 0);
+	pl->build_graphics();
+
+	auto ub = create_buffer(d, sizeof(Vec4), BufferUsageUniformBuffer, MemPropHost | MemPropHostCoherent);
+	ub->map();
+	*(Vec4*)ub->mapped = Vec4(0.5f, 0.7f, 0.3f, 1.f);
+	auto ds = d->dp->create_descriptorset(pl, 0);
+	ds->set_uniformbuffer(0, 0, ub);
+
+	// a shadow map or a g-buffer like frame: some passes of many small draws
+	const auto pass_count = 6;
+	const auto draw_count = 20000;
+	const auto frame_count = 20;
+	RecordPass passes[pass_count];
+	for (auto i = 0; i < pass_count; i++)
+	{
+		passes[i].renderpass = rp;
+		passes[i].framebuffer = fb;
+		passes[i].item_count = draw_count;
+		passes[i].record = [&](Commandbuffer *cb, int begin, int end) {
+			cb->bind_pipeline(pl);
+			cb->bind_descriptorset(ds);
+			for (auto j = begin; j < end; j++)
+				cb->draw(3, 1, j);
+		};
+	}
+
+	auto hw = std::max((int)std::thread::hardware_concurrency(), 1);
+	double base_time = 0.0;
+	for (auto workers = 1; ; workers *= 2)
+	{
+		workers = std::min(workers, hw);
+		auto js = create_job_system(workers);
+
+		auto total_ns = 0LL;
+		for (auto f = 0; f < frame_count + 1; f++)
+		{
+			fc->begin_frame();
+			auto cb = fc->get_commandbuffer();
+			cb->begin(true);
+			auto t0 = get_now_ns();
+			fc->record_passes(cb, js, pass_count, passes, 256);
+			auto t1 = get_now_ns();
+			cb->end();
+			fc->add_submit(cb);
+			fc->end_frame(d->q);
+			if (f > 0) // the first frame creates the command buffers
+				total_ns += t1 - t0;
+		}
+		fc->wait_all();
+
+		FrameStats st;
+		fc->get_stats(&st);
+		auto ms = total_ns / 1000000.0 / frame_count;
+		if (workers == 1)
+			base_time = ms;
+		printf("record %d passes of %d draws, %2d workers: %.3fms, x%.2f (threads busy x%.2f)\n", pass_count, draw_count,
+			workers, ms, base_time / ms, st.record_ms > 0.f ? st.record_work_ms / st.record_ms : 0.f);
+
+		destroy_job_system(js);
+		if (workers == hw)
+			break;
+	}
+
+	d->dp->destroy_descriptorset(ds);
+	destroy_buffer(d, ub);
+	destroy_pipeline(d, pl);
+	destroy_shader(d, vert);
+	destroy_shader(d, frag);
+	destroy_framebuffer(d, fb);
+	destroy_renderpass(d, rp);
+	destroy_textureview(d, tv);
+	destroy_texture(d, t);
+	destroy_framecontext(d, fc);
+	destroy_device(d);
+
+	printf("ok\n");
+
+	return 0;
+}
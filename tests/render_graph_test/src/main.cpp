@@ -0,0 +1,249 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/graphics/rendergraph.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+using namespace flame;
+using namespace graphics;
+
+static void nothing(Commandbuffer *cb)
+{
+}
+
+static bool has_barrier(const RendergraphCompiled &c, int before, int resource, TextureLayout from, TextureLayout to)
+{
+	for (auto &b : c.barriers)
+	{
+		if (b.before == before && b.resource == resource && b.from == from && b.to == to)
+			return true;
+	}
+	return false;
+}
+
+// shadow map, g-buffer, lighting, a debug view nobody looks at, a bloom chain and the tone mapping to the back buffer
+static void test_deferred()
+{
+	Rendergraph g;
+	auto gbuffer_usage = TextureUsageAttachment | TextureUsageShaderSampled;
+
+	auto esm = g.add_texture("esm", Ivec2(1024), 1, 1, Format_R16_UNORM, gbuffer_usage);
+	auto albedo = g.add_texture("albedo", Ivec2(1280, 720), 1, 1, Format_R8G8B8A8_UNORM, gbuffer_usage);
+	auto normal = g.add_texture("normal", Ivec2(1280, 720), 1, 1, Format_R8G8B8A8_UNORM, gbuffer_usage);
+	auto depth = g.add_texture("depth", Ivec2(1280, 720), 1, 1, Format_Depth32, gbuffer_usage);
+	auto hdr = g.add_texture("hdr", Ivec2(1280, 720), 1, 1, Format_R16G16B16A16_UNORM, gbuffer_usage);
+	auto debug = g.add_texture("debug", Ivec2(1280, 720), 1, 1, Format_R8G8B8A8_UNORM, gbuffer_usage);
+	auto bloom_a = g.add_texture("bloom a", Ivec2(1280, 720), 1, 1, Format_R8G8B8A8_UNORM, gbuffer_usage);
+	auto bloom_b = g.add_texture("bloom b", Ivec2(1280, 720), 1, 1, Format_R8G8B8A8_UNORM, gbuffer_usage);
+	auto bloom_c = g.add_texture("bloom c", Ivec2(1280, 720), 1, 1, Format_R8G8B8A8_UNORM, gbuffer_usage);
+	auto back = g.import_texture("back", nullptr, TextureLayoutUndefined, TextureLayoutShaderReadOnly);
+
+	auto p_shadow = g.add_pass("shadow", nothing);
+	g.write(p_shadow, esm);
+	auto p_gbuffer = g.add_pass("gbuffer", nothing);
+	g.write(p_gbuffer, albedo);
+	g.write(p_gbuffer, normal);
+	g.write(p_gbuffer, depth);
+	auto p_lighting = g.add_pass("lighting", nothing);
+	g.read(p_lighting, albedo);
+	g.read(p_lighting, normal);
+	g.read(p_lighting, depth);
+	g.read(p_lighting, esm);
+	g.write(p_lighting, hdr);
+	auto p_debug = g.add_pass("debug", nothing);
+	g.read(p_debug, normal);
+	g.write(p_debug, debug);
+	auto p_bright = g.add_pass("bright", nothing);
+	g.read(p_bright, hdr);
+	g.write(p_bright, bloom_a);
+	auto p_blur = g.add_pass("blur", nothing);
+	g.read(p_blur, bloom_a);
+	g.write(p_blur, bloom_b);
+	auto p_blur2 = g.add_pass("blur2", nothing);
+	g.read(p_blur2, bloom_b);
+	g.write(p_blur2, bloom_c);
+	auto p_tonemap = g.add_pass("tonemap", nothing);
+	g.read(p_tonemap, hdr);
+	g.read(p_tonemap, bloom_c);
+	g.write(p_tonemap, back);
+
+	RendergraphCompiled c;
+	g.compile(&c);
+
+	int order[] = { p_shadow, p_gbuffer, p_lighting, p_bright, p_blur, p_blur2, p_tonemap };
+	assert(c.order.size() == 7);
+	for (auto i = 0; i < 7; i++)
+		assert(c.order[i] == order[i]);
+
+	auto U = TextureLayoutUndefined;
+	auto A = TextureLayoutAttachment;
+	auto R = TextureLayoutShaderReadOnly;
+	assert(c.barriers.size() == 18);
+	assert(has_barrier(c, 0, esm, U, A));
+	assert(has_barrier(c, 1, albedo, U, A));
+	assert(has_barrier(c, 1, normal, U, A));
+	assert(has_barrier(c, 1, depth, U, A));
+	assert(has_barrier(c, 2, albedo, A, R));
+	assert(has_barrier(c, 2, normal, A, R));
+	assert(has_barrier(c, 2, depth, A, R));
+	assert(has_barrier(c, 2, esm, A, R));
+	assert(has_barrier(c, 2, hdr, U, A));
+	assert(has_barrier(c, 3, hdr, A, R));
+	assert(has_barrier(c, 3, bloom_a, U, A));
+	assert(has_barrier(c, 4, bloom_a, A, R));
+	assert(has_barrier(c, 4, bloom_b, U, A));
+	assert(has_barrier(c, 5, bloom_b, A, R));
+	assert(has_barrier(c, 5, bloom_c, U, A));
+	assert(has_barrier(c, 6, bloom_c, A, R));
+	assert(has_barrier(c, 6, back, U, A));
+	assert(has_barrier(c, 7, back, A, R));
+
+	// the bloom chain lives after the g-buffer, so it takes its textures
+	assert(c.slots[debug] == -1);
+	assert(c.slots[back] == -1);
+	assert(c.slots[bloom_a] == c.slots[albedo]);
+	assert(c.slots[bloom_b] == c.slots[normal]);
+	assert(c.slots[bloom_c] == c.slots[albedo]);
+	assert(c.slots[esm] != c.slots[albedo]);
+	assert(c.slots[albedo] != c.slots[normal]);
+	assert(c.slots[depth] != c.slots[albedo] && c.slots[depth] != c.slots[normal]);
+	assert(c.slots[hdr] != c.slots[albedo] && c.slots[hdr] != c.slots[normal] && c.slots[hdr] != c.slots[depth]);
+	assert(c.slot_count == 5);
+}
+
+// a pass that writes the whole texture makes the earlier writers useless, unless it loads what they wrote
+static void test_overwrite()
+{
+	for (auto load = 0; load < 2; load++)
+	{
+		Rendergraph g;
+		auto t = g.add_texture("t", Ivec2(256), 1, 1, Format_R8G8B8A8_UNORM, TextureUsageAttachment | TextureUsageShaderSampled);
+		auto out = g.import_texture("out", nullptr, TextureLayoutShaderReadOnly, TextureLayoutShaderReadOnly);
+
+		auto p0 = g.add_pass("first", nothing);
+		g.write(p0, t);
+		auto p1 = g.add_pass("second", nothing);
+		if (load)
+			g.read(p1, t, TextureLayoutAttachment);
+		g.write(p1, t);
+		auto p2 = g.add_pass("resolve", nothing);
+		g.read(p2, t);
+		g.write(p2, out);
+
+		RendergraphCompiled c;
+		g.compile(&c);
+		if (load)
+		{
+			assert(c.order.size() == 3);
+			// the layout stays, but the second renderpass must wait for the first
+			assert(has_barrier(c, 1, t, TextureLayoutAttachment, TextureLayoutAttachment));
+			assert(c.barriers.size() == 5);
+		}
+		else
+		{
+			assert(c.order.size() == 2);
+			assert(c.order[0] == p1 && c.order[1] == p2);
+			assert(has_barrier(c, 0, t, TextureLayoutUndefined, TextureLayoutAttachment));
+			assert(c.barriers.size() == 4);
+		}
+		assert(has_barrier(c, c.order.size() - 1, out, TextureLayoutShaderReadOnly, TextureLayoutAttachment));
+		assert(has_barrier(c, c.order.size(), out, TextureLayoutAttachment, TextureLayoutShaderReadOnly));
+	}
+}
+
+// compute passes that keep a texture in the general layout still need a barrier after each write,
+// but readers after readers do not
+static void test_storage()
+{
+	Rendergraph g;
+	auto s = g.add_texture("s", Ivec2(64), 1, 1, Format_R8G8B8A8_UNORM, TextureUsageShaderStorage | TextureUsageShaderSampled);
+	auto out = g.import_texture("out", nullptr, TextureLayoutUndefined, TextureLayoutUndefined);
+	auto S = TextureLayoutShaderStorage;
+
+	auto p0 = g.add_pass("init", nothing);
+	g.write(p0, s, S);
+	auto p1 = g.add_pass("step", nothing);
+	g.read(p1, s, S);
+	g.write(p1, s, S);
+	auto p2 = g.add_pass("gather", nothing);
+	g.read(p2, s, S);
+	auto p3 = g.add_pass("again", nothing);
+	g.read(p3, s, S);
+	auto p4 = g.add_pass("show", nothing);
+	g.read(p4, s);
+	g.write(p4, out);
+
+	RendergraphCompiled c;
+	g.compile(&c);
+
+	// gather and again only read and write nothing that is needed
+	assert(c.order.size() == 3);
+	assert(c.order[0] == p0 && c.order[1] == p1 && c.order[2] == p4);
+	assert(has_barrier(c, 0, s, TextureLayoutUndefined, S));
+	assert(has_barrier(c, 1, s, S, S));
+	assert(has_barrier(c, 2, s, S, TextureLayoutShaderReadOnly));
+	assert(has_barrier(c, 2, out, TextureLayoutUndefined, TextureLayoutAttachment));
+	// the final layout of out is undefined, so it stays as it is
+	assert(c.barriers.size() == 4);
+
+	// a reader in the general layout between them is kept apart from the writes by a barrier too
+	g.passes[p2].side_effect = true;
+	g.compile(&c);
+	assert(c.order.size() == 4);
+	assert(has_barrier(c, 2, s, S, S));
+	assert(c.barriers.size() == 5);
+}
+
+static void test_side_effect()
+{
+	Rendergraph g;
+	auto t = g.add_texture("t", Ivec2(16), 1, 1, Format_R8_UNORM, TextureUsageAttachment);
+	auto p0 = g.add_pass("draw", nothing);
+	g.write(p0, t);
+	auto p1 = g.add_pass("readback", nothing, true);
+	g.read(p1, t, TextureLayoutTransferSrc);
+
+	RendergraphCompiled c;
+	g.compile(&c);
+	assert(c.order.size() == 2);
+	assert(has_barrier(c, 1, t, TextureLayoutAttachment, TextureLayoutTransferSrc));
+
+	g.passes[p1].side_effect = false;
+	g.compile(&c);
+	assert(c.order.empty());
+	assert(c.barriers.empty());
+	assert(c.slot_count == 0);
+}
+
+int main(int argc, char **args)
+{
+	test_deferred();
+	test_overwrite();
+	test_storage();
+	test_side_effect();
+
+	printf("ok\n");
+
+	return 0;
+}
@@ -0,0 +1,282 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/shadow_cascade.h>
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <random>
+
+using namespace flame;
+
+static std::mt19937 rng(1);
+
+static bool near_eq(float a, float b, float eps = 1e-3f)
+{
+	return fabsf(a - b) <= eps * std::max(1.f, std::max(fabsf(a), fabsf(b)));
+}
+
+struct TestCamera
+{
+	Vec3 coord;
+	Vec3 x_axis, y_axis, z_axis;
+
+	TestCamera(const Vec3 &_coord, float yaw, float pitch) :
+		coord(_coord)
+	{
+		z_axis = Vec3(sinf(yaw) * cosf(pitch), sinf(pitch), cosf(yaw) * cosf(pitch));
+		x_axis = cross(Vec3(0.f, 1.f, 0.f), z_axis).get_normalize();
+		y_axis = cross(z_axis, x_axis);
+	}
+
+	void corners(float d0, float d1, Vec3 *out) const
+	{
+		get_frustum_slice_corners(coord, x_axis, y_axis, z_axis, tanf(0.5f), 16.f / 9.f, d0, d1, out);
+	}
+};
+
+static ShadowCascade fit(const ShadowLightSpace &ls, const TestCamera &cam, float d0, float d1, const std::vector<AABB> &casters)
+{
+	Vec3 corners[8];
+	cam.corners(d0, d1, corners);
+	ShadowCascade c;
+	begin_shadow_cascade(ls, corners, 2048, d0, d1, c);
+	for (auto i = 0; i < (int)casters.size(); i++)
+	{
+		if (shadow_cascade_overlaps(ls, c, casters[i]))
+			add_shadow_caster(ls, casters[i], i, c);
+	}
+	end_shadow_cascade(c);
+	return c;
+}
+
+static Vec3 transform(const float *m, const Vec3 &p)
+{
+	return Vec3(
+		m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+		m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+		m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]
+	);
+}
+
+static void test_splits()
+{
+	float s[5];
+	get_shadow_cascade_splits(4, 1.f, 1000.f, 0.f, s);
+	assert(s[0] == 1.f && s[4] == 1000.f);
+	assert(near_eq(s[2], 500.5f));
+	get_shadow_cascade_splits(4, 1.f, 1000.f, 1.f, s);
+	assert(near_eq(s[1], powf(1000.f, 0.25f)) && near_eq(s[2], powf(1000.f, 0.5f)));
+	get_shadow_cascade_splits(3, 0.1f, 200.f, 0.7f, s);
+	for (auto i = 0; i < 3; i++)
+		assert(s[i] < s[i + 1]);
+	printf("splits: ok\n");
+}
+
+static void test_corners()
+{
+	TestCamera cam(Vec3(3.f, 2.f, 1.f), 0.8f, -0.3f);
+	Vec3 p[8];
+	cam.corners(2.f, 10.f, p);
+	for (auto i = 0; i < 8; i++)
+	{
+		auto d = -dot(p[i] - cam.coord, cam.z_axis);
+		assert(near_eq(d, i < 4 ? 2.f : 10.f));
+	}
+	printf("slice corners: ok\n");
+}
+
+// turning the camera keeps the size, moving it moves the box by whole texels
+static void test_stability()
+{
+	ShadowLightSpace ls;
+	ls.set_direction(Vec3(0.3f, -1.f, 0.2f));
+	std::vector<AABB> no_casters;
+
+	std::uniform_real_distribution<float> angle(-3.14f, 3.14f);
+	std::uniform_real_distribution<float> offset(-50.f, 50.f);
+	auto first = fit(ls, TestCamera(Vec3(0.f), 0.f, 0.f), 5.f, 20.f, no_casters);
+	for (auto i = 0; i < 1000; i++)
+	{
+		auto c = fit(ls, TestCamera(Vec3(offset(rng), offset(rng), offset(rng)), angle(rng), angle(rng) * 0.45f), 5.f, 20.f, no_casters);
+		assert(c.texel_size == first.texel_size);
+		assert(c.max.x - c.min.x == first.max.x - first.min.x);
+		auto tx = c.min.x / c.texel_size, ty = c.min.y / c.texel_size;
+		assert(fabsf(tx - roundf(tx)) < 1e-2f && fabsf(ty - roundf(ty)) < 1e-2f);
+	}
+
+	// a move smaller than a texel along the light does not change anything
+	TestCamera cam(Vec3(1.f, 2.f, 3.f), 0.4f, -0.2f);
+	auto a = fit(ls, cam, 5.f, 20.f, no_casters);
+	cam.coord += ls.z_axis * (a.texel_size * 0.5f);
+	auto b = fit(ls, cam, 5.f, 20.f, no_casters);
+	assert(a.min.x == b.min.x && a.min.y == b.min.y && a.max.x == b.max.x && a.max.y == b.max.y);
+	// same camera, same box
+	assert(fit(ls, cam, 5.f, 20.f, no_casters).same_box(b));
+
+	// moving a few texels sideways moves the box by whole texels
+	cam.coord += ls.x_axis * (a.texel_size * 3.5f);
+	auto d = fit(ls, cam, 5.f, 20.f, no_casters);
+	auto moved = (d.min.x - b.min.x) / a.texel_size;
+	assert(fabsf(moved - roundf(moved)) < 1e-2f && (roundf(moved) == 3.f || roundf(moved) == 4.f));
+	printf("texel snapping: ok\n");
+}
+
+static void test_casters()
+{
+	ShadowLightSpace ls;
+	ls.set_direction(Vec3(0.f, -1.f, 0.f));
+	TestCamera cam(Vec3(0.f, 5.f, 0.f), 0.f, -0.5f);
+
+	std::vector<AABB> casters;
+	casters.push_back(AABB(Vec3(-100.f, -1.f, -100.f), Vec3(100.f, 0.f, 100.f))); // ground
+	casters.push_back(AABB(Vec3(-1.f, 0.f, -8.f), Vec3(1.f, 12.f, -6.f))); // a pillar in front of the camera
+	casters.push_back(AABB(Vec3(500.f, 0.f, 500.f), Vec3(501.f, 50.f, 501.f))); // far away
+
+	auto c = fit(ls, cam, 1.f, 20.f, casters);
+	assert(c.caster_count == 2);
+	// the depth goes up to the top of the pillar and no further than a snap step
+	assert(c.max.z >= 12.f && c.max.z < 12.f + c.texel_size * 16.f + 1e-3f);
+	assert(c.min.z <= -1.f + 1e-3f);
+
+	float m[16];
+	get_shadow_cascade_matrix(ls, c, m);
+	Vec3 corners[8];
+	cam.corners(1.f, 20.f, corners);
+	for (auto i = 0; i < 8; i++)
+	{
+		auto p = transform(m, corners[i]);
+		assert(p.x >= -1.f && p.x <= 1.f && p.y >= -1.f && p.y <= 1.f);
+	}
+	auto top = transform(m, Vec3(0.f, 12.f, -7.f));
+	auto ground = transform(m, Vec3(0.f, 0.f, -7.f));
+	assert(top.z >= 0.f && top.z < ground.z && ground.z <= 1.f);
+
+	// a swapped caster changes the hash even when the count stays
+	auto moved = casters;
+	moved[1] = AABB(Vec3(-1.f, 0.f, -5.f), Vec3(1.f, 12.f, -3.f));
+	std::swap(moved[1], moved[2]);
+	moved[2] = AABB(Vec3(2.f, 0.f, -8.f), Vec3(3.f, 12.f, -6.f));
+	auto c2 = fit(ls, cam, 1.f, 20.f, moved);
+	assert(c2.caster_count == c.caster_count && c2.caster_hash != c.caster_hash);
+
+	// no casters, the receivers are kept
+	auto empty = fit(ls, cam, 1.f, 20.f, std::vector<AABB>());
+	assert(empty.caster_count == 0 && empty.max.z > empty.min.z);
+	printf("caster fitting: ok\n");
+}
+
+// a receiver that casts nothing (terrain) still has to land inside the depth range, behind the casters
+static void test_receiver_not_caster()
+{
+	ShadowLightSpace ls;
+	ls.set_direction(Vec3(0.f, -1.f, 0.f));
+	TestCamera cam(Vec3(0.f, 5.f, 0.f), 0.f, -0.5f);
+
+	std::vector<AABB> casters;
+	casters.push_back(AABB(Vec3(-1.f, 0.f, -8.f), Vec3(1.f, 2.f, -6.f))); // a box on the ground, the ground is not a caster
+
+	Vec3 corners[8];
+	cam.corners(1.f, 20.f, corners);
+	ShadowCascade receivers;
+	begin_shadow_cascade(ls, corners, 2048, 1.f, 20.f, receivers);
+
+	auto c = fit(ls, cam, 1.f, 20.f, casters);
+	assert(c.caster_count == 1);
+	assert(c.min.z <= receivers.min.z);
+	assert(c.max.z >= 2.f && c.max.z < 2.f + c.texel_size * 16.f + 1e-3f);
+
+	float m[16];
+	get_shadow_cascade_matrix(ls, c, m);
+	auto top = transform(m, Vec3(0.f, 2.f, -7.f));
+	auto ground = transform(m, Vec3(0.f, 0.f, -7.f)); // under the box
+	assert(top.z >= 0.f && top.z < ground.z && ground.z <= 1.f);
+	for (auto i = 0; i < 8; i++)
+	{
+		auto p = transform(m, corners[i]);
+		assert(p.z <= 1.f);
+	}
+	printf("receiver not a caster: ok\n");
+}
+
+// the planes find the same casters in a tree as the overlap test
+static void test_tree_query()
+{
+	ShadowLightSpace ls;
+	ls.set_direction(Vec3(-0.4f, -1.f, 0.6f));
+	TestCamera cam(Vec3(0.f, 10.f, 0.f), 1.f, -0.4f);
+	Vec3 corners[8];
+	cam.corners(5.f, 60.f, corners);
+	ShadowCascade c;
+	begin_shadow_cascade(ls, corners, 1024, 5.f, 60.f, c);
+
+	std::uniform_real_distribution<float> pos(-200.f, 200.f);
+	std::uniform_real_distribution<float> size(0.5f, 10.f);
+	std::vector<AABB> boxes(5000);
+	AABBTree tree(0.1f);
+	for (auto i = 0; i < (int)boxes.size(); i++)
+	{
+		auto p = Vec3(pos(rng), pos(rng) * 0.1f, pos(rng));
+		boxes[i] = AABB(p, p + Vec3(size(rng), size(rng), size(rng)));
+		tree.insert(boxes[i], i);
+	}
+
+	Vec4 planes[6];
+	get_shadow_cascade_planes(ls, c, planes);
+	std::vector<int> found;
+	tree.query_frustum(planes, [&](int id) {
+		found.push_back(id);
+	});
+	std::sort(found.begin(), found.end());
+	// the tree keeps fat boxes, so it may also give casters that are just outside by the margin,
+	// the renderer tests those again with the real bounds
+	auto grown = c;
+	grown.min = c.min - Vec3(0.1f * 2.f);
+	grown.max = c.max + Vec3(0.1f * 2.f);
+	auto j = 0;
+	for (auto i = 0; i < (int)boxes.size(); i++)
+	{
+		auto found_it = j < (int)found.size() && found[j] == i;
+		if (found_it)
+			j++;
+		if (shadow_cascade_overlaps(ls, c, boxes[i]))
+			assert(found_it);
+		else if (found_it)
+			assert(shadow_cascade_overlaps(ls, grown, boxes[i]));
+	}
+	assert(j == (int)found.size());
+	printf("caster query: ok, %d of %d\n", (int)found.size(), (int)boxes.size());
+}
+
+int main(int argc, char **args)
+{
+	test_splits();
+	test_corners();
+	test_stability();
+	test_casters();
+	test_receiver_not_caster();
+	test_tree_query();
+
+	return 0;
+}
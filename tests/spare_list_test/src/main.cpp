@@ -0,0 +1,259 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/time.h>
+#include <flame/spare_list.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+using namespace flame;
+
+// the old implementation, kept here to compare with
+class MapSpareList
+{
+protected:
+	unsigned int capacity;
+	std::map<void*, int> map;
+	std::list<int> spare_list;
+public:
+	MapSpareList(unsigned int _capacity) :
+		capacity(_capacity)
+	{
+		for (auto i = 0u; i < capacity; i++)
+			spare_list.push_back(i);
+	}
+
+	int add(void *p)
+	{
+		if (map.find(p) != map.end())
+			return -2;
+		if (spare_list.size() == 0)
+			return -1;
+		auto index = spare_list.front();
+		map[p] = index;
+		spare_list.pop_front();
+		return index;
+	}
+
+	void remove(void *p)
+	{
+		auto it = map.find(p);
+		if (it == map.end())
+			return;
+		spare_list.push_back(it->second);
+		map.erase(it);
+	}
+
+	void iterate(const std::function<bool(int index, void *p, bool &remove)> &callback)
+	{
+		for (auto it = map.begin(); it != map.end(); it++)
+		{
+			bool remove = false;
+			if (!callback(it->second, it->first, remove))
+				break;
+		}
+	}
+};
+
+static void *to_ptr(int i)
+{
+	return (void*)(size_t)((i + 1) * 16);
+}
+
+static void test_correctness()
+{
+	const auto N = 1000;
+	SpareList l(N);
+	std::vector<int> slot_of(N * 2, -1);
+
+	for (auto i = 0; i < N; i++)
+	{
+		slot_of[i] = l.add(to_ptr(i));
+		assert(slot_of[i] == i);
+	}
+	assert(l.add(to_ptr(0)) == -2);
+	assert(l.add(to_ptr(N)) == -1);
+	assert(l.get_size() == N);
+
+	// random removes and re-adds, checked against a plain array
+	srand(1);
+	for (auto round = 0; round < 100000; round++)
+	{
+		auto i = rand() % (N * 2);
+		if (slot_of[i] != -1)
+		{
+			l.remove(to_ptr(i));
+			slot_of[i] = -1;
+		}
+		else
+		{
+			auto slot = l.add(to_ptr(i));
+			if (slot >= 0)
+				slot_of[i] = slot;
+			else
+				assert(slot == -1 && l.get_size() == N);
+		}
+	}
+
+	std::vector<bool> seen(N, false);
+	auto count = 0;
+	for (auto i = 0; i < N * 2; i++)
+	{
+		if (slot_of[i] != -1)
+		{
+			assert(l.find(to_ptr(i)) == slot_of[i]);
+			assert(!seen[slot_of[i]]);
+			seen[slot_of[i]] = true;
+			count++;
+		}
+		else
+			assert(l.find(to_ptr(i)) == -1);
+	}
+	assert(count == l.get_size());
+
+	auto iterated = 0;
+	l.iterate([&](int index, void *p, bool &remove) {
+		auto i = (int)((size_t)p / 16) - 1;
+		assert(slot_of[i] == index);
+		iterated++;
+		return true;
+	});
+	assert(iterated == count);
+
+	// remove inside iterate, every other one
+	auto k = 0;
+	l.iterate([&](int index, void *p, bool &remove) {
+		if (k++ % 2 == 0)
+		{
+			remove = true;
+			slot_of[(size_t)p / 16 - 1] = -1;
+		}
+		return true;
+	});
+	assert(l.get_size() == count - (count + 1) / 2);
+	for (auto i = 0; i < N * 2; i++)
+		assert(l.find(to_ptr(i)) == slot_of[i]);
+
+	// handles go stale when the slot is reused
+	SpareList hl(4);
+	auto h0 = hl.add_handle(to_ptr(0));
+	assert(hl.is_valid(h0) && hl.get(h0) == to_ptr(0));
+	hl.remove(h0);
+	assert(!hl.is_valid(h0) && hl.get(h0) == nullptr);
+	auto h1 = hl.add_handle(to_ptr(1));
+	assert(h1.index == h0.index && h1.generation != h0.generation);
+	assert(!hl.is_valid(h0) && hl.is_valid(h1));
+
+	// dirty slots are visited in index order, once
+	SpareList dl(200);
+	for (auto i = 0; i < 200; i++)
+		dl.add(to_ptr(i));
+	std::vector<int> dirty;
+	dl.iterate_dirty([&](int index, void *p) {
+		dirty.push_back(index);
+	});
+	assert(dirty.size() == 200);
+	dirty.clear();
+	dl.mark_dirty(130);
+	dl.mark_dirty(3);
+	dl.mark_dirty(64);
+	dl.remove(to_ptr(64));
+	dl.iterate_dirty([&](int index, void *p) {
+		assert(p == to_ptr(index));
+		dirty.push_back(index);
+	});
+	assert(dirty.size() == 2 && dirty[0] == 3 && dirty[1] == 130);
+
+	printf("correctness: ok\n");
+}
+
+template <class L>
+static void run_benchmark(int n, const std::vector<void*> &ptrs, const std::vector<int> &order, double *out_ms)
+{
+	L l(n);
+
+	auto t0 = get_now_ns();
+	for (auto i = 0; i < n; i++)
+		l.add(ptrs[order[i]]);
+	auto t1 = get_now_ns();
+
+	size_t sum = 0;
+	const auto R = 10;
+	for (auto r = 0; r < R; r++)
+	{
+		l.iterate([&](int index, void *p, bool &remove) {
+			sum += index;
+			return true;
+		});
+	}
+	auto t2 = get_now_ns();
+
+	// churn: remove half, then add them back, like objects coming and going
+	for (auto i = 0; i < n; i += 2)
+		l.remove(ptrs[order[i]]);
+	for (auto i = 0; i < n; i += 2)
+		l.add(ptrs[order[i]]);
+	auto t3 = get_now_ns();
+
+	out_ms[0] = (t1 - t0) / 1000000.0;
+	out_ms[1] = (t2 - t1) / 1000000.0 / R;
+	out_ms[2] = (t3 - t2) / 1000000.0;
+	static volatile size_t sink;
+	sink = sum;
+	(void)sink;
+}
+
+static void benchmark()
+{
+	printf("entries     add(map)   add(slots) iterate(map) iterate(slots) churn(map) churn(slots)\n");
+	for (auto n : { 1024, 16 * 1024, 256 * 1024 })
+	{
+		std::vector<void*> ptrs(n);
+		std::vector<int> order(n);
+		for (auto i = 0; i < n; i++)
+		{
+			ptrs[i] = to_ptr(i);
+			order[i] = i;
+		}
+		std::shuffle(order.begin(), order.end(), std::mt19937(n));
+
+		double a[3], b[3];
+		run_benchmark<MapSpareList>(n, ptrs, order, a);
+		run_benchmark<SpareList>(n, ptrs, order, b);
+		printf("%7d %10.3fms %10.3fms %10.3fms %12.3fms %10.3fms %10.3fms\n", n, a[0], b[0], a[1], b[1], a[2], b[2]);
+	}
+}
+
+int main(int argc, char **args)
+{
+	test_correctness();
+	benchmark();
+
+	return 0;
+}
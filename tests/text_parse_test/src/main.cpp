@@ -0,0 +1,273 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/time.h>
+#include <flame/filesystem.h>
+#include <flame/system.h>
+#include <flame/text_parse.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sstream>
+#include <regex>
+#include <random>
+
+using namespace flame;
+
+static void test_float()
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> mantissa(-1.f, 1.f);
+	std::uniform_int_distribution<int> exponent(-30, 30);
+	const char *fmts[] = { "%.9g", "%f", "%e", "%.3f", "%.12e" };
+	char buf[64];
+	for (auto i = 0; i < 200000; i++)
+	{
+		auto v = mantissa(rng) * powf(10.f, exponent(rng));
+		sprintf(buf, fmts[i % 5], v);
+		const char *p = buf;
+		float a;
+		auto ok = parse_float(p, buf + strlen(buf), a);
+		auto b = strtof(buf, nullptr);
+		assert(ok && *p == 0);
+		if (a != b && fabsf(a - b) > fabsf(nextafterf(b, 0.f) - b))
+		{
+			printf("parse_float: %s gives %.9g, strtof gives %.9g\n", buf, a, b);
+			assert(0);
+		}
+	}
+
+	const char *special = "  -0 +1.5 1e3 .25 -7. inf 42";
+	float expected[] = { -0.f, 1.5f, 1000.f, 0.25f, -7.f, INFINITY, 42.f };
+	float out[8];
+	assert(parse_floats(special, special + strlen(special), out, 8) == 7);
+	for (auto i = 0; i < 7; i++)
+		assert(out[i] == expected[i]);
+
+	const char *ints = "3 3 \n 3\t-12 x 5";
+	int iout[8];
+	assert(parse_ints(ints, ints + strlen(ints), iout, 8) == 4 && iout[3] == -12);
+
+	printf("float/int parsing: ok\n");
+}
+
+static void test_obj()
+{
+	const char *text =
+		"# comment\n"
+		"mtllib a.mtl\n"
+		"v 0 0 0\n"
+		"v 1 0 0\n"
+		"v 1 1 0\n"
+		"v 0 1 0\r\n"
+		"vt 0 0\n"
+		"vn 0 0 1\n"
+		"usemtl red \n"
+		"f 1/1/1 2/1/1 3/1/1 4/1/1\n"
+		"usemtl blue\n"
+		"f -4//-1 -3//-1 -2//-1\n"
+		"f 1 2 3";
+	ObjData d;
+	parse_obj(text, strlen(text), d, 1);
+	assert(d.positions.size() == 12 && d.uvs.size() == 2 && d.normals.size() == 3);
+	assert(d.mtllibs.size() == 1 && d.mtllibs[0] == "a.mtl");
+	assert(d.groups.size() == 2 && d.groups[0].material == "red" && d.groups[0].corner_begin == 0);
+	assert(d.groups[1].material == "blue" && d.groups[1].corner_begin == 6);
+	assert(d.corners.size() == 12 * 3);
+	int quad[] = { 0, 1, 2, 0, 2, 3 };
+	for (auto i = 0; i < 6; i++)
+		assert(d.corners[i * 3] == quad[i] && d.corners[i * 3 + 1] == 0 && d.corners[i * 3 + 2] == 0);
+	for (auto i = 0; i < 3; i++)
+		assert(d.corners[(6 + i) * 3] == i && d.corners[(6 + i) * 3 + 1] == -1 && d.corners[(6 + i) * 3 + 2] == 0);
+	assert(d.corners[9 * 3 + 1] == -1 && d.corners[9 * 3 + 2] == -1);
+	printf("obj: ok\n");
+}
+
+// a grid with relative indices in the second half, so chunk boundaries matter
+static std::string make_obj(int size)
+{
+	std::string s;
+	char buf[160];
+	for (auto y = 0; y <= size; y++)
+	{
+		for (auto x = 0; x <= size; x++)
+		{
+			sprintf(buf, "v %f %f %f\nvt %f %f\nvn 0 1 0\n", x * 0.1f, sinf(x * 0.3f) * cosf(y * 0.2f), y * 0.1f, x / (float)size, y / (float)size);
+			s += buf;
+		}
+	}
+	s += "usemtl grid\n";
+	for (auto y = 0; y < size; y++)
+	{
+		for (auto x = 0; x < size; x++)
+		{
+			auto i = y * (size + 1) + x + 1;
+			auto j = i + size + 1;
+			snprintf(buf, sizeof(buf), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", i, i, i, i + 1, i + 1, i + 1, j + 1, j + 1, j + 1, j, j, j);
+			s += buf;
+		}
+		if (y == size / 2)
+			s += "usemtl half\n";
+	}
+	for (auto i = 0; i < 1000; i++)
+		s += "v 1 2 3\nv 4 5 6\nv 7 8 9\nf -3 -2 -1\n";
+	return s;
+}
+
+static void test_obj_chunks(const std::string &s)
+{
+	ObjData a, b;
+	parse_obj(s.data(), s.size(), a, 1);
+	parse_obj(s.data(), s.size(), b, 8);
+	assert(a.positions == b.positions && a.uvs == b.uvs && a.normals == b.normals && a.corners == b.corners);
+	assert(a.groups.size() == 2 && b.groups.size() == 2 && a.groups[1].corner_begin == b.groups[1].corner_begin);
+	auto n = a.corners.size();
+	assert(a.corners[n - 3] == (int)a.positions.size() / 3 - 1);
+	printf("obj chunks: ok\n");
+}
+
+// what OBJ::load used to do per line, kept to compare with
+static void parse_obj_stringstream(const std::string &s, std::vector<float> &out_floats, std::vector<int> &out_ids)
+{
+	std::stringstream file(s);
+	std::regex pattern(R"(([0-9]+)?/([0-9]+)?/([0-9]+)?)");
+	while (!file.eof())
+	{
+		std::string line;
+		std::getline(file, line);
+		std::stringstream ss(line);
+		std::string token;
+		ss >> token;
+		if (token == "v" || token == "vn")
+		{
+			float x, y, z;
+			ss >> x >> y >> z;
+			out_floats.push_back(x);
+		}
+		else if (token == "vt")
+		{
+			float x, y;
+			ss >> x >> y;
+			out_floats.push_back(x);
+		}
+		else if (token == "f")
+		{
+			for (auto i = 0; i < 3; i++)
+			{
+				ss >> token;
+				std::smatch match;
+				std::regex_search(token, match, pattern);
+				if (match[1].matched)
+					out_ids.push_back(std::stoi(match[1].str()));
+			}
+		}
+	}
+}
+
+static void benchmark_obj(const std::string &s)
+{
+	auto filename = "text_parse_test.obj";
+	{
+		std::ofstream file(filename, std::ios::binary);
+		file.write(s.data(), s.size());
+	}
+
+	auto mb = s.size() / (1024.0 * 1024.0);
+	auto f = map_file(filename);
+	assert(f && f->size == (long long)s.size());
+
+	auto thread_counts = { 1, 2, 4, (int)std::thread::hardware_concurrency() };
+	for (auto n : thread_counts)
+	{
+		ObjData d;
+		auto t0 = get_now_ns();
+		parse_obj((const char*)f->data, f->size, d, n);
+		auto t = (get_now_ns() - t0) / 1000000000.0;
+		printf("obj %.1fMB, %2d threads: %8.1fMB/s\n", mb, n, mb / t);
+	}
+	unmap_file(f);
+	std::remove(filename);
+
+	auto part = s.substr(0, std::min(s.size(), (size_t)4 * 1024 * 1024));
+	std::vector<float> floats;
+	std::vector<int> ids;
+	auto t0 = get_now_ns();
+	parse_obj_stringstream(part, floats, ids);
+	auto t = (get_now_ns() - t0) / 1000000000.0;
+	printf("obj stringstream + regex:    %8.1fMB/s\n", part.size() / (1024.0 * 1024.0) / t);
+}
+
+static void benchmark_collada()
+{
+	auto f = map_file("res/cube.dae");
+	if (!f)
+	{
+		printf("res/cube.dae not found, skip\n");
+		return;
+	}
+
+	// the number lists are where the time goes, parse all <float_array> and <p> contents
+	const auto R = 1000;
+	std::vector<float> floats(1024 * 1024);
+	std::vector<int> ints(1024 * 1024);
+	size_t total = 0;
+	auto data = (const char*)f->data;
+	auto end = data + f->size;
+	auto t0 = get_now_ns();
+	for (auto r = 0; r < R; r++)
+	{
+		for (auto p = data; p < end; p++)
+		{
+			if (*p != '<')
+				continue;
+			auto is_float = end - p > 12 && strncmp(p, "<float_array", 12) == 0;
+			auto is_int = end - p > 3 && (strncmp(p, "<p>", 3) == 0 || strncmp(p, "<vcount>", 8) == 0);
+			if (!is_float && !is_int)
+				continue;
+			auto b = (const char*)memchr(p, '>', end - p) + 1;
+			auto e = (const char*)memchr(b, '<', end - b);
+			if (is_float)
+				total += parse_floats(b, e, floats.data(), floats.size());
+			else
+				total += parse_ints(b, e, ints.data(), ints.size());
+			p = e - 1;
+		}
+	}
+	auto t = (get_now_ns() - t0) / 1000000000.0;
+	printf("cube.dae x %d: %d numbers, %8.1fMB/s\n", R, (int)(total / R), f->size * R / (1024.0 * 1024.0) / t);
+	unmap_file(f);
+}
+
+int main(int argc, char **args)
+{
+	test_float();
+	test_obj();
+	auto s = make_obj(600);
+	test_obj_chunks(s);
+
+	benchmark_obj(s);
+	benchmark_collada();
+
+	return 0;
+}
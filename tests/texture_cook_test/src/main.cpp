@@ -0,0 +1,453 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/filesystem.h>
+#include <flame/image.h>
+#include <flame/texture_cook.h>
+#include <flame/time.h>
+
+// the checks run in release builds too
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <random>
+
+using namespace flame;
+
+static std::mt19937 rng(1);
+
+// reference decoders
+
+static void decode_565(unsigned short v, int *c)
+{
+	auto r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+static void decode_bc1(const unsigned char *src, unsigned char *rgba, bool force_four)
+{
+	unsigned short c0 = src[0] | (src[1] << 8), c1 = src[2] | (src[3] << 8);
+	int p[4][4];
+	decode_565(c0, p[0]);
+	decode_565(c1, p[1]);
+	p[0][3] = p[1][3] = 255;
+	for (auto k = 0; k < 3; k++)
+	{
+		if (c0 > c1 || force_four)
+		{
+			p[2][k] = (2 * p[0][k] + p[1][k]) / 3;
+			p[3][k] = (p[0][k] + 2 * p[1][k]) / 3;
+		}
+		else
+		{
+			p[2][k] = (p[0][k] + p[1][k]) / 2;
+			p[3][k] = 0;
+		}
+	}
+	p[2][3] = 255;
+	p[3][3] = (c0 > c1 || force_four) ? 255 : 0;
+	unsigned int bits;
+	memcpy(&bits, src + 4, 4);
+	for (auto i = 0; i < 16; i++)
+	{
+		auto idx = (bits >> (i * 2)) & 3;
+		for (auto k = 0; k < 4; k++)
+			rgba[i * 4 + k] = p[idx][k];
+	}
+}
+
+static void decode_bc4(const unsigned char *src, unsigned char *rgba, int channel)
+{
+	int a0 = src[0], a1 = src[1], p[8];
+	p[0] = a0;
+	p[1] = a1;
+	if (a0 > a1)
+	{
+		for (auto i = 1; i < 7; i++)
+			p[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+	}
+	else
+	{
+		for (auto i = 1; i < 5; i++)
+			p[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+		p[6] = 0;
+		p[7] = 255;
+	}
+	unsigned long long bits = 0;
+	for (auto i = 0; i < 6; i++)
+		bits |= (unsigned long long)src[2 + i] << (i * 8);
+	for (auto i = 0; i < 16; i++)
+		rgba[i * 4 + channel] = p[(bits >> (i * 3)) & 7];
+}
+
+static void decode_bc7_mode6(const unsigned char *src, unsigned char *rgba)
+{
+	auto pos = 0;
+	auto read = [&](int n) {
+		auto v = 0;
+		for (auto i = 0; i < n; i++, pos++)
+			v |= ((src[pos >> 3] >> (pos & 7)) & 1) << i;
+		return v;
+	};
+	auto mode = read(7);
+	assert(mode == (1 << 6));
+	int e[2][4];
+	for (auto k = 0; k < 4; k++)
+	{
+		e[0][k] = read(7);
+		e[1][k] = read(7);
+	}
+	auto p0 = read(1), p1 = read(1);
+	for (auto k = 0; k < 4; k++)
+	{
+		e[0][k] = (e[0][k] << 1) | p0;
+		e[1][k] = (e[1][k] << 1) | p1;
+	}
+	static const int w[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+	for (auto i = 0; i < 16; i++)
+	{
+		auto idx = read(i == 0 ? 3 : 4);
+		for (auto k = 0; k < 4; k++)
+			rgba[i * 4 + k] = ((64 - w[idx]) * e[0][k] + w[idx] * e[1][k] + 32) >> 6;
+	}
+	assert(pos == 128);
+}
+
+static float rmse(const unsigned char *a, const unsigned char *b, int channels_mask)
+{
+	auto sum = 0.f;
+	auto n = 0;
+	for (auto i = 0; i < 16; i++)
+	{
+		for (auto k = 0; k < 4; k++)
+		{
+			if (channels_mask & (1 << k))
+			{
+				auto d = (float)a[i * 4 + k] - b[i * 4 + k];
+				sum += d * d;
+				n++;
+			}
+		}
+	}
+	return sqrtf(sum / n);
+}
+
+// a blend of two colors across the block with a bit of noise, what photos mostly look like at 4x4
+static void rand_block(unsigned char *rgba)
+{
+	std::uniform_int_distribution<int> base(0, 255), noise(-2, 2);
+	std::uniform_real_distribution<float> angle(0.f, 6.28f);
+	int c0[4], c1[4];
+	for (auto k = 0; k < 4; k++)
+	{
+		c0[k] = base(rng);
+		c1[k] = base(rng);
+	}
+	auto a = angle(rng);
+	auto dx = cosf(a), dy = sinf(a);
+	for (auto y = 0; y < 4; y++)
+	{
+		for (auto x = 0; x < 4; x++)
+		{
+			auto t = ((x - 1.5f) * dx + (y - 1.5f) * dy) / 4.25f + 0.5f;
+			for (auto k = 0; k < 4; k++)
+			{
+				auto v = c0[k] + (c1[k] - c0[k]) * t + noise(rng);
+				rgba[(y * 4 + x) * 4 + k] = std::min(std::max((int)v, 0), 255);
+			}
+		}
+	}
+}
+
+static void test_mips()
+{
+	std::vector<unsigned char> img(37 * 20 * 4);
+	for (auto i = 0; i < 37 * 20; i++)
+	{
+		img[i * 4 + 0] = 200;
+		img[i * 4 + 1] = 100;
+		img[i * 4 + 2] = 50;
+		img[i * 4 + 3] = 255;
+	}
+	for (auto filter : { MipFilterBox, MipFilterKaiser })
+	{
+		std::vector<CookedLevel> levels;
+		generate_mips(img.data(), 37, 20, true, filter, levels);
+		// 37x20, 18x10, 9x5, 4x2, 2x1, 1x1
+		assert(levels.size() == 6);
+		assert(levels[1].cx == 18 && levels[1].cy == 10 && levels[5].cx == 1 && levels[5].cy == 1);
+		// a flat image stays flat at every level
+		for (auto &l : levels)
+		{
+			assert((int)l.data.size() == l.cx * l.cy * 4);
+			for (auto i = 0; i < l.cx * l.cy; i++)
+			{
+				assert(abs(l.data[i * 4 + 0] - 200) <= 1 && abs(l.data[i * 4 + 1] - 100) <= 1);
+				assert(abs(l.data[i * 4 + 2] - 50) <= 1 && l.data[i * 4 + 3] == 255);
+			}
+		}
+	}
+
+	// black and white stripes average to half the light, not half the srgb value
+	std::vector<unsigned char> stripes(8 * 8 * 4);
+	for (auto i = 0; i < 64; i++)
+	{
+		auto v = (i % 2) ? 255 : 0;
+		stripes[i * 4 + 0] = stripes[i * 4 + 1] = stripes[i * 4 + 2] = v;
+		stripes[i * 4 + 3] = v;
+	}
+	std::vector<CookedLevel> levels;
+	generate_mips(stripes.data(), 8, 8, true, MipFilterBox, levels);
+	assert(abs(levels[1].data[0] - 188) <= 1); // linear 0.5 in srgb
+	assert(abs(levels[1].data[3] - 128) <= 1); // alpha is linear
+	generate_mips(stripes.data(), 8, 8, false, MipFilterBox, levels);
+	assert(abs(levels[1].data[0] - 128) <= 1);
+	printf("mips: ok\n");
+}
+
+static void test_blocks()
+{
+	const auto N = 2000;
+	float bc1_err = 0.f, bc3_err = 0.f, bc5_err = 0.f, bc7_err = 0.f;
+	unsigned char src[64], dec[64], blk[16];
+	for (auto n = 0; n < N; n++)
+	{
+		rand_block(src);
+		for (auto i = 0; i < 16; i++)
+			src[i * 4 + 3] = std::max(src[i * 4 + 3], (unsigned char)128); // bc1 keeps these opaque
+
+		encode_bc1_block(src, blk);
+		decode_bc1(blk, dec, false);
+		bc1_err += rmse(src, dec, 7);
+
+		encode_bc3_block(src, blk);
+		decode_bc1(blk + 8, dec, true);
+		decode_bc4(blk, dec, 3);
+		bc3_err += rmse(src, dec, 15);
+
+		encode_bc5_block(src, blk);
+		decode_bc4(blk, dec, 0);
+		decode_bc4(blk + 8, dec, 1);
+		bc5_err += rmse(src, dec, 3);
+
+		encode_bc7_block(src, blk);
+		decode_bc7_mode6(blk, dec);
+		bc7_err += rmse(src, dec, 15);
+	}
+	bc1_err /= N;
+	bc3_err /= N;
+	bc5_err /= N;
+	bc7_err /= N;
+	printf("average rmse, bc1 %.2f, bc3 %.2f, bc5 %.2f, bc7 %.2f\n", bc1_err, bc3_err, bc5_err, bc7_err);
+	assert(bc1_err < 9.f && bc3_err < 8.f && bc5_err < 5.f && bc7_err < 4.f);
+	assert(bc7_err < bc3_err * 0.6f);
+
+	// a solid block is as exact as the endpoints allow
+	for (auto i = 0; i < 16; i++)
+	{
+		src[i * 4 + 0] = 90;
+		src[i * 4 + 1] = 180;
+		src[i * 4 + 2] = 33;
+		src[i * 4 + 3] = 77;
+	}
+	encode_bc7_block(src, blk);
+	decode_bc7_mode6(blk, dec);
+	assert(rmse(src, dec, 15) <= 1.f);
+	encode_bc1_block(src, blk); // alpha under 128 is transparent in bc1
+	decode_bc1(blk, dec, false);
+	for (auto i = 0; i < 16; i++)
+		assert(dec[i * 4 + 3] == 0);
+	src[3] = 255;
+	encode_bc1_block(src, blk);
+	decode_bc1(blk, dec, false);
+	assert(dec[3] == 255 && abs(dec[0] - 90) <= 4 && abs(dec[1] - 180) <= 2 && dec[7] == 0);
+	printf("blocks: ok\n");
+}
+
+static std::vector<unsigned char> make_picture(int cx, int cy)
+{
+	std::vector<unsigned char> img(cx * cy * 4);
+	for (auto y = 0; y < cy; y++)
+	{
+		for (auto x = 0; x < cx; x++)
+		{
+			auto p = img.data() + (y * cx + x) * 4;
+			p[0] = (x * 255) / cx;
+			p[1] = (y * 255) / cy;
+			p[2] = (unsigned char)(128 + 127 * sinf(x * 0.05f + y * 0.03f));
+			p[3] = 255;
+		}
+	}
+	return img;
+}
+
+static void test_threads()
+{
+	auto img = make_picture(300, 200);
+	for (auto format : { TextureCookBC1, TextureCookBC3, TextureCookBC5, TextureCookBC7 })
+	{
+		std::vector<CookedLevel> a, b;
+		generate_mips(img.data(), 300, 200, true, MipFilterBox, a);
+		b = a;
+		compress_levels(a, format, 1);
+		compress_levels(b, format, 8);
+		assert(a.size() == b.size());
+		for (auto i = 0; i < (int)a.size(); i++)
+		{
+			auto blocks = ((a[i].cx + 3) / 4) * ((a[i].cy + 3) / 4);
+			assert((int)a[i].data.size() == blocks * get_cooked_block_size(format));
+			assert(a[i].data == b[i].data);
+		}
+	}
+	printf("threads: ok\n");
+}
+
+static std::vector<unsigned char> read_all(const std::string &filename)
+{
+	std::vector<unsigned char> ret;
+	auto f = fopen(filename.c_str(), "rb");
+	assert(f);
+	unsigned char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		ret.insert(ret.end(), buf, buf + n);
+	fclose(f);
+	return ret;
+}
+
+static unsigned int u32(const std::vector<unsigned char> &b, int offset)
+{
+	unsigned int v;
+	memcpy(&v, b.data() + offset, 4);
+	return v;
+}
+
+static void test_containers()
+{
+	auto img = make_picture(64, 32);
+	CookedTexture t;
+	t.format = TextureCookBC7;
+	t.srgb = true;
+	generate_mips(img.data(), 64, 32, true, MipFilterBox, t.levels);
+	compress_levels(t.levels, t.format, 0);
+
+	auto saved = save_ktx(t, "texture_cook_test.ktx");
+	assert(saved);
+	auto ktx = read_all("texture_cook_test.ktx");
+	assert(ktx[1] == 'K' && ktx[2] == 'T' && ktx[3] == 'X');
+	assert(u32(ktx, 12) == 0x04030201 && u32(ktx, 28) == 0x8E8D);
+	assert(u32(ktx, 36) == 64 && u32(ktx, 40) == 32 && u32(ktx, 56) == 7);
+	auto offset = 64;
+	for (auto &l : t.levels)
+	{
+		assert(u32(ktx, offset) == l.data.size());
+		assert(memcmp(ktx.data() + offset + 4, l.data.data(), l.data.size()) == 0);
+		offset += 4 + l.data.size();
+	}
+	assert(offset == (int)ktx.size());
+
+	saved = save_dds(t, "texture_cook_test.dds");
+	assert(saved);
+	auto dds = read_all("texture_cook_test.dds");
+	assert(u32(dds, 0) == 0x20534444 && u32(dds, 4) == 124);
+	assert(u32(dds, 12) == 32 && u32(dds, 16) == 64 && u32(dds, 28) == 7);
+	assert(u32(dds, 84) == 0x30315844 && u32(dds, 128) == 99);
+	auto total = 0;
+	for (auto &l : t.levels)
+		total += l.data.size();
+	assert((int)dds.size() == 148 + total);
+
+	remove("texture_cook_test.ktx");
+	remove("texture_cook_test.dds");
+	printf("containers: ok\n");
+}
+
+static void test_cook()
+{
+	auto img = make_picture(128, 128);
+	save_image(128, 128, 4, 32, img.data(), "texture_cook_test.png");
+	auto dst = get_cooked_texture_filename("texture_cook_test.png");
+	remove(dst.c_str());
+	remove((dst + ".hash").c_str());
+
+	TextureCookOptions options;
+	auto r = cook_texture("texture_cook_test.png", dst, options);
+	assert(r == CookDone);
+	r = cook_texture("texture_cook_test.png", dst, options);
+	assert(r == CookSkipped);
+	options.format = TextureCookBC1;
+	r = cook_texture("texture_cook_test.png", dst, options);
+	assert(r == CookDone);
+	r = cook_texture("texture_cook_test.png", dst, options);
+	assert(r == CookSkipped);
+
+	// a changed source cooks again
+	img[0] ^= 0xff;
+	save_image(128, 128, 4, 32, img.data(), "texture_cook_test.png");
+	r = cook_texture("texture_cook_test.png", dst, options);
+	assert(r == CookDone);
+	auto ktx = read_all(dst);
+	assert(u32(ktx, 28) == 0x8C4D && u32(ktx, 56) == 8);
+	r = cook_texture("missing.png", "missing.png.ktx", options);
+	assert(r == CookFailed);
+
+	remove("texture_cook_test.png");
+	remove(dst.c_str());
+	remove((dst + ".hash").c_str());
+	printf("cook: ok\n");
+}
+
+static void benchmark()
+{
+	auto img = make_picture(1024, 1024);
+	for (auto format : { TextureCookBC1, TextureCookBC7 })
+	{
+		for (auto threads : { 1, 0 })
+		{
+			std::vector<CookedLevel> levels;
+			auto t0 = get_now_ns();
+			generate_mips(img.data(), 1024, 1024, true, MipFilterBox, levels);
+			auto t1 = get_now_ns();
+			compress_levels(levels, format, threads);
+			auto t2 = get_now_ns();
+			printf("1024x1024 %s, %s threads: mips %.1fms, encode %.1fms\n", format == TextureCookBC1 ? "bc1" : "bc7",
+				threads == 1 ? "1" : "all", (t1 - t0) / 1000000.0, (t2 - t1) / 1000000.0);
+		}
+	}
+}
+
+int main(int argc, char **args)
+{
+	test_mips();
+	test_blocks();
+	test_threads();
+	test_containers();
+	test_cook();
+	benchmark();
+
+	return 0;
+}
@@ -0,0 +1,208 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/filesystem.h>
+#include <flame/image.h>
+#include <flame/thumbnail.h>
+#include <flame/time.h>
+
+// the checks run in release builds too
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+using namespace flame;
+
+static const char *cache_dir = "thumbnail_test_cache";
+
+static int count_cache_files()
+{
+	auto n = 0;
+	for (std::filesystem::directory_iterator it(cache_dir), end; it != end; it++)
+	{
+		if (it->path().extension() == ".thumb")
+			n++;
+	}
+	return n;
+}
+
+// a horizontal red ramp over a blue background, with a checker in the alpha
+static std::vector<unsigned char> make_picture(int cx, int cy)
+{
+	std::vector<unsigned char> img(cx * cy * 4);
+	for (auto y = 0; y < cy; y++)
+	{
+		for (auto x = 0; x < cx; x++)
+		{
+			auto p = &img[(y * cx + x) * 4];
+			p[0] = x * 255 / (cx - 1);
+			p[1] = 0;
+			p[2] = 200;
+			p[3] = ((x / 8 + y / 8) % 2) ? 255 : 128;
+		}
+	}
+	return img;
+}
+
+static void test_cache()
+{
+	std::filesystem::remove_all(cache_dir);
+
+	auto img = make_picture(640, 320);
+	save_image(640, 320, 4, 32, img.data(), "thumbnail_test_a.png");
+	auto small = make_picture(40, 20);
+	save_image(40, 20, 4, 32, small.data(), "thumbnail_test_b.png");
+
+	// fits in the size with the aspect kept
+	Thumbnail t;
+	auto t0 = get_now_ns();
+	auto ok = get_thumbnail("thumbnail_test_a.png", 64, cache_dir, &t);
+	assert(ok);
+	auto t1 = get_now_ns();
+	assert(t.cx == 64 && t.cy == 32 && t.data.size() == 64 * 32 * 4);
+	// the ramp survives the filter
+	assert(t.data[0] < 16 && t.data[(63) * 4] > 240 && t.data[2] > 190);
+	assert(count_cache_files() == 1);
+
+	// the second time comes from the cache and is the same
+	Thumbnail t2;
+	auto t2_0 = get_now_ns();
+	ok = get_thumbnail("thumbnail_test_a.png", 64, cache_dir, &t2);
+	assert(ok);
+	auto t2_1 = get_now_ns();
+	assert(t2.cx == t.cx && t2.cy == t.cy && t2.data == t.data);
+	assert(count_cache_files() == 1);
+
+	// small images are not scaled up, other sizes are cached separately
+	ok = get_thumbnail("thumbnail_test_b.png", 64, cache_dir, &t2);
+	assert(ok);
+	assert(t2.cx == 40 && t2.cy == 20 && t2.data == small);
+	ok = get_thumbnail("thumbnail_test_a.png", 128, cache_dir, &t2);
+	assert(ok);
+	assert(t2.cx == 128 && t2.cy == 64);
+	assert(count_cache_files() == 3);
+
+	// a modified file gets a new entry
+	auto img2 = make_picture(320, 640);
+	save_image(320, 640, 4, 32, img2.data(), "thumbnail_test_a.png");
+	std::filesystem::last_write_time("thumbnail_test_a.png",
+		std::filesystem::last_write_time("thumbnail_test_a.png") + std::chrono::seconds(10));
+	ok = get_thumbnail("thumbnail_test_a.png", 64, cache_dir, &t2);
+	assert(ok);
+	assert(t2.cx == 32 && t2.cy == 64);
+	assert(count_cache_files() == 4);
+
+	// not an image
+	{
+		std::ofstream f("thumbnail_test_c.png");
+		f << "not a png";
+	}
+	ok = get_thumbnail("thumbnail_test_c.png", 64, cache_dir, &t2);
+	assert(!ok);
+	ok = get_thumbnail("thumbnail_test_missing.png", 64, cache_dir, &t2);
+	assert(!ok);
+	assert(count_cache_files() == 4);
+
+	// a broken cache file is made again
+	for (std::filesystem::directory_iterator it(cache_dir), end; it != end; it++)
+	{
+		std::ofstream f(it->path().string(), std::ios::binary);
+		f << "x";
+	}
+	ok = get_thumbnail("thumbnail_test_b.png", 64, cache_dir, &t2);
+	assert(ok);
+	assert(t2.cx == 40 && t2.cy == 20 && t2.data == small);
+
+	trim_thumbnail_cache(cache_dir, 40 * 20 * 4 + 16);
+	assert(count_cache_files() == 1);
+	trim_thumbnail_cache(cache_dir, 0);
+	assert(count_cache_files() == 0);
+
+	remove("thumbnail_test_a.png");
+	remove("thumbnail_test_b.png");
+	remove("thumbnail_test_c.png");
+	std::filesystem::remove_all(cache_dir);
+	printf("cache: ok, made %.3fms, cached %.3fms\n", (t1 - t0) / 1000000.0, (t2_1 - t2_0) / 1000000.0);
+}
+
+static void test_atlas()
+{
+	ThumbnailAtlas a(256, 64);
+	assert(a.get_cell_count() == 16);
+
+	std::string evicted;
+	std::vector<int> ids;
+	for (auto i = 0; i < 16; i++)
+	{
+		ids.push_back(a.add(std::to_string(i), &evicted));
+		assert(evicted.empty());
+	}
+	assert(a.get_used_count() == 16);
+	// all cells are different
+	for (auto i = 0; i < 16; i++)
+	{
+		for (auto j = i + 1; j < 16; j++)
+			assert(ids[i] != ids[j]);
+	}
+	auto id = a.add("3");
+	assert(id == ids[3]);
+
+	// 0 is the least recently used unless it is touched
+	id = a.find("0");
+	assert(id == ids[0]);
+	id = a.add("16", &evicted);
+	assert(evicted == "1" && id == ids[1]);
+	id = a.find("1");
+	assert(id == -1);
+	id = a.add("17", &evicted);
+	assert(evicted == "2" && id == ids[2]);
+	id = a.add("18", &evicted);
+	assert(evicted == "4" && id == ids[4]);
+	assert(a.get_used_count() == 16);
+
+	// removed cells are reused first, before evicting anything
+	a.remove("10");
+	assert(a.get_used_count() == 15);
+	id = a.add("19", &evicted);
+	assert(evicted.empty() && id == ids[10]);
+
+	a.clear();
+	id = a.find("19");
+	assert(a.get_used_count() == 0 && id == -1);
+
+	auto pos = a.get_cell_pos(5);
+	assert(pos.x == 64 && pos.y == 64);
+	auto uv = a.get_uv(5, 32, 16);
+	assert(uv.x == 0.25f && uv.y == 0.25f && uv.z == 0.375f && uv.w == 0.3125f);
+
+	printf("atlas: ok\n");
+}
+
+int main(int argc, char **args)
+{
+	test_cache();
+	test_atlas();
+
+	return 0;
+}
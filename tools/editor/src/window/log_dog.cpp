@@ -1,5 +1,3 @@
-#include <regex>
-
 #include <flame/global.h>
 #include <flame/engine/ui/fileselector.h>
 #include "log_dog.h"
@@ -12,9 +10,13 @@ LogDog::Column::Column() :
 LogDog::LogDog() :
 	Window("Log Dog"),
 	log_file_timestamp(0),
-	curr_page(0)
+	follow(false),
+	curr_page(0),
+	page_rows_page(-1),
+	page_rows_dirty(true)
 {
 	strcpy(match_regex, R"((\[[\w\s:]+\])[\s]*(INFO|DEBUG|WARNING|ERROR)[:\s]*(.*))");
+	matcher.compile(match_regex);
 	
 	auto col1 = new Column;
 	strcpy(col1->name, "Time");
@@ -56,33 +58,45 @@ struct SelectFileDialog : flame::ui::FileSelector
 	}
 };
 
+static const int element_per_page = 15;
+
 void LogDog::set_log_filename(const std::string &filename)
 {
 	log_filename = filename;
-	std::ifstream file(log_filename);
-	if (!file.good())
+	index.open(log_filename);
+
+	curr_page = 0;
+	page_rows_dirty = true;
+}
+
+void LogDog::update_page_rows(int line_count)
+{
+	if (!page_rows_dirty && page_rows_page == curr_page)
 		return;
+	page_rows_dirty = false;
+	page_rows_page = curr_page;
+	page_rows.clear();
+
+	std::vector<int> indices(columns.size());
+	for (auto i = 0; i < columns.size(); i++)
+		indices[i] = columns[i]->match_index;
 
-	std::regex regex(match_regex);
-	while (!file.eof())
+	for (int i = 0; i < element_per_page; i++)
 	{
-		std::string line;
-		std::getline(file, line);
-		std::smatch match;
-		if (std::regex_search(line, match, regex))
+		auto line = curr_page * element_per_page + i;
+		if (line >= line_count)
+			break;
+		auto l = index.get_line(line);
+		std::vector<std::string> row(columns.size());
+		// lines the regex does not take (e.g. call stacks) go whole into the last column
+		if (!matcher.match(l, indices.data(), indices.size(), row.data()) && !row.empty())
 		{
-			std::vector<std::string> row(columns.size());
-			for (auto i = 0; i < columns.size(); i++)
-			{
-				auto c = columns[i].get();
-				if (c->match_index < match.size())
-					row[i] = match[c->match_index].str();
-			}
-			logs.push_back(row);
+			for (auto &c : row)
+				c.clear();
+			row.back().assign(l.str, l.length);
 		}
+		page_rows.push_back(std::move(row));
 	}
-
-	curr_page = 0;
 }
 
 void LogDog::on_show()
@@ -108,8 +122,11 @@ void LogDog::on_show()
 
 		if (ImGui::InputText("Match Regex", match_regex, TK_ARRAYSIZE(match_regex)))
 		{
-
+			matcher.compile(match_regex);
+			page_rows_dirty = true;
 		}
+		if (!matcher.is_valid())
+			ImGui::TextColored(ImVec4(1.f, 0.f, 0.f, 1.f), "invalid regex");
 		ImGui::BeginChild("columns", ImVec2(350, 150), true);
 		ImGui::Columns(3, "_column_columns");
 		ImGui::Separator();
@@ -124,7 +141,9 @@ void LogDog::on_show()
 			auto c = columns[i].get();
 			ImGui::PushID(i);
 			ImGui::InputText("##name", c->name, TK_ARRAYSIZE(c->name)); ImGui::NextColumn();
-			ImGui::InputInt("##index", &c->match_index); ImGui::NextColumn();
+			if (ImGui::InputInt("##index", &c->match_index))
+				page_rows_dirty = true;
+			ImGui::NextColumn();
 			if (ImGui::IconButton(ICON_FA_TRASH))
 			{
 				op = 1;
@@ -145,6 +164,8 @@ void LogDog::on_show()
 			ImGui::NextColumn();
 			ImGui::PopID();
 		}
+		if (op != 0)
+			page_rows_dirty = true;
 		switch (op)
 		{
 			case 1:
@@ -167,13 +188,26 @@ void LogDog::on_show()
 		{
 			auto col = new Column;
 			strcpy(col->name, "NewColumn");
-			columns.emplace_back(new Column);
+			columns.emplace_back(col);
+			page_rows_dirty = true;
 		}
 	}
 	if (ImGui::TabItem("Log"))
 	{
 		static bool show_error;
 		ImGui::Checkbox_2in1("Error", &show_error);
+		ImGui::SameLine();
+		ImGui::Checkbox("Follow", &follow);
+
+		// only the bytes appended since last time get indexed
+		if (follow && index.update() > 0)
+			page_rows_dirty = true;
+		auto line_count = index.get_line_count();
+		int total_page = (line_count + element_per_page - 1) / element_per_page;
+		if (follow)
+			curr_page = total_page > 0 ? total_page - 1 : 0;
+		update_page_rows(line_count);
+
 		ImGui::Columns(columns.size(), "_log_columns");
 		ImGui::Separator();
 		for (auto &c : columns)
@@ -182,28 +216,25 @@ void LogDog::on_show()
 			ImGui::NextColumn();
 		}
 		ImGui::Separator();
-		const int element_per_page = 15;
-		int total_page = logs.size() / element_per_page;
-		for (int i = 0; i < element_per_page; i++)
+		for (auto &r : page_rows)
 		{
-			auto index = curr_page * element_per_page + i;
-			if (index >= logs.size())
-				break;
-			auto &l = logs[index];
-			for (auto j = 0; j < columns.size(); j++)
+			for (auto j = 0; j < r.size() && j < columns.size(); j++)
 			{
-				ImGui::Text(l[j].c_str());
+				ImGui::TextUnformatted(r[j].c_str());
 				ImGui::NextColumn();
 			}
 		}
 		ImGui::Columns(1);
 		ImGui::Separator();
-		ImGui::Text("%d/%d", curr_page + 1, total_page);
+		ImGui::Text("%d/%d (%d lines)", curr_page + 1, total_page, line_count);
 		ImGui::SameLine();
 		if (ImGui::IconButton(ICON_FA_CARET_LEFT))
 		{
 			if (curr_page > 0)
+			{
 				curr_page--;
+				follow = false;
+			}
 		}
 		ImGui::SameLine();
 		if (ImGui::IconButton(ICON_FA_CARET_RIGHT))
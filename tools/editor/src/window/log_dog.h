@@ -1,5 +1,6 @@
 #pragma once
 
+#include <flame/log_index.h>
 #include <flame/engine/ui/ui.h>
 
 struct LogDog : flame::ui::Window
@@ -16,14 +17,22 @@ struct LogDog : flame::ui::Window
 	long long log_file_timestamp;
 
 	char match_regex[100];
+	flame::LogMatcher matcher;
 	std::vector<std::unique_ptr<Column>> columns;
 
-	std::vector<std::vector<std::string>> logs;
+	flame::LogIndex index;
+	bool follow;
 	int curr_page;
 
+	// rows of the visible page only, extracted when the page, the matcher or the columns change
+	std::vector<std::vector<std::string>> page_rows;
+	int page_rows_page;
+	bool page_rows_dirty;
+
 	LogDog();
 	~LogDog();
 	void set_log_filename(const std::string &filename);
+	void update_page_rows(int line_count);
 	virtual void on_show() override;
 };
 
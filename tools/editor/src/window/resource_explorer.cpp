@@ -99,18 +99,15 @@ void ResourceExplorer::on_right_area_show()
 				sel = 2;
 			if (sel > 0)
 				draw_list->AddRectFilled(pos, pos + widget_size, ImColor(255, 122, 50, sel == 1 ? 60 : 255));
-			flame::Texture *img = nullptr;
 			if (is_folder)
-				img = folder_image.get();
+				draw_list->AddImage(ImTextureID(folder_image->ui_index), pos, pos + img_size);
 			else
 			{
-				auto f = (FileItem*)d;
-				if (f->file_type == flame::FileTypeImage)
-					img = f->preview_image.get();
-				else
-					img = file_image.get();
+				ImVec2 draw_size, uv0, uv1;
+				auto img = get_item_image((FileItem*)d, img_size.x, &draw_size, &uv0, &uv1);
+				auto img_pos = pos + (img_size - draw_size) * 0.5f;
+				draw_list->AddImage(ImTextureID(img->ui_index), img_pos, img_pos + draw_size, uv0, uv1);
 			}
-			draw_list->AddImage(ImTextureID(img->ui_index), pos, pos + img_size);
 			draw_list->AddText(pos + ImVec2(0, img_size.y), ImColor(0, 0, 0), d->value.c_str());
 			//draw_list->PopClipRect();
 			if (column_count > 1)
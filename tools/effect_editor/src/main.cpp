@@ -26,6 +26,7 @@
 #include <flame/math.h>
 #include <flame/string.h>
 #include <flame/select.h>
+#include <flame/profiler.h>
 #include <flame/graphics/device.h>
 #include <flame/graphics/swapchain.h>
 #include <flame/graphics/renderpass.h>
@@ -38,6 +39,8 @@
 #include <flame/graphics/commandbuffer.h>
 #include <flame/graphics/semaphore.h>
 #include <flame/graphics/queue.h>
+#include <flame/graphics/frame.h>
+#include <flame/graphics/gpu_profiler.h>
 #include <flame/UI/instance.h>
 
 using namespace flame;
@@ -84,20 +87,33 @@ int main(int argc, char **args)
 
 	Vec2 effect_size(800, 600);
 
-	auto t = graphics::create_texture(d, effect_size.x, effect_size.y, 1, 1,
-		graphics::Format_R8G8B8A8_UNORM,
-		graphics::TextureUsageAttachment | graphics::TextureUsageShaderSampled,
-		graphics::MemPropDevice);
-	auto tv = graphics::create_textureview(d, t);
+	const auto frame_count = 2;
+
+	// a target for each frame in flight, the ui of a frame samples the one its frame rendered
+	graphics::Texture *ts[frame_count];
+	graphics::Textureview *tvs[frame_count];
+	for (auto i = 0; i < frame_count; i++)
+	{
+		ts[i] = graphics::create_texture(d, effect_size.x, effect_size.y, 1, 1,
+			graphics::Format_R8G8B8A8_UNORM,
+			graphics::TextureUsageAttachment | graphics::TextureUsageShaderSampled,
+			graphics::MemPropDevice);
+		tvs[i] = graphics::create_textureview(d, ts[i]);
+	}
 
 	auto rp_rtt = graphics::create_renderpass(d);
-	rp_rtt->add_attachment(t->format, true);
+	rp_rtt->add_attachment(ts[0]->format, true);
 	rp_rtt->add_subpass({ 0 }, -1);
+	rp_rtt->add_dependency(0, -1); // the ui samples it
 	rp_rtt->build();
 
-	auto fb_rtt = graphics::create_framebuffer(d, effect_size.x, effect_size.y, rp_rtt);
-	fb_rtt->set_view(0, tv);
-	fb_rtt->build();
+	graphics::Framebuffer *fbs_rtt[frame_count];
+	for (auto i = 0; i < frame_count; i++)
+	{
+		fbs_rtt[i] = graphics::create_framebuffer(d, effect_size.x, effect_size.y, rp_rtt);
+		fbs_rtt[i]->set_view(0, tvs[i]);
+		fbs_rtt[i]->build();
+	}
 
 	auto particle_liquid_vert = graphics::create_shader(d, "fullscreen.vert");
 	particle_liquid_vert->add_define("USE_UV");
@@ -136,15 +152,6 @@ int main(int argc, char **args)
 	auto ds_particle_liquid = d->dp->create_descriptorset(pl_particle_liquid, 0);
 	ds_particle_liquid->set_uniformbuffer(0, 0, ub_particle_liquid);
 
-	auto cb_effect = d->cp->create_commandbuffer();
-	cb_effect->begin();
-	cb_effect->begin_renderpass(rp_rtt, fb_rtt);
-	cb_effect->bind_pipeline(pl_particle_liquid);
-	cb_effect->bind_descriptorset(ds_particle_liquid);
-	cb_effect->draw(3, 1, 0);
-	cb_effect->end_renderpass();
-	cb_effect->end();
-
 	auto rp_ui = graphics::create_renderpass(d);
 	rp_ui->add_attachment(sc->format, true);
 	rp_ui->add_subpass({ 0 }, -1);
@@ -157,16 +164,14 @@ int main(int argc, char **args)
 		fbs_ui[i]->set_view_swapchain(0, sc, i);
 		fbs_ui[i]->build();
 	}
-	auto cb_ui = d->cp->create_commandbuffer();
-	cb_ui->begin();
-	cb_ui->end();
 
-	auto image_avalible = graphics::create_semaphore(d);
-	auto effect_finished = graphics::create_semaphore(d);
-	auto ui_finished = graphics::create_semaphore(d);
+	auto fc = graphics::create_framecontext(d, frame_count);
+	auto gp = graphics::create_gpu_profiler(d);
+	auto show_profiler = false;
 
 	auto ui = UI::create_instance(d, rp_ui, s);
-	ui->set_texture(1, tv);
+	for (auto i = 0; i < frame_count; i++)
+		ui->set_texture(1 + i, tvs[i]);
 
 	auto update_ubo = [&]() {
 		ubo_particle_liquid->data.x = particles.size();
@@ -555,6 +560,9 @@ int main(int argc, char **args)
 	auto curr_tab = TabScene;
 
 	sm->run([&](){
+		profile_begin_frame();
+		fc->begin_frame();
+
 		ui->begin(res.x, res.y, sm->elapsed_time);
 
 		ui->begin_mainmenu();
@@ -752,6 +760,13 @@ int main(int argc, char **args)
 			}
 			ui->end_menu();
 		}
+		if (ui->begin_menu("View"))
+		{
+			if (ui->menuitem("Profiler", nullptr, show_profiler))
+				show_profiler = !show_profiler;
+
+			ui->end_menu();
+		}
 		if (ui->begin_menu("Setting"))
 		{
 			if (ui->menuitem("Scene Options"))
@@ -810,7 +825,7 @@ int main(int argc, char **args)
 		{
 			curr_tab = TabScene;
 
-			ui->image(1, effect_size);
+			ui->image(1 + fc->index, effect_size);
 			auto img_rect = ui->get_last_item_rect();
 			auto dl_ws = ui->get_curr_window_drawlist();
 
@@ -1019,6 +1034,9 @@ int main(int argc, char **args)
 
 		ui->end_window();
 
+		if (show_profiler)
+			ui->show_profiler(&show_profiler);
+
 		ui->end();
 
 		if (running)
@@ -1032,26 +1050,50 @@ int main(int argc, char **args)
 
 		if (need_update_ubo)
 		{
+			// the ubo is read by the frames in flight, it only changes while editing
+			fc->wait_all();
 			update_ubo();
 			need_update_ubo = false;
 		}
 
-		auto index = sc->acquire_image(image_avalible);
-
-		cb_ui->begin();
+		auto index = sc->acquire_image(fc->image_available);
+
+		auto cb_effect = fc->get_commandbuffer();
+		cb_effect->begin(true);
+		gp->begin_frame(cb_effect);
+		gp->begin_renderpass(cb_effect, CHASH("effect"), "effect", rp_rtt, fbs_rtt[fc->index]);
+		cb_effect->bind_pipeline(pl_particle_liquid);
+		cb_effect->bind_descriptorset(ds_particle_liquid);
+		cb_effect->draw(3, 1, 0);
+		gp->end_renderpass(cb_effect);
+		cb_effect->end();
+
+		auto cb_ui = fc->get_commandbuffer();
+		cb_ui->begin(true);
+		gp->begin_zone(cb_ui, CHASH("ui"), "ui");
 		ui->record_commandbuffer(cb_ui, rp_ui, fbs_ui[index]);
+		gp->end_zone(cb_ui);
 		cb_ui->end();
 
-		d->q->submit(cb_effect, image_avalible, effect_finished);
-		d->q->submit(cb_ui, effect_finished, ui_finished);
-		d->q->wait_idle();
-		d->q->present(index, sc, ui_finished);
+		fc->add_submit(cb_effect, fc->image_available);
+		fc->add_submit(cb_ui, nullptr, fc->render_finished);
+		fc->end_frame(d->q);
+		d->q->present(index, sc, fc->render_finished);
 
 		static long long last_fps = 0;
 		if (last_fps != sm->fps)
-			printf("%lld\n", sm->fps);
+		{
+			graphics::FrameStats st;
+			fc->get_stats(&st);
+			printf("%lld fps, cpu %.2fms, waiting for gpu %.2fms, overlap %d%%\n", sm->fps, st.cpu_ms, st.wait_ms, int(st.overlap * 100.f));
+		}
 		last_fps = sm->fps;
+
+		profile_end_frame();
 	});
 
+	graphics::destroy_framecontext(d, fc);
+	graphics::destroy_gpu_profiler(d, gp);
+
 	return 0;
 }
@@ -0,0 +1,131 @@
+//MIT License
+//
+//Copyright (c) 2018 wjs
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <flame/filesystem.h>
+#include <flame/texture_cook.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+
+using namespace flame;
+
+static bool is_source_image(const std::filesystem::path &p)
+{
+	auto ext = p.extension().string();
+	for (auto &c : ext)
+		c = tolower(c);
+	return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".tga" || ext == ".bmp";
+}
+
+int main(int argc, char **args)
+{
+	TextureCookOptions options;
+	std::string output;
+	auto dds = false;
+	std::vector<std::string> inputs;
+	for (auto i = 1; i < argc; i++)
+	{
+		std::string a(args[i]);
+		if (a == "-rgba8")
+			options.format = TextureCookRGBA8;
+		else if (a == "-bc1")
+			options.format = TextureCookBC1;
+		else if (a == "-bc3")
+			options.format = TextureCookBC3;
+		else if (a == "-bc5")
+		{
+			options.format = TextureCookBC5;
+			options.srgb = false;
+		}
+		else if (a == "-bc7")
+			options.format = TextureCookBC7;
+		else if (a == "-linear")
+			options.srgb = false;
+		else if (a == "-nomips")
+			options.mips = false;
+		else if (a == "-kaiser")
+			options.mip_filter = MipFilterKaiser;
+		else if (a == "-dds")
+			dds = true;
+		else if (a == "-j" && i + 1 < argc)
+			options.thread_count = atoi(args[++i]);
+		else if (a == "-o" && i + 1 < argc)
+			output = args[++i];
+		else
+			inputs.push_back(a);
+	}
+
+	if (inputs.empty())
+	{
+		printf("usage: texture_cooker [-rgba8|-bc1|-bc3|-bc5|-bc7] [-linear] [-nomips] [-kaiser] [-dds] [-j threads] [-o output] files or directories\n");
+		printf("  the default is bc7, srgb, box filtered mips, the output goes next to the source as <source>.ktx,\n");
+		printf("  which create_texture_from_file picks up, unchanged sources are skipped\n");
+		return 1;
+	}
+
+	std::vector<std::string> files;
+	for (auto &i : inputs)
+	{
+		std::filesystem::path p(i);
+		if (std::filesystem::is_directory(p))
+		{
+			for (auto &e : std::filesystem::recursive_directory_iterator(p))
+			{
+				if (std::filesystem::is_regular_file(e.status()) && is_source_image(e.path()))
+					files.push_back(e.path().string());
+			}
+		}
+		else
+			files.push_back(i);
+	}
+	if (!output.empty() && files.size() != 1)
+	{
+		printf("-o takes exactly one input\n");
+		return 1;
+	}
+
+	auto done = 0, skipped = 0, failed = 0;
+	for (auto &f : files)
+	{
+		auto dst = output.empty() ? (dds ? f + ".dds" : get_cooked_texture_filename(f)) : output;
+		switch (cook_texture(f, dst, options))
+		{
+			case CookDone:
+				printf("cooked: %s\n", dst.c_str());
+				done++;
+				break;
+			case CookSkipped:
+				skipped++;
+				break;
+			case CookFailed:
+				printf("failed: %s\n", f.c_str());
+				failed++;
+				break;
+		}
+	}
+	printf("%d cooked, %d up to date, %d failed\n", done, skipped, failed);
+
+	return failed > 0 ? 1 : 0;
+}